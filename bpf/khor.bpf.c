@@ -2,6 +2,7 @@
 #include "vmlinux.h"
 
 #include <bpf/bpf_core_read.h>
+#include <bpf/bpf_endian.h>
 #include <bpf/bpf_helpers.h>
 #include <bpf/bpf_tracing.h>
 
@@ -18,7 +19,7 @@ struct {
   __uint(type, BPF_MAP_TYPE_ARRAY);
   __uint(max_entries, 1);
   __type(key, __u32);
-  __type(value, struct khor_bpf_config);
+  __type(value, struct khor_bpf_sessions);
 } khor_cfg SEC(".maps");
 
 struct khor_counters {
@@ -26,54 +27,257 @@ struct khor_counters {
   struct khor_sample_payload acc;
 };
 
+// One accumulator per session slot, per CPU.
+struct khor_counter_set {
+  struct khor_counters s[KHOR_MAX_SESSIONS];
+};
+
 struct {
   __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
   __uint(max_entries, 1);
   __type(key, __u32);
-  __type(value, struct khor_counters);
+  __type(value, struct khor_counter_set);
 } khor_accum SEC(".maps");
 
-static __always_inline struct khor_bpf_config* get_cfg(void) {
+// Profiler maps. Sizes are placeholders: userspace sets them before load (profile.max_stacks),
+// and to 1 when profiling is off.
+struct {
+  __uint(type, BPF_MAP_TYPE_STACK_TRACE);
+  __uint(max_entries, 1);
+  __uint(key_size, sizeof(__u32));
+  __uint(value_size, KHOR_PROF_STACK_DEPTH * sizeof(__u64));
+} khor_stacks SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __uint(max_entries, 1);
+  __type(key, struct khor_prof_key);
+  __type(value, struct khor_prof_value);
+} khor_prof SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  __uint(max_entries, 1);
+  __type(key, __u32);
+  __type(value, struct khor_prof_stats);
+} khor_prof_stats SEC(".maps");
+
+// Switch-out stamp of a blocked task, keyed by pid (thread id). LRU so tasks that exit
+// while blocked age out instead of filling the map.
+struct khor_offcpu_stamp {
+  __u64 ts_ns;
+  __u32 sessions; // slots whose filters accepted the task when it blocked
+  __u32 state;    // khor_offcpu_state
+};
+
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH);
+  __uint(max_entries, 32768);
+  __type(key, __u32);
+  __type(value, struct khor_offcpu_stamp);
+} khor_offcpu_start SEC(".maps");
+
+// Slot 0 only; per CPU so the hot path needs no atomics. Userspace sums the CPUs.
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  __uint(max_entries, 1);
+  __type(key, __u32);
+  __type(value, struct khor_offcpu_hist);
+} khor_offcpu_hist SEC(".maps");
+
+// Exec time of a process, keyed by tgid. LRU: long-lived processes age out, which only
+// loses lifetimes far past anything that counts as churn.
+struct khor_exec_stamp {
+  __u64 ts_ns;
+  __u32 sessions; // slots whose filters accepted the process at exec
+  __u32 _pad;
+};
+
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH);
+  __uint(max_entries, 32768);
+  __type(key, __u32);
+  __type(value, struct khor_exec_stamp);
+} khor_exec_start SEC(".maps");
+
+// Slot 0 only.
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  __uint(max_entries, 1);
+  __type(key, __u32);
+  __type(value, struct khor_lifetime_hist);
+} khor_lifetime SEC(".maps");
+
+// Exec events, slot 0 only.
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  __uint(max_entries, 1);
+  __type(key, __u32);
+  __type(value, struct khor_exec_limiter);
+} khor_exec_limit SEC(".maps");
+
+// A contention in progress, keyed by thread id (per-CPU key for the idle tasks, which all have pid 0).
+// LRU, so a begin whose end never comes is evicted instead of filling the map.
+struct khor_lock_stamp {
+  __u64 ts_ns;
+  __u64 lock;
+  __u32 sessions;
+  __u32 type; // khor_lock_type
+};
+
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH);
+  __uint(max_entries, 16384);
+  __type(key, __u32);
+  __type(value, struct khor_lock_stamp);
+} khor_lock_start SEC(".maps");
+
+// Slot 0's RTT samples, one histogram per window epoch.
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  __uint(max_entries, 2);
+  __type(key, __u32);
+  __type(value, struct khor_rtt_hist);
+} khor_rtt SEC(".maps");
+
+// Per lock type, slot 0 only.
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  __uint(max_entries, KHOR_LOCK_TYPES);
+  __type(key, __u32);
+  __type(value, struct khor_lock_stat);
+} khor_lock_stats SEC(".maps");
+
+// A VFS call in progress. Keyed by thread id << 1, with the low bit set for fsync: an O_SYNC
+// write runs vfs_fsync_range inside vfs_write, and both are timed.
+struct khor_vfs_stamp {
+  __u64 ts_ns;
+  __u64 file;
+  __u32 sessions;
+  __u32 op; // khor_vfs_op
+};
+
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH);
+  __uint(max_entries, 16384);
+  __type(key, __u64);
+  __type(value, struct khor_vfs_stamp);
+} khor_vfs_start SEC(".maps");
+
+// Per operation, slot 0 only.
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  __uint(max_entries, KHOR_VFS_OPS);
+  __type(key, __u32);
+  __type(value, struct khor_vfs_stat);
+} khor_vfs_stats SEC(".maps");
+
+// Per file, slot 0 only. Shared by all CPUs (a per-CPU LRU would split a file's totals), so
+// updates are atomic adds.
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH);
+  __uint(max_entries, KHOR_VFS_FILES);
+  __type(key, struct khor_vfs_file_key);
+  __type(value, struct khor_vfs_file);
+} khor_vfs_files SEC(".maps");
+
+// Slot 0 only.
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  __uint(max_entries, KHOR_DROP_REASONS);
+  __type(key, __u32);
+  __type(value, __u64);
+} khor_drops SEC(".maps");
+
+// Slot 0 only. Entry khor_bpf_sessions.window_epoch is being filled; userspace reads and clears the other.
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  __uint(max_entries, 2);
+  __type(key, __u32);
+  __type(value, struct khor_hll);
+} khor_hll SEC(".maps");
+
+// Slot 0 only. Key sketch * 2 + window_epoch, same flip as khor_hll.
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  __uint(max_entries, KHOR_CMS_SKETCHES * 2);
+  __type(key, __u32);
+  __type(value, struct khor_cms);
+} khor_cms SEC(".maps");
+
+enum khor_field {
+  KHOR_F_EXEC,
+  KHOR_F_NET_RX,
+  KHOR_F_NET_TX,
+  KHOR_F_SCHED,
+  KHOR_F_BLK_ISSUE,
+  KHOR_F_BLK_READ,
+  KHOR_F_BLK_WRITE,
+  KHOR_F_TCP_RETX,
+  KHOR_F_IRQ,
+  KHOR_F_OFFCPU_D,
+  KHOR_F_OFFCPU_S,
+  KHOR_F_LOCK,
+  KHOR_F_LOCK_WAIT,
+  KHOR_F_DROP,
+  KHOR_F_EXEC_FAIL,
+  KHOR_F_EXEC_SHORT,
+  KHOR_F_VFS_READ,
+  KHOR_F_VFS_WRITE,
+  KHOR_F_VFS_WAIT,
+  KHOR_F_FSYNC,
+  KHOR_F_FSYNC_WAIT,
+  KHOR_F_RTT,
+  KHOR_F_RTT_US,
+  KHOR_F_LISTEN_OVERFLOW,
+  KHOR_F_SYN_OVERFLOW,
+};
+
+static __always_inline struct khor_bpf_sessions* get_cfg(void) {
   __u32 k = 0;
   return bpf_map_lookup_elem(&khor_cfg, &k);
 }
 
 static __always_inline __u32 cfg_enabled_mask(const struct khor_bpf_config* cfg) {
-  const __u32 all = (KHOR_PROBE_EXEC | KHOR_PROBE_NET | KHOR_PROBE_SCHED | KHOR_PROBE_BLOCK | KHOR_PROBE_TCP | KHOR_PROBE_IRQ);
-  if (!cfg) return all;
+  const __u32 all = (KHOR_PROBE_EXEC | KHOR_PROBE_NET | KHOR_PROBE_SCHED | KHOR_PROBE_BLOCK | KHOR_PROBE_TCP | KHOR_PROBE_IRQ |
+                     KHOR_PROBE_OFFCPU | KHOR_PROBE_LOCK | KHOR_PROBE_DROP | KHOR_PROBE_VFS);
   return cfg->enabled_mask ? cfg->enabled_mask : all;
 }
 
 static __always_inline __u64 cfg_interval_ns(const struct khor_bpf_config* cfg) {
-  __u32 ms = cfg ? cfg->sample_interval_ms : 0;
+  __u32 ms = cfg->sample_interval_ms;
   if (!ms) ms = 200;
   return (__u64)ms * 1000000ULL;
 }
 
-static __always_inline bool pass_filters(const struct khor_bpf_config* cfg) {
-  if (!cfg) return true;
-
-  __u64 pid_tgid = bpf_get_current_pid_tgid();
-  __u32 tgid = (__u32)(pid_tgid >> 32);
+// The task's identity, read at most once per event however many sessions look at it.
+struct khor_task {
+  __u32 tgid;
+  bool have_cg;
+  __u64 cg;
+};
 
-  if (cfg->tgid_allow && tgid != cfg->tgid_allow) return false;
-  if (cfg->tgid_deny && tgid == cfg->tgid_deny) return false;
+static __always_inline bool pass_filters(const struct khor_bpf_config* cfg, struct khor_task* t) {
+  if (cfg->tgid_allow && t->tgid != cfg->tgid_allow) return false;
+  if (cfg->tgid_deny && t->tgid == cfg->tgid_deny) return false;
 
   if (cfg->cgroup_id) {
-    __u64 cg = bpf_get_current_cgroup_id();
-    if (cg != cfg->cgroup_id) return false;
+    if (!t->have_cg) {
+      t->cg = bpf_get_current_cgroup_id();
+      t->have_cg = true;
+    }
+    if (t->cg != cfg->cgroup_id) return false;
   }
 
   return true;
 }
 
-static __always_inline struct khor_counters* get_counters(void) {
+static __always_inline struct khor_counter_set* get_counters(void) {
   __u32 k = 0;
   return bpf_map_lookup_elem(&khor_accum, &k);
 }
 
-static __always_inline void emit_sample(struct khor_counters* c, const struct khor_bpf_config* cfg, __u64 now) {
-  (void)cfg;
+static __always_inline void emit_sample(struct khor_counters* c, __u32 session, __u64 now) {
   struct khor_event* e = bpf_ringbuf_reserve(&events, sizeof(*e), 0);
   if (!e) {
     c->acc.lost_events++;
@@ -86,6 +290,8 @@ static __always_inline void emit_sample(struct khor_counters* c, const struct kh
   e->tgid = (__u32)(pid_tgid >> 32);
   e->type = KHOR_EV_SAMPLE;
   e->cpu = bpf_get_smp_processor_id();
+  e->session = session;
+  e->_reserved = 0;
   bpf_get_current_comm(e->comm, sizeof(e->comm));
 
   e->u.sample = c->acc;
@@ -93,7 +299,7 @@ static __always_inline void emit_sample(struct khor_counters* c, const struct kh
   bpf_ringbuf_submit(e, 0);
 }
 
-static __always_inline void maybe_flush(struct khor_counters* c, const struct khor_bpf_config* cfg, __u64 now) {
+static __always_inline void maybe_flush(struct khor_counters* c, const struct khor_bpf_config* cfg, __u32 session, __u64 now) {
   if (!c->last_flush_ns) {
     c->last_flush_ns = now;
     return;
@@ -104,8 +310,11 @@ static __always_inline void maybe_flush(struct khor_counters* c, const struct kh
 
   if (c->acc.exec_count || c->acc.net_rx_bytes || c->acc.net_tx_bytes || c->acc.sched_switches ||
       c->acc.blk_read_bytes || c->acc.blk_write_bytes || c->acc.blk_issue_count || c->acc.lost_events ||
-      c->acc.tcp_retransmits || c->acc.irq_count) {
-    emit_sample(c, cfg, now);
+      c->acc.tcp_retransmits || c->acc.irq_count || c->acc.offcpu_d_ns || c->acc.offcpu_s_ns ||
+      c->acc.lock_count || c->acc.skb_drops || c->acc.exec_fail || c->acc.exec_short ||
+      c->acc.vfs_read_bytes || c->acc.vfs_write_bytes || c->acc.fsync_count || c->acc.rtt_count ||
+      c->acc.listen_overflow || c->acc.syn_overflow) {
+    emit_sample(c, session, now);
   }
 
   c->acc.exec_count = 0;
@@ -117,145 +326,794 @@ static __always_inline void maybe_flush(struct khor_counters* c, const struct kh
   c->acc.blk_issue_count = 0;
   c->acc.tcp_retransmits = 0;
   c->acc.irq_count = 0;
+  c->acc.offcpu_d_ns = 0;
+  c->acc.offcpu_s_ns = 0;
+  c->acc.lock_count = 0;
+  c->acc.lock_wait_ns = 0;
+  c->acc.skb_drops = 0;
+  c->acc.exec_fail = 0;
+  c->acc.exec_short = 0;
+  c->acc.vfs_read_bytes = 0;
+  c->acc.vfs_write_bytes = 0;
+  c->acc.vfs_ns = 0;
+  c->acc.fsync_count = 0;
+  c->acc.fsync_ns = 0;
+  c->acc.rtt_count = 0;
+  c->acc.rtt_us = 0;
+  c->acc.listen_overflow = 0;
+  c->acc.syn_overflow = 0;
   c->acc.lost_events = 0;
   c->last_flush_ns = now;
 }
 
-SEC("tracepoint/syscalls/sys_enter_execve")
-int tp_execve(struct trace_event_raw_sys_enter* ctx) {
-  (void)ctx;
-  const struct khor_bpf_config* cfg = get_cfg();
-  if (!pass_filters(cfg)) return 0;
-  if (!(cfg_enabled_mask(cfg) & KHOR_PROBE_EXEC)) return 0;
+static __always_inline void add_field(struct khor_sample_payload* acc, enum khor_field f, __u64 v) {
+  switch (f) {
+    case KHOR_F_EXEC: acc->exec_count += v; break;
+    case KHOR_F_NET_RX: acc->net_rx_bytes += v; break;
+    case KHOR_F_NET_TX: acc->net_tx_bytes += v; break;
+    case KHOR_F_SCHED: acc->sched_switches += v; break;
+    case KHOR_F_BLK_ISSUE: acc->blk_issue_count += v; break;
+    case KHOR_F_BLK_READ: acc->blk_read_bytes += v; break;
+    case KHOR_F_BLK_WRITE: acc->blk_write_bytes += v; break;
+    case KHOR_F_TCP_RETX: acc->tcp_retransmits += v; break;
+    case KHOR_F_IRQ: acc->irq_count += v; break;
+    case KHOR_F_OFFCPU_D: acc->offcpu_d_ns += v; break;
+    case KHOR_F_OFFCPU_S: acc->offcpu_s_ns += v; break;
+    case KHOR_F_LOCK: acc->lock_count += v; break;
+    case KHOR_F_LOCK_WAIT: acc->lock_wait_ns += v; break;
+    case KHOR_F_DROP: acc->skb_drops += v; break;
+    case KHOR_F_EXEC_FAIL: acc->exec_fail += v; break;
+    case KHOR_F_EXEC_SHORT: acc->exec_short += v; break;
+    case KHOR_F_VFS_READ: acc->vfs_read_bytes += v; break;
+    case KHOR_F_VFS_WRITE: acc->vfs_write_bytes += v; break;
+    case KHOR_F_VFS_WAIT: acc->vfs_ns += v; break;
+    case KHOR_F_FSYNC: acc->fsync_count += v; break;
+    case KHOR_F_FSYNC_WAIT: acc->fsync_ns += v; break;
+    case KHOR_F_RTT: acc->rtt_count += v; break;
+    case KHOR_F_RTT_US: acc->rtt_us += v; break;
+    case KHOR_F_LISTEN_OVERFLOW: acc->listen_overflow += v; break;
+    case KHOR_F_SYN_OVERFLOW: acc->syn_overflow += v; break;
+  }
+}
+
+// Live sessions whose mask has probe and (if task_scoped) whose filters accept the current task.
+static __always_inline __u32 match_sessions(const struct khor_bpf_sessions* cfg, __u32 probe, bool task_scoped) {
+  struct khor_task t = {};
+  if (task_scoped) t.tgid = (__u32)(bpf_get_current_pid_tgid() >> 32);
 
-  struct khor_counters* c = get_counters();
-  if (!c) return 0;
+  __u32 match = 0;
+  const __u32 n = cfg->count;
+  for (__u32 i = 0; i < KHOR_MAX_SESSIONS; i++) {
+    if (i >= n) break;
+    if (!(cfg->active & (1u << i))) continue;
+    const struct khor_bpf_config* sc = &cfg->s[i];
+    if (!(cfg_enabled_mask(sc) & probe)) continue;
+    if (task_scoped && !pass_filters(sc, &t)) continue;
+    match |= 1u << i;
+  }
+  return match;
+}
 
-  c->acc.exec_count++;
-  maybe_flush(c, cfg, bpf_ktime_get_ns());
+// Adds v to field f of every session in match. One counter lookup shared by all of them.
+static __always_inline void add_sessions(const struct khor_bpf_sessions* cfg, __u32 match, enum khor_field f, __u64 v) {
+  if (!match) return;
+  struct khor_counter_set* set = get_counters();
+  if (!set) return;
+  const __u64 now = bpf_ktime_get_ns();
+
+  for (__u32 i = 0; i < KHOR_MAX_SESSIONS; i++) {
+    if (!(match & (1u << i))) continue;
+    struct khor_counters* c = &set->s[i];
+    add_field(&c->acc, f, v);
+    maybe_flush(c, &cfg->s[i], i, now);
+  }
+}
+
+static __always_inline void account(__u32 probe, bool task_scoped, enum khor_field f, __u64 v) {
+  const struct khor_bpf_sessions* cfg = get_cfg();
+  if (!cfg) return;
+  add_sessions(cfg, match_sessions(cfg, probe, task_scoped), f, v);
+}
+
+static __always_inline __u32 log2_u64(__u64 v) {
+  __u32 r = 0;
+  if (v >> 32) { v >>= 32; r += 32; }
+  if (v >> 16) { v >>= 16; r += 16; }
+  if (v >> 8) { v >>= 8; r += 8; }
+  if (v >> 4) { v >>= 4; r += 4; }
+  if (v >> 2) { v >>= 2; r += 2; }
+  if (v >> 1) r += 1;
+  return r;
+}
+
+// murmur3 finalizer. The salt keeps 0 (which the finalizer maps to 0) from colliding across sets.
+static __always_inline __u64 mix64(__u64 x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+static __always_inline void hll_add(const struct khor_bpf_sessions* cfg, __u32 set, __u64 h) {
+  __u32 epoch = cfg->window_epoch & 1u;
+  struct khor_hll* r = bpf_map_lookup_elem(&khor_hll, &epoch);
+  if (!r || set >= KHOR_HLL_SETS) return;
+  const __u32 idx = (__u32)(h >> (64 - KHOR_HLL_BITS)) & (KHOR_HLL_REGS - 1);
+  const __u64 w = h << KHOR_HLL_BITS;
+  const unsigned char rank = w ? (unsigned char)(64 - log2_u64(w)) : (unsigned char)(64 - KHOR_HLL_BITS + 1);
+  if (rank > r->reg[set][idx]) r->reg[set][idx] = rank;
+}
+
+#define KHOR_ETH_P_IP   0x0800
+#define KHOR_ETH_P_IPV6 0x86DD
+
+// O(rows) per event: bump one counter per row, then offer the key to its candidate slot.
+// label is copied for a new candidate; NULL means the current comm.
+static __always_inline void cms_add(const struct khor_bpf_sessions* cfg, __u32 sketch, __u64 h, __u64 w,
+                                    __u32 id, __u32 family, const unsigned char* label) {
+  __u32 key = sketch * 2 + (cfg->window_epoch & 1u);
+  struct khor_cms* m = bpf_map_lookup_elem(&khor_cms, &key);
+  if (!m) return;
+  const __u32 h1 = (__u32)h;
+  const __u32 h2 = (__u32)(h >> 32) | 1u;
+  __u64 est = ~0ULL;
+#pragma unroll
+  for (__u32 r = 0; r < KHOR_CMS_ROWS; r++) {
+    const __u32 i = (h1 + r * h2) & (KHOR_CMS_WIDTH - 1);
+    const __u64 v = m->c[r][i] + w;
+    m->c[r][i] = v;
+    if (v < est) est = v;
+  }
+
+  struct khor_cms_candidate* c = &m->cand[(h >> 58) & (KHOR_CMS_CANDIDATES - 1)];
+  if (c->hash == h) {
+    c->est = est;
+    return;
+  }
+  if (est <= c->est) return;
+  c->hash = h;
+  c->est = est;
+  c->id = id;
+  c->family = family;
+  if (label) __builtin_memcpy(c->label, label, sizeof(c->label));
+  else bpf_get_current_comm(c->label, sizeof(c->label));
+}
+
+struct khor_peer {
+  __u32 family; // 4 or 6
+  unsigned char addr[16];
+};
+
+// Hash of the remote address (source on receive, destination on send); 0 if not IP.
+static __always_inline __u64 skb_peer(struct sk_buff* skb, bool rx, struct khor_peer* p) {
+  const __u16 proto = BPF_CORE_READ(skb, protocol);
+  const unsigned char* l3;
+  if (rx) {
+    // netif_receive_skb fires before the network header offset is reset; data is at L3 already.
+    l3 = BPF_CORE_READ(skb, data);
+  } else {
+    const __u16 nh = BPF_CORE_READ(skb, network_header);
+    if (nh == (__u16)~0u) return 0;
+    l3 = BPF_CORE_READ(skb, head) + nh;
+  }
+
+  if (proto == bpf_htons(KHOR_ETH_P_IP)) {
+    struct iphdr ip;
+    if (bpf_probe_read_kernel(&ip, sizeof(ip), l3)) return 0;
+    const __u32 a = rx ? ip.saddr : ip.daddr;
+    p->family = 4;
+    __builtin_memcpy(p->addr, &a, 4);
+    return mix64((__u64)a | (4ULL << 32));
+  }
+  if (proto == bpf_htons(KHOR_ETH_P_IPV6)) {
+    struct ipv6hdr ip6;
+    if (bpf_probe_read_kernel(&ip6, sizeof(ip6), l3)) return 0;
+    const struct in6_addr* a = rx ? &ip6.saddr : &ip6.daddr;
+    __u64 hi, lo;
+    __builtin_memcpy(&hi, &a->in6_u.u6_addr8[0], 8);
+    __builtin_memcpy(&lo, &a->in6_u.u6_addr8[8], 8);
+    p->family = 6;
+    __builtin_memcpy(p->addr, &a->in6_u.u6_addr8[0], 16);
+    return mix64(hi ^ mix64(lo ^ (6ULL << 32)));
+  }
   return 0;
 }
 
-SEC("tracepoint/net/netif_receive_skb")
-int tp_net_rx(struct trace_event_raw_net_dev_template* ctx) {
-  const struct khor_bpf_config* cfg = get_cfg();
-  if (!pass_filters(cfg)) return 0;
-  if (!(cfg_enabled_mask(cfg) & KHOR_PROBE_NET)) return 0;
+#define KHOR_EXEC_EVENT_SIZE (__builtin_offsetof(struct khor_event, u) + sizeof(struct khor_exec_payload))
 
-  struct khor_counters* c = get_counters();
-  if (!c) return 0;
+// One record per exec, as long as this CPU's bucket has a token. Nothing runs with exec_rate 0.
+static __always_inline void exec_event(const struct khor_bpf_sessions* cfg, __u64 now) {
+  const __u64 rate = cfg->exec_rate;
+  if (!rate) return;
+  __u32 zero = 0;
+  struct khor_exec_limiter* l = bpf_map_lookup_elem(&khor_exec_limit, &zero);
+  if (!l) return;
 
-  c->acc.net_rx_bytes += (__u64)ctx->len;
+  __u64 dt = now - l->last_ns;
+  if (dt > 10000000000ULL) dt = 10000000000ULL; // also covers the first event (last_ns = 0)
+  const __u64 cap = (__u64)(cfg->exec_burst ? cfg->exec_burst : 1) * 1000000000ULL;
+  __u64 credit = l->credit + dt * rate;
+  if (credit > cap) credit = cap;
+  l->last_ns = now;
+  if (credit < 1000000000ULL) {
+    l->credit = credit;
+    l->throttled++;
+    return;
+  }
+  l->credit = credit - 1000000000ULL;
 
-  // v1.0: ifindex is computed but not yet exported in the sample payload.
-  struct sk_buff* skb = (struct sk_buff*)ctx->skbaddr;
-  if (skb) {
-    (void)BPF_CORE_READ(skb, dev, ifindex);
+  struct khor_event* e = bpf_ringbuf_reserve(&events, KHOR_EXEC_EVENT_SIZE, 0);
+  if (!e) {
+    l->lost++;
+    return;
+  }
+  const __u64 pid_tgid = bpf_get_current_pid_tgid();
+  e->ts_ns = now;
+  e->pid = (__u32)pid_tgid;
+  e->tgid = (__u32)(pid_tgid >> 32);
+  e->type = KHOR_EV_EXEC;
+  e->cpu = bpf_get_smp_processor_id();
+  e->session = 0;
+  e->_reserved = 0;
+  bpf_get_current_comm(e->comm, sizeof(e->comm));
+  e->u.exec.cgroup_id = bpf_get_current_cgroup_id();
+  bpf_ringbuf_submit(e, 0);
+  l->emitted++;
+}
+
+// Successful execs only; failed ones are counted on the syscall's exit.
+SEC("tracepoint/sched/sched_process_exec")
+int tp_exec(struct trace_event_raw_sched_process_exec* ctx) {
+  (void)ctx;
+  const struct khor_bpf_sessions* cfg = get_cfg();
+  if (!cfg) return 0;
+  const __u32 match = match_sessions(cfg, KHOR_PROBE_EXEC, true);
+  if (!match) return 0;
+  add_sessions(cfg, match, KHOR_F_EXEC, 1);
+
+  // After exec the caller is the group leader, so pid == tgid here.
+  const __u32 tgid = (__u32)(bpf_get_current_pid_tgid() >> 32);
+  const __u64 now = bpf_ktime_get_ns();
+  struct khor_exec_stamp st = {.ts_ns = now, .sessions = match};
+  (void)bpf_map_update_elem(&khor_exec_start, &tgid, &st, BPF_ANY);
+
+  if (match & 1u) {
+    exec_event(cfg, now);
+    // The parent, not the caller: a script's children all have fresh tgids but one parent.
+    struct task_struct* task = (struct task_struct*)bpf_get_current_task();
+    const __u32 ppid = (__u32)BPF_CORE_READ(task, real_parent, tgid);
+    hll_add(cfg, KHOR_HLL_EXEC, mix64((__u64)ppid | (1ULL << 32)));
   }
+  return 0;
+}
 
-  maybe_flush(c, cfg, bpf_ktime_get_ns());
+static __always_inline int exec_exit(struct trace_event_raw_sys_exit* ctx) {
+  if (ctx->ret >= 0) return 0;
+  account(KHOR_PROBE_EXEC, true, KHOR_F_EXEC_FAIL, 1);
   return 0;
 }
 
-SEC("tracepoint/net/net_dev_queue")
-int tp_net_tx(struct trace_event_raw_net_dev_template* ctx) {
-  const struct khor_bpf_config* cfg = get_cfg();
-  if (!pass_filters(cfg)) return 0;
-  if (!(cfg_enabled_mask(cfg) & KHOR_PROBE_NET)) return 0;
+SEC("tracepoint/syscalls/sys_exit_execve")
+int tp_execve_exit(struct trace_event_raw_sys_exit* ctx) {
+  return exec_exit(ctx);
+}
+
+SEC("tracepoint/syscalls/sys_exit_execveat")
+int tp_execveat_exit(struct trace_event_raw_sys_exit* ctx) {
+  return exec_exit(ctx);
+}
 
-  struct khor_counters* c = get_counters();
-  if (!c) return 0;
+SEC("tracepoint/sched/sched_process_exit")
+int tp_exit(struct trace_event_raw_sched_process_template* ctx) {
+  (void)ctx;
+  const __u64 pid_tgid = bpf_get_current_pid_tgid();
+  const __u32 tgid = (__u32)(pid_tgid >> 32);
+  if ((__u32)pid_tgid != tgid) return 0; // a thread, not the process
+  struct khor_exec_stamp* sp = bpf_map_lookup_elem(&khor_exec_start, &tgid);
+  if (!sp) return 0;
+  const struct khor_exec_stamp st = *sp;
+  (void)bpf_map_delete_elem(&khor_exec_start, &tgid);
 
-  c->acc.net_tx_bytes += (__u64)ctx->len;
+  const struct khor_bpf_sessions* cfg = get_cfg();
+  if (!cfg) return 0;
+  const __u64 now = bpf_ktime_get_ns();
+  if (now <= st.ts_ns) return 0;
+  const __u64 life = now - st.ts_ns;
+  // Sessions stopped or reconfigured since the exec drop out here.
+  const __u32 match = st.sessions & match_sessions(cfg, KHOR_PROBE_EXEC, false);
+  if (life < KHOR_SHORT_LIVED_NS) add_sessions(cfg, match, KHOR_F_EXEC_SHORT, 1);
 
-  struct sk_buff* skb = (struct sk_buff*)ctx->skbaddr;
-  if (skb) {
-    (void)BPF_CORE_READ(skb, dev, ifindex);
+  if (match & 1u) {
+    __u32 zero = 0;
+    struct khor_lifetime_hist* h = bpf_map_lookup_elem(&khor_lifetime, &zero);
+    if (h) {
+      __u32 b = log2_u64(life / 1000);
+      if (b >= KHOR_LIFETIME_BUCKETS) b = KHOR_LIFETIME_BUCKETS - 1;
+      h->b[b]++;
+    }
   }
+  return 0;
+}
 
-  maybe_flush(c, cfg, bpf_ktime_get_ns());
+static __always_inline int net_event(struct trace_event_raw_net_dev_template* ctx, bool rx) {
+  const struct khor_bpf_sessions* cfg = get_cfg();
+  if (!cfg) return 0;
+  const __u32 match = match_sessions(cfg, KHOR_PROBE_NET, true);
+  add_sessions(cfg, match, rx ? KHOR_F_NET_RX : KHOR_F_NET_TX, (__u64)ctx->len);
+  struct sk_buff* skb = (struct sk_buff*)ctx->skbaddr;
+  if ((match & 1u) && skb) {
+    struct khor_peer p = {};
+    const __u64 h = skb_peer(skb, rx, &p);
+    if (h) {
+      hll_add(cfg, KHOR_HLL_PEER, h);
+      cms_add(cfg, KHOR_CMS_PEER_BYTES, h, (__u64)ctx->len, 0, p.family, p.addr);
+    }
+  }
   return 0;
 }
 
+SEC("tracepoint/net/netif_receive_skb")
+int tp_net_rx(struct trace_event_raw_net_dev_template* ctx) {
+  return net_event(ctx, true);
+}
+
+SEC("tracepoint/net/net_dev_queue")
+int tp_net_tx(struct trace_event_raw_net_dev_template* ctx) {
+  return net_event(ctx, false);
+}
+
+// prev_state as reported by the tracepoint (TASK_REPORT bits; 0x100 = preempted, still runnable).
+#define KHOR_TASK_REPORT_S 0x1
+#define KHOR_TASK_REPORT_D 0x2
+
 SEC("tracepoint/sched/sched_switch")
 int tp_sched_switch(struct trace_event_raw_sched_switch* ctx) {
-  (void)ctx;
-  const struct khor_bpf_config* cfg = get_cfg();
-  if (!pass_filters(cfg)) return 0;
-  if (!(cfg_enabled_mask(cfg) & KHOR_PROBE_SCHED)) return 0;
+  const struct khor_bpf_sessions* cfg = get_cfg();
+  if (!cfg) return 0;
+  // Runs in prev's context, so the task filters see the task being switched out.
+  const __u32 sched_match = match_sessions(cfg, KHOR_PROBE_SCHED, true);
+  add_sessions(cfg, sched_match, KHOR_F_SCHED, 1);
+  if (sched_match & 1u) {
+    const __u32 tgid = (__u32)(bpf_get_current_pid_tgid() >> 32);
+    if (tgid) {
+      const __u64 h = mix64((__u64)tgid | (2ULL << 32));
+      hll_add(cfg, KHOR_HLL_CSW, h);
+      cms_add(cfg, KHOR_CMS_TGID_CSW, h, 1, tgid, 0, NULL);
+    }
+  }
+
+  const __u64 now = bpf_ktime_get_ns();
+
+  // Switch-out: stamp prev if it blocked. Idle kthreads (I), stopped and dying tasks are skipped.
+  const long st = ctx->prev_state & 0x1ff;
+  const __u32 state = st == KHOR_TASK_REPORT_D ? KHOR_OFFCPU_D : st == KHOR_TASK_REPORT_S ? KHOR_OFFCPU_S : 0;
+  if (state) {
+    const __u32 match = match_sessions(cfg, KHOR_PROBE_OFFCPU, true);
+    if (match) {
+      const __u32 prev = (__u32)ctx->prev_pid;
+      struct khor_offcpu_stamp s = {.ts_ns = now, .sessions = match, .state = state};
+      (void)bpf_map_update_elem(&khor_offcpu_start, &prev, &s, BPF_ANY);
+    }
+  }
+
+  // Switch-in: next ran again; credit its wait to the sessions that saw it block.
+  const __u32 next = (__u32)ctx->next_pid;
+  if (!next) return 0;
+  struct khor_offcpu_stamp* sp = bpf_map_lookup_elem(&khor_offcpu_start, &next);
+  if (!sp) return 0;
+  const struct khor_offcpu_stamp s = *sp;
+  (void)bpf_map_delete_elem(&khor_offcpu_start, &next);
+  if (now <= s.ts_ns) return 0;
+  const __u64 delta = now - s.ts_ns;
 
-  struct khor_counters* c = get_counters();
-  if (!c) return 0;
+  add_sessions(cfg, s.sessions, s.state == KHOR_OFFCPU_D ? KHOR_F_OFFCPU_D : KHOR_F_OFFCPU_S, delta);
 
-  c->acc.sched_switches++;
-  maybe_flush(c, cfg, bpf_ktime_get_ns());
+  if (s.sessions & 1u) {
+    __u32 zero = 0;
+    struct khor_offcpu_hist* h = bpf_map_lookup_elem(&khor_offcpu_hist, &zero);
+    if (h) {
+      __u32 b = log2_u64(delta / 1000);
+      if (b >= KHOR_OFFCPU_BUCKETS) b = KHOR_OFFCPU_BUCKETS - 1;
+      if (s.state == KHOR_OFFCPU_D) h->d[b]++;
+      else h->s[b]++;
+    }
+  }
   return 0;
 }
 
 SEC("tracepoint/block/block_rq_issue")
 int tp_block_rq_issue(struct trace_event_raw_block_rq* ctx) {
-  const struct khor_bpf_config* cfg = get_cfg();
-  if (!pass_filters(cfg)) return 0;
-  if (!(cfg_enabled_mask(cfg) & KHOR_PROBE_BLOCK)) return 0;
-
-  struct khor_counters* c = get_counters();
-  if (!c) return 0;
-
   (void)ctx;
-  c->acc.blk_issue_count++;
-
-  maybe_flush(c, cfg, bpf_ktime_get_ns());
+  account(KHOR_PROBE_BLOCK, true, KHOR_F_BLK_ISSUE, 1);
   return 0;
 }
 
 SEC("tracepoint/block/block_rq_complete")
 int tp_block_rq_complete(struct trace_event_raw_block_rq_completion* ctx) {
-  const struct khor_bpf_config* cfg = get_cfg();
-  if (!pass_filters(cfg)) return 0;
-  if (!(cfg_enabled_mask(cfg) & KHOR_PROBE_BLOCK)) return 0;
-
-  struct khor_counters* c = get_counters();
-  if (!c) return 0;
-
   // rwbs is a short string like "R", "W", "WS" etc.
   const char rw = ctx->rwbs[0];
   const __u64 bytes = (__u64)ctx->nr_sector * 512ULL;
   if (rw == 'R') {
-    c->acc.blk_read_bytes += bytes;
+    account(KHOR_PROBE_BLOCK, true, KHOR_F_BLK_READ, bytes);
   } else if (rw == 'W') {
-    c->acc.blk_write_bytes += bytes;
+    account(KHOR_PROBE_BLOCK, true, KHOR_F_BLK_WRITE, bytes);
   }
-
-  maybe_flush(c, cfg, bpf_ktime_get_ns());
   return 0;
 }
 
 SEC("tracepoint/tcp/tcp_retransmit_skb")
 int tp_tcp_retransmit(struct trace_event_raw_tcp_retransmit_skb* ctx) {
   (void)ctx;
-  const struct khor_bpf_config* cfg = get_cfg();
-  if (!pass_filters(cfg)) return 0;
-  if (!(cfg_enabled_mask(cfg) & KHOR_PROBE_TCP)) return 0;
+  account(KHOR_PROBE_TCP, true, KHOR_F_TCP_RETX, 1);
+  return 0;
+}
 
-  struct khor_counters* c = get_counters();
-  if (!c) return 0;
+// Runs for every segment received on an established socket, in softirq: not task-scoped.
+SEC("tracepoint/tcp/tcp_probe")
+int tp_tcp_probe(struct trace_event_raw_tcp_probe* ctx) {
+  const __u32 srtt = ctx->srtt; // us
+  if (!srtt) return 0;          // no RTT sample on this socket yet
+  const struct khor_bpf_sessions* cfg = get_cfg();
+  if (!cfg) return 0;
+  const __u32 match = match_sessions(cfg, KHOR_PROBE_TCP, false);
+  if (!match) return 0;
+  add_sessions(cfg, match, KHOR_F_RTT, 1);
+  add_sessions(cfg, match, KHOR_F_RTT_US, srtt);
+  if (!(match & 1u)) return 0;
 
-  c->acc.tcp_retransmits++;
-  maybe_flush(c, cfg, bpf_ktime_get_ns());
+  __u32 epoch = cfg->window_epoch & 1u;
+  struct khor_rtt_hist* h = bpf_map_lookup_elem(&khor_rtt, &epoch);
+  if (h) {
+    __u32 b = log2_u64(srtt);
+    if (b >= KHOR_RTT_BUCKETS) b = KHOR_RTT_BUCKETS - 1;
+    h->b[b]++;
+  }
   return 0;
 }
 
+// Listen queues, checked where the kernel is about to make the same decision. The accept
+// queue is full once sk_ack_backlog exceeds sk_max_ack_backlog (sk_acceptq_is_full); the SYN
+// queue once it holds sk_max_ack_backlog requests (inet_csk_reqsk_queue_is_full).
+static __always_inline bool acceptq_full(struct sock* sk) {
+  return BPF_CORE_READ(sk, sk_ack_backlog) > BPF_CORE_READ(sk, sk_max_ack_backlog);
+}
+
+SEC("kprobe/tcp_conn_request")
+int BPF_KPROBE(kp_tcp_conn_request, struct request_sock_ops* rsk_ops, const struct tcp_request_sock_ops* af_ops,
+               struct sock* sk) {
+  const int synq = BPF_CORE_READ((struct inet_connection_sock*)sk, icsk_accept_queue.qlen.counter);
+  const bool syn_full = synq >= 0 && (__u32)synq >= BPF_CORE_READ(sk, sk_max_ack_backlog);
+  const bool accept_full = acceptq_full(sk);
+  if (!syn_full && !accept_full) return 0;
+  const struct khor_bpf_sessions* cfg = get_cfg();
+  if (!cfg) return 0;
+  const __u32 match = match_sessions(cfg, KHOR_PROBE_TCP, false);
+  if (syn_full) add_sessions(cfg, match, KHOR_F_SYN_OVERFLOW, 1);
+  if (accept_full) add_sessions(cfg, match, KHOR_F_LISTEN_OVERFLOW, 1);
+  return 0;
+}
+
+// The handshake's final ACK: the child socket is dropped if the accept queue is full.
+static __always_inline int syn_recv_sock(struct sock* sk) {
+  if (!acceptq_full(sk)) return 0;
+  account(KHOR_PROBE_TCP, false, KHOR_F_LISTEN_OVERFLOW, 1);
+  return 0;
+}
+
+SEC("kprobe/tcp_v4_syn_recv_sock")
+int BPF_KPROBE(kp_tcp_v4_syn_recv_sock, struct sock* sk) {
+  return syn_recv_sock(sk);
+}
+
+// In the ipv6 module, which may not be loaded: attached separately, and allowed to fail.
+SEC("kprobe/tcp_v6_syn_recv_sock")
+int BPF_KPROBE(kp_tcp_v6_syn_recv_sock, struct sock* sk) {
+  return syn_recv_sock(sk);
+}
+
 SEC("tracepoint/irq/irq_handler_entry")
 int tp_irq_entry(struct trace_event_raw_irq_handler_entry* ctx) {
   (void)ctx;
-  const struct khor_bpf_config* cfg = get_cfg();
-  if (!(cfg_enabled_mask(cfg) & KHOR_PROBE_IRQ)) return 0;
-  // Skip pass_filters for IRQs — they aren't process-scoped.
+  // Skip the task filters for IRQs — they aren't process-scoped.
+  account(KHOR_PROBE_IRQ, false, KHOR_F_IRQ, 1);
+  return 0;
+}
+
+// skb:kfree_skb. The record layout and the drop reason values differ between kernels, so both
+// are CO-RE relocated against these local flavors.
+enum skb_drop_reason___khor {
+  SKB_NOT_DROPPED_YET___khor = 0,
+  SKB_CONSUMED___khor = 1,
+  SKB_DROP_REASON_NOT_SPECIFIED___khor = 2,
+};
+
+struct trace_event_raw_kfree_skb___khor {
+  enum skb_drop_reason___khor reason;
+} __attribute__((preserve_access_index));
+
+// Reasons that aren't drops (or aren't annotated): every ordinary free would otherwise count.
+static __always_inline bool drop_benign(__u32 r) {
+  if (bpf_core_enum_value_exists(enum skb_drop_reason___khor, SKB_NOT_DROPPED_YET___khor) &&
+      r == (__u32)bpf_core_enum_value(enum skb_drop_reason___khor, SKB_NOT_DROPPED_YET___khor))
+    return true;
+  if (bpf_core_enum_value_exists(enum skb_drop_reason___khor, SKB_CONSUMED___khor) &&
+      r == (__u32)bpf_core_enum_value(enum skb_drop_reason___khor, SKB_CONSUMED___khor))
+    return true;
+  if (bpf_core_enum_value_exists(enum skb_drop_reason___khor, SKB_DROP_REASON_NOT_SPECIFIED___khor) &&
+      r == (__u32)bpf_core_enum_value(enum skb_drop_reason___khor, SKB_DROP_REASON_NOT_SPECIFIED___khor))
+    return true;
+  return false;
+}
 
-  struct khor_counters* c = get_counters();
-  if (!c) return 0;
+SEC("tracepoint/skb/kfree_skb")
+int tp_kfree_skb(struct trace_event_raw_kfree_skb___khor* ctx) {
+  // Before 5.17 there is no reason, and nothing tells a drop from a normal free.
+  if (!bpf_core_field_exists(ctx->reason)) return 0;
+  const __u32 reason = (__u32)ctx->reason;
+  if (drop_benign(reason)) return 0;
 
-  c->acc.irq_count++;
-  maybe_flush(c, cfg, bpf_ktime_get_ns());
+  const struct khor_bpf_sessions* cfg = get_cfg();
+  if (!cfg) return 0;
+  // Drops happen in softirq context, on whatever task was running; like IRQs, not task-scoped.
+  const __u32 match = match_sessions(cfg, KHOR_PROBE_DROP, false);
+  add_sessions(cfg, match, KHOR_F_DROP, 1);
+  if (!(match & 1u)) return 0;
+
+  const __u32 idx = reason < KHOR_DROP_REASONS ? reason : KHOR_DROP_REASONS - 1;
+  __u64* c = bpf_map_lookup_elem(&khor_drops, &idx);
+  if (c) (*c)++;
+  return 0;
+}
+
+// lock:contention_begin/end (Linux 5.19+). Loaded only with features.locks. The records are
+// declared here from the tracepoint format files, so the object builds against any vmlinux.h.
+struct khor_contention_begin_args {
+  __u64 __common;
+  __u64 lock_addr;
+  unsigned int flags;
+};
+
+struct khor_contention_end_args {
+  __u64 __common;
+  __u64 lock_addr;
+  int ret;
+};
+
+#define KHOR_LCB_F_SPIN   (1u << 0)
+#define KHOR_LCB_F_READ   (1u << 1)
+#define KHOR_LCB_F_WRITE  (1u << 2)
+#define KHOR_LCB_F_RT     (1u << 3)
+#define KHOR_LCB_F_PERCPU (1u << 4)
+#define KHOR_LCB_F_MUTEX  (1u << 5)
+
+static __always_inline __u32 lock_type(unsigned int flags) {
+  if (flags & KHOR_LCB_F_PERCPU) return KHOR_LOCK_PCPU_SEM;
+  if (flags & KHOR_LCB_F_MUTEX) return KHOR_LOCK_MUTEX;
+  if (flags & KHOR_LCB_F_RT) return KHOR_LOCK_RTMUTEX;
+  if (flags & KHOR_LCB_F_SPIN) return (flags & (KHOR_LCB_F_READ | KHOR_LCB_F_WRITE)) ? KHOR_LOCK_RWLOCK : KHOR_LOCK_SPIN;
+  if (flags & (KHOR_LCB_F_READ | KHOR_LCB_F_WRITE)) return KHOR_LOCK_RWSEM;
+  return KHOR_LOCK_OTHER;
+}
+
+static __always_inline __u32 lock_stamp_key(void) {
+  const __u32 pid = (__u32)bpf_get_current_pid_tgid();
+  return pid ? pid : (0x80000000u | bpf_get_smp_processor_id());
+}
+
+SEC("tracepoint/lock/contention_begin")
+int tp_contention_begin(struct khor_contention_begin_args* ctx) {
+  const __u32 key = lock_stamp_key();
+  const __u64 lock = ctx->lock_addr;
+  struct khor_lock_stamp* cur = bpf_map_lookup_elem(&khor_lock_start, &key);
+  if (cur) {
+    // A mutex spins first and then sleeps, with a second begin for the same lock: keep the
+    // start time and take the later class. A different lock here is a nested contention
+    // (e.g. from an interrupt); the outer one is kept.
+    if (cur->lock == lock) cur->type = lock_type(ctx->flags);
+    return 0;
+  }
+
+  const struct khor_bpf_sessions* cfg = get_cfg();
+  if (!cfg) return 0;
+  const __u32 match = match_sessions(cfg, KHOR_PROBE_LOCK, true);
+  if (!match) return 0;
+  struct khor_lock_stamp s = {.ts_ns = bpf_ktime_get_ns(), .lock = lock, .sessions = match, .type = lock_type(ctx->flags)};
+  (void)bpf_map_update_elem(&khor_lock_start, &key, &s, BPF_ANY);
+  return 0;
+}
+
+SEC("tracepoint/lock/contention_end")
+int tp_contention_end(struct khor_contention_end_args* ctx) {
+  const __u32 key = lock_stamp_key();
+  struct khor_lock_stamp* sp = bpf_map_lookup_elem(&khor_lock_start, &key);
+  if (!sp || sp->lock != ctx->lock_addr) return 0;
+  const struct khor_lock_stamp s = *sp;
+  (void)bpf_map_delete_elem(&khor_lock_start, &key);
+
+  const __u64 now = bpf_ktime_get_ns();
+  if (now <= s.ts_ns) return 0;
+  const __u64 delta = now - s.ts_ns;
+
+  const struct khor_bpf_sessions* cfg = get_cfg();
+  if (!cfg) return 0;
+  add_sessions(cfg, s.sessions, KHOR_F_LOCK, 1);
+  add_sessions(cfg, s.sessions, KHOR_F_LOCK_WAIT, delta);
+
+  if (!(s.sessions & 1u)) return 0;
+  const __u32 type = s.type < KHOR_LOCK_TYPES ? s.type : KHOR_LOCK_OTHER;
+  struct khor_lock_stat* st = bpf_map_lookup_elem(&khor_lock_stats, &type);
+  if (!st) return 0;
+  st->count++;
+  st->wait_ns += delta;
+  if (delta > st->max_ns) st->max_ns = delta;
+  __u32 b = log2_u64(delta);
+  if (b >= KHOR_LOCK_BUCKETS) b = KHOR_LOCK_BUCKETS - 1;
+  st->hist[b]++;
+  return 0;
+}
+
+// VFS calls on regular files (features.vfs). Pipes, sockets and ttys also go through
+// vfs_read/vfs_write; they are rejected on entry before any map is touched.
+#define KHOR_S_IFMT  0170000
+#define KHOR_S_IFREG 0100000
+
+static __always_inline __u64 vfs_stamp_key(__u32 op) {
+  const __u32 pid = (__u32)bpf_get_current_pid_tgid();
+  return ((__u64)pid << 1) | (op == KHOR_VFS_FSYNC ? 1u : 0u);
+}
+
+static __always_inline int vfs_enter(struct file* file, __u32 op) {
+  if (!file) return 0;
+  const umode_t mode = BPF_CORE_READ(file, f_inode, i_mode);
+  if ((mode & KHOR_S_IFMT) != KHOR_S_IFREG) return 0;
+  const __u64 key = vfs_stamp_key(op);
+  // Stacked filesystems (overlayfs) call the VFS again for the lower file; the outer call is kept.
+  if (bpf_map_lookup_elem(&khor_vfs_start, &key)) return 0;
+
+  const struct khor_bpf_sessions* cfg = get_cfg();
+  if (!cfg) return 0;
+  const __u32 match = match_sessions(cfg, KHOR_PROBE_VFS, true);
+  if (!match) return 0;
+  struct khor_vfs_stamp s = {.ts_ns = bpf_ktime_get_ns(), .file = (__u64)file, .sessions = match, .op = op};
+  (void)bpf_map_update_elem(&khor_vfs_start, &key, &s, BPF_ANY);
+  return 0;
+}
+
+static __always_inline void vfs_file_add(struct file* file, __u32 op, __u64 bytes, __u64 delta) {
+  struct inode* inode = BPF_CORE_READ(file, f_inode);
+  struct khor_vfs_file_key k = {.ino = BPF_CORE_READ(inode, i_ino), .dev = (__u32)BPF_CORE_READ(inode, i_sb, s_dev)};
+  struct khor_vfs_file* f = bpf_map_lookup_elem(&khor_vfs_files, &k);
+  if (!f) {
+    struct khor_vfs_file nf = {};
+    const unsigned char* name = BPF_CORE_READ(file, f_path.dentry, d_name.name);
+    (void)bpf_probe_read_kernel_str(nf.name, sizeof(nf.name), name);
+    bpf_get_current_comm(nf.comm, sizeof(nf.comm));
+    // Another CPU may have inserted the file meanwhile.
+    (void)bpf_map_update_elem(&khor_vfs_files, &k, &nf, BPF_NOEXIST);
+    f = bpf_map_lookup_elem(&khor_vfs_files, &k);
+    if (!f) return;
+  }
+  if (op == KHOR_VFS_READ) {
+    __sync_fetch_and_add(&f->read_bytes, bytes);
+  } else if (op == KHOR_VFS_WRITE) {
+    __sync_fetch_and_add(&f->write_bytes, bytes);
+  } else {
+    __sync_fetch_and_add(&f->fsync_count, 1);
+    __sync_fetch_and_add(&f->fsync_ns, delta);
+  }
+  __sync_fetch_and_add(&f->ops, 1);
+  __sync_fetch_and_add(&f->ns, delta);
+}
+
+static __always_inline int vfs_exit(struct file* file, __u32 op, long ret) {
+  const __u64 key = vfs_stamp_key(op);
+  struct khor_vfs_stamp* sp = bpf_map_lookup_elem(&khor_vfs_start, &key);
+  if (!sp || sp->file != (__u64)file) return 0;
+  const struct khor_vfs_stamp s = *sp;
+  (void)bpf_map_delete_elem(&khor_vfs_start, &key);
+
+  const __u64 now = bpf_ktime_get_ns();
+  if (now <= s.ts_ns) return 0;
+  const __u64 delta = now - s.ts_ns;
+  const __u64 bytes = op != KHOR_VFS_FSYNC && ret > 0 ? (__u64)ret : 0;
+
+  const struct khor_bpf_sessions* cfg = get_cfg();
+  if (!cfg) return 0;
+  if (op == KHOR_VFS_FSYNC) {
+    add_sessions(cfg, s.sessions, KHOR_F_FSYNC, 1);
+    add_sessions(cfg, s.sessions, KHOR_F_FSYNC_WAIT, delta);
+  } else {
+    add_sessions(cfg, s.sessions, op == KHOR_VFS_READ ? KHOR_F_VFS_READ : KHOR_F_VFS_WRITE, bytes);
+    add_sessions(cfg, s.sessions, KHOR_F_VFS_WAIT, delta);
+  }
+
+  if (!(s.sessions & 1u)) return 0;
+  __u32 idx = op;
+  struct khor_vfs_stat* st = bpf_map_lookup_elem(&khor_vfs_stats, &idx);
+  if (st) {
+    st->count++;
+    st->bytes += bytes;
+    st->ns += delta;
+    if (delta > st->max_ns) st->max_ns = delta;
+    __u32 b = log2_u64(delta);
+    if (b >= KHOR_VFS_BUCKETS) b = KHOR_VFS_BUCKETS - 1;
+    st->hist[b]++;
+  }
+  vfs_file_add(file, op, bytes, delta);
+  return 0;
+}
+
+// Loaded only with features.vfs, and attached one by one: a kernel without BPF trampolines
+// (fentry/fexit) loses these and keeps everything else.
+SEC("fentry/vfs_read")
+int BPF_PROG(fentry_vfs_read, struct file* file) {
+  return vfs_enter(file, KHOR_VFS_READ);
+}
+
+SEC("fexit/vfs_read")
+int BPF_PROG(fexit_vfs_read, struct file* file, char* buf, size_t count, loff_t* pos, ssize_t ret) {
+  return vfs_exit(file, KHOR_VFS_READ, ret);
+}
+
+SEC("fentry/vfs_write")
+int BPF_PROG(fentry_vfs_write, struct file* file) {
+  return vfs_enter(file, KHOR_VFS_WRITE);
+}
+
+SEC("fexit/vfs_write")
+int BPF_PROG(fexit_vfs_write, struct file* file, const char* buf, size_t count, loff_t* pos, ssize_t ret) {
+  return vfs_exit(file, KHOR_VFS_WRITE, ret);
+}
+
+SEC("fentry/vfs_fsync_range")
+int BPF_PROG(fentry_vfs_fsync_range, struct file* file) {
+  return vfs_enter(file, KHOR_VFS_FSYNC);
+}
+
+SEC("fexit/vfs_fsync_range")
+int BPF_PROG(fexit_vfs_fsync_range, struct file* file, loff_t start, loff_t end, int datasync, int ret) {
+  return vfs_exit(file, KHOR_VFS_FSYNC, ret);
+}
+
+// Not auto-attached: userspace opens one CPU-clock perf event per CPU and attaches this to each.
+SEC("perf_event")
+int khor_cpu_sample(struct bpf_perf_event_data* ctx) {
+  const __u64 pid_tgid = bpf_get_current_pid_tgid();
+  if ((__u32)pid_tgid == 0) return 0; // idle
+
+  const struct khor_bpf_sessions* cfg = get_cfg();
+  if (!cfg) return 0;
+  __u32 zero = 0;
+  struct khor_prof_stats* st = bpf_map_lookup_elem(&khor_prof_stats, &zero);
+  if (!st) return 0;
+
+  struct khor_task t = {.tgid = (__u32)(pid_tgid >> 32)};
+  if (!pass_filters(&cfg->s[0], &t)) return 0;
+  st->samples++;
+
+  struct khor_prof_key key = {};
+  key.tgid = t.tgid;
+  key.user_stack = bpf_get_stackid(ctx, &khor_stacks, BPF_F_USER_STACK);
+  key.kernel_stack = bpf_get_stackid(ctx, &khor_stacks, 0);
+  if (key.user_stack < 0 && key.kernel_stack < 0) {
+    st->stack_errors++;
+    return 0;
+  }
+
+  struct khor_prof_value* v = bpf_map_lookup_elem(&khor_prof, &key);
+  if (!v) {
+    struct khor_prof_value nv = {.count = 0};
+    bpf_get_current_comm(nv.comm, sizeof(nv.comm));
+    // Another CPU may have inserted the key meanwhile; only a full map is a drop.
+    (void)bpf_map_update_elem(&khor_prof, &key, &nv, BPF_NOEXIST);
+    v = bpf_map_lookup_elem(&khor_prof, &key);
+    if (!v) {
+      st->dropped++;
+      return 0;
+    }
+  }
+  __sync_fetch_and_add(&v->count, 1);
   return 0;
 }
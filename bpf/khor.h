@@ -16,8 +16,13 @@ typedef uint64_t khor_u64;
 // Keep this struct fixed-size and CO-RE friendly (no pointers).
 #define KHOR_COMM_LEN 16
 
+// Filter/counter slots in the one loaded object. Slot 0 is the daemon's own pipeline,
+// the rest are extra sessions (/api/sessions).
+#define KHOR_MAX_SESSIONS 8
+
 enum khor_event_type {
   KHOR_EV_SAMPLE = 1,
+  KHOR_EV_EXEC = 2, // one successful exec (slot 0, exec events on); header + khor_exec_payload only
 };
 
 enum khor_probe_mask {
@@ -27,6 +32,161 @@ enum khor_probe_mask {
   KHOR_PROBE_BLOCK = 1u << 3,
   KHOR_PROBE_TCP   = 1u << 4,
   KHOR_PROBE_IRQ   = 1u << 5,
+  KHOR_PROBE_OFFCPU = 1u << 6,
+  KHOR_PROBE_LOCK  = 1u << 7, // only when loaded with features.locks
+  KHOR_PROBE_DROP  = 1u << 8,
+  KHOR_PROBE_VFS   = 1u << 9, // only when loaded with features.vfs
+};
+
+// Per-reason drop counters: index = enum skb_drop_reason value; larger values (subsystem
+// reasons) share the last slot.
+#define KHOR_DROP_REASONS 256
+
+// Why a task was switched out, from sched_switch's prev_state (TASK_REPORT bits).
+enum khor_offcpu_state {
+  KHOR_OFFCPU_S = 1, // interruptible sleep: waiting on an event, a timer, a socket
+  KHOR_OFFCPU_D = 2, // uninterruptible: disk I/O, some locks, page faults
+};
+
+// Off-CPU histograms: bucket i counts waits in [2^i, 2^(i+1)) us (bucket 0 includes < 1 us).
+#define KHOR_OFFCPU_BUCKETS 32
+
+struct khor_offcpu_hist {
+  khor_u64 d[KHOR_OFFCPU_BUCKETS];
+  khor_u64 s[KHOR_OFFCPU_BUCKETS];
+};
+
+// Process lifetime, exec to exit of the group leader: bucket i counts [2^i, 2^(i+1)) us
+// (bucket 0 includes < 1 us, the last everything from ~36 minutes up).
+#define KHOR_LIFETIME_BUCKETS 32
+// Processes gone sooner than this after a successful exec count as churn.
+#define KHOR_SHORT_LIVED_NS 1000000ULL
+
+struct khor_lifetime_hist {
+  khor_u64 b[KHOR_LIFETIME_BUCKETS];
+};
+
+// Smoothed RTT of established TCP sockets (tcp:tcp_probe, one sample per received segment):
+// bucket i counts [2^i, 2^(i+1)) us. Double-buffered on window_epoch like the sketches.
+#define KHOR_RTT_BUCKETS 32
+
+struct khor_rtt_hist {
+  khor_u64 b[KHOR_RTT_BUCKETS];
+};
+
+// Kernel lock classes, from the contention_begin flags (LCB_F_*).
+enum khor_lock_type {
+  KHOR_LOCK_SPIN,
+  KHOR_LOCK_RWLOCK,
+  KHOR_LOCK_MUTEX,
+  KHOR_LOCK_RWSEM,
+  KHOR_LOCK_RTMUTEX,
+  KHOR_LOCK_PCPU_SEM,
+  KHOR_LOCK_OTHER,
+  KHOR_LOCK_TYPES,
+};
+
+// Lock wait histograms: bucket i counts waits in [2^i, 2^(i+1)) ns.
+#define KHOR_LOCK_BUCKETS 32
+
+struct khor_lock_stat {
+  khor_u64 count;
+  khor_u64 wait_ns;
+  khor_u64 max_ns;
+  khor_u64 hist[KHOR_LOCK_BUCKETS];
+};
+
+// VFS calls on regular files (fentry/fexit, features.vfs), per CPU and per operation.
+enum khor_vfs_op {
+  KHOR_VFS_READ,
+  KHOR_VFS_WRITE,
+  KHOR_VFS_FSYNC,
+  KHOR_VFS_OPS,
+};
+
+// VFS latency histograms: bucket i counts calls taking [2^i, 2^(i+1)) ns.
+#define KHOR_VFS_BUCKETS 32
+
+struct khor_vfs_stat {
+  khor_u64 count;
+  khor_u64 bytes; // returned by read/write; 0 for fsync
+  khor_u64 ns;
+  khor_u64 max_ns;
+  khor_u64 hist[KHOR_VFS_BUCKETS];
+};
+
+// Per-file totals in an LRU hash shared by all CPUs (slot 0 only); cold files are evicted.
+#define KHOR_VFS_FILES 4096
+#define KHOR_VFS_NAME_LEN 32
+
+struct khor_vfs_file_key {
+  khor_u64 ino;
+  khor_u32 dev; // kernel dev_t: major << 20 | minor
+  khor_u32 _pad;
+};
+
+struct khor_vfs_file {
+  khor_u64 read_bytes;
+  khor_u64 write_bytes;
+  khor_u64 ops;      // reads + writes + fsyncs
+  khor_u64 ns;       // time spent in all of them
+  khor_u64 fsync_count;
+  khor_u64 fsync_ns;
+  char name[KHOR_VFS_NAME_LEN]; // dentry name when first seen (no directories)
+  char comm[KHOR_COMM_LEN];     // first caller
+};
+
+// HyperLogLog distinct counters: 2^KHOR_HLL_BITS one-byte registers per set. A register
+// holds the highest rank (leading zeros + 1 of the hash bits below the index) seen.
+#define KHOR_HLL_BITS 8
+#define KHOR_HLL_REGS (1u << KHOR_HLL_BITS)
+
+enum khor_hll_set {
+  KHOR_HLL_EXEC,  // parent tgids of exec callers (who is spawning)
+  KHOR_HLL_CSW,   // tgids switched out (who is running)
+  KHOR_HLL_PEER,  // remote IPv4/IPv6 addresses of received and sent packets
+  KHOR_HLL_SETS,
+};
+
+struct khor_hll {
+  unsigned char reg[KHOR_HLL_SETS][KHOR_HLL_REGS];
+};
+
+// Count-min sketches: KHOR_CMS_ROWS rows of KHOR_CMS_WIDTH counters. Row r of hash h
+// is (lo32(h) + r * (hi32(h) | 1)) mod width. Each sketch also keeps a small candidate
+// table, slot picked by hash bits 58..63, holding the key with the largest estimate seen
+// (per CPU) so userspace knows which keys to ask the merged sketch about.
+#define KHOR_CMS_ROWS 4
+#define KHOR_CMS_WIDTH 512
+#define KHOR_CMS_CANDIDATES 64
+
+enum khor_cms_sketch {
+  KHOR_CMS_TGID_CSW,   // context switches by tgid
+  KHOR_CMS_PEER_BYTES, // packet bytes by remote address
+  KHOR_CMS_SKETCHES,
+};
+
+struct khor_cms_candidate {
+  khor_u64 hash;             // 0 = empty
+  khor_u64 est;              // this CPU's estimate when last seen
+  khor_u32 id;               // tgid (KHOR_CMS_TGID_CSW)
+  khor_u32 family;           // 4 or 6 (KHOR_CMS_PEER_BYTES)
+  unsigned char label[16];   // comm, or the address in network order
+};
+
+struct khor_cms {
+  khor_u64 c[KHOR_CMS_ROWS][KHOR_CMS_WIDTH];
+  struct khor_cms_candidate cand[KHOR_CMS_CANDIDATES];
+};
+
+// Exec event token bucket (per CPU) and its accounting. credit is in event-nanoseconds:
+// it grows by exec_rate per ns elapsed, an event costs 1e9, and it tops out at exec_burst events.
+struct khor_exec_limiter {
+  khor_u64 credit;
+  khor_u64 last_ns;
+  khor_u64 emitted;
+  khor_u64 throttled; // no token
+  khor_u64 lost;      // ring buffer full
 };
 
 struct khor_bpf_config {
@@ -37,8 +197,19 @@ struct khor_bpf_config {
   khor_u64 cgroup_id;           // 0 => off
 };
 
+// The whole filter table is one map value, so a probe does a single lookup however many sessions run.
+struct khor_bpf_sessions {
+  khor_u32 count;  // slots [0, count) are evaluated
+  khor_u32 active; // bitmask of live slots
+  khor_u32 window_epoch; // khor_hll/khor_cms/khor_rtt entry the probes fill; userspace flips it to close a window
+  khor_u32 exec_rate;    // exec events per second per CPU; 0 = off
+  khor_u32 exec_burst;   // bucket depth, in events
+  khor_u32 _pad;
+  struct khor_bpf_config s[KHOR_MAX_SESSIONS];
+};
+
 struct khor_sample_payload {
-  khor_u64 exec_count;
+  khor_u64 exec_count; // successful execs (sched_process_exec)
   khor_u64 net_rx_bytes;
   khor_u64 net_tx_bytes;
   khor_u64 sched_switches;
@@ -48,6 +219,26 @@ struct khor_sample_payload {
   khor_u64 lost_events; // ringbuf reserve failures since last flush
   khor_u64 tcp_retransmits;
   khor_u64 irq_count;
+  khor_u64 offcpu_d_ns; // time tasks spent switched out in D state, credited when they run again
+  khor_u64 offcpu_s_ns; // same for S state
+  khor_u64 lock_count;   // contended lock acquisitions (features.locks)
+  khor_u64 lock_wait_ns; // time spent waiting in them
+  khor_u64 skb_drops;    // kfree_skb with a non-benign drop reason
+  khor_u64 exec_fail;    // execve/execveat that returned an error
+  khor_u64 exec_short;   // processes that exited within KHOR_SHORT_LIVED_NS of their exec
+  khor_u64 vfs_read_bytes;  // vfs_read on regular files, page cache hits included (features.vfs)
+  khor_u64 vfs_write_bytes; // vfs_write on regular files
+  khor_u64 vfs_ns;          // time spent in those reads and writes
+  khor_u64 fsync_count;     // vfs_fsync_range calls (fsync, fdatasync, O_SYNC writes)
+  khor_u64 fsync_ns;        // time spent in them
+  khor_u64 rtt_count;       // tcp_probe samples with a smoothed RTT
+  khor_u64 rtt_us;          // sum of those RTTs
+  khor_u64 listen_overflow; // SYNs and handshake ACKs dropped because a listener's accept queue was full
+  khor_u64 syn_overflow;    // SYNs that found the SYN queue full (dropped, or answered with a cookie)
+};
+
+struct khor_exec_payload {
+  khor_u64 cgroup_id;
 };
 
 struct khor_event {
@@ -56,9 +247,34 @@ struct khor_event {
   khor_u32 tgid;
   khor_u32 type;
   khor_u32 cpu;
+  khor_u32 session; // slot the sample belongs to
+  khor_u32 _reserved;
   char comm[KHOR_COMM_LEN];
   union {
     struct khor_sample_payload sample;
-    khor_u64 _u64[10]; // keep event size stable
+    struct khor_exec_payload exec;
+    khor_u64 _u64[15]; // keep event size stable
   } u;
 };
+
+// On-CPU profiler (perf_event CPU-clock samples, slot 0 filters). Stacks are aggregated in
+// the kernel; userspace drains khor_prof and the stack ids it references about once a second.
+#define KHOR_PROF_STACK_DEPTH 127 // PERF_MAX_STACK_DEPTH
+
+struct khor_prof_key {
+  khor_u32 tgid;
+  int user_stack;   // khor_stacks id, < 0 if none
+  int kernel_stack; // khor_stacks id, < 0 if none (sample taken in user mode)
+  khor_u32 _pad;
+};
+
+struct khor_prof_value {
+  khor_u64 count;
+  char comm[KHOR_COMM_LEN];
+};
+
+struct khor_prof_stats {
+  khor_u64 samples;      // samples that passed the filters
+  khor_u64 dropped;      // khor_prof was full
+  khor_u64 stack_errors; // neither stack could be captured (khor_stacks full or unwinding failed)
+};
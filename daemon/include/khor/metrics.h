@@ -19,6 +19,53 @@ struct KhorMetrics {
   std::atomic<uint64_t> irq_total{0};
   std::atomic<double> mem_pressure_pct{0.0}; // PSI some avg10, 0..100
 
+  // Off-CPU time (sum over tasks) by why they were switched out.
+  std::atomic<uint64_t> offcpu_d_ns_total{0}; // uninterruptible (D)
+  std::atomic<uint64_t> offcpu_s_ns_total{0}; // interruptible sleep (S)
+
+  // Kernel lock contention (features.locks).
+  std::atomic<uint64_t> lock_contended_total{0};
+  std::atomic<uint64_t> lock_wait_ns_total{0};
+
+  // Process churn: failed execs, and processes that exited within 1 ms of exec.
+  std::atomic<uint64_t> exec_fail_total{0};
+  std::atomic<uint64_t> proc_short_total{0};
+
+  // VFS calls on regular files (features.vfs): page cache hits count, unlike block I/O.
+  std::atomic<uint64_t> vfs_read_bytes_total{0};
+  std::atomic<uint64_t> vfs_write_bytes_total{0};
+  std::atomic<uint64_t> vfs_ns_total{0}; // time spent in those reads and writes
+  std::atomic<uint64_t> fsync_total{0};
+  std::atomic<uint64_t> fsync_ns_total{0};
+
+  // TCP health: smoothed RTT samples of established sockets, and listen-queue overflows.
+  std::atomic<uint64_t> rtt_samples_total{0};
+  std::atomic<uint64_t> rtt_us_total{0};
+  std::atomic<uint64_t> listen_overflow_total{0}; // accept queue full
+  std::atomic<uint64_t> syn_overflow_total{0};    // SYN queue full
+  std::atomic<double> rtt_p50_us{0.0};            // over the last ~1 s window (slot 0)
+  std::atomic<double> rtt_p99_us{0.0};
+
+  // Hardware counters summed over CPUs (features.pmu), or the software fallback's page faults.
+  std::atomic<uint64_t> pmu_cycles_total{0};
+  std::atomic<uint64_t> pmu_instructions_total{0};
+  std::atomic<uint64_t> pmu_cache_misses_total{0}; // last-level cache
+  std::atomic<uint64_t> pmu_branch_misses_total{0};
+  std::atomic<uint64_t> page_faults_total{0};
+  std::atomic<uint64_t> major_faults_total{0};
+
+  // kfree_skb drops with a real reason.
+  std::atomic<uint64_t> skb_drop_total{0};
+
+  // On-CPU profiler (features.profile).
+  std::atomic<uint64_t> prof_samples_total{0};
+  std::atomic<double> prof_entropy{0.0}; // 0 = one function takes every sample, 1 = spread evenly
+
+  // Distinct counts (HyperLogLog) over the last ~1 s window.
+  std::atomic<double> distinct_spawners{0.0}; // parents of exec callers
+  std::atomic<double> distinct_actors{0.0};   // processes that ran
+  std::atomic<double> distinct_peers{0.0};    // remote addresses
+
   std::atomic<double> bpm{110.0};
   std::atomic<int> key_midi{62}; // D4
 };
@@ -6,7 +6,21 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
 
+#include <csignal>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include "engine/preset_rules.h"
+#include "engine/presets.h"
+#include "engine/sketch.h"
 #include "util/paths.h"
 
 namespace khor {
@@ -23,22 +37,70 @@ static JsonValue json_error(const std::string& msg) {
   });
 }
 
-static double read_psi_memory_some_avg10() {
-  FILE* f = std::fopen("/proc/pressure/memory", "r");
-  if (!f) return 0.0;
-  char line[256];
+// Reads "some avg10" from a kept-open PSI file (pread from 0 re-renders it; no allocation).
+static double read_psi_some_avg10(int fd) {
+  if (fd < 0) return 0.0;
+  char buf[256];
+  const ssize_t n = ::pread(fd, buf, sizeof(buf) - 1, 0);
+  if (n <= 0) return 0.0;
+  buf[n] = 0;
   double avg10 = 0.0;
-  while (std::fgets(line, sizeof(line), f)) {
-    if (std::strncmp(line, "some ", 5) == 0) {
-      const char* p = std::strstr(line, "avg10=");
-      if (p) avg10 = std::strtod(p + 6, nullptr);
-      break;
-    }
+  if (std::strncmp(buf, "some ", 5) == 0) {
+    const char* p = std::strstr(buf, "avg10=");
+    if (p) avg10 = std::strtod(p + 6, nullptr);
   }
-  std::fclose(f);
   return std::clamp(avg10, 0.0, 100.0);
 }
 
+static bool read_text_file(const std::string& path, std::string* out) {
+  std::ifstream f(path);
+  if (!f.good()) return false;
+  std::ostringstream ss;
+  ss << f.rdbuf();
+  *out = ss.str();
+  return true;
+}
+
+static MusicConfig make_music_cfg(const KhorConfig& cfg) {
+  MusicConfig mc;
+  mc.bpm = cfg.bpm;
+  mc.key_midi = cfg.key_midi;
+  mc.scale = cfg.scale;
+  mc.preset = cfg.preset;
+  mc.density = cfg.density;
+  return mc;
+}
+
+static RtConfig make_rt_cfg(const KhorConfig& cfg) {
+  RtConfig rt;
+  (void)rt_policy_parse(cfg.rt_policy, &rt.policy);
+  rt.priority = cfg.rt_priority;
+  rt.cpus = cfg.rt_cpus;
+  return rt;
+}
+
+static AudioConfig make_audio_cfg(const KhorConfig& cfg) {
+  AudioConfig ac;
+  ac.backend = cfg.audio_backend;
+  ac.device = cfg.audio_device;
+  ac.sample_rate = cfg.audio_sample_rate;
+  ac.master_gain = cfg.audio_master_gain;
+  ac.rt = make_rt_cfg(cfg);
+  return ac;
+}
+
+static JsonValue rt_thread_json(const RtConfig& want, const RtThreadStatus& st) {
+  JsonValue o = JsonValue::make_object({
+    {"tid", JsonValue::make_number(st.tid)},
+    {"policy", JsonValue::make_string(rt_sched_name(st.policy))},
+    {"priority", JsonValue::make_number(st.priority)},
+    {"cpus_allowed", JsonValue::make_number(st.cpus_allowed)},
+  });
+  const std::string e = rt_status_error(want, st);
+  if (!e.empty()) o.o["error"] = JsonValue::make_string(e);
+  return o;
+}
+
 } // namespace
 
 int64_t App::unix_ms_now() {
@@ -49,10 +111,13 @@ int64_t App::unix_ms_now() {
 App::App(std::string config_path, KhorConfig cfg)
   : config_path_(std::move(config_path)), cfg_(std::move(cfg)) {
   if (cfg_.ui_dir.empty()) cfg_.ui_dir = path_default_ui_dir();
+  presets_dir_ = (std::filesystem::path(config_path_).parent_path() / "presets").string();
+  presets_ = std::make_shared<const PresetLibrary>();
   density_.store(cfg_.density);
   smoothing_.store(cfg_.smoothing);
   metrics_.bpm.store(cfg_.bpm);
   metrics_.key_midi.store(cfg_.key_midi);
+  bpf_.set_exec_queue(&exec_q_);
 }
 
 App::~App() { stop(); }
@@ -62,15 +127,39 @@ KhorConfig App::config_snapshot() const {
   return cfg_;
 }
 
-bool App::start_audio_locked(const KhorConfig& cfg, std::string* err) {
-  AudioConfig ac;
-  ac.backend = cfg.audio_backend;
-  ac.device = cfg.audio_device;
-  ac.sample_rate = cfg.audio_sample_rate;
-  ac.master_gain = cfg.audio_master_gain;
+void App::publish_config(const KhorConfig& next) {
+  std::scoped_lock lk(cfg_mu_);
+  cfg_ = next;
+  cfg_gen_.fetch_add(1, std::memory_order_release);
+}
+
+std::shared_ptr<const PresetLibrary> App::presets_snapshot() const {
+  std::scoped_lock lk(presets_mu_);
+  return presets_;
+}
+
+bool App::reload_presets(bool force) {
+  const uint64_t fp = preset_dir_fingerprint(presets_dir_);
+  {
+    std::scoped_lock lk(presets_mu_);
+    if (!force && fp == presets_fp_) return false;
+  }
+
+  auto lib = PresetLibrary::load_dir(presets_dir_);
+  for (const auto& e : lib->errors()) std::fprintf(stderr, "preset %s\n", e.c_str());
+  {
+    std::scoped_lock lk(presets_mu_);
+    presets_ = std::move(lib);
+    presets_fp_ = fp;
+  }
+  // The music loop picks the new library up with the next config generation.
+  cfg_gen_.fetch_add(1, std::memory_order_release);
+  return true;
+}
 
+bool App::start_audio_locked(const KhorConfig& cfg, std::string* err) {
   std::string e;
-  bool ok = audio_.start(ac, &e);
+  bool ok = audio_.start(make_audio_cfg(cfg), &e);
   audio_.set_master_gain(cfg.audio_master_gain);
   if (!ok) {
     audio_err_ = e.empty() ? "audio init failed" : e;
@@ -86,14 +175,8 @@ void App::stop_audio_locked() {
 }
 
 bool App::restart_audio_locked(const KhorConfig& cfg, std::string* err) {
-  AudioConfig ac;
-  ac.backend = cfg.audio_backend;
-  ac.device = cfg.audio_device;
-  ac.sample_rate = cfg.audio_sample_rate;
-  ac.master_gain = cfg.audio_master_gain;
-
   std::string e;
-  bool ok = audio_.restart(ac, &e);
+  bool ok = audio_.restart(make_audio_cfg(cfg), &e);
   audio_.set_master_gain(cfg.audio_master_gain);
   if (!ok) {
     audio_err_ = e.empty() ? "audio init failed" : e;
@@ -106,7 +189,7 @@ bool App::restart_audio_locked(const KhorConfig& cfg, std::string* err) {
 
 bool App::start_midi_locked(const KhorConfig& cfg, std::string* err) {
   std::string e;
-  bool ok = midi_.start(cfg.midi_port, cfg.midi_channel, &e);
+  bool ok = midi_.start(cfg.midi_port, cfg.midi_channel, &seq_reactor_, &e);
   if (!ok) {
     midi_err_ = e.empty() ? "midi init failed" : e;
     if (err) *err = midi_err_;
@@ -119,8 +202,15 @@ bool App::start_midi_locked(const KhorConfig& cfg, std::string* err) {
 void App::stop_midi_locked() { midi_.stop(); }
 
 bool App::start_osc_locked(const KhorConfig& cfg, std::string* err) {
+  std::vector<OscDest> dests;
+  dests.push_back(OscDest{cfg.osc_host, cfg.osc_port});
+  for (const auto& t : cfg.osc_targets) {
+    OscDest d;
+    if (osc_parse_dest(t, &d)) dests.push_back(std::move(d));
+  }
+
   std::string e;
-  bool ok = osc_.start(cfg.osc_host, cfg.osc_port, &e);
+  bool ok = osc_.start(dests, cfg.osc_multicast_ttl, &e);
   if (!ok) {
     osc_err_ = e.empty() ? "osc init failed" : e;
     if (err) *err = osc_err_;
@@ -132,20 +222,87 @@ bool App::start_osc_locked(const KhorConfig& cfg, std::string* err) {
 
 void App::stop_osc_locked() { osc_.stop(); }
 
-static BpfConfig make_bpf_cfg(const KhorConfig& cfg) {
+bool App::start_osc_in_locked(const KhorConfig& cfg, std::string* err) {
+  std::string e;
+  bool ok = osc_in_.start(cfg.osc_in_host, cfg.osc_in_port, [this](const osc::Message& m) { on_osc_control(m); }, &reactor_, &e);
+  if (!ok) {
+    osc_in_err_ = e.empty() ? "osc input init failed" : e;
+    if (err) *err = osc_in_err_;
+    return false;
+  }
+  osc_in_err_.clear();
+  return true;
+}
+
+void App::stop_osc_in_locked() { osc_in_.stop(); }
+
+void App::on_osc_control(const osc::Message& m) {
+  // Live modulation writes the hot controls directly; it is not persisted to the config file.
+  const std::string_view addr = m.address;
+  const bool num0 = m.argc >= 1 && m.args[0].is_number();
+
+  if (addr == "/khor/bpm" && num0) {
+    set_bpm_live(std::clamp((double)m.args[0].as_float(), 1.0, 400.0));
+  } else if (addr == "/khor/density" && num0) {
+    density_.store(std::clamp((double)m.args[0].as_float(), 0.0, 1.0), std::memory_order_relaxed);
+  } else if (addr == "/khor/smoothing" && num0) {
+    smoothing_.store(std::clamp((double)m.args[0].as_float(), 0.0, 1.0), std::memory_order_relaxed);
+  } else if (addr == "/khor/key" && num0) {
+    metrics_.key_midi.store(std::clamp((int)m.args[0].as_int(), 0, 127), std::memory_order_relaxed);
+  } else if (addr == "/khor/preset" && m.argc >= 1 && m.args[0].tag == 's') {
+    const auto lib = presets_snapshot();
+    if (const PresetDef* p = lib->find(m.args[0].s)) set_preset_live(*p);
+  } else if (addr == "/khor/note" && m.argc >= 4 && m.args[0].is_number() && m.args[1].is_number() &&
+             m.args[2].is_number() && m.args[3].is_number()) {
+    // /khor/note iiff: channel, midi, velocity, duration (same layout as the output message).
+    NoteEvent ev;
+    ev.channel = std::clamp((int)m.args[0].as_int(), 1, 16);
+    ev.midi = std::clamp((int)m.args[1].as_int(), 0, 127);
+    ev.velocity = std::clamp(m.args[2].as_float(), 0.0f, 1.0f);
+    ev.dur_s = std::clamp(m.args[3].as_float(), 0.02f, 3.0f);
+    // Not echoed to OSC out, so a controller that also listens can't feed back into itself.
+    if (audio_.is_running()) play_live_note(ev);
+    if (midi_.is_running()) midi_.send_note(ev);
+  } else {
+    osc_in_unknown_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void App::play_live_note(const NoteEvent& ev) {
+  // The live lane is single-producer; the main reactor is that producer.
+  if (reactor_.in_loop_thread()) {
+    audio_.submit_live_note(ev);
+  } else {
+    reactor_.post([this, ev] { audio_.submit_live_note(ev); });
+  }
+}
+
+uint64_t App::resolve_cgroup(const std::string& name, uint64_t id) const {
+  if (name.empty()) return id;
+  const uint64_t r = cgroups_.resolve(name);
+  return r ? r : kCgroupNone;
+}
+
+BpfConfig App::make_bpf_cfg(const KhorConfig& cfg) const {
   BpfConfig b;
   b.enabled = cfg.enable_bpf;
   b.enabled_mask = cfg.bpf_enabled_mask;
   b.sample_interval_ms = cfg.bpf_sample_interval_ms;
   b.tgid_allow = cfg.bpf_tgid_allow;
   b.tgid_deny = cfg.bpf_tgid_deny;
-  b.cgroup_id = cfg.bpf_cgroup_id;
+  b.cgroup_id = resolve_cgroup(cfg.bpf_cgroup, cfg.bpf_cgroup_id);
+  b.profile_hz = cfg.enable_profile ? cfg.profile_hz : 0;
+  b.profile_max_stacks = cfg.profile_max_stacks;
+  b.locks = cfg.enable_locks;
+  b.vfs = cfg.enable_vfs;
+  b.exec_event_rate = cfg.enable_exec_events ? cfg.exec_events_rate : 0;
+  b.exec_event_burst = cfg.exec_events_burst;
   return b;
 }
 
 bool App::start_bpf_locked(const KhorConfig& cfg, std::string* err) {
   std::string e;
-  bool ok = bpf_.start(make_bpf_cfg(cfg), &metrics_, &e);
+  bool ok = bpf_.start(make_bpf_cfg(cfg), &metrics_, &reactor_, &e);
   if (!ok) {
     bpf_err_ = e.empty() ? "bpf init failed" : e;
     if (err) *err = bpf_err_;
@@ -157,69 +314,265 @@ bool App::start_bpf_locked(const KhorConfig& cfg, std::string* err) {
 
 void App::stop_bpf_locked() { bpf_.stop(); }
 
+bool App::start_pmu_locked(std::string* err) {
+  if (!pmu_.start(err)) return false;
+  const PmuStatus st = pmu_.status();
+  std::fprintf(stderr, "khor-daemon: pmu: %s counters on %d CPUs\n", pmu_mode_name(st.mode), st.cpus);
+  if (st.mode == PmuMode::Software) std::fprintf(stderr, "khor-daemon: pmu: %s\n", st.error.c_str());
+  return true;
+}
+
+void App::stop_pmu_locked() { pmu_.stop(); }
+
 void App::apply_bpf_cfg_locked(const KhorConfig& cfg) {
   (void)bpf_.apply_config(make_bpf_cfg(cfg), nullptr);
 }
 
+void App::apply_seq_rt(const RtConfig& rt) {
+  const RtThreadStatus st = rt_apply_current_thread(rt);
+  const std::string e = rt_status_error(rt, st);
+  if (!e.empty()) std::fprintf(stderr, "khor: sequencer %s\n", e.c_str());
+  std::scoped_lock lk(rt_mu_);
+  seq_rt_ = st;
+}
+
+void App::apply_mlock(bool on) {
+  std::scoped_lock lk(rt_mu_);
+  if (on == mlocked_) return;
+  mlock_err_.clear();
+  if (!on) {
+    rt_unlock_memory();
+    mlocked_ = false;
+  } else if (rt_lock_memory(&mlock_err_)) {
+    mlocked_ = true;
+  } else {
+    std::fprintf(stderr, "khor: %s\n", mlock_err_.c_str());
+  }
+}
+
 bool App::start(std::string* err) {
   if (running_.load()) return true;
-  stop_.store(false);
+  if (!reactor_.open(err) || !seq_reactor_.open(err) || !render_seq_.open(err)) {
+    starting_.store(false);
+    return false;
+  }
   running_.store(true);
 
+  // HTTP is already up: a PUT during startup waits here instead of being overwritten by the captured cfg.
+  std::unique_lock apply_lk(config_apply_mu_);
   KhorConfig cfg = config_snapshot();
+  // Before any thread starts, so their stacks are populated and locked as they are mapped.
+  apply_mlock(cfg.rt_mlock);
   metrics_.bpm.store(cfg.bpm);
   metrics_.key_midi.store(cfg.key_midi);
   density_.store(cfg.density);
   smoothing_.store(cfg.smoothing);
 
+  using clock = std::chrono::steady_clock;
+  const auto t0 = clock::now();
+  starting_.store(true);
+  {
+    std::scoped_lock lk(startup_mu_);
+    startup_.clear();
+    startup_total_ms_ = 0.0;
+  }
+
+  // Before BPF, which resolves bpf.cgroup names through it. One walk of cgroupfs; inotify keeps it current.
+  cgroup_timer_ = reactor_.add_timer([this](uint64_t) { refresh_cgroup_filters(); });
+  {
+    std::string e;
+    const bool ok = cgroups_.start("/sys/fs/cgroup", &reactor_, [this] { arm_cgroup_refresh(); }, &e);
+    std::scoped_lock lk(cgroups_mu_);
+    cgroups_err_ = ok ? "" : (e.empty() ? "cgroup cache failed" : e);
+  }
+
   // Start outputs + BPF. Failures are reported via /api/health but don't stop the daemon.
+  // They share nothing but the reactors (whose registration is serialized), so they come up
+  // concurrently: startup costs the slowest of them (usually BPF verification or the
+  // PulseAudio connection), not their sum.
+  struct Phase {
+    const char* name;
+    std::function<bool(std::string*)> fn;
+    std::string err;
+  };
+  std::vector<Phase> phases;
+  phases.push_back({"presets", [this](std::string*) { (void)reload_presets(/*force=*/true); return true; }, {}});
   if (cfg.enable_audio) {
-    std::scoped_lock lk(audio_mu_);
-    (void)start_audio_locked(cfg, err);
+    phases.push_back({"audio", [&](std::string* e) { std::scoped_lock lk(audio_mu_); return start_audio_locked(cfg, e); }, {}});
   }
   if (cfg.enable_midi) {
-    std::scoped_lock lk(midi_mu_);
-    (void)start_midi_locked(cfg, err);
+    phases.push_back({"midi", [&](std::string* e) { std::scoped_lock lk(midi_mu_); return start_midi_locked(cfg, e); }, {}});
   }
   if (cfg.enable_osc) {
-    std::scoped_lock lk(osc_mu_);
-    (void)start_osc_locked(cfg, err);
+    phases.push_back({"osc", [&](std::string* e) { std::scoped_lock lk(osc_mu_); return start_osc_locked(cfg, e); }, {}});
+  }
+  if (cfg.enable_osc_in) {
+    phases.push_back({"osc_in", [&](std::string* e) { std::scoped_lock lk(osc_in_mu_); return start_osc_in_locked(cfg, e); }, {}});
   }
-
   if (cfg.enable_bpf) {
-    std::scoped_lock lk(bpf_mu_);
-    (void)start_bpf_locked(cfg, err);
+    phases.push_back({"bpf", [&](std::string* e) { std::scoped_lock lk(bpf_mu_); return start_bpf_locked(cfg, e); }, {}});
   } else {
     std::scoped_lock lk(bpf_mu_);
     bpf_err_ = "disabled by config";
   }
+  if (cfg.enable_pmu) {
+    phases.push_back({"pmu", [this](std::string* e) { std::scoped_lock lk(pmu_mu_); return start_pmu_locked(e); }, {}});
+  }
 
-  // Fake metrics mode only if explicitly enabled and BPF isn't ok.
-  if (cfg.enable_fake && !bpf_.status().ok) {
-    fake_running_.store(true);
-    fake_ = std::thread([this] { fake_loop(); });
+  {
+    std::scoped_lock lk(startup_mu_);
+    for (const auto& ph : phases) startup_.push_back(StartupPhase{.name = ph.name});
+  }
+  std::vector<std::thread> workers;
+  workers.reserve(phases.size());
+  for (std::size_t i = 0; i < phases.size(); i++) {
+    workers.emplace_back([this, &phases, i, t0] {
+      const auto t = clock::now();
+      const bool ok = phases[i].fn(&phases[i].err);
+      const auto end = clock::now();
+      std::scoped_lock lk(startup_mu_);
+      StartupPhase& sp = startup_[i];
+      sp.done = true;
+      sp.ok = ok;
+      sp.ms = std::chrono::duration<double, std::milli>(end - t).count();
+      sp.end_ms = std::chrono::duration<double, std::milli>(end - t0).count();
+    });
   }
+  for (auto& w : workers) w.join();
+  for (const auto& ph : phases) {
+    if (!ph.err.empty() && err && err->empty()) *err = ph.err;
+  }
+
+  psi_fd_ = ::open("/proc/pressure/memory", O_RDONLY | O_CLOEXEC);
+  prof_req_ = prof_req_stop_ = false;
+  prof_thread_ = std::thread([this] { profile_worker(); });
+  sampler_last_ = std::chrono::steady_clock::now();
+  sampler_timer_ = reactor_.add_timer([this](uint64_t) { sampler_tick(); });
+  (void)reactor_.arm_periodic(sampler_timer_, std::chrono::milliseconds(100));
+
+  ClockOverrun overrun = ClockOverrun::Skip;
+  (void)clock_overrun_parse(cfg.music_overrun, &overrun);
+  clock_.set_overrun(overrun);
+  clock_.reset(mono_now_ns(), cfg.bpm);
+  music_timer_ = seq_reactor_.add_timer([this](uint64_t) { music_tick(); });
+  arm_music_timer();
+  (void)seq_reactor_.add_fd(render_seq_.notify_fd(), [this] { on_render_steps(); });
+
+  fake_timer_ = reactor_.add_timer([this](uint64_t) { fake_tick(); });
+  config_req_stop_ = false;
+  config_thread_ = std::thread([this] { config_worker(); });
+  config_timer_ = reactor_.add_timer([this](uint64_t) {
+    std::scoped_lock lk(config_req_mu_);
+    config_req_ = true;
+    config_req_cv_.notify_one();
+  });
+  sync_sessions_locked(cfg);
+  if (!read_text_file(config_path_, &config_text_)) config_text_ = config_to_text(cfg);
+  {
+    std::string e;
+    if (cfg.enable_config_watch && !start_config_watch_locked(&e)) {
+      std::fprintf(stderr, "khor-daemon: config watch disabled: %s\n", e.c_str());
+    }
+  }
+  apply_lk.unlock();
+  // Fake metrics mode only if explicitly enabled and BPF isn't ok.
+  set_fake_running(cfg.enable_fake && !bpf_.status().ok);
+
+  seq_thread_ = std::thread([this, rt = make_rt_cfg(cfg)] {
+    rt_prefault_stack(256 * 1024);
+    apply_seq_rt(rt);
+    (void)seq_reactor_.run();
+  });
 
-  sampler_ = std::thread([this] { sampler_loop(); });
-  music_ = std::thread([this] { music_loop(); });
+  {
+    std::scoped_lock lk(startup_mu_);
+    startup_total_ms_ = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+    std::string line;
+    for (const auto& sp : startup_) {
+      char buf[96];
+      std::snprintf(buf, sizeof(buf), " %s=%.1fms%s", sp.name.c_str(), sp.ms, sp.ok ? "" : "(failed)");
+      line += buf;
+    }
+    std::fprintf(stderr, "khor-daemon: started in %.1f ms:%s\n", startup_total_ms_, line.c_str());
+  }
+  starting_.store(false);
 
   return true;
 }
 
+void App::run() {
+  if (!running_.load()) return;
+
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  const int sig_fd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (sig_fd >= 0) {
+    (void)reactor_.add_fd(sig_fd, [this, sig_fd] {
+      signalfd_siginfo si{};
+      (void)!::read(sig_fd, &si, sizeof(si));
+      reactor_.stop();
+    });
+  }
+
+  (void)reactor_.run();
+
+  if (sig_fd >= 0) {
+    reactor_.remove_fd(sig_fd);
+    ::close(sig_fd);
+  }
+}
+
 void App::stop() {
+  starting_.store(false);
   if (!running_.exchange(false)) return;
-  stop_.store(true);
 
-  fake_running_.store(false);
-
-  if (music_.joinable()) music_.join();
-  if (sampler_.joinable()) sampler_.join();
-  if (fake_.joinable()) fake_.join();
+  {
+    std::scoped_lock lk(config_req_mu_);
+    config_req_stop_ = true;
+  }
+  config_req_cv_.notify_one();
+  if (config_thread_.joinable()) config_thread_.join();
+  {
+    std::scoped_lock lk(prof_req_mu_);
+    prof_req_stop_ = true;
+  }
+  prof_req_cv_.notify_one();
+  if (prof_thread_.joinable()) prof_thread_.join();
+  {
+    std::scoped_lock lk(config_apply_mu_);
+    stop_config_watch_locked();
+    stop_sessions_locked();
+    reactor_.remove_timer(config_timer_);
+    config_timer_ = -1;
+    cgroups_.stop();
+    reactor_.remove_timer(cgroup_timer_);
+    cgroup_timer_ = -1;
+  }
+  set_fake_running(false);
+  reactor_.remove_timer(fake_timer_);
+  seq_reactor_.remove_timer(music_timer_);
+  seq_reactor_.remove_fd(render_seq_.notify_fd());
+  audio_.set_step_source(nullptr);
+  render_seq_.cancel_pending();
+  reactor_.remove_timer(sampler_timer_);
+  fake_timer_ = music_timer_ = sampler_timer_ = -1;
+  if (psi_fd_ >= 0) ::close(psi_fd_);
+  psi_fd_ = -1;
 
   {
     std::scoped_lock lk(bpf_mu_);
     stop_bpf_locked();
   }
+  {
+    std::scoped_lock lk(pmu_mu_);
+    stop_pmu_locked();
+  }
+  {
+    std::scoped_lock lk(osc_in_mu_);
+    stop_osc_in_locked();
+  }
   {
     std::scoped_lock lk(osc_mu_);
     stop_osc_locked();
@@ -232,157 +585,457 @@ void App::stop() {
     std::scoped_lock lk(audio_mu_);
     stop_audio_locked();
   }
+
+  seq_reactor_.stop();
+  if (seq_thread_.joinable()) seq_thread_.join();
+
+  // Ends run() if it is still dispatching on another thread.
+  reactor_.stop();
 }
 
-void App::sampler_loop() {
+void App::sampler_tick() {
   using clock = std::chrono::steady_clock;
-  auto last_t = clock::now();
-  int psi_tick = 0;
-  double mem_psi = 0.0;
-
-  while (!stop_.load()) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    auto now = clock::now();
-    double dt_s = std::chrono::duration_cast<std::chrono::duration<double>>(now - last_t).count();
-    if (dt_s <= 0.0) dt_s = 0.1;
-    last_t = now;
-
-    Signals::Totals t;
-    t.exec_total = metrics_.exec_total.load(std::memory_order_relaxed);
-    t.net_rx_bytes_total = metrics_.net_rx_bytes_total.load(std::memory_order_relaxed);
-    t.net_tx_bytes_total = metrics_.net_tx_bytes_total.load(std::memory_order_relaxed);
-    t.sched_switch_total = metrics_.sched_switch_total.load(std::memory_order_relaxed);
-    t.blk_read_bytes_total = metrics_.blk_read_bytes_total.load(std::memory_order_relaxed);
-    t.blk_write_bytes_total = metrics_.blk_write_bytes_total.load(std::memory_order_relaxed);
-    t.tcp_retransmit_total = metrics_.tcp_retransmit_total.load(std::memory_order_relaxed);
-    t.irq_total = metrics_.irq_total.load(std::memory_order_relaxed);
-
-    const double smoothing = std::clamp(smoothing_.load(std::memory_order_relaxed), 0.0, 1.0);
-
-    if (++psi_tick >= 10) {
-      psi_tick = 0;
-      mem_psi = read_psi_memory_some_avg10();
-      metrics_.mem_pressure_pct.store(mem_psi, std::memory_order_relaxed);
-    }
-
+  const auto now = clock::now();
+  double dt_s = std::chrono::duration_cast<std::chrono::duration<double>>(now - sampler_last_).count();
+  if (dt_s <= 0.0) dt_s = 0.1;
+  sampler_last_ = now;
+
+  Signals::Totals t;
+  t.exec_total = metrics_.exec_total.load(std::memory_order_relaxed);
+  t.net_rx_bytes_total = metrics_.net_rx_bytes_total.load(std::memory_order_relaxed);
+  t.net_tx_bytes_total = metrics_.net_tx_bytes_total.load(std::memory_order_relaxed);
+  t.sched_switch_total = metrics_.sched_switch_total.load(std::memory_order_relaxed);
+  t.blk_read_bytes_total = metrics_.blk_read_bytes_total.load(std::memory_order_relaxed);
+  t.blk_write_bytes_total = metrics_.blk_write_bytes_total.load(std::memory_order_relaxed);
+  t.tcp_retransmit_total = metrics_.tcp_retransmit_total.load(std::memory_order_relaxed);
+  t.irq_total = metrics_.irq_total.load(std::memory_order_relaxed);
+  t.offcpu_d_ns_total = metrics_.offcpu_d_ns_total.load(std::memory_order_relaxed);
+  t.offcpu_s_ns_total = metrics_.offcpu_s_ns_total.load(std::memory_order_relaxed);
+  t.lock_contended_total = metrics_.lock_contended_total.load(std::memory_order_relaxed);
+  t.lock_wait_ns_total = metrics_.lock_wait_ns_total.load(std::memory_order_relaxed);
+  t.skb_drop_total = metrics_.skb_drop_total.load(std::memory_order_relaxed);
+  t.exec_fail_total = metrics_.exec_fail_total.load(std::memory_order_relaxed);
+  t.proc_short_total = metrics_.proc_short_total.load(std::memory_order_relaxed);
+  t.vfs_read_bytes_total = metrics_.vfs_read_bytes_total.load(std::memory_order_relaxed);
+  t.vfs_write_bytes_total = metrics_.vfs_write_bytes_total.load(std::memory_order_relaxed);
+  t.vfs_ns_total = metrics_.vfs_ns_total.load(std::memory_order_relaxed);
+  t.fsync_total = metrics_.fsync_total.load(std::memory_order_relaxed);
+  t.fsync_ns_total = metrics_.fsync_ns_total.load(std::memory_order_relaxed);
+  t.rtt_samples_total = metrics_.rtt_samples_total.load(std::memory_order_relaxed);
+  t.rtt_us_total = metrics_.rtt_us_total.load(std::memory_order_relaxed);
+  t.listen_overflow_total = metrics_.listen_overflow_total.load(std::memory_order_relaxed);
+  t.syn_overflow_total = metrics_.syn_overflow_total.load(std::memory_order_relaxed);
+
+  pull_pmu();
+  t.pmu_cycles_total = metrics_.pmu_cycles_total.load(std::memory_order_relaxed);
+  t.pmu_instructions_total = metrics_.pmu_instructions_total.load(std::memory_order_relaxed);
+  t.pmu_cache_misses_total = metrics_.pmu_cache_misses_total.load(std::memory_order_relaxed);
+  t.pmu_branch_misses_total = metrics_.pmu_branch_misses_total.load(std::memory_order_relaxed);
+  t.page_faults_total = metrics_.page_faults_total.load(std::memory_order_relaxed);
+  t.major_faults_total = metrics_.major_faults_total.load(std::memory_order_relaxed);
+
+  const double smoothing = std::clamp(smoothing_.load(std::memory_order_relaxed), 0.0, 1.0);
+
+  if (++psi_tick_ >= 10) {
+    psi_tick_ = 0;
+    mem_psi_ = read_psi_some_avg10(psi_fd_);
+    metrics_.mem_pressure_pct.store(mem_psi_, std::memory_order_relaxed);
+    (void)reload_presets(/*force=*/false);
     {
-      std::scoped_lock lk(sig_mu_);
-      signals_.update(t, dt_s, smoothing, mem_psi);
-      last_rates_ = signals_.rates();
-      last_v01_ = signals_.value01();
+      std::scoped_lock lk(prof_req_mu_);
+      prof_req_ = true;
     }
+    prof_req_cv_.notify_one();
+    pull_sketches();
+  }
 
-    {
-      std::scoped_lock lk(hist_mu_);
-      history_.push_back(HistSample{
-        .ts_ms = unix_ms_now(),
-        .rates = last_rates_,
-      });
-      while (history_.size() > 600) history_.pop_front();
+  {
+    const Signals::Gauges g{
+      .mem_pressure_pct = mem_psi_,
+      .prof_hz = prof_hz_.load(std::memory_order_relaxed),
+      .prof_entropy = metrics_.prof_entropy.load(std::memory_order_relaxed),
+      .distinct_spawners = metrics_.distinct_spawners.load(std::memory_order_relaxed),
+      .distinct_actors = metrics_.distinct_actors.load(std::memory_order_relaxed),
+      .distinct_peers = metrics_.distinct_peers.load(std::memory_order_relaxed),
+      .rtt_p50_us = metrics_.rtt_p50_us.load(std::memory_order_relaxed),
+      .rtt_p99_us = metrics_.rtt_p99_us.load(std::memory_order_relaxed),
+    };
+    std::scoped_lock lk(sig_mu_);
+    signals_.update(t, dt_s, smoothing, g);
+    last_rates_ = signals_.rates();
+    last_v01_ = signals_.value01();
+  }
+  sig_snap_.store(SignalSnapshot{.v01 = signals_.value01(), .rates = signals_.rates()});
+  {
+    std::scoped_lock lk(sessions_mu_);
+    for (auto& sess : sessions_) sess->sample(dt_s, mem_psi_);
+  }
+
+  {
+    std::scoped_lock lk(hist_mu_);
+    history_.push(HistSample{
+      .ts_ms = unix_ms_now(),
+      .rates = last_rates_,
+    });
+  }
+}
+
+void App::pull_profile() {
+  // Frames are read and symbolized for the heaviest stacks only; the rest are counted as "[other]".
+  constexpr std::size_t kSymbolizeStacks = 256;
+  const auto now = std::chrono::steady_clock::now();
+  const double dt_s = prof_last_ == std::chrono::steady_clock::time_point{}
+    ? 1.0 : std::chrono::duration<double>(now - prof_last_).count();
+  prof_last_ = now;
+
+  std::vector<ProfileStack> stacks;
+  bool ok = false;
+  {
+    // A BPF restart holds this for seconds; skip the window rather than stall behind it.
+    std::unique_lock lk(bpf_mu_, std::try_to_lock);
+    if (!lk.owns_lock()) return;
+    ok = bpf_.drain_profile(&stacks, kSymbolizeStacks, nullptr);
+  }
+  if (!ok) {
+    prof_hz_.store(0.0, std::memory_order_relaxed);
+    metrics_.prof_entropy.store(0.0, std::memory_order_relaxed);
+    return;
+  }
+
+  std::scoped_lock lk(prof_mu_);
+  for (std::size_t i = 0; i < stacks.size(); i++) {
+    const ProfileStack& ps = stacks[i];
+    if (i >= kSymbolizeStacks) {
+      hot_.add("[other]", "", ps.count);
+      continue;
     }
+    // The leaf frame is where the CPU was: kernel if the sample hit in kernel mode.
+    Symbol s;
+    if (!ps.kernel.empty()) s = symbolizer_.kernel(ps.kernel.front());
+    else if (!ps.user.empty()) s = symbolizer_.user(ps.tgid, ps.user.front());
+    if (!s.known) s.name = "[" + ps.comm + "]";
+    hot_.add(s.name, s.module, ps.count);
   }
+  const double entropy = hot_.end_window();
+  prof_hz_.store(dt_s > 0.0 ? (double)hot_.last_window_samples() / dt_s : 0.0, std::memory_order_relaxed);
+  metrics_.prof_entropy.store(entropy, std::memory_order_relaxed);
 }
 
-void App::music_loop() {
-  MusicEngine engine;
-  uint32_t osc_signal_tick = 0;
-  uint32_t osc_metrics_tick = 0;
+void App::profile_worker() {
+  std::unique_lock lk(prof_req_mu_);
+  for (;;) {
+    prof_req_cv_.wait(lk, [this] { return prof_req_ || prof_req_stop_; });
+    if (prof_req_stop_) return;
+    prof_req_ = false;
+    lk.unlock();
+    pull_profile();
+    lk.lock();
+  }
+}
 
-  using clock = std::chrono::steady_clock;
-  auto next = clock::now();
+static void peer_name(const CmsCandidate& c, char* buf, std::size_t len) {
+  const int af = c.family == 6 ? AF_INET6 : AF_INET;
+  if (!::inet_ntop(af, c.label.data(), buf, (socklen_t)len)) std::snprintf(buf, len, "?");
+}
 
-  while (!stop_.load()) {
-    const double bpm = metrics_.bpm.load(std::memory_order_relaxed);
-    const double ms = MusicEngine::tick_ms(bpm);
-    next += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(ms));
-    std::this_thread::sleep_until(next);
-    if (stop_.load()) break;
+static void comm_name(const CmsCandidate& c, char* buf, std::size_t len) {
+  const auto* p = reinterpret_cast<const char*>(c.label.data());
+  const std::size_t n = std::min(::strnlen(p, c.label.size()), len - 1);
+  std::memcpy(buf, p, n);
+  buf[n] = '\0';
+}
 
-    KhorConfig cfg = config_snapshot();
+void App::pull_pmu() {
+  PmuDeltas d;
+  {
+    std::unique_lock lk(pmu_mu_, std::try_to_lock);
+    if (!lk.owns_lock() || !pmu_.read(&d)) return;
+  }
+  const auto add = [](std::atomic<uint64_t>& total, double v) {
+    if (v > 0.0) total.fetch_add((uint64_t)std::llround(v), std::memory_order_relaxed);
+  };
+  add(metrics_.pmu_cycles_total, d.hw[(std::size_t)PmuEvent::Cycles]);
+  add(metrics_.pmu_instructions_total, d.hw[(std::size_t)PmuEvent::Instructions]);
+  add(metrics_.pmu_cache_misses_total, d.hw[(std::size_t)PmuEvent::CacheMisses]);
+  add(metrics_.pmu_branch_misses_total, d.hw[(std::size_t)PmuEvent::BranchMisses]);
+  add(metrics_.page_faults_total, d.sw[(std::size_t)PmuSwEvent::PageFaults]);
+  add(metrics_.major_faults_total, d.sw[(std::size_t)PmuSwEvent::MajorFaults]);
+  pmu_running_.store(d.running, std::memory_order_relaxed);
+}
 
-    Signal01 s01;
-    SignalRates rates;
+void App::pull_sketches() {
+  SketchWindow& w = sketch_win_;
+  bool ok = false;
+  {
+    std::unique_lock lk(bpf_mu_, std::try_to_lock);
+    if (!lk.owns_lock()) return;
+    ok = bpf_.take_window(&w, nullptr);
+  }
+  const auto now = std::chrono::steady_clock::now();
+  const double window_s = sketch_last_.time_since_epoch().count() ? std::chrono::duration<double>(now - sketch_last_).count() : 0.0;
+  sketch_last_ = now;
+  if (!ok) {
     {
-      std::scoped_lock lk(sig_mu_);
-      s01 = last_v01_;
-      rates = last_rates_;
+      std::scoped_lock lk(heavy_mu_);
+      heavy_procs_ = HeavyList{};
+      heavy_peers_ = HeavyList{};
+      rtt_window_ = {};
+    }
+    if (fake_running_.load()) return; // fake_tick() fills these in
+    metrics_.distinct_spawners.store(0.0, std::memory_order_relaxed);
+    metrics_.distinct_actors.store(0.0, std::memory_order_relaxed);
+    metrics_.distinct_peers.store(0.0, std::memory_order_relaxed);
+    metrics_.rtt_p50_us.store(0.0, std::memory_order_relaxed);
+    metrics_.rtt_p99_us.store(0.0, std::memory_order_relaxed);
+    return;
+  }
+  const HllWindow& h = w.hll;
+  metrics_.distinct_spawners.store(hll_estimate(h.exec_parents.data(), h.exec_parents.size()), std::memory_order_relaxed);
+  metrics_.distinct_actors.store(hll_estimate(h.tgids.data(), h.tgids.size()), std::memory_order_relaxed);
+  metrics_.distinct_peers.store(hll_estimate(h.peers.data(), h.peers.size()), std::memory_order_relaxed);
+  metrics_.rtt_p50_us.store((double)log2_quantile(w.rtt.data(), w.rtt.size(), 0.50), std::memory_order_relaxed);
+  metrics_.rtt_p99_us.store((double)log2_quantile(w.rtt.data(), w.rtt.size(), 0.99), std::memory_order_relaxed);
+
+  double confidence = 0.0;
+  static_assert(sizeof(HeavyKey::name) >= INET6_ADDRSTRLEN, "an IPv6 address fits");
+  const auto heavy = [&](const CmsWindow& cw, bool peers, HeavyList* out) {
+    heavy_cms_.clear();
+    heavy_cms_.merge(cw.counters.data());
+    std::array<uint64_t, CmsWindow::kMaxCandidates> hashes;
+    for (std::size_t i = 0; i < cw.n_candidates; i++) hashes[i] = cw.candidates[i].hash;
+    std::array<HeavyHitter, HeavyList::kTop> top;
+    out->total = heavy_cms_.total();
+    out->error = heavy_cms_.error_bound();
+    out->n = cms_top_k(heavy_cms_, std::span<const uint64_t>(hashes.data(), cw.n_candidates), top);
+    for (std::size_t i = 0; i < out->n; i++) {
+      const CmsCandidate& c = cw.candidates[top[i].index];
+      HeavyKey& k = out->top[i];
+      (peers ? peer_name : comm_name)(c, k.name.data(), k.name.size());
+      k.tgid = c.tgid;
+      k.count = top[i].estimate;
     }
+    confidence = heavy_cms_.confidence();
+  };
+  HeavyList procs, peers;
+  heavy(w.switches, false, &procs);
+  heavy(w.peer_bytes, true, &peers);
+
+  std::scoped_lock lk(heavy_mu_);
+  heavy_procs_ = procs;
+  heavy_peers_ = peers;
+  heavy_window_s_ = window_s;
+  heavy_confidence_ = confidence;
+  rtt_window_ = w.rtt;
+}
+
+void App::arm_music_timer() {
+  (void)seq_reactor_.arm_at(music_timer_, clock_.next_deadline_ns());
+}
 
-    MusicConfig mc;
-    mc.bpm = bpm;
-    mc.key_midi = metrics_.key_midi.load(std::memory_order_relaxed);
-    mc.scale = cfg.scale;
-    mc.preset = cfg.preset;
-    mc.density = std::clamp(density_.load(std::memory_order_relaxed), 0.0, 1.0);
+void App::set_bpm_live(double bpm) {
+  metrics_.bpm.store(bpm, std::memory_order_relaxed);
+  seq_reactor_.post([this] {
+    if (!running_.load()) return;
+    clock_.set_bpm(mono_now_ns(), metrics_.bpm.load(std::memory_order_relaxed));
+    arm_music_timer();
+  });
+}
 
-    MusicFrame frame = engine.tick(s01, mc);
+void App::refresh_music_cfg() {
+  const uint64_t gen = cfg_gen_.load(std::memory_order_acquire);
+  if (gen == music_cfg_gen_) return;
+  music_cfg_gen_ = gen;
+  music_cfg_ = config_snapshot();
+  engine_.set_library(presets_snapshot());
+  engine_.configure(make_music_cfg(music_cfg_));
+  exec_triggers_.configure(music_cfg_.exec_triggers);
+  render_cfg_dirty_ = render_mode_;
+
+  ClockOverrun overrun = ClockOverrun::Skip;
+  (void)clock_overrun_parse(music_cfg_.music_overrun, &overrun);
+  clock_.set_overrun(overrun);
+  clock_slaved_ = music_cfg_.music_clock == "audio_slaved";
+}
 
-    // Apply synth params.
-    if (cfg.enable_audio && audio_.is_running()) {
-      audio_.set_filter(frame.synth.cutoff01, frame.synth.resonance01);
-      audio_.set_fx(frame.synth.delay_mix01, frame.synth.reverb_mix01);
-    }
+void App::retune_clock(int64_t now_ns) {
+  clock_.set_bpm(now_ns, metrics_.bpm.load(std::memory_order_relaxed));
+
+  uint64_t frames = 0;
+  int64_t at_ns = 0;
+  uint32_t sr = 0;
+  if (clock_slaved_ && audio_.clock_sample(&frames, &at_ns, &sr)) {
+    if (audio_clock_.observe(frames, at_ns, sr)) clock_.set_rate(now_ns, audio_clock_.rate());
+  } else if (clock_.rate() != 1.0) {
+    audio_clock_.reset();
+    clock_.set_rate(now_ns, 1.0);
+  }
 
-    // Emit notes.
-    for (const auto& n : frame.notes) {
-      if (cfg.enable_audio && audio_.is_running()) audio_.submit_note(n);
-      if (cfg.enable_midi && midi_.is_running()) midi_.send_note(n);
-      if (cfg.enable_osc && osc_.is_running()) osc_.send_note(n);
-    }
+  clock_period_ms_.store(clock_.period_ns() * 1e-6, std::memory_order_relaxed);
+  clock_rate_.store(clock_.rate(), std::memory_order_relaxed);
+}
 
-    if (cfg.enable_midi && midi_.is_running()) {
-      midi_.send_signals_cc(s01, frame.synth.cutoff01);
+bool App::update_render_mode(int64_t now_ns) {
+  const bool want = music_cfg_.music_clock == "audio" && audio_.is_running();
+  if (want != render_mode_) {
+    render_mode_ = want;
+    render_cfg_dirty_ = want;
+    if (!want) {
+      audio_.set_step_source(nullptr);
+      render_seq_.cancel_pending();
+      clock_.reset(now_ns, metrics_.bpm.load(std::memory_order_relaxed));
     }
+  }
+  if (render_mode_ && render_cfg_dirty_ && render_seq_.configure(presets_snapshot(), make_music_cfg(music_cfg_))) {
+    render_cfg_dirty_ = false;
+    audio_.set_step_source(&render_seq_);
+  }
+  return render_mode_;
+}
 
-    if (cfg.enable_osc && osc_.is_running()) {
-      // Throttle OSC signal spam.
-      if ((osc_signal_tick++ & 3u) == 0u) {
-        osc_.send_signal("exec", (float)s01.exec);
-        osc_.send_signal("rx", (float)s01.rx);
-        osc_.send_signal("tx", (float)s01.tx);
-        osc_.send_signal("csw", (float)s01.csw);
-        osc_.send_signal("io", (float)s01.io);
-        osc_.send_signal("retx", (float)s01.retx);
-        osc_.send_signal("irq", (float)s01.irq);
-        osc_.send_signal("mem", (float)s01.mem);
-      }
-      if ((osc_metrics_tick++ & 7u) == 0u) {
-        osc_.send_metrics(rates);
-      }
+void App::music_tick() {
+  const int64_t now = mono_now_ns();
+  refresh_music_cfg();
+  if (update_render_mode(now)) {
+    // Steps run in the audio callback; this timer only hands config changes over (or retries one).
+    const int64_t at = now + 100 * 1000000LL;
+    (void)seq_reactor_.arm_at(music_timer_, at);
+    return;
+  }
+  retune_clock(now);
+  const uint32_t steps = clock_.advance(now);
+  arm_music_timer();
+  for (uint32_t i = 0; i < steps; i++) music_step();
+}
+
+void App::music_step() {
+  engine_.set_key(metrics_.key_midi.load(std::memory_order_relaxed));
+  // RT thread: never wait on a writer stalled mid-store; play the previous snapshot instead.
+  if (!sig_snap_.try_load(&music_sig_)) music_stale_signals_.fetch_add(1, std::memory_order_relaxed);
+  const SignalSnapshot& sig = music_sig_;
+  MusicFrame frame = engine_.tick(sig.v01, density_.load(std::memory_order_relaxed));
+  take_exec_triggers(&frame.notes);
+  emit_step(frame, sig, /*to_audio=*/true);
+}
+
+void App::on_render_steps() {
+  render_seq_.take_notify();
+  RenderSequencer::StepRecord rec;
+  while (render_seq_.pop(&rec)) emit_step(rec.frame, rec.sig, /*to_audio=*/false);
+  // The callback only plays its own steps; triggers are mixed in from here, on the same grid.
+  NoteBuffer triggered;
+  take_exec_triggers(&triggered);
+  emit_notes(triggered, /*to_audio=*/music_cfg_.enable_audio && audio_.is_running());
+}
+
+void App::take_exec_triggers(NoteBuffer* out) {
+  const int key = metrics_.key_midi.load(std::memory_order_relaxed);
+  const std::size_t hits = exec_triggers_.drain(&exec_q_, key, out);
+  if (hits) exec_triggered_.fetch_add(hits, std::memory_order_relaxed);
+}
+
+void App::emit_step(const MusicFrame& frame, const SignalSnapshot& sig, bool to_audio) {
+  const KhorConfig& cfg = music_cfg_;
+  to_audio = to_audio && cfg.enable_audio && audio_.is_running();
+
+  // Apply synth params.
+  if (to_audio) {
+    audio_.set_filter(frame.synth.cutoff01, frame.synth.resonance01);
+    audio_.set_fx(frame.synth.delay_mix01, frame.synth.reverb_mix01);
+  }
+
+  emit_notes(frame.notes, to_audio);
+
+  if (cfg.enable_midi && midi_.is_running()) {
+    midi_.send_signals_cc(sig.v01, frame.synth.cutoff01);
+  }
+
+  if (cfg.enable_osc && osc_.is_running()) {
+    // Throttle OSC signal spam.
+    if ((osc_signal_tick_++ & 3u) == 0u) {
+      osc_.send_signals(sig.v01);
+    }
+    if ((osc_metrics_tick_++ & 7u) == 0u) {
+      osc_.send_metrics(sig.rates);
     }
   }
 }
 
-void App::fake_loop() {
-  while (!stop_.load() && fake_running_.load()) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(250));
-    metrics_.exec_total.fetch_add(1, std::memory_order_relaxed);
-    metrics_.net_rx_bytes_total.fetch_add(1000 + (std::rand() % 60000), std::memory_order_relaxed);
-    metrics_.net_tx_bytes_total.fetch_add(1000 + (std::rand() % 40000), std::memory_order_relaxed);
-    metrics_.sched_switch_total.fetch_add(5 + (std::rand() % 200), std::memory_order_relaxed);
-    metrics_.blk_read_bytes_total.fetch_add(4096 * (std::rand() % 8), std::memory_order_relaxed);
-    metrics_.blk_write_bytes_total.fetch_add(4096 * (std::rand() % 6), std::memory_order_relaxed);
-    metrics_.tcp_retransmit_total.fetch_add(std::rand() % 3, std::memory_order_relaxed);
-    metrics_.irq_total.fetch_add(500 + (std::rand() % 5000), std::memory_order_relaxed);
-    metrics_.mem_pressure_pct.store((double)(std::rand() % 30), std::memory_order_relaxed);
+void App::emit_notes(const NoteBuffer& notes, bool to_audio) {
+  const KhorConfig& cfg = music_cfg_;
+  if (notes.dropped()) notes_dropped_.fetch_add(notes.dropped(), std::memory_order_relaxed);
+  for (const auto& n : notes) {
+    if (to_audio) audio_.submit_note(n);
+    if (cfg.enable_midi && midi_.is_running()) midi_.send_note(n);
+    if (cfg.enable_osc && osc_.is_running()) osc_.send_note(n);
   }
 }
 
+void App::set_fake_running(bool on) {
+  fake_running_.store(on);
+  (void)reactor_.arm_periodic(fake_timer_, on ? std::chrono::milliseconds(250) : std::chrono::milliseconds(0));
+}
+
+void App::fake_tick() {
+  metrics_.exec_total.fetch_add(1, std::memory_order_relaxed);
+  metrics_.net_rx_bytes_total.fetch_add(1000 + (std::rand() % 60000), std::memory_order_relaxed);
+  metrics_.net_tx_bytes_total.fetch_add(1000 + (std::rand() % 40000), std::memory_order_relaxed);
+  metrics_.sched_switch_total.fetch_add(5 + (std::rand() % 200), std::memory_order_relaxed);
+  metrics_.blk_read_bytes_total.fetch_add(4096 * (std::rand() % 8), std::memory_order_relaxed);
+  metrics_.blk_write_bytes_total.fetch_add(4096 * (std::rand() % 6), std::memory_order_relaxed);
+  metrics_.tcp_retransmit_total.fetch_add(std::rand() % 3, std::memory_order_relaxed);
+  metrics_.irq_total.fetch_add(500 + (std::rand() % 5000), std::memory_order_relaxed);
+  metrics_.offcpu_d_ns_total.fetch_add((uint64_t)(std::rand() % 20) * 1000000ULL, std::memory_order_relaxed);
+  metrics_.offcpu_s_ns_total.fetch_add((uint64_t)(200 + std::rand() % 800) * 1000000ULL, std::memory_order_relaxed);
+  const uint64_t contended = (uint64_t)(std::rand() % 50);
+  metrics_.lock_contended_total.fetch_add(contended, std::memory_order_relaxed);
+  metrics_.lock_wait_ns_total.fetch_add(contended * (uint64_t)(1000 + std::rand() % 20000), std::memory_order_relaxed);
+  metrics_.skb_drop_total.fetch_add(std::rand() % 4, std::memory_order_relaxed);
+  metrics_.exec_fail_total.fetch_add(std::rand() % 8 == 0 ? 1 : 0, std::memory_order_relaxed);
+  metrics_.proc_short_total.fetch_add(std::rand() % 3, std::memory_order_relaxed);
+  metrics_.vfs_read_bytes_total.fetch_add((uint64_t)(std::rand() % 4000000), std::memory_order_relaxed);
+  metrics_.vfs_write_bytes_total.fetch_add((uint64_t)(std::rand() % 1000000), std::memory_order_relaxed);
+  metrics_.vfs_ns_total.fetch_add((uint64_t)(std::rand() % 20000000), std::memory_order_relaxed);
+  const uint64_t fsyncs = std::rand() % 5;
+  metrics_.fsync_total.fetch_add(fsyncs, std::memory_order_relaxed);
+  metrics_.fsync_ns_total.fetch_add(fsyncs * (uint64_t)(200000 + std::rand() % 5000000), std::memory_order_relaxed);
+  metrics_.distinct_spawners.store((double)(1 + std::rand() % 5), std::memory_order_relaxed);
+  metrics_.distinct_actors.store((double)(40 + std::rand() % 80), std::memory_order_relaxed);
+  metrics_.distinct_peers.store((double)(5 + std::rand() % 50), std::memory_order_relaxed);
+  const uint64_t rtts = 50 + std::rand() % 200;
+  metrics_.rtt_samples_total.fetch_add(rtts, std::memory_order_relaxed);
+  metrics_.rtt_us_total.fetch_add(rtts * (uint64_t)(2000 + std::rand() % 40000), std::memory_order_relaxed);
+  metrics_.listen_overflow_total.fetch_add(std::rand() % 16 == 0 ? 1 + std::rand() % 20 : 0, std::memory_order_relaxed);
+  metrics_.rtt_p50_us.store((double)(8192 << (std::rand() % 2)), std::memory_order_relaxed);
+  metrics_.rtt_p99_us.store((double)(65536 << (std::rand() % 3)), std::memory_order_relaxed);
+  const uint64_t cycles = (uint64_t)(200 + std::rand() % 800) * 1000000ULL;
+  metrics_.pmu_cycles_total.fetch_add(cycles, std::memory_order_relaxed);
+  metrics_.pmu_instructions_total.fetch_add(cycles / 100 * (uint64_t)(40 + std::rand() % 160), std::memory_order_relaxed);
+  metrics_.pmu_cache_misses_total.fetch_add(cycles / 1000 * (uint64_t)(std::rand() % 20), std::memory_order_relaxed);
+  metrics_.pmu_branch_misses_total.fetch_add(cycles / 1000 * (uint64_t)(std::rand() % 10), std::memory_order_relaxed);
+  metrics_.mem_pressure_pct.store((double)(std::rand() % 30), std::memory_order_relaxed);
+}
+
 JsonValue App::api_health() const {
   KhorConfig cfg = config_snapshot();
 
   JsonValue root = JsonValue::make_object({});
   root.o["ts_ms"] = JsonValue::make_number((double)unix_ms_now());
   root.o["config_path"] = JsonValue::make_string(config_path_);
+  root.o["state"] = JsonValue::make_string(starting_.load() ? "starting" : (running_.load() ? "running" : "stopped"));
 
+  // A module whose lock is held is starting (or restarting); report that instead of waiting for it.
   {
     JsonValue a = JsonValue::make_object({});
     a.o["enabled"] = JsonValue::make_bool(cfg.enable_audio);
     a.o["ok"] = JsonValue::make_bool(audio_.is_running());
-    a.o["backend"] = JsonValue::make_string(audio_.backend_name().empty() ? "none" : audio_.backend_name());
-    a.o["device"] = JsonValue::make_string(audio_.device_name().empty() ? "none" : audio_.device_name());
-    std::scoped_lock lk(audio_mu_);
-    if (!audio_err_.empty()) a.o["error"] = JsonValue::make_string(audio_err_);
+    std::unique_lock lk(audio_mu_, std::try_to_lock);
+    if (!lk.owns_lock()) {
+      a.o["starting"] = JsonValue::make_bool(true);
+    } else {
+      a.o["backend"] = JsonValue::make_string(audio_.backend_name().empty() ? "none" : audio_.backend_name());
+      a.o["device"] = JsonValue::make_string(audio_.device_name().empty() ? "none" : audio_.device_name());
+      if (!audio_err_.empty()) a.o["error"] = JsonValue::make_string(audio_err_);
+    }
     root.o["audio"] = std::move(a);
   }
 
@@ -392,8 +1045,9 @@ JsonValue App::api_health() const {
     m.o["ok"] = JsonValue::make_bool(midi_.is_running());
     m.o["port"] = JsonValue::make_string(cfg.midi_port);
     m.o["channel"] = JsonValue::make_number(cfg.midi_channel);
-    std::scoped_lock lk(midi_mu_);
-    if (!midi_err_.empty()) m.o["error"] = JsonValue::make_string(midi_err_);
+    std::unique_lock lk(midi_mu_, std::try_to_lock);
+    if (!lk.owns_lock()) m.o["starting"] = JsonValue::make_bool(true);
+    else if (!midi_err_.empty()) m.o["error"] = JsonValue::make_string(midi_err_);
     root.o["midi"] = std::move(m);
   }
 
@@ -403,32 +1057,185 @@ JsonValue App::api_health() const {
     o.o["ok"] = JsonValue::make_bool(osc_.is_running());
     o.o["host"] = JsonValue::make_string(cfg.osc_host);
     o.o["port"] = JsonValue::make_number(cfg.osc_port);
-    std::scoped_lock lk(osc_mu_);
-    if (!osc_err_.empty()) o.o["error"] = JsonValue::make_string(osc_err_);
+    std::vector<JsonValue> targets;
+    for (const auto& t : cfg.osc_targets) targets.push_back(JsonValue::make_string(t));
+    o.o["targets"] = JsonValue::make_array(std::move(targets));
+    std::unique_lock lk(osc_mu_, std::try_to_lock);
+    if (!lk.owns_lock()) {
+      o.o["starting"] = JsonValue::make_bool(true);
+    } else {
+      o.o["destinations"] = JsonValue::make_number(osc_.dest_count());
+      if (!osc_err_.empty()) o.o["error"] = JsonValue::make_string(osc_err_);
+    }
     root.o["osc"] = std::move(o);
   }
 
+  {
+    JsonValue o = JsonValue::make_object({});
+    o.o["enabled"] = JsonValue::make_bool(cfg.enable_osc_in);
+    o.o["ok"] = JsonValue::make_bool(osc_in_.is_running());
+    o.o["host"] = JsonValue::make_string(cfg.osc_in_host);
+    o.o["port"] = JsonValue::make_number(cfg.osc_in_port);
+    const OscServerStats st = osc_in_.stats();
+    o.o["packets"] = JsonValue::make_number((double)st.packets);
+    o.o["messages"] = JsonValue::make_number((double)st.messages);
+    o.o["errors"] = JsonValue::make_number((double)st.errors);
+    o.o["unknown"] = JsonValue::make_number((double)osc_in_unknown_.load(std::memory_order_relaxed));
+    std::unique_lock lk(osc_in_mu_, std::try_to_lock);
+    if (!lk.owns_lock()) o.o["starting"] = JsonValue::make_bool(true);
+    else if (!osc_in_err_.empty()) o.o["error"] = JsonValue::make_string(osc_in_err_);
+    root.o["osc_in"] = std::move(o);
+  }
+
   {
     JsonValue b = JsonValue::make_object({});
     b.o["enabled"] = JsonValue::make_bool(cfg.enable_bpf);
-    const BpfStatus st = bpf_.status();
-    b.o["ok"] = JsonValue::make_bool(st.ok);
-    b.o["err_code"] = JsonValue::make_number((double)st.err_code);
-    {
-      std::scoped_lock lk(bpf_mu_);
+    std::unique_lock lk(bpf_mu_, std::try_to_lock);
+    if (!lk.owns_lock()) {
+      b.o["ok"] = JsonValue::make_bool(false);
+      b.o["starting"] = JsonValue::make_bool(true);
+    } else {
+      const BpfStatus st = bpf_.status();
+      b.o["ok"] = JsonValue::make_bool(st.ok);
+      b.o["err_code"] = JsonValue::make_number((double)st.err_code);
       const std::string e = !bpf_err_.empty() ? bpf_err_ : st.error;
       if (!e.empty()) b.o["error"] = JsonValue::make_string(e);
     }
+    if (!cfg.bpf_cgroup.empty()) {
+      CgroupInfo ci;
+      JsonValue c = JsonValue::make_object({{"name", JsonValue::make_string(cfg.bpf_cgroup)}});
+      if (cgroups_.resolve(cfg.bpf_cgroup, &ci)) {
+        c.o["id"] = JsonValue::make_number((double)ci.id);
+        c.o["path"] = JsonValue::make_string(ci.path);
+      } else {
+        c.o["error"] = JsonValue::make_string("no such cgroup (matching nothing until it appears)");
+      }
+      b.o["cgroup"] = std::move(c);
+    }
     root.o["bpf"] = std::move(b);
   }
 
+  {
+    JsonValue p = JsonValue::make_object({});
+    p.o["enabled"] = JsonValue::make_bool(cfg.enable_pmu);
+    std::unique_lock lk(pmu_mu_, std::try_to_lock);
+    if (!lk.owns_lock()) {
+      p.o["ok"] = JsonValue::make_bool(false);
+      p.o["starting"] = JsonValue::make_bool(true);
+    } else {
+      const PmuStatus st = pmu_.status();
+      p.o["ok"] = JsonValue::make_bool(st.mode != PmuMode::Off);
+      p.o["mode"] = JsonValue::make_string(pmu_mode_name(st.mode));
+      p.o["cpus"] = JsonValue::make_number(st.cpus);
+      std::vector<JsonValue> events;
+      for (const auto& e : st.events) events.push_back(JsonValue::make_string(e));
+      p.o["events"] = JsonValue::make_array(std::move(events));
+      // Below 1 the kernel is multiplexing the groups with other perf users; counts are scaled up.
+      p.o["running"] = JsonValue::make_number(pmu_running_.load(std::memory_order_relaxed));
+      if (!st.error.empty()) p.o["error"] = JsonValue::make_string(st.error);
+    }
+    root.o["pmu"] = std::move(p);
+  }
+
+  {
+    JsonValue c = JsonValue::make_object({});
+    c.o["ok"] = JsonValue::make_bool(cgroups_.is_running());
+    c.o["entries"] = JsonValue::make_number((double)cgroups_.size());
+    c.o["watches"] = JsonValue::make_number((double)cgroups_.watches());
+    c.o["watch_limited"] = JsonValue::make_bool(cgroups_.watch_limited());
+    c.o["generation"] = JsonValue::make_number((double)cgroups_.generation());
+    c.o["refreshes"] = JsonValue::make_number((double)cgroup_refreshes_.load(std::memory_order_relaxed));
+    std::scoped_lock lk(cgroups_mu_);
+    if (!cgroups_err_.empty()) c.o["error"] = JsonValue::make_string(cgroups_err_);
+    root.o["cgroups"] = std::move(c);
+  }
+
+  {
+    JsonValue w = JsonValue::make_object({});
+    w.o["enabled"] = JsonValue::make_bool(cfg.enable_config_watch);
+    w.o["ok"] = JsonValue::make_bool(config_watch_.is_running());
+    w.o["events"] = JsonValue::make_number((double)config_watch_.events());
+    w.o["reloads"] = JsonValue::make_number((double)config_reloads_.load(std::memory_order_relaxed));
+    w.o["suppressed"] = JsonValue::make_number((double)config_suppressed_.load(std::memory_order_relaxed));
+    w.o["errors"] = JsonValue::make_number((double)config_reload_errors_.load(std::memory_order_relaxed));
+    std::unique_lock lk(config_apply_mu_, std::try_to_lock);
+    if (lk.owns_lock() && !config_watch_err_.empty()) w.o["error"] = JsonValue::make_string(config_watch_err_);
+    root.o["config_watch"] = std::move(w);
+  }
+
+  {
+    std::scoped_lock lk(startup_mu_);
+    std::vector<JsonValue> phases;
+    for (const auto& sp : startup_) {
+      JsonValue p = JsonValue::make_object({
+        {"name", JsonValue::make_string(sp.name)},
+        {"done", JsonValue::make_bool(sp.done)},
+      });
+      if (sp.done) {
+        p.o["ok"] = JsonValue::make_bool(sp.ok);
+        p.o["ms"] = JsonValue::make_number(sp.ms);
+        p.o["end_ms"] = JsonValue::make_number(sp.end_ms);
+      }
+      phases.push_back(std::move(p));
+    }
+    root.o["startup"] = JsonValue::make_object({
+      {"total_ms", JsonValue::make_number(startup_total_ms_)},
+      {"phases", JsonValue::make_array(std::move(phases))},
+    });
+  }
+
+  root.o["reactor"] = JsonValue::make_object({
+    {"running", JsonValue::make_bool(reactor_.is_running())},
+    {"fds", JsonValue::make_number((double)reactor_.fd_count())},
+    {"wakeups", JsonValue::make_number((double)reactor_.wakeups())},
+  });
+
+  root.o["rt"] = rt_health(cfg);
+
   root.o["features"] = JsonValue::make_object({
     {"fake", JsonValue::make_bool(cfg.enable_fake)},
   });
 
+  {
+    std::scoped_lock lk(sessions_mu_);
+    root.o["sessions"] = JsonValue::make_object({
+      {"configured", JsonValue::make_number((double)cfg.sessions.size())},
+      {"running", JsonValue::make_number((double)sessions_.size())},
+    });
+  }
+
   return root;
 }
 
+JsonValue App::rt_health(const KhorConfig& cfg) const {
+  const RtConfig want = make_rt_cfg(cfg);
+
+  std::vector<JsonValue> cpus;
+  for (int c : cfg.rt_cpus) cpus.push_back(JsonValue::make_number(c));
+  JsonValue o = JsonValue::make_object({
+    {"policy", JsonValue::make_string(rt_policy_name(want.policy))},
+    {"priority", JsonValue::make_number(want.priority)},
+    {"cpus", JsonValue::make_array(std::move(cpus))},
+  });
+
+  {
+    std::scoped_lock lk(rt_mu_);
+    JsonValue m = JsonValue::make_object({
+      {"enabled", JsonValue::make_bool(cfg.rt_mlock)},
+      {"ok", JsonValue::make_bool(mlocked_)},
+    });
+    if (!mlock_err_.empty()) m.o["error"] = JsonValue::make_string(mlock_err_);
+    o.o["mlock"] = std::move(m);
+    if (seq_rt_.applied) o.o["sequencer"] = rt_thread_json(want, seq_rt_);
+  }
+
+  // The status lives in the current output, which a device switch frees; skip it while one runs.
+  std::unique_lock lk(audio_mu_, std::try_to_lock);
+  RtThreadStatus ast;
+  if (lk.owns_lock() && audio_.rt_status(&ast)) o.o["audio"] = rt_thread_json(want, ast);
+  return o;
+}
+
 JsonValue App::api_metrics(bool include_history) const {
   JsonValue root = JsonValue::make_object({});
   root.o["ts_ms"] = JsonValue::make_number((double)unix_ms_now());
@@ -444,6 +1251,29 @@ JsonValue App::api_metrics(bool include_history) const {
     {"blk_write_bytes_total", JsonValue::make_number((double)metrics_.blk_write_bytes_total.load(std::memory_order_relaxed))},
     {"tcp_retransmit_total", JsonValue::make_number((double)metrics_.tcp_retransmit_total.load(std::memory_order_relaxed))},
     {"irq_total", JsonValue::make_number((double)metrics_.irq_total.load(std::memory_order_relaxed))},
+    {"offcpu_d_ns_total", JsonValue::make_number((double)metrics_.offcpu_d_ns_total.load(std::memory_order_relaxed))},
+    {"offcpu_s_ns_total", JsonValue::make_number((double)metrics_.offcpu_s_ns_total.load(std::memory_order_relaxed))},
+    {"lock_contended_total", JsonValue::make_number((double)metrics_.lock_contended_total.load(std::memory_order_relaxed))},
+    {"lock_wait_ns_total", JsonValue::make_number((double)metrics_.lock_wait_ns_total.load(std::memory_order_relaxed))},
+    {"skb_drop_total", JsonValue::make_number((double)metrics_.skb_drop_total.load(std::memory_order_relaxed))},
+    {"exec_fail_total", JsonValue::make_number((double)metrics_.exec_fail_total.load(std::memory_order_relaxed))},
+    {"proc_short_total", JsonValue::make_number((double)metrics_.proc_short_total.load(std::memory_order_relaxed))},
+    {"vfs_read_bytes_total", JsonValue::make_number((double)metrics_.vfs_read_bytes_total.load(std::memory_order_relaxed))},
+    {"vfs_write_bytes_total", JsonValue::make_number((double)metrics_.vfs_write_bytes_total.load(std::memory_order_relaxed))},
+    {"vfs_ns_total", JsonValue::make_number((double)metrics_.vfs_ns_total.load(std::memory_order_relaxed))},
+    {"fsync_total", JsonValue::make_number((double)metrics_.fsync_total.load(std::memory_order_relaxed))},
+    {"fsync_ns_total", JsonValue::make_number((double)metrics_.fsync_ns_total.load(std::memory_order_relaxed))},
+    {"rtt_samples_total", JsonValue::make_number((double)metrics_.rtt_samples_total.load(std::memory_order_relaxed))},
+    {"rtt_us_total", JsonValue::make_number((double)metrics_.rtt_us_total.load(std::memory_order_relaxed))},
+    {"listen_overflow_total", JsonValue::make_number((double)metrics_.listen_overflow_total.load(std::memory_order_relaxed))},
+    {"syn_overflow_total", JsonValue::make_number((double)metrics_.syn_overflow_total.load(std::memory_order_relaxed))},
+    {"pmu_cycles_total", JsonValue::make_number((double)metrics_.pmu_cycles_total.load(std::memory_order_relaxed))},
+    {"pmu_instructions_total", JsonValue::make_number((double)metrics_.pmu_instructions_total.load(std::memory_order_relaxed))},
+    {"pmu_cache_misses_total", JsonValue::make_number((double)metrics_.pmu_cache_misses_total.load(std::memory_order_relaxed))},
+    {"pmu_branch_misses_total", JsonValue::make_number((double)metrics_.pmu_branch_misses_total.load(std::memory_order_relaxed))},
+    {"page_faults_total", JsonValue::make_number((double)metrics_.page_faults_total.load(std::memory_order_relaxed))},
+    {"major_faults_total", JsonValue::make_number((double)metrics_.major_faults_total.load(std::memory_order_relaxed))},
+    {"prof_samples_total", JsonValue::make_number((double)metrics_.prof_samples_total.load(std::memory_order_relaxed))},
   });
 
   SignalRates r{};
@@ -461,8 +1291,148 @@ JsonValue App::api_metrics(bool include_history) const {
     {"retx_s", JsonValue::make_number(r.retx_s)},
     {"irq_s", JsonValue::make_number(r.irq_s)},
     {"mem_pct", JsonValue::make_number(r.mem_pct)},
+    {"prof_hz", JsonValue::make_number(r.prof_hz)},
+    {"entropy", JsonValue::make_number(r.entropy)},
+    {"dwait_ms_s", JsonValue::make_number(r.dwait_ms_s)},
+    {"swait_ms_s", JsonValue::make_number(r.swait_ms_s)},
+    {"lock_s", JsonValue::make_number(r.lock_s)},
+    {"lock_wait_ms_s", JsonValue::make_number(r.lock_wait_ms_s)},
+    {"drop_s", JsonValue::make_number(r.drop_s)},
+    {"exec_fail_s", JsonValue::make_number(r.exec_fail_s)},
+    {"churn_s", JsonValue::make_number(r.churn_s)},
+    {"vfs_r_kbs", JsonValue::make_number(r.vfs_r_kbs)},
+    {"vfs_w_kbs", JsonValue::make_number(r.vfs_w_kbs)},
+    {"vfs_ms_s", JsonValue::make_number(r.vfs_ms_s)},
+    {"fsync_s", JsonValue::make_number(r.fsync_s)},
+    {"fsync_ms_s", JsonValue::make_number(r.fsync_ms_s)},
+    {"rtt_ms", JsonValue::make_number(r.rtt_ms)},
+    {"rtt_p50_ms", JsonValue::make_number(r.rtt_p50_ms)},
+    {"rtt_p99_ms", JsonValue::make_number(r.rtt_p99_ms)},
+    {"listen_s", JsonValue::make_number(r.listen_s)},
+    {"syn_s", JsonValue::make_number(r.syn_s)},
+    {"gcycles_s", JsonValue::make_number(r.gcycles_s)},
+    {"ipc", JsonValue::make_number(r.ipc)},
+    {"llc_mpki", JsonValue::make_number(r.llc_mpki)},
+    {"branch_mpki", JsonValue::make_number(r.branch_mpki)},
+    {"fault_s", JsonValue::make_number(r.fault_s)},
+    {"major_fault_s", JsonValue::make_number(r.major_fault_s)},
+    {"spawners", JsonValue::make_number(r.spawners)},
+    {"actors", JsonValue::make_number(r.actors)},
+    {"peers", JsonValue::make_number(r.peers)},
   });
 
+  {
+    OffCpuHistogram oh;
+    std::string oerr;
+    bool ok = false;
+    {
+      std::unique_lock lk(bpf_mu_, std::try_to_lock);
+      ok = lk.owns_lock() && bpf_.offcpu_histogram(&oh, &oerr);
+    }
+    if (ok) {
+      // Trailing empty buckets are left out.
+      std::size_t n = OffCpuHistogram::kBuckets;
+      while (n > 0 && !oh.d[n - 1] && !oh.s[n - 1]) n--;
+      std::vector<JsonValue> buckets;
+      for (std::size_t i = 0; i < n; i++) {
+        buckets.push_back(JsonValue::make_object({
+          {"le_us", JsonValue::make_number((double)(2ULL << i))},
+          {"d", JsonValue::make_number((double)oh.d[i])},
+          {"s", JsonValue::make_number((double)oh.s[i])},
+        }));
+      }
+      auto summary = [](const std::array<uint64_t, OffCpuHistogram::kBuckets>& b) {
+        uint64_t count = 0;
+        for (uint64_t c : b) count += c;
+        return JsonValue::make_object({
+          {"count", JsonValue::make_number((double)count)},
+          {"p50_le_us", JsonValue::make_number((double)log2_quantile(b.data(), b.size(), 0.50))},
+          {"p99_le_us", JsonValue::make_number((double)log2_quantile(b.data(), b.size(), 0.99))},
+        });
+      };
+      root.o["offcpu"] = JsonValue::make_object({
+        {"d", summary(oh.d)},
+        {"s", summary(oh.s)},
+        {"buckets", JsonValue::make_array(std::move(buckets))},
+      });
+    } else if (!oerr.empty()) {
+      root.o["offcpu"] = JsonValue::make_object({{"error", JsonValue::make_string(oerr)}});
+    }
+  }
+
+  {
+    LifetimeHistogram lh;
+    bool ok = false;
+    {
+      std::unique_lock lk(bpf_mu_, std::try_to_lock);
+      ok = lk.owns_lock() && bpf_.lifetime_histogram(&lh, nullptr);
+    }
+    if (ok) {
+      std::size_t n = LifetimeHistogram::kBuckets;
+      while (n > 0 && !lh.b[n - 1]) n--;
+      uint64_t count = 0;
+      std::vector<JsonValue> buckets;
+      for (std::size_t i = 0; i < n; i++) {
+        count += lh.b[i];
+        buckets.push_back(JsonValue::make_object({
+          {"le_us", JsonValue::make_number((double)(2ULL << i))},
+          {"count", JsonValue::make_number((double)lh.b[i])},
+        }));
+      }
+      root.o["lifetime"] = JsonValue::make_object({
+        {"count", JsonValue::make_number((double)count)},
+        {"p50_le_us", JsonValue::make_number((double)log2_quantile(lh.b.data(), lh.b.size(), 0.50))},
+        {"p99_le_us", JsonValue::make_number((double)log2_quantile(lh.b.data(), lh.b.size(), 0.99))},
+        {"buckets", JsonValue::make_array(std::move(buckets))},
+      });
+    }
+  }
+
+  {
+    std::array<uint64_t, SketchWindow::kRttBuckets> rb;
+    {
+      std::scoped_lock lk(heavy_mu_);
+      rb = rtt_window_;
+    }
+    std::size_t n = rb.size();
+    while (n > 0 && !rb[n - 1]) n--;
+    uint64_t count = 0;
+    std::vector<JsonValue> buckets;
+    for (std::size_t i = 0; i < n; i++) {
+      count += rb[i];
+      buckets.push_back(JsonValue::make_object({
+        {"le_us", JsonValue::make_number((double)(2ULL << i))},
+        {"count", JsonValue::make_number((double)rb[i])},
+      }));
+    }
+    // The last sketch window (about 1 s), slot 0.
+    root.o["rtt"] = JsonValue::make_object({
+      {"count", JsonValue::make_number((double)count)},
+      {"p50_le_us", JsonValue::make_number((double)log2_quantile(rb.data(), rb.size(), 0.50))},
+      {"p99_le_us", JsonValue::make_number((double)log2_quantile(rb.data(), rb.size(), 0.99))},
+      {"buckets", JsonValue::make_array(std::move(buckets))},
+    });
+  }
+
+  {
+    ExecEventStats es;
+    {
+      std::unique_lock lk(bpf_mu_, std::try_to_lock);
+      if (lk.owns_lock()) es = bpf_.exec_event_stats();
+    }
+    const KhorConfig cfg = config_snapshot();
+    root.o["exec_events"] = JsonValue::make_object({
+      {"enabled", JsonValue::make_bool(cfg.enable_exec_events)},
+      {"rate", JsonValue::make_number(cfg.exec_events_rate)},
+      {"burst", JsonValue::make_number(cfg.exec_events_burst)},
+      {"emitted", JsonValue::make_number((double)es.emitted)},
+      {"throttled", JsonValue::make_number((double)es.throttled)},
+      {"lost", JsonValue::make_number((double)es.lost)},
+      {"queue_full", JsonValue::make_number((double)es.queue_full)},
+      {"triggered", JsonValue::make_number((double)exec_triggered_.load(std::memory_order_relaxed))},
+    });
+  }
+
   root.o["controls"] = JsonValue::make_object({
     {"bpm", JsonValue::make_number(metrics_.bpm.load(std::memory_order_relaxed))},
     {"key_midi", JsonValue::make_number(metrics_.key_midi.load(std::memory_order_relaxed))},
@@ -470,12 +1440,51 @@ JsonValue App::api_metrics(bool include_history) const {
     {"smoothing", JsonValue::make_number(smoothing_.load(std::memory_order_relaxed))},
   });
 
+  {
+    const ClockStats& cs = clock_.stats();
+    const LatenessHistogram& h = clock_.lateness();
+    std::vector<JsonValue> buckets;
+    for (std::size_t i = 0; i < LatenessHistogram::kBuckets; i++) {
+      JsonValue b = JsonValue::make_object({{"count", JsonValue::make_number((double)h.bucket(i))}});
+      // The last bucket is open-ended.
+      b.o["le_us"] = i < LatenessHistogram::kBoundsUs.size() ? JsonValue::make_number(LatenessHistogram::kBoundsUs[i])
+                                                             : JsonValue::make_null();
+      buckets.push_back(std::move(b));
+    }
+    KhorConfig cfg = config_snapshot();
+    root.o["clock"] = JsonValue::make_object({
+      {"source", JsonValue::make_string(cfg.music_clock)},
+      {"overrun", JsonValue::make_string(cfg.music_overrun)},
+      {"period_ms", JsonValue::make_number(clock_period_ms_.load(std::memory_order_relaxed))},
+      {"rate", JsonValue::make_number(clock_rate_.load(std::memory_order_relaxed))},
+      {"wakeups", JsonValue::make_number((double)cs.wakeups.load(std::memory_order_relaxed))},
+      {"steps", JsonValue::make_number((double)cs.steps.load(std::memory_order_relaxed))},
+      {"overruns", JsonValue::make_number((double)cs.overruns.load(std::memory_order_relaxed))},
+      {"skipped", JsonValue::make_number((double)cs.skipped.load(std::memory_order_relaxed))},
+      {"retempos", JsonValue::make_number((double)cs.retempos.load(std::memory_order_relaxed))},
+      {"render_steps", JsonValue::make_number((double)render_seq_.steps())},
+      {"render_dropped", JsonValue::make_number((double)render_seq_.dropped())},
+      {"stale_signals", JsonValue::make_number((double)music_stale_signals_.load(std::memory_order_relaxed))},
+      {"render_stale_signals", JsonValue::make_number((double)render_seq_.stale_signals())},
+      {"notes_dropped", JsonValue::make_number((double)notes_dropped_.load(std::memory_order_relaxed))},
+      {"lateness", JsonValue::make_object({
+        {"count", JsonValue::make_number((double)h.count())},
+        {"mean_us", JsonValue::make_number(h.mean_ns() * 1e-3)},
+        {"max_us", JsonValue::make_number((double)h.max_ns() * 1e-3)},
+        {"p50_le_us", JsonValue::make_number(h.quantile_us(0.50))},
+        {"p99_le_us", JsonValue::make_number(h.quantile_us(0.99))},
+        {"buckets", JsonValue::make_array(std::move(buckets))},
+      })},
+    });
+  }
+
   if (include_history) {
     std::vector<JsonValue> arr;
     {
       std::scoped_lock lk(hist_mu_);
       arr.reserve(history_.size());
-      for (const auto& s : history_) {
+      for (std::size_t i = 0; i < history_.size(); i++) {
+        const HistSample& s = history_[i];
         JsonValue o = JsonValue::make_object({});
         o.o["ts_ms"] = JsonValue::make_number((double)s.ts_ms);
         o.o["exec_s"] = JsonValue::make_number(s.rates.exec_s);
@@ -494,62 +1503,77 @@ JsonValue App::api_metrics(bool include_history) const {
 }
 
 JsonValue App::api_presets() const {
+  const auto lib = presets_snapshot();
+
   std::vector<JsonValue> arr;
-  arr.push_back(JsonValue::make_object({
-    {"name", JsonValue::make_string("ambient")},
-    {"hint", JsonValue::make_string("slow, sparse, more reverb")},
-  }));
-  arr.push_back(JsonValue::make_object({
-    {"name", JsonValue::make_string("percussive")},
-    {"hint", JsonValue::make_string("tight envelope, scheduler-driven rhythm")},
-  }));
-  arr.push_back(JsonValue::make_object({
-    {"name", JsonValue::make_string("arp")},
-    {"hint", JsonValue::make_string("network-driven arpeggio + exec stabs")},
-  }));
-  arr.push_back(JsonValue::make_object({
-    {"name", JsonValue::make_string("drone")},
-    {"hint", JsonValue::make_string("IO controls timbre; sustained tones")},
-  }));
-
-  return JsonValue::make_object({{"presets", JsonValue::make_array(std::move(arr))}});
+  for (const PresetDef* p : lib->all()) {
+    JsonValue o = JsonValue::make_object({
+      {"name", JsonValue::make_string(p->name)},
+      {"hint", JsonValue::make_string(p->hint)},
+    });
+    const UserPreset* u = lib->user(p);
+    o.o["source"] = JsonValue::make_string(u ? "user" : "builtin");
+    if (u) o.o["file"] = JsonValue::make_string(u->file);
+    arr.push_back(std::move(o));
+  }
+
+  std::vector<JsonValue> scales;
+  for (const auto& sc : builtin_scales()) scales.push_back(JsonValue::make_string(sc.name));
+
+  std::vector<JsonValue> errors;
+  for (const auto& e : lib->errors()) errors.push_back(JsonValue::make_string(e));
+
+  return JsonValue::make_object({
+    {"presets", JsonValue::make_array(std::move(arr))},
+    {"scales", JsonValue::make_array(std::move(scales))},
+    {"dir", JsonValue::make_string(presets_dir_)},
+    {"errors", JsonValue::make_array(std::move(errors))},
+  });
+}
+
+JsonValue App::api_reload_presets() {
+  (void)reload_presets(/*force=*/true);
+  JsonValue v = api_presets();
+  v.o["ok"] = JsonValue::make_bool(true);
+  return v;
 }
 
 bool App::api_select_preset(const std::string& name, std::string* err) {
-  if (name != "ambient" && name != "percussive" && name != "arp" && name != "drone") {
+  const auto lib = presets_snapshot();
+  const PresetDef* p = lib->find(name);
+  if (!p) {
     if (err) *err = "unknown preset";
     return false;
   }
 
+  std::scoped_lock lk(config_apply_mu_);
   KhorConfig next = config_snapshot();
-  next.preset = name;
-
-  if (name == "ambient") {
-    next.density = 0.20;
-    next.smoothing = 0.92;
-  } else if (name == "percussive") {
-    next.density = 0.80;
-    next.smoothing = 0.35;
-  } else if (name == "arp") {
-    next.density = 0.55;
-    next.smoothing = 0.60;
-  } else if (name == "drone") {
-    next.density = 0.10;
-    next.smoothing = 0.95;
-  }
+  next.preset = p->name;
+  next.density = p->density;
+  next.smoothing = p->smoothing;
 
   // Save + apply.
-  {
-    std::scoped_lock lk(cfg_mu_);
-    cfg_ = next;
-  }
+  publish_config(next);
   density_.store(next.density);
   smoothing_.store(next.smoothing);
 
-  (void)save_config_file(config_path_, next, nullptr);
+  persist_config_locked(next);
   return true;
 }
 
+void App::set_preset_live(const PresetDef& p) {
+  // Like the other live controls: the running config changes, the file doesn't.
+  {
+    std::scoped_lock lk(cfg_mu_);
+    cfg_.preset = p.name;
+    cfg_.density = p.density;
+    cfg_.smoothing = p.smoothing;
+    cfg_gen_.fetch_add(1, std::memory_order_release);
+  }
+  density_.store(p.density, std::memory_order_relaxed);
+  smoothing_.store(p.smoothing, std::memory_order_relaxed);
+}
+
 bool App::api_test_note(int midi, float vel, double dur_s, std::string* err) {
   midi = std::clamp(midi, 0, 127);
   vel = std::clamp(vel, 0.0f, 1.0f);
@@ -564,7 +1588,7 @@ bool App::api_test_note(int midi, float vel, double dur_s, std::string* err) {
   bool any = false;
 
   if (cfg.enable_audio && audio_.is_running()) {
-    audio_.submit_note(ev);
+    play_live_note(ev);
     any = true;
   }
   if (cfg.enable_midi && midi_.is_running()) {
@@ -583,27 +1607,348 @@ bool App::api_test_note(int midi, float vel, double dur_s, std::string* err) {
   return true;
 }
 
+JsonValue App::api_sessions() const {
+  std::vector<JsonValue> arr;
+  {
+    std::scoped_lock lk(sessions_mu_);
+    for (const auto& sess : sessions_) arr.push_back(sess->status());
+  }
+  return JsonValue::make_object({
+    {"max", JsonValue::make_number(kMaxSessions)},
+    {"sessions", JsonValue::make_array(std::move(arr))},
+  });
+}
+
+JsonValue App::api_profile() const {
+  const KhorConfig cfg = config_snapshot();
+  JsonValue root = JsonValue::make_object({
+    {"enabled", JsonValue::make_bool(cfg.enable_profile)},
+    {"hz", JsonValue::make_number((double)cfg.profile_hz)},
+    {"samples_s", JsonValue::make_number(prof_hz_.load(std::memory_order_relaxed))},
+    {"entropy", JsonValue::make_number(metrics_.prof_entropy.load(std::memory_order_relaxed))},
+  });
+  {
+    std::unique_lock lk(bpf_mu_, std::try_to_lock);
+    if (lk.owns_lock()) {
+      const ProfileStatus st = bpf_.profile_status();
+      root.o["running"] = JsonValue::make_bool(st.hz > 0);
+      root.o["cpus"] = JsonValue::make_number(st.cpus);
+      root.o["max_stacks"] = JsonValue::make_number(st.max_stacks);
+      root.o["samples"] = JsonValue::make_number((double)st.samples);
+      root.o["dropped"] = JsonValue::make_number((double)st.dropped);
+      root.o["stack_errors"] = JsonValue::make_number((double)st.stack_errors);
+      if (!st.error.empty()) root.o["error"] = JsonValue::make_string(st.error);
+    } else {
+      root.o["starting"] = JsonValue::make_bool(true);
+    }
+  }
+  std::scoped_lock lk(prof_mu_);
+  std::vector<JsonValue> top;
+  for (const auto& h : hot_.top((std::size_t)cfg.profile_top)) {
+    top.push_back(JsonValue::make_object({
+      {"function", JsonValue::make_string(h.name)},
+      {"module", JsonValue::make_string(h.module)},
+      {"samples", JsonValue::make_number(h.samples)},
+      {"share", JsonValue::make_number(h.share)},
+    }));
+  }
+  root.o["top"] = JsonValue::make_array(std::move(top));
+  root.o["symbolizer"] = JsonValue::make_object({
+    {"files", JsonValue::make_number((double)symbolizer_.files_cached())},
+    {"processes", JsonValue::make_number((double)symbolizer_.procs_cached())},
+  });
+  return root;
+}
+
+JsonValue App::api_locks() const {
+  const KhorConfig cfg = config_snapshot();
+  SignalRates r{};
+  {
+    std::scoped_lock lk(sig_mu_);
+    r = last_rates_;
+  }
+  JsonValue root = JsonValue::make_object({
+    {"enabled", JsonValue::make_bool(cfg.enable_locks)},
+    {"lock_s", JsonValue::make_number(r.lock_s)},
+    {"wait_ms_s", JsonValue::make_number(r.lock_wait_ms_s)},
+  });
+
+  std::vector<LockTypeStat> stats;
+  std::string err;
+  {
+    std::unique_lock lk(bpf_mu_, std::try_to_lock);
+    if (!lk.owns_lock()) {
+      root.o["starting"] = JsonValue::make_bool(true);
+      return root;
+    }
+    if (!bpf_.lock_stats(&stats, &err)) {
+      root.o["running"] = JsonValue::make_bool(false);
+      root.o["error"] = JsonValue::make_string(err);
+      return root;
+    }
+  }
+  root.o["running"] = JsonValue::make_bool(true);
+
+  std::sort(stats.begin(), stats.end(), [](const LockTypeStat& a, const LockTypeStat& b) { return a.wait_ns > b.wait_ns; });
+  std::vector<JsonValue> types;
+  for (const auto& s : stats) {
+    if (!s.count) continue;
+    types.push_back(JsonValue::make_object({
+      {"type", JsonValue::make_string(s.type)},
+      {"count", JsonValue::make_number((double)s.count)},
+      {"wait_ms", JsonValue::make_number((double)s.wait_ns * 1e-6)},
+      {"mean_us", JsonValue::make_number((double)s.wait_ns / (double)s.count * 1e-3)},
+      {"max_us", JsonValue::make_number((double)s.max_ns * 1e-3)},
+      {"p50_le_ns", JsonValue::make_number((double)log2_quantile(s.hist.data(), s.hist.size(), 0.50))},
+      {"p99_le_ns", JsonValue::make_number((double)log2_quantile(s.hist.data(), s.hist.size(), 0.99))},
+    }));
+  }
+  root.o["types"] = JsonValue::make_array(std::move(types));
+  return root;
+}
+
+JsonValue App::api_vfs() const {
+  const KhorConfig cfg = config_snapshot();
+  SignalRates r{};
+  {
+    std::scoped_lock lk(sig_mu_);
+    r = last_rates_;
+  }
+  JsonValue root = JsonValue::make_object({
+    {"enabled", JsonValue::make_bool(cfg.enable_vfs)},
+    {"read_kbs", JsonValue::make_number(r.vfs_r_kbs)},
+    {"write_kbs", JsonValue::make_number(r.vfs_w_kbs)},
+    {"vfs_ms_s", JsonValue::make_number(r.vfs_ms_s)},
+    {"fsync_s", JsonValue::make_number(r.fsync_s)},
+    {"fsync_ms_s", JsonValue::make_number(r.fsync_ms_s)},
+  });
+
+  std::vector<VfsOpStat> ops;
+  std::vector<VfsFileStat> files;
+  std::string err;
+  {
+    std::unique_lock lk(bpf_mu_, std::try_to_lock);
+    if (!lk.owns_lock()) {
+      root.o["starting"] = JsonValue::make_bool(true);
+      return root;
+    }
+    if (!bpf_.vfs_stats(&ops, &err) || !bpf_.vfs_files(&files, &err)) {
+      root.o["running"] = JsonValue::make_bool(false);
+      root.o["error"] = JsonValue::make_string(err);
+      return root;
+    }
+  }
+  root.o["running"] = JsonValue::make_bool(true);
+
+  std::vector<JsonValue> op_list;
+  for (const auto& s : ops) {
+    JsonValue o = JsonValue::make_object({
+      {"op", JsonValue::make_string(s.op)},
+      {"count", JsonValue::make_number((double)s.count)},
+      {"bytes", JsonValue::make_number((double)s.bytes)},
+      {"time_ms", JsonValue::make_number((double)s.ns * 1e-6)},
+      {"mean_us", JsonValue::make_number(s.count ? (double)s.ns / (double)s.count * 1e-3 : 0.0)},
+      {"max_us", JsonValue::make_number((double)s.max_ns * 1e-3)},
+      {"p50_le_ns", JsonValue::make_number((double)log2_quantile(s.hist.data(), s.hist.size(), 0.50))},
+      {"p99_le_ns", JsonValue::make_number((double)log2_quantile(s.hist.data(), s.hist.size(), 0.99))},
+    });
+    op_list.push_back(std::move(o));
+  }
+  root.o["ops"] = JsonValue::make_array(std::move(op_list));
+
+  // By time spent, so a small file that is fsynced constantly outranks a big one read from cache.
+  constexpr std::size_t kTopFiles = 10;
+  const std::size_t n = std::min(files.size(), kTopFiles);
+  std::partial_sort(files.begin(), files.begin() + (std::ptrdiff_t)n, files.end(),
+                    [](const VfsFileStat& a, const VfsFileStat& b) { return a.ns > b.ns; });
+  std::vector<JsonValue> top;
+  for (std::size_t i = 0; i < n; i++) {
+    const VfsFileStat& f = files[i];
+    top.push_back(JsonValue::make_object({
+      {"name", JsonValue::make_string(f.name)},
+      {"dev", JsonValue::make_string(std::to_string(f.dev_major) + ":" + std::to_string(f.dev_minor))},
+      {"ino", JsonValue::make_number((double)f.ino)},
+      {"comm", JsonValue::make_string(f.comm)},
+      {"read_bytes", JsonValue::make_number((double)f.read_bytes)},
+      {"write_bytes", JsonValue::make_number((double)f.write_bytes)},
+      {"ops", JsonValue::make_number((double)f.ops)},
+      {"time_ms", JsonValue::make_number((double)f.ns * 1e-6)},
+      {"fsync_count", JsonValue::make_number((double)f.fsync_count)},
+      {"fsync_ms", JsonValue::make_number((double)f.fsync_ns * 1e-6)},
+    }));
+  }
+  root.o["tracked_files"] = JsonValue::make_number((double)files.size());
+  root.o["files"] = JsonValue::make_array(std::move(top));
+  return root;
+}
+
+JsonValue App::api_drops() const {
+  SignalRates r{};
+  {
+    std::scoped_lock lk(sig_mu_);
+    r = last_rates_;
+  }
+  JsonValue root = JsonValue::make_object({
+    {"drop_s", JsonValue::make_number(r.drop_s)},
+    {"total", JsonValue::make_number((double)metrics_.skb_drop_total.load(std::memory_order_relaxed))},
+  });
+
+  std::vector<DropReasonStat> reasons;
+  std::string err;
+  {
+    std::unique_lock lk(bpf_mu_, std::try_to_lock);
+    if (!lk.owns_lock()) {
+      root.o["starting"] = JsonValue::make_bool(true);
+      return root;
+    }
+    if (!bpf_.drop_reasons(&reasons, &err)) {
+      root.o["running"] = JsonValue::make_bool(false);
+      root.o["error"] = JsonValue::make_string(err);
+      return root;
+    }
+  }
+  root.o["running"] = JsonValue::make_bool(true);
+  std::vector<JsonValue> top;
+  for (std::size_t i = 0; i < reasons.size() && i < 20; i++) {
+    top.push_back(JsonValue::make_object({
+      {"reason", JsonValue::make_string(reasons[i].name)},
+      {"code", JsonValue::make_number(reasons[i].reason)},
+      {"count", JsonValue::make_number((double)reasons[i].count)},
+    }));
+  }
+  root.o["reasons"] = JsonValue::make_array(std::move(top));
+  return root;
+}
+
+JsonValue App::api_heavy() const {
+  std::scoped_lock lk(heavy_mu_);
+  const auto list = [](const HeavyList& l, const char* unit, bool peers) {
+    std::vector<JsonValue> top;
+    for (std::size_t i = 0; i < l.n; i++) {
+      const HeavyKey& k = l.top[i];
+      JsonValue e = JsonValue::make_object({
+        {peers ? "addr" : "comm", JsonValue::make_string(k.name.data())},
+        {unit, JsonValue::make_number((double)k.count)},
+        {"share", JsonValue::make_number(l.total ? (double)k.count / (double)l.total : 0.0)},
+      });
+      if (!peers) e.o["tgid"] = JsonValue::make_number(k.tgid);
+      top.push_back(std::move(e));
+    }
+    return JsonValue::make_object({
+      {"total", JsonValue::make_number((double)l.total)},
+      {"error", JsonValue::make_number(l.error)},
+      {"top", JsonValue::make_array(std::move(top))},
+    });
+  };
+  return JsonValue::make_object({
+    {"window_s", JsonValue::make_number(heavy_window_s_)},
+    {"confidence", JsonValue::make_number(heavy_confidence_)},
+    {"processes", list(heavy_procs_, "switches", false)},
+    {"peers", list(heavy_peers_, "bytes", true)},
+  });
+}
+
+static JsonValue cgroup_to_json(const CgroupInfo& ci) {
+  JsonValue o = JsonValue::make_object({
+    {"id", JsonValue::make_number((double)ci.id)},
+    {"path", JsonValue::make_string(ci.path)},
+  });
+  if (!ci.unit.empty()) o.o["unit"] = JsonValue::make_string(ci.unit);
+  if (!ci.container.empty()) o.o["container"] = JsonValue::make_string(ci.container);
+  return o;
+}
+
+JsonValue App::api_cgroups(const std::string& name, int* http_status) const {
+  if (!name.empty()) {
+    CgroupInfo ci;
+    if (!cgroups_.resolve(name, &ci) || ci.path.empty()) {
+      if (http_status) *http_status = 404;
+      return json_error("no cgroup matches '" + name + "'");
+    }
+    return cgroup_to_json(ci);
+  }
+  constexpr std::size_t kMax = 4096;
+  std::vector<JsonValue> arr;
+  for (const auto& ci : cgroups_.list(kMax)) arr.push_back(cgroup_to_json(ci));
+  return JsonValue::make_object({
+    {"ok", JsonValue::make_bool(cgroups_.is_running())},
+    {"total", JsonValue::make_number((double)cgroups_.size())},
+    {"cgroups", JsonValue::make_array(std::move(arr))},
+  });
+}
+
+bool App::api_put_session(const JsonValue& body, JsonValue* out, int* http_status) {
+  if (!out) return false;
+  std::scoped_lock lk(config_apply_mu_);
+  const KhorConfig prev = config_snapshot();
+  KhorConfig next = prev;
+
+  const std::string name = json_get_string(body, "name", "");
+  auto it = std::find_if(next.sessions.begin(), next.sessions.end(), [&](const SessionConfig& sc) { return sc.name == name; });
+  const bool created = it == next.sessions.end();
+  SessionConfig sc = created ? SessionConfig{} : *it;
+  std::string e;
+  if (!session_config_from_json(body, &sc, &e)) {
+    if (http_status) *http_status = 400;
+    *out = json_error(e);
+    return true;
+  }
+  if (created) {
+    if ((int)next.sessions.size() >= kMaxSessions) {
+      if (http_status) *http_status = 409;
+      *out = json_error("session limit reached");
+      return true;
+    }
+    next.sessions.push_back(std::move(sc));
+  } else {
+    *it = std::move(sc);
+  }
+
+  (void)apply_config_locked(prev, next);
+  publish_config(next);
+  persist_config_locked(next);
+
+  JsonValue v = JsonValue::make_object({{"ok", JsonValue::make_bool(true)}});
+  v.o["session"] = session_config_to_json(created ? next.sessions.back() : *it);
+  *out = std::move(v);
+  if (http_status) *http_status = created ? 201 : 200;
+  return true;
+}
+
+bool App::api_delete_session(const std::string& name, JsonValue* out, int* http_status) {
+  if (!out) return false;
+  std::scoped_lock lk(config_apply_mu_);
+  const KhorConfig prev = config_snapshot();
+  KhorConfig next = prev;
+  const auto n = std::erase_if(next.sessions, [&](const SessionConfig& sc) { return sc.name == name; });
+  if (n == 0) {
+    if (http_status) *http_status = 404;
+    *out = json_error("unknown session");
+    return true;
+  }
+
+  (void)apply_config_locked(prev, next);
+  publish_config(next);
+  persist_config_locked(next);
+
+  *out = json_ok(true);
+  if (http_status) *http_status = 200;
+  return true;
+}
+
 bool App::api_audio_devices(std::vector<AudioDeviceInfo>* out, std::string* err) const {
   if (!out) return false;
-  KhorConfig cfg = config_snapshot();
-  AudioConfig ac;
-  ac.backend = cfg.audio_backend;
-  ac.device = cfg.audio_device;
-  ac.sample_rate = cfg.audio_sample_rate;
-  ac.master_gain = cfg.audio_master_gain;
-  return AudioEngine::enumerate_playback_devices(ac, out, err);
+  return AudioEngine::enumerate_playback_devices(make_audio_cfg(config_snapshot()), out, err);
 }
 
 bool App::api_audio_set_device(const std::string& device, std::string* err) {
+  std::scoped_lock cfg_lk(config_apply_mu_);
   KhorConfig prev = config_snapshot();
   KhorConfig next = prev;
   next.audio_device = device;
 
-  {
-    std::scoped_lock lk(cfg_mu_);
-    cfg_ = next;
-  }
-  (void)save_config_file(config_path_, next, nullptr);
+  publish_config(next);
+  persist_config_locked(next);
 
   density_.store(next.density);
   smoothing_.store(next.smoothing);
@@ -624,6 +1969,7 @@ bool App::api_put_config(const JsonValue& patch, JsonValue* out, int* http_statu
     return true;
   }
 
+  std::scoped_lock lk(config_apply_mu_);
   KhorConfig prev = config_snapshot();
   KhorConfig next = prev;
 
@@ -634,16 +1980,39 @@ bool App::api_put_config(const JsonValue& patch, JsonValue* out, int* http_statu
     return true;
   }
 
+  const bool restart_required = apply_config_locked(prev, next);
+
+  // Save config + publish.
+  publish_config(next);
+  persist_config_locked(next);
+
+  JsonValue v = config_to_json(next);
+  v.o["ok"] = JsonValue::make_bool(true);
+  v.o["restart_required"] = JsonValue::make_bool(restart_required);
+  *out = std::move(v);
+  if (http_status) *http_status = 200;
+  return true;
+}
+
+bool App::apply_config_locked(const KhorConfig& prev, const KhorConfig& next) {
   bool restart_required = false;
   restart_required |= (prev.listen_host != next.listen_host) || (prev.listen_port != next.listen_port);
   restart_required |= (prev.ui_dir != next.ui_dir) || (prev.serve_ui != next.serve_ui);
 
   // Live apply: always.
-  metrics_.bpm.store(next.bpm);
+  set_bpm_live(next.bpm);
   metrics_.key_midi.store(next.key_midi);
   density_.store(next.density);
   smoothing_.store(next.smoothing);
 
+  // ---- Real-time scheduling ----
+  const bool rt_changed = (prev.rt_policy != next.rt_policy) ||
+    (prev.rt_priority != next.rt_priority) || (prev.rt_cpus != next.rt_cpus);
+  if (rt_changed) {
+    seq_reactor_.post([this, rt = make_rt_cfg(next)] { apply_seq_rt(rt); });
+  }
+  apply_mlock(next.rt_mlock);
+
   // ---- Audio ----
   {
     std::scoped_lock lk(audio_mu_);
@@ -653,7 +2022,8 @@ bool App::api_put_config(const JsonValue& patch, JsonValue* out, int* http_statu
     const bool audio_restart_needed =
       (prev.audio_backend != next.audio_backend) ||
       (prev.audio_sample_rate != next.audio_sample_rate) ||
-      (prev.audio_device != next.audio_device);
+      (prev.audio_device != next.audio_device) ||
+      rt_changed; // the callback thread only picks up scheduling on its first buffer
 
     if (audio_enable_changed) {
       if (next.enable_audio) (void)start_audio_locked(next, nullptr);
@@ -678,61 +2048,254 @@ bool App::api_put_config(const JsonValue& patch, JsonValue* out, int* http_statu
   {
     std::scoped_lock lk(osc_mu_);
     const bool enable_changed = (prev.enable_osc != next.enable_osc) ||
-      (prev.osc_host != next.osc_host) || (prev.osc_port != next.osc_port);
+      (prev.osc_host != next.osc_host) || (prev.osc_port != next.osc_port) ||
+      (prev.osc_targets != next.osc_targets) || (prev.osc_multicast_ttl != next.osc_multicast_ttl);
     if (enable_changed) {
       stop_osc_locked();
       if (next.enable_osc) (void)start_osc_locked(next, nullptr);
     }
   }
 
+  // ---- OSC input ----
+  {
+    std::scoped_lock lk(osc_in_mu_);
+    const bool enable_changed = (prev.enable_osc_in != next.enable_osc_in) ||
+      (prev.osc_in_host != next.osc_in_host) || (prev.osc_in_port != next.osc_in_port);
+    if (enable_changed) {
+      stop_osc_in_locked();
+      if (next.enable_osc_in) (void)start_osc_in_locked(next, nullptr);
+    }
+  }
+
   // ---- BPF ----
   {
     std::scoped_lock lk(bpf_mu_);
+    // The profiler's maps are sized at load and the lock and VFS probes are chosen at load,
+    // so switching any of them on/off (or resizing the profiler) reloads the object.
+    const bool reload = (prev.enable_profile != next.enable_profile) ||
+      (next.enable_profile && prev.profile_max_stacks != next.profile_max_stacks) ||
+      (prev.enable_locks != next.enable_locks) || (prev.enable_vfs != next.enable_vfs);
     const bool enable_changed = (prev.enable_bpf != next.enable_bpf);
-    if (enable_changed) {
+    if (enable_changed || (next.enable_bpf && reload)) {
       stop_bpf_locked();
       if (next.enable_bpf) (void)start_bpf_locked(next, nullptr);
     } else if (next.enable_bpf) {
-      // Mask/interval/filters are live-tunable.
+      // Mask/interval/filters and the sampling rate are live-tunable.
       if (prev.bpf_enabled_mask != next.bpf_enabled_mask ||
+          prev.profile_hz != next.profile_hz ||
           prev.bpf_sample_interval_ms != next.bpf_sample_interval_ms ||
           prev.bpf_tgid_allow != next.bpf_tgid_allow ||
           prev.bpf_tgid_deny != next.bpf_tgid_deny ||
-          prev.bpf_cgroup_id != next.bpf_cgroup_id) {
+          prev.bpf_cgroup_id != next.bpf_cgroup_id ||
+          prev.bpf_cgroup != next.bpf_cgroup) {
         apply_bpf_cfg_locked(next);
       }
     }
   }
 
+  // ---- PMU ----
+  if (prev.enable_pmu != next.enable_pmu) {
+    std::scoped_lock lk(pmu_mu_);
+    stop_pmu_locked();
+    if (next.enable_pmu) (void)start_pmu_locked(nullptr);
+  }
+
   // ---- Fake mode ----
   {
     const bool want_fake = next.enable_fake && !bpf_.status().ok;
-    if (want_fake) {
-      if (!fake_running_.load()) {
-        if (fake_.joinable()) fake_.join();
-        fake_running_.store(true);
-        fake_ = std::thread([this] { fake_loop(); });
+    if (want_fake != fake_running_.load()) set_fake_running(want_fake);
+  }
+
+  sync_sessions_locked(next);
+
+  // ---- Config file watch ----
+  if (prev.enable_config_watch != next.enable_config_watch) {
+    if (next.enable_config_watch) (void)start_config_watch_locked(nullptr);
+    else stop_config_watch_locked();
+  }
+
+  return restart_required;
+}
+
+void App::sync_sessions_locked(const KhorConfig& cfg) {
+  // A session whose config changed is restarted with fresh state.
+  std::vector<std::unique_ptr<Session>> dropped;
+  uint32_t used = 1u; // slot 0 is the main pipeline
+  {
+    std::scoped_lock lk(sessions_mu_);
+    for (auto it = sessions_.begin(); it != sessions_.end();) {
+      const auto want = std::find_if(cfg.sessions.begin(), cfg.sessions.end(),
+        [&](const SessionConfig& sc) { return sc.name == (*it)->config().name; });
+      if (want == cfg.sessions.end() || !(*want == (*it)->config())) {
+        dropped.push_back(std::move(*it));
+        it = sessions_.erase(it);
+      } else {
+        used |= 1u << (*it)->slot();
+        ++it;
       }
-    } else {
-      fake_running_.store(false);
-      if (fake_.joinable()) fake_.join();
     }
   }
+  for (auto& sess : dropped) {
+    {
+      std::scoped_lock lk(bpf_mu_);
+      bpf_.clear_session(sess->slot());
+    }
+    sess->stop();
+  }
+  dropped.clear();
 
-  // Save config + publish.
+  for (const auto& sc : cfg.sessions) {
+    {
+      std::scoped_lock lk(sessions_mu_);
+      if (std::any_of(sessions_.begin(), sessions_.end(), [&](const auto& p) { return p->config().name == sc.name; })) continue;
+    }
+    int slot = 1;
+    while (slot < BpfCollector::kMaxSessions && (used & (1u << slot))) slot++;
+    if (slot >= BpfCollector::kMaxSessions) break;
+
+    auto sess = std::make_unique<Session>(sc, slot);
+    std::string e;
+    if (!sess->start(presets_snapshot(), &seq_reactor_, &audio_, &e)) {
+      std::fprintf(stderr, "khor-daemon: session %s failed: %s\n", sc.name.c_str(), e.c_str());
+      continue;
+    }
+    used |= 1u << slot;
+    std::scoped_lock lk(sessions_mu_);
+    sessions_.push_back(std::move(sess));
+  }
+
+  program_sessions_locked(cfg);
+}
+
+void App::program_sessions_locked(const KhorConfig& cfg) {
+  // The sample interval follows the daemon's.
+  std::scoped_lock lk(bpf_mu_, sessions_mu_);
+  for (auto& sess : sessions_) {
+    const SessionConfig& sc = sess->config();
+    BpfConfig bc;
+    bc.enabled_mask = sc.bpf_enabled_mask;
+    bc.sample_interval_ms = cfg.bpf_sample_interval_ms;
+    bc.tgid_allow = sc.bpf_tgid_allow;
+    bc.tgid_deny = sc.bpf_tgid_deny;
+    bc.cgroup_id = resolve_cgroup(sc.bpf_cgroup, sc.bpf_cgroup_id);
+    (void)bpf_.set_session(sess->slot(), bc, sess->metrics(), nullptr);
+  }
+}
+
+void App::stop_sessions_locked() {
+  std::vector<std::unique_ptr<Session>> all;
   {
-    std::scoped_lock lk(cfg_mu_);
-    cfg_ = next;
+    std::scoped_lock lk(sessions_mu_);
+    all.swap(sessions_);
   }
+  for (auto& sess : all) {
+    {
+      std::scoped_lock lk(bpf_mu_);
+      bpf_.clear_session(sess->slot());
+    }
+    sess->stop();
+  }
+}
 
-  (void)save_config_file(config_path_, next, nullptr);
+void App::persist_config_locked(const KhorConfig& next) {
+  std::string e;
+  if (!save_config_file(config_path_, next, &e)) {
+    std::fprintf(stderr, "khor-daemon: config save failed: %s\n", e.c_str());
+    return;
+  }
+  config_text_ = config_to_text(next);
+}
 
-  JsonValue v = config_to_json(next);
-  v.o["ok"] = JsonValue::make_bool(true);
-  v.o["restart_required"] = JsonValue::make_bool(restart_required);
-  *out = std::move(v);
-  if (http_status) *http_status = 200;
+bool App::start_config_watch_locked(std::string* err) {
+  std::error_code ec;
+  std::filesystem::create_directories(std::filesystem::path(config_path_).parent_path(), ec);
+  std::string e;
+  // Bursts (write + rename, several saves in a row) settle before one reload.
+  const bool ok = config_watch_.start(config_path_, [this] { arm_config_reload(); }, &reactor_, &e);
+  if (!ok) {
+    config_watch_err_ = e.empty() ? "config watch failed" : e;
+    if (err) *err = config_watch_err_;
+    return false;
+  }
+  config_watch_err_.clear();
   return true;
 }
 
+void App::stop_config_watch_locked() {
+  config_watch_.stop();
+  (void)reactor_.arm_periodic(config_timer_, std::chrono::milliseconds(0));
+}
+
+void App::arm_config_reload() {
+  const int64_t at = mono_now_ns() + 100'000'000;
+  (void)reactor_.arm_at(config_timer_, at);
+}
+
+void App::arm_cgroup_refresh() {
+  // A container start creates a burst of cgroups; resolve once it settles.
+  const int64_t at = mono_now_ns() + 250'000'000;
+  (void)reactor_.arm_at(cgroup_timer_, at);
+}
+
+void App::refresh_cgroup_filters() {
+  std::unique_lock lk(config_apply_mu_, std::try_to_lock);
+  if (!lk.owns_lock()) {
+    arm_cgroup_refresh();
+    return;
+  }
+  const KhorConfig cfg = config_snapshot();
+  const bool named = !cfg.bpf_cgroup.empty() ||
+    std::any_of(cfg.sessions.begin(), cfg.sessions.end(), [](const SessionConfig& sc) { return !sc.bpf_cgroup.empty(); });
+  if (!named) return;
+  cgroup_refreshes_.fetch_add(1, std::memory_order_relaxed);
+  if (cfg.enable_bpf) {
+    std::scoped_lock blk(bpf_mu_);
+    apply_bpf_cfg_locked(cfg);
+  }
+  program_sessions_locked(cfg);
+}
+
+void App::config_worker() {
+  std::unique_lock lk(config_req_mu_);
+  for (;;) {
+    config_req_cv_.wait(lk, [this] { return config_req_ || config_req_stop_; });
+    if (config_req_stop_) return;
+    config_req_ = false;
+    lk.unlock();
+    reload_config_file();
+    lk.lock();
+  }
+}
+
+void App::reload_config_file() {
+  std::scoped_lock lk(config_apply_mu_);
+  if (!config_watch_.is_running()) return;
+
+  std::string text;
+  if (!read_text_file(config_path_, &text)) return; // between unlink and rename; the rename fires again
+  if (text == config_text_) {
+    config_suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  // Same semantics as a PUT: the file is a patch over the running config.
+  const KhorConfig prev = config_snapshot();
+  KhorConfig next = prev;
+  std::string e;
+  if (!config_from_text(text, &next, &e)) {
+    config_reload_errors_.fetch_add(1, std::memory_order_relaxed);
+    config_watch_err_ = e.empty() ? "invalid config" : e;
+    std::fprintf(stderr, "khor-daemon: config reload rejected: %s\n", config_watch_err_.c_str());
+    return;
+  }
+  config_watch_err_.clear();
+
+  const bool restart_required = apply_config_locked(prev, next);
+  publish_config(next);
+  config_text_ = text;
+  config_reloads_.fetch_add(1, std::memory_order_relaxed);
+  std::fprintf(stderr, "khor-daemon: reloaded %s%s\n", config_path_.c_str(),
+    restart_required ? " (listen/ui changes apply after a restart)" : "");
+}
+
 } // namespace khor
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
-#include <deque>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
@@ -10,14 +13,29 @@
 #include <vector>
 
 #include "app/config.h"
+#include "app/session.h"
 #include "audio/engine.h"
 #include "bpf/collector.h"
+#include "engine/clock.h"
+#include "engine/exec_triggers.h"
 #include "engine/music.h"
+#include "engine/profile.h"
+#include "engine/render_sequencer.h"
 #include "engine/signals.h"
+#include "engine/sketch.h"
 #include "khor/metrics.h"
 #include "midi/alsa_seq.h"
 #include "osc/osc.h"
+#include "osc/server.h"
+#include "pmu/pmu.h"
+#include "util/cgroup_cache.h"
+#include "util/file_watch.h"
 #include "util/json.h"
+#include "util/reactor.h"
+#include "util/ring.h"
+#include "util/rt.h"
+#include "util/seqlock.h"
+#include "util/symbolizer.h"
 
 namespace khor {
 
@@ -30,8 +48,13 @@ class App {
   App& operator=(const App&) = delete;
 
   bool start(std::string* err);
+  // Runs the reactor on the calling thread until SIGINT/SIGTERM or stop().
+  // The caller must block SIGINT/SIGTERM in every thread first (main does, before start()).
+  void run();
   void stop();
   bool is_running() const { return running_.load(); }
+  // True until start() has brought the subsystems up (HTTP is already serving by then).
+  bool is_starting() const { return starting_.load(); }
 
   std::string config_path() const { return config_path_; }
 
@@ -40,26 +63,79 @@ class App {
   JsonValue api_health() const;
   JsonValue api_metrics(bool include_history) const;
   JsonValue api_presets() const;
+  // Re-reads the presets directory now (it is also polled about once a second).
+  JsonValue api_reload_presets();
 
   // Applies a JSON config patch (same schema as /api/config) and persists the result.
+  // Edits to the config file on disk go through the same path (features.config_watch).
   // Returns the updated full config JSON with {"ok":true,"restart_required":...}.
   bool api_put_config(const JsonValue& patch, JsonValue* out, int* http_status);
 
+  // Blocks on config_apply_mu_, so never from the reactor thread (OSC uses set_preset_live).
   bool api_select_preset(const std::string& name, std::string* err);
   bool api_test_note(int midi, float vel, double dur_s, std::string* err);
 
+  // Extra pipelines; stored in the config's "sessions" array and applied through the same path as PUT /api/config.
+  JsonValue api_sessions() const;
+  // Creates the session named in the body, or patches it if it exists.
+  bool api_put_session(const JsonValue& body, JsonValue* out, int* http_status);
+  bool api_delete_session(const std::string& name, JsonValue* out, int* http_status);
+
+  // Hot functions from the on-CPU profiler (features.profile) and its sampling state.
+  JsonValue api_profile() const;
+  // Kernel lock classes by total contended wait (features.locks).
+  JsonValue api_locks() const;
+  // Packet drop counts by kfree_skb reason, most frequent first.
+  JsonValue api_drops() const;
+  // Top processes by context switches and top peers by bytes over the last sketch window.
+  JsonValue api_heavy() const;
+  // VFS read/write/fsync latency and the files taking the most time in them (features.vfs).
+  JsonValue api_vfs() const;
+
+  // Known cgroups, or with a name ("nginx.service", a path, a container id prefix) the one it resolves to.
+  JsonValue api_cgroups(const std::string& name, int* http_status) const;
+
   bool api_audio_devices(std::vector<AudioDeviceInfo>* out, std::string* err) const;
   bool api_audio_set_device(const std::string& device, std::string* err);
 
  private:
+  struct StartupPhase {
+    std::string name;
+    bool done = false;
+    bool ok = false;
+    double ms = 0.0;     // own duration
+    double end_ms = 0.0; // finished this long after start() began
+  };
+
   struct HistSample {
     int64_t ts_ms = 0;
     SignalRates rates{};
   };
 
-  void sampler_loop();
-  void music_loop();
-  void fake_loop();
+  // Reactor timer callbacks.
+  void sampler_tick();
+  void music_tick();
+  void fake_tick();
+  // Sequencer thread: one 16th step, config refresh, clock tempo/rate/overrun upkeep.
+  void music_step();
+  void refresh_music_cfg();
+  void retune_clock(int64_t now_ns);
+  // music.clock = "audio": attaches/detaches the render sequencer. True while steps run in the callback.
+  bool update_render_mode(int64_t now_ns);
+  void on_render_steps();
+  void emit_step(const MusicFrame& frame, const SignalSnapshot& sig, bool to_audio);
+  void emit_notes(const NoteBuffer& notes, bool to_audio);
+  // Sequencer thread: drains exec_q_, appending a note for each exec that matches a trigger;
+  // while out is full the rest stay queued for the next step.
+  void take_exec_triggers(NoteBuffer* out);
+  void arm_music_timer();
+  // Stores the hot bpm and re-phases the clock right away instead of at the next step.
+  void set_bpm_live(double bpm);
+  void set_fake_running(bool on);
+  // Runs on the sequencer thread.
+  void apply_seq_rt(const RtConfig& rt);
+  void apply_mlock(bool on);
+  JsonValue rt_health(const KhorConfig& cfg) const;
 
   bool start_audio_locked(const KhorConfig& cfg, std::string* err);
   void stop_audio_locked();
@@ -71,9 +147,58 @@ class App {
   bool start_osc_locked(const KhorConfig& cfg, std::string* err);
   void stop_osc_locked();
 
+  bool start_osc_in_locked(const KhorConfig& cfg, std::string* err);
+  void stop_osc_in_locked();
+  // Runs on the reactor thread; touches hot atomics, lock-free queues and cfg_ (cfg_mu_ only), never the file.
+  void on_osc_control(const osc::Message& m);
+  // Every live note goes through here: it hops onto the main reactor, the live lane's only producer.
+  void play_live_note(const NoteEvent& ev);
+  // Swaps the running preset and bumps cfg_gen_ without config_apply_mu_ or persisting.
+  void set_preset_live(const PresetDef& p);
+
   bool start_bpf_locked(const KhorConfig& cfg, std::string* err);
   void stop_bpf_locked();
   void apply_bpf_cfg_locked(const KhorConfig& cfg);
+  BpfConfig make_bpf_cfg(const KhorConfig& cfg) const;
+  // bpf.cgroup (a name) wins over bpf.cgroup_id; an unresolved name yields kCgroupNone.
+  uint64_t resolve_cgroup(const std::string& name, uint64_t id) const;
+  // prof_thread_, woken by the sampler about once a second: drains the profiler maps, symbolizes, updates hot_.
+  void pull_profile();
+  void profile_worker();
+  // Closes the sketch window (about once a second): HyperLogLog into the distinct_* gauges,
+  // count-min heavy hitters into heavy_.
+  void pull_sketches();
+  bool start_pmu_locked(std::string* err);
+  void stop_pmu_locked();
+  // Reactor thread, every sampler tick: adds the counter deltas to metrics_.
+  void pull_pmu();
+  void arm_cgroup_refresh();
+  // Reactor thread: re-resolves cgroup names after cgroups were created or removed.
+  void refresh_cgroup_filters();
+
+  // Brings sessions_ in line with cfg.sessions: removed or changed sessions are torn down, new ones started.
+  void sync_sessions_locked(const KhorConfig& cfg);
+  // Writes every running session's BPF filter slot.
+  void program_sessions_locked(const KhorConfig& cfg);
+  void stop_sessions_locked();
+
+  // Replaces cfg_ and bumps cfg_gen_ so loops can re-read it only on change.
+  void publish_config(const KhorConfig& next);
+  // Brings the running modules from prev to next. True if listen/ui changed (needs a daemon restart).
+  bool apply_config_locked(const KhorConfig& prev, const KhorConfig& next);
+  // Saves next and remembers the text, so the file watch ignores our own write.
+  void persist_config_locked(const KhorConfig& next);
+
+  bool start_config_watch_locked(std::string* err);
+  void stop_config_watch_locked();
+  void arm_config_reload();
+  // Config thread: debounced re-read of config_path_, applied like a PUT /api/config.
+  void reload_config_file();
+  void config_worker();
+
+  std::shared_ptr<const PresetLibrary> presets_snapshot() const;
+  // Loads user presets when the directory changed (or always, if force). Returns true if reloaded.
+  bool reload_presets(bool force);
 
   static int64_t unix_ms_now();
 
@@ -81,13 +206,56 @@ class App {
 
   mutable std::mutex cfg_mu_;
   KhorConfig cfg_;
+  std::atomic<uint64_t> cfg_gen_{0};
+
+  // Serializes config changes (API and file reloads); taken before any module lock.
+  mutable std::mutex config_apply_mu_;
+  std::string config_text_; // file content matching the running config
+  FileWatch config_watch_{};
+  int config_timer_ = -1; // debounce; fires on the reactor and hands the reload to config_thread_
+  // An apply can verify BPF programs or wait out a device switch, so it never runs on the reactor.
+  std::thread config_thread_;
+  std::mutex config_req_mu_;
+  std::condition_variable config_req_cv_;
+  bool config_req_ = false;
+  bool config_req_stop_ = false;
+  std::string config_watch_err_;
+  std::atomic<uint64_t> config_reloads_{0};
+  std::atomic<uint64_t> config_suppressed_{0};
+  std::atomic<uint64_t> config_reload_errors_{0};
+
+  // Built-in + user presets; swapped as a whole on reload (bumps cfg_gen_).
+  std::string presets_dir_;
+  mutable std::mutex presets_mu_;
+  std::shared_ptr<const PresetLibrary> presets_;
+  uint64_t presets_fp_ = 0;
 
   // Hot controls (avoid holding cfg_mu_ in loops).
   std::atomic<double> density_{0.35};
   std::atomic<double> smoothing_{0.85};
 
   std::atomic<bool> running_{false};
-  std::atomic<bool> stop_{false};
+  std::atomic<bool> starting_{true}; // until start() has brought everything up
+
+  mutable std::mutex startup_mu_;
+  std::vector<StartupPhase> startup_;
+  double startup_total_ms_ = 0.0;
+
+  // Event loop for everything except audio rendering, sequencing and HTTP.
+  Reactor reactor_{};
+  int sampler_timer_ = -1;
+  int fake_timer_ = -1;
+
+  // Sequencer thread: music clock + MIDI note-offs, the only timing-critical work besides audio.
+  // It gets the configured RT policy/affinity; the main reactor stays SCHED_OTHER.
+  Reactor seq_reactor_{};
+  std::thread seq_thread_;
+  int music_timer_ = -1;
+
+  mutable std::mutex rt_mu_;
+  RtThreadStatus seq_rt_{};
+  bool mlocked_ = false;
+  std::string mlock_err_;
 
   // Modules.
   KhorMetrics metrics_{};
@@ -104,25 +272,112 @@ class App {
   mutable std::mutex osc_mu_;
   std::string osc_err_;
 
+  OscServer osc_in_{};
+  mutable std::mutex osc_in_mu_;
+  std::string osc_in_err_;
+  std::atomic<uint64_t> osc_in_unknown_{0};
+
   BpfCollector bpf_{};
   mutable std::mutex bpf_mu_;
   std::string bpf_err_;
 
+  PmuCollector pmu_{};
+  mutable std::mutex pmu_mu_;
+  std::atomic<double> pmu_running_{0.0}; // share of the last interval the groups were counting
+
+  // Matches no cgroup: the filter for a bpf.cgroup name that doesn't resolve (yet).
+  static constexpr uint64_t kCgroupNone = ~0ULL;
+  CgroupCache cgroups_{};
+  mutable std::mutex cgroups_mu_;
+  std::string cgroups_err_;
+  int cgroup_timer_ = -1;
+  std::atomic<uint64_t> cgroup_refreshes_{0};
+
+  // On-CPU profiler results. Only prof_thread_ drains and symbolizes (kallsyms, ELF, /proc maps);
+  // the sampler reads just prof_hz_ and metrics_.prof_entropy.
+  std::thread prof_thread_;
+  std::mutex prof_req_mu_;
+  std::condition_variable prof_req_cv_;
+  bool prof_req_ = false;
+  bool prof_req_stop_ = false;
+  mutable std::mutex prof_mu_;
+  Symbolizer symbolizer_{};
+  HotFunctions hot_{};
+  std::chrono::steady_clock::time_point prof_last_{};
+  std::atomic<double> prof_hz_{0.0};
+
   std::atomic<bool> fake_running_{false};
 
+  // Count-min heavy hitters of the last closed sketch window; written by the reactor thread.
+  // Fixed size, so pull_sketches publishes them without allocating.
+  struct HeavyKey {
+    std::array<char, 48> name{}; // comm, or the formatted address; NUL-terminated
+    uint32_t tgid = 0;
+    uint64_t count = 0;
+  };
+  struct HeavyList {
+    static constexpr std::size_t kTop = 10;
+    std::array<HeavyKey, kTop> top{};
+    std::size_t n = 0;
+    uint64_t total = 0;
+    double error = 0.0; // each count may be over by up to this much
+  };
+  mutable std::mutex heavy_mu_;
+  HeavyList heavy_procs_{};
+  HeavyList heavy_peers_{};
+  double heavy_window_s_ = 0.0;
+  double heavy_confidence_ = 0.0;
+  std::array<uint64_t, SketchWindow::kRttBuckets> rtt_window_{}; // TCP RTT histogram of the same window
+  std::chrono::steady_clock::time_point sketch_last_{};
+  // pull_sketches() scratch, reactor thread only.
+  SketchWindow sketch_win_{};
+  CountMin heavy_cms_{CmsWindow::kRows, CmsWindow::kWidth};
+
+  // Extra pipelines. The list is swapped under sessions_mu_ (the sampler iterates it);
+  // sessions themselves are started/stopped outside it, under config_apply_mu_.
+  mutable std::mutex sessions_mu_;
+  std::vector<std::unique_ptr<Session>> sessions_;
+
   // Signals + history.
   mutable std::mutex sig_mu_;
   Signals signals_{};
   SignalRates last_rates_{};
   Signal01 last_v01_{};
+  // Same values, lock-free for the sequencer and the audio callback.
+  SeqLock<SignalSnapshot> sig_snap_{};
 
   mutable std::mutex hist_mu_;
-  std::deque<HistSample> history_;
-
-  // Threads.
-  std::thread sampler_;
-  std::thread music_;
-  std::thread fake_;
+  FixedRing<HistSample, 600> history_; // 60 s at the 100 ms sampler period
+
+  // Sampler state (reactor thread).
+  std::chrono::steady_clock::time_point sampler_last_{};
+  int psi_tick_ = 0;
+  double mem_psi_ = 0.0;
+  int psi_fd_ = -1;
+
+  // Sequencer state (sequencer thread). Config is re-read only when cfg_gen_ changes.
+  MusicEngine engine_{};
+  SignalSnapshot music_sig_{}; // last consistent read of sig_snap_
+  std::atomic<uint64_t> music_stale_signals_{0};
+  KhorConfig music_cfg_{};
+  uint64_t music_cfg_gen_ = ~0ULL;
+  MusicClock clock_{};
+  AudioClockTracker audio_clock_{};
+  bool clock_slaved_ = false;
+  RenderSequencer render_seq_{RenderSequencer::Inputs{
+    .signals = &sig_snap_, .bpm = &metrics_.bpm, .density = &density_, .key_midi = &metrics_.key_midi}};
+  bool render_mode_ = false;
+  bool render_cfg_dirty_ = false;
+  uint32_t osc_signal_tick_ = 0;
+  uint32_t osc_metrics_tick_ = 0;
+  // Exec records from the collector (reactor thread) to the triggers (sequencer thread).
+  ExecEventQueue exec_q_{};
+  ExecTriggerTable exec_triggers_{};
+  std::atomic<uint64_t> exec_triggered_{0};
+  std::atomic<uint64_t> notes_dropped_{0}; // notes past NoteBuffer::kCapacity in one step
+  // Published by the sequencer for /api/metrics.
+  std::atomic<double> clock_period_ms_{0.0};
+  std::atomic<double> clock_rate_{1.0};
 };
 
 } // namespace khor
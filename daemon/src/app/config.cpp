@@ -8,7 +8,10 @@
 #include <fstream>
 #include <sstream>
 
+#include "engine/clock.h"
+#include "osc/osc.h"
 #include "util/paths.h"
+#include "util/rt.h"
 
 namespace khor {
 
@@ -30,6 +33,73 @@ static double clamp_double(double v, double lo, double hi) {
   return v;
 }
 
+static bool valid_session_name(const std::string& n) {
+  if (n.empty() || n.size() > 64) return false;
+  return std::all_of(n.begin(), n.end(), [](char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.' || c == '-';
+  });
+}
+
+JsonValue session_config_to_json(const SessionConfig& s) {
+  return JsonValue::make_object({
+    {"name", JsonValue::make_string(s.name)},
+    {"bpf", JsonValue::make_object({
+      {"enabled_mask", JsonValue::make_number((double)s.bpf_enabled_mask)},
+      {"tgid_allow", JsonValue::make_number((double)s.bpf_tgid_allow)},
+      {"tgid_deny", JsonValue::make_number((double)s.bpf_tgid_deny)},
+      {"cgroup_id", JsonValue::make_number((double)s.bpf_cgroup_id)},
+      {"cgroup", JsonValue::make_string(s.bpf_cgroup)},
+    })},
+    {"music", JsonValue::make_object({
+      {"bpm", JsonValue::make_number(s.bpm)},
+      {"key_midi", JsonValue::make_number(s.key_midi)},
+      {"scale", JsonValue::make_string(s.scale)},
+      {"preset", JsonValue::make_string(s.preset)},
+      {"density", JsonValue::make_number(s.density)},
+      {"smoothing", JsonValue::make_number(s.smoothing)},
+    })},
+    {"audio", JsonValue::make_bool(s.audio)},
+    {"osc", JsonValue::make_object({
+      {"host", JsonValue::make_string(s.osc_host)},
+      {"port", JsonValue::make_number(s.osc_port)},
+    })},
+  });
+}
+
+bool session_config_from_json(const JsonValue& root, SessionConfig* s, std::string* err) {
+  if (!s) return false;
+  if (!root.is_object()) {
+    if (err) *err = "session must be a JSON object";
+    return false;
+  }
+  s->name = json_get_string(root, "name", s->name);
+  if (!valid_session_name(s->name)) {
+    if (err) *err = "session name must be 1-64 characters of [A-Za-z0-9_.-]";
+    return false;
+  }
+  if (const JsonValue* b = obj_get_obj(root, "bpf")) {
+    s->bpf_enabled_mask = (uint32_t)json_get_number(*b, "enabled_mask", s->bpf_enabled_mask);
+    s->bpf_tgid_allow = (uint32_t)json_get_number(*b, "tgid_allow", s->bpf_tgid_allow);
+    s->bpf_tgid_deny = (uint32_t)json_get_number(*b, "tgid_deny", s->bpf_tgid_deny);
+    s->bpf_cgroup_id = (uint64_t)json_get_number(*b, "cgroup_id", (double)s->bpf_cgroup_id);
+    s->bpf_cgroup = json_get_string(*b, "cgroup", s->bpf_cgroup);
+  }
+  if (const JsonValue* m = obj_get_obj(root, "music")) {
+    s->bpm = clamp_double(json_get_number(*m, "bpm", s->bpm), 1.0, 400.0);
+    s->key_midi = clamp_int((int)json_get_number(*m, "key_midi", s->key_midi), 0, 127);
+    s->scale = json_get_string(*m, "scale", s->scale);
+    s->preset = json_get_string(*m, "preset", s->preset);
+    s->density = clamp_double(json_get_number(*m, "density", s->density), 0.0, 1.0);
+    s->smoothing = clamp_double(json_get_number(*m, "smoothing", s->smoothing), 0.0, 1.0);
+  }
+  s->audio = json_get_bool(root, "audio", s->audio);
+  if (const JsonValue* o = obj_get_obj(root, "osc")) {
+    s->osc_host = json_get_string(*o, "host", s->osc_host);
+    s->osc_port = clamp_int((int)json_get_number(*o, "port", s->osc_port), 0, 65535);
+  }
+  return true;
+}
+
 JsonValue config_to_json(const KhorConfig& cfg) {
   JsonValue root = JsonValue::make_object({});
 
@@ -50,7 +120,14 @@ JsonValue config_to_json(const KhorConfig& cfg) {
     {"audio", JsonValue::make_bool(cfg.enable_audio)},
     {"midi", JsonValue::make_bool(cfg.enable_midi)},
     {"osc", JsonValue::make_bool(cfg.enable_osc)},
+    {"osc_in", JsonValue::make_bool(cfg.enable_osc_in)},
     {"fake", JsonValue::make_bool(cfg.enable_fake)},
+    {"config_watch", JsonValue::make_bool(cfg.enable_config_watch)},
+    {"profile", JsonValue::make_bool(cfg.enable_profile)},
+    {"locks", JsonValue::make_bool(cfg.enable_locks)},
+    {"vfs", JsonValue::make_bool(cfg.enable_vfs)},
+    {"pmu", JsonValue::make_bool(cfg.enable_pmu)},
+    {"exec_events", JsonValue::make_bool(cfg.enable_exec_events)},
   });
 
   root.o["bpf"] = JsonValue::make_object({
@@ -59,6 +136,30 @@ JsonValue config_to_json(const KhorConfig& cfg) {
     {"tgid_allow", JsonValue::make_number((double)cfg.bpf_tgid_allow)},
     {"tgid_deny", JsonValue::make_number((double)cfg.bpf_tgid_deny)},
     {"cgroup_id", JsonValue::make_number((double)cfg.bpf_cgroup_id)},
+    {"cgroup", JsonValue::make_string(cfg.bpf_cgroup)},
+  });
+
+  root.o["profile"] = JsonValue::make_object({
+    {"hz", JsonValue::make_number((double)cfg.profile_hz)},
+    {"max_stacks", JsonValue::make_number((double)cfg.profile_max_stacks)},
+    {"top", JsonValue::make_number(cfg.profile_top)},
+  });
+
+  std::vector<JsonValue> triggers;
+  for (const auto& t : cfg.exec_triggers) {
+    triggers.push_back(JsonValue::make_object({
+      {"comm", JsonValue::make_string(t.comm)},
+      {"cgroup_id", JsonValue::make_number((double)t.cgroup_id)},
+      {"semitones", JsonValue::make_number(t.semitones)},
+      {"velocity", JsonValue::make_number(t.velocity)},
+      {"duration", JsonValue::make_number(t.duration)},
+      {"channel", JsonValue::make_number(t.channel)},
+    }));
+  }
+  root.o["exec_events"] = JsonValue::make_object({
+    {"rate", JsonValue::make_number((double)cfg.exec_events_rate)},
+    {"burst", JsonValue::make_number((double)cfg.exec_events_burst)},
+    {"triggers", JsonValue::make_array(std::move(triggers))},
   });
 
   root.o["music"] = JsonValue::make_object({
@@ -68,6 +169,8 @@ JsonValue config_to_json(const KhorConfig& cfg) {
     {"preset", JsonValue::make_string(cfg.preset)},
     {"density", JsonValue::make_number(cfg.density)},
     {"smoothing", JsonValue::make_number(cfg.smoothing)},
+    {"clock", JsonValue::make_string(cfg.music_clock)},
+    {"overrun", JsonValue::make_string(cfg.music_overrun)},
   });
 
   root.o["audio"] = JsonValue::make_object({
@@ -82,11 +185,34 @@ JsonValue config_to_json(const KhorConfig& cfg) {
     {"channel", JsonValue::make_number(cfg.midi_channel)},
   });
 
+  std::vector<JsonValue> osc_targets;
+  osc_targets.reserve(cfg.osc_targets.size());
+  for (const auto& t : cfg.osc_targets) osc_targets.push_back(JsonValue::make_string(t));
   root.o["osc"] = JsonValue::make_object({
     {"host", JsonValue::make_string(cfg.osc_host)},
     {"port", JsonValue::make_number(cfg.osc_port)},
+    {"targets", JsonValue::make_array(std::move(osc_targets))},
+    {"multicast_ttl", JsonValue::make_number(cfg.osc_multicast_ttl)},
+  });
+
+  root.o["osc_in"] = JsonValue::make_object({
+    {"host", JsonValue::make_string(cfg.osc_in_host)},
+    {"port", JsonValue::make_number(cfg.osc_in_port)},
   });
 
+  std::vector<JsonValue> rt_cpus;
+  for (int c : cfg.rt_cpus) rt_cpus.push_back(JsonValue::make_number(c));
+  root.o["rt"] = JsonValue::make_object({
+    {"policy", JsonValue::make_string(cfg.rt_policy)},
+    {"priority", JsonValue::make_number(cfg.rt_priority)},
+    {"cpus", JsonValue::make_array(std::move(rt_cpus))},
+    {"mlock", JsonValue::make_bool(cfg.rt_mlock)},
+  });
+
+  std::vector<JsonValue> sessions;
+  for (const auto& s : cfg.sessions) sessions.push_back(session_config_to_json(s));
+  root.o["sessions"] = JsonValue::make_array(std::move(sessions));
+
   return root;
 }
 
@@ -118,7 +244,14 @@ bool config_from_json(const JsonValue& root, KhorConfig* cfg, std::string* err)
     cfg->enable_audio = json_get_bool(*f, "audio", cfg->enable_audio);
     cfg->enable_midi = json_get_bool(*f, "midi", cfg->enable_midi);
     cfg->enable_osc = json_get_bool(*f, "osc", cfg->enable_osc);
+    cfg->enable_osc_in = json_get_bool(*f, "osc_in", cfg->enable_osc_in);
     cfg->enable_fake = json_get_bool(*f, "fake", cfg->enable_fake);
+    cfg->enable_config_watch = json_get_bool(*f, "config_watch", cfg->enable_config_watch);
+    cfg->enable_profile = json_get_bool(*f, "profile", cfg->enable_profile);
+    cfg->enable_locks = json_get_bool(*f, "locks", cfg->enable_locks);
+    cfg->enable_vfs = json_get_bool(*f, "vfs", cfg->enable_vfs);
+    cfg->enable_pmu = json_get_bool(*f, "pmu", cfg->enable_pmu);
+    cfg->enable_exec_events = json_get_bool(*f, "exec_events", cfg->enable_exec_events);
   }
 
   // bpf
@@ -130,6 +263,14 @@ bool config_from_json(const JsonValue& root, KhorConfig* cfg, std::string* err)
     cfg->bpf_tgid_allow = (uint32_t)json_get_number(*bpf, "tgid_allow", cfg->bpf_tgid_allow);
     cfg->bpf_tgid_deny = (uint32_t)json_get_number(*bpf, "tgid_deny", cfg->bpf_tgid_deny);
     cfg->bpf_cgroup_id = (uint64_t)json_get_number(*bpf, "cgroup_id", (double)cfg->bpf_cgroup_id);
+    cfg->bpf_cgroup = json_get_string(*bpf, "cgroup", cfg->bpf_cgroup);
+  }
+
+  // profile
+  if (const JsonValue* p = obj_get_obj(root, "profile")) {
+    cfg->profile_hz = (uint32_t)clamp_int((int)json_get_number(*p, "hz", cfg->profile_hz), 1, 1000);
+    cfg->profile_max_stacks = (uint32_t)clamp_int((int)json_get_number(*p, "max_stacks", cfg->profile_max_stacks), 64, 65536);
+    cfg->profile_top = clamp_int((int)json_get_number(*p, "top", cfg->profile_top), 1, 200);
   }
 
   // music
@@ -140,6 +281,19 @@ bool config_from_json(const JsonValue& root, KhorConfig* cfg, std::string* err)
     cfg->preset = json_get_string(*m, "preset", cfg->preset);
     cfg->density = clamp_double(json_get_number(*m, "density", cfg->density), 0.0, 1.0);
     cfg->smoothing = clamp_double(json_get_number(*m, "smoothing", cfg->smoothing), 0.0, 1.0);
+
+    const std::string clock = json_get_string(*m, "clock", cfg->music_clock);
+    if (clock != "monotonic" && clock != "audio_slaved" && clock != "audio") {
+      if (err) *err = "music.clock must be \"monotonic\", \"audio_slaved\" or \"audio\"";
+      return false;
+    }
+    cfg->music_clock = clock;
+    const std::string overrun = json_get_string(*m, "overrun", cfg->music_overrun);
+    if (!clock_overrun_parse(overrun, nullptr)) {
+      if (err) *err = "music.overrun must be \"skip\" or \"catch_up\"";
+      return false;
+    }
+    cfg->music_overrun = overrun;
   }
 
   // audio
@@ -160,6 +314,124 @@ bool config_from_json(const JsonValue& root, KhorConfig* cfg, std::string* err)
   if (const JsonValue* o = obj_get_obj(root, "osc")) {
     cfg->osc_host = json_get_string(*o, "host", cfg->osc_host);
     cfg->osc_port = clamp_int((int)json_get_number(*o, "port", cfg->osc_port), 1, 65535);
+    cfg->osc_multicast_ttl = clamp_int((int)json_get_number(*o, "multicast_ttl", cfg->osc_multicast_ttl), 0, 255);
+
+    if (const JsonValue* t = json_get(*o, "targets")) {
+      if (!t->is_array()) {
+        if (err) *err = "osc.targets must be an array of \"host:port\" strings";
+        return false;
+      }
+      if ((int)t->a.size() + 1 > OscClient::kMaxDests) {
+        if (err) *err = "osc.targets: too many destinations";
+        return false;
+      }
+      std::vector<std::string> targets;
+      for (const auto& v : t->a) {
+        OscDest d;
+        if (!v.is_string() || !osc_parse_dest(v.s, &d)) {
+          if (err) *err = "osc.targets entries must be \"host:port\" strings";
+          return false;
+        }
+        targets.push_back(v.s);
+      }
+      cfg->osc_targets = std::move(targets);
+    }
+  }
+
+  // osc_in
+  if (const JsonValue* o = obj_get_obj(root, "osc_in")) {
+    cfg->osc_in_host = json_get_string(*o, "host", cfg->osc_in_host);
+    cfg->osc_in_port = clamp_int((int)json_get_number(*o, "port", cfg->osc_in_port), 1, 65535);
+  }
+
+  // exec_events: the triggers array replaces the whole list
+  if (const JsonValue* x = obj_get_obj(root, "exec_events")) {
+    cfg->exec_events_rate = (uint32_t)clamp_int((int)json_get_number(*x, "rate", cfg->exec_events_rate), 1, 10000);
+    cfg->exec_events_burst = (uint32_t)clamp_int((int)json_get_number(*x, "burst", cfg->exec_events_burst), 1, 10000);
+    if (const JsonValue* ts = json_get(*x, "triggers")) {
+      if (!ts->is_array()) {
+        if (err) *err = "exec_events.triggers must be an array of trigger objects";
+        return false;
+      }
+      if (ts->a.size() > ExecTriggerTable::kMaxTriggers) {
+        if (err) *err = "exec_events.triggers: at most " + std::to_string(ExecTriggerTable::kMaxTriggers) + " triggers";
+        return false;
+      }
+      std::vector<ExecTrigger> triggers;
+      for (const auto& v : ts->a) {
+        const std::string comm = v.is_object() ? json_get_string(v, "comm", "") : "";
+        if (comm.empty() || comm.size() > 64) {
+          if (err) *err = "exec_events.triggers entries need a \"comm\" pattern (1..64 chars)";
+          return false;
+        }
+        ExecTrigger t;
+        t.comm = comm;
+        t.cgroup_id = (uint64_t)json_get_number(v, "cgroup_id", 0.0);
+        t.semitones = clamp_int((int)json_get_number(v, "semitones", t.semitones), -48, 48);
+        t.velocity = clamp_double(json_get_number(v, "velocity", t.velocity), 0.0, 1.0);
+        t.duration = clamp_double(json_get_number(v, "duration", t.duration), 0.01, 8.0);
+        t.channel = clamp_int((int)json_get_number(v, "channel", t.channel), 1, 16);
+        triggers.push_back(std::move(t));
+      }
+      cfg->exec_triggers = std::move(triggers);
+    }
+  }
+
+  // rt
+  if (const JsonValue* r = obj_get_obj(root, "rt")) {
+    const std::string policy = json_get_string(*r, "policy", cfg->rt_policy);
+    if (!rt_policy_parse(policy, nullptr)) {
+      if (err) *err = "rt.policy must be \"other\", \"fifo\" or \"rr\"";
+      return false;
+    }
+    cfg->rt_policy = policy;
+    cfg->rt_priority = clamp_int((int)json_get_number(*r, "priority", cfg->rt_priority), 1, 99);
+    cfg->rt_mlock = json_get_bool(*r, "mlock", cfg->rt_mlock);
+
+    if (const JsonValue* c = json_get(*r, "cpus")) {
+      if (!c->is_array()) {
+        if (err) *err = "rt.cpus must be an array of CPU numbers";
+        return false;
+      }
+      std::vector<int> cpus;
+      for (const auto& v : c->a) {
+        if (!v.is_number() || v.num < 0 || v.num >= 1024 || v.num != (double)(int)v.num) {
+          if (err) *err = "rt.cpus entries must be CPU numbers 0..1023";
+          return false;
+        }
+        cpus.push_back((int)v.num);
+      }
+      cfg->rt_cpus = std::move(cpus);
+    }
+  }
+
+  // sessions: the array replaces the whole list
+  if (const JsonValue* ss = json_get(root, "sessions")) {
+    if (!ss->is_array()) {
+      if (err) *err = "sessions must be an array of session objects";
+      return false;
+    }
+    if ((int)ss->a.size() > kMaxSessions) {
+      if (err) *err = "sessions: at most " + std::to_string(kMaxSessions) + " sessions";
+      return false;
+    }
+    std::vector<SessionConfig> sessions;
+    for (const auto& v : ss->a) {
+      SessionConfig sc;
+      std::string e;
+      if (!session_config_from_json(v, &sc, &e)) {
+        if (err) *err = "sessions: " + e;
+        return false;
+      }
+      for (const auto& other : sessions) {
+        if (other.name == sc.name) {
+          if (err) *err = "sessions: duplicate name \"" + sc.name + "\"";
+          return false;
+        }
+      }
+      sessions.push_back(std::move(sc));
+    }
+    cfg->sessions = std::move(sessions);
   }
 
   // Back-compat for very old flat keys (best-effort).
@@ -180,11 +452,13 @@ bool load_config_file(const std::string& path, KhorConfig* cfg, std::string* err
 
   std::ostringstream ss;
   ss << f.rdbuf();
-  std::string content = ss.str();
+  return config_from_text(ss.str(), cfg, err);
+}
 
+bool config_from_text(std::string_view text, KhorConfig* cfg, std::string* err) {
   JsonValue root;
   JsonParseError perr;
-  if (!json_parse(content, &root, &perr)) {
+  if (!json_parse(text, &root, &perr)) {
     if (err) {
       *err = "failed to parse config JSON: " + perr.message;
     }
@@ -194,13 +468,16 @@ bool load_config_file(const std::string& path, KhorConfig* cfg, std::string* err
   return config_from_json(root, cfg, err);
 }
 
+std::string config_to_text(const KhorConfig& cfg) {
+  return json_stringify(config_to_json(cfg), 2);
+}
+
 bool save_config_file(const std::string& path, const KhorConfig& cfg, std::string* err) {
   try {
     std::filesystem::path p(path);
     std::filesystem::create_directories(p.parent_path());
 
-    JsonValue root = config_to_json(cfg);
-    std::string out = json_stringify(root, 2);
+    std::string out = config_to_text(cfg);
 
     std::ofstream f(path, std::ios::trunc);
     if (!f.good()) {
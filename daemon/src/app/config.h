@@ -2,11 +2,48 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 
+#include "engine/exec_triggers.h"
 #include "util/json.h"
 
 namespace khor {
 
+// An extra sonification pipeline sharing the daemon's BPF object: own filter, signals,
+// music state and outputs. Audio and MIDI hardware stay with the main pipeline.
+struct SessionConfig {
+  std::string name; // [A-Za-z0-9_.-], unique
+
+  // BPF filter slot (same meaning as bpf.*; the sample interval is the daemon's)
+  uint32_t bpf_enabled_mask = 0xFFFFFFFFu;
+  uint32_t bpf_tgid_allow = 0;
+  uint32_t bpf_tgid_deny = 0;
+  uint64_t bpf_cgroup_id = 0;
+  std::string bpf_cgroup; // overrides bpf_cgroup_id when set
+
+  // Music
+  double bpm = 110.0;
+  int key_midi = 62;
+  std::string scale = "pentatonic_minor";
+  std::string preset = "ambient";
+  double density = 0.35;
+  double smoothing = 0.85;
+
+  // Outputs
+  bool audio = false;               // mix notes into the daemon's synth
+  std::string osc_host = "127.0.0.1";
+  int osc_port = 0;                 // 0 = no OSC
+
+  bool operator==(const SessionConfig&) const = default;
+};
+
+inline constexpr int kMaxSessions = 7; // BPF slots 1..7; slot 0 is the main pipeline
+
+JsonValue session_config_to_json(const SessionConfig& s);
+// Fields missing from root keep their current value in *s.
+bool session_config_from_json(const JsonValue& root, SessionConfig* s, std::string* err);
+
 struct KhorConfig {
   int version = 1;
 
@@ -20,7 +57,14 @@ struct KhorConfig {
   bool enable_audio = true;
   bool enable_midi = false;
   bool enable_osc = false;
+  bool enable_osc_in = false;
   bool enable_fake = false;
+  bool enable_config_watch = true; // reload the config file when it changes on disk
+  bool enable_profile = false;      // on-CPU stack sampling (needs BPF and CAP_PERFMON)
+  bool enable_locks = false;        // lock:contention_* probes (needs BPF, Linux 5.19+)
+  bool enable_exec_events = false;  // one ring buffer record per exec, for exec_events.triggers
+  bool enable_vfs = false;          // fentry/fexit on vfs_read/vfs_write/vfs_fsync_range (needs BPF, BTF)
+  bool enable_pmu = false;          // per-CPU hardware counters, page faults without a PMU (needs CAP_PERFMON)
 
   // eBPF
   uint32_t bpf_enabled_mask = 0xFFFFFFFFu;
@@ -28,6 +72,20 @@ struct KhorConfig {
   uint32_t bpf_tgid_allow = 0;
   uint32_t bpf_tgid_deny = 0;
   uint64_t bpf_cgroup_id = 0;
+  // Cgroup by name, resolved (and re-resolved as cgroups come and go) by the daemon:
+  // "nginx.service", "/system.slice/foo.scope", a container id prefix, or a decimal id.
+  // Overrides bpf_cgroup_id when set; a name that doesn't resolve matches nothing.
+  std::string bpf_cgroup;
+
+  // On-CPU profiler
+  uint32_t profile_hz = 49;           // samples/sec per CPU (off the timer tick, so it doesn't alias)
+  uint32_t profile_max_stacks = 2048; // distinct stacks kept between drains; changing it reloads BPF
+  int profile_top = 20;               // hot functions reported
+
+  // Exec events: token bucket per CPU in the kernel, then the first matching trigger plays
+  uint32_t exec_events_rate = 20;  // events/sec per CPU
+  uint32_t exec_events_burst = 20; // events a quiet CPU can send back to back
+  std::vector<ExecTrigger> exec_triggers; // at most ExecTriggerTable::kMaxTriggers
 
   // Music
   double bpm = 110.0;
@@ -36,6 +94,9 @@ struct KhorConfig {
   std::string preset = "ambient";
   double density = 0.35;   // 0..1
   double smoothing = 0.85; // 0..1
+  // "monotonic" | "audio_slaved" (step rate follows the audio device clock) | "audio" (steps run in the render callback)
+  std::string music_clock = "monotonic";
+  std::string music_overrun = "skip";    // "skip" | "catch_up" when a step deadline is missed
 
   // Audio
   std::string audio_backend; // "" | "pulseaudio" | "alsa" | "null"
@@ -50,10 +111,28 @@ struct KhorConfig {
   // OSC
   std::string osc_host = "127.0.0.1";
   int osc_port = 9000;
+  std::vector<std::string> osc_targets; // extra "host:port" destinations (unicast or multicast)
+  int osc_multicast_ttl = 1;
+
+  // OSC control input (UDP listener)
+  std::string osc_in_host = "127.0.0.1";
+  int osc_in_port = 9001;
+
+  // Real-time scheduling for the sequencer and audio threads
+  std::string rt_policy = "other"; // "other" | "fifo" | "rr"
+  int rt_priority = 10;            // 1..99
+  std::vector<int> rt_cpus;        // pin to these CPUs; empty = no pinning
+  bool rt_mlock = false;           // mlockall() at startup
+
+  // Extra pipelines (/api/sessions)
+  std::vector<SessionConfig> sessions;
 };
 
 JsonValue config_to_json(const KhorConfig& cfg);
 bool config_from_json(const JsonValue& root, KhorConfig* cfg, std::string* err);
+// The config file format: config_to_text() is exactly what save_config_file() writes.
+bool config_from_text(std::string_view text, KhorConfig* cfg, std::string* err);
+std::string config_to_text(const KhorConfig& cfg);
 
 bool load_config_file(const std::string& path, KhorConfig* cfg, std::string* err);
 bool save_config_file(const std::string& path, const KhorConfig& cfg, std::string* err);
@@ -0,0 +1,172 @@
+#include "app/session.h"
+
+#include <algorithm>
+
+#include <time.h>
+
+#include "audio/engine.h"
+#include "util/reactor.h"
+
+namespace khor {
+
+Session::Session(SessionConfig cfg, int slot) : cfg_(std::move(cfg)), slot_(slot) {}
+
+Session::~Session() { stop(); }
+
+bool Session::start(std::shared_ptr<const PresetLibrary> lib, Reactor* seq, AudioEngine* audio, std::string* err) {
+  if (!seq) {
+    if (err) *err = "session: no sequencer reactor";
+    return false;
+  }
+
+  MusicConfig mc;
+  mc.bpm = cfg_.bpm;
+  mc.key_midi = cfg_.key_midi;
+  mc.scale = cfg_.scale;
+  mc.preset = cfg_.preset;
+  mc.density = cfg_.density;
+  engine_.set_library(std::move(lib));
+  engine_.configure(mc);
+
+  if (cfg_.osc_port > 0) {
+    std::string e;
+    if (!osc_.start({OscDest{cfg_.osc_host, cfg_.osc_port}}, 1, &e)) osc_err_ = e.empty() ? "osc init failed" : e;
+  }
+  audio_ = cfg_.audio ? audio : nullptr;
+
+  clock_.reset(mono_now_ns(), cfg_.bpm);
+  timer_ = seq->add_timer([this](uint64_t) { tick(); });
+  if (timer_ < 0) {
+    if (err) *err = "session: timer setup failed";
+    osc_.stop();
+    return false;
+  }
+  seq_ = seq;
+  const int64_t at = clock_.next_deadline_ns();
+  (void)seq_->arm_at(timer_, at);
+  return true;
+}
+
+void Session::stop() {
+  if (seq_ && timer_ >= 0) seq_->remove_timer(timer_);
+  seq_ = nullptr;
+  timer_ = -1;
+  audio_ = nullptr;
+  osc_.stop();
+}
+
+void Session::sample(double dt_s, double mem_pressure_pct) {
+  Signals::Totals t;
+  t.exec_total = metrics_.exec_total.load(std::memory_order_relaxed);
+  t.net_rx_bytes_total = metrics_.net_rx_bytes_total.load(std::memory_order_relaxed);
+  t.net_tx_bytes_total = metrics_.net_tx_bytes_total.load(std::memory_order_relaxed);
+  t.sched_switch_total = metrics_.sched_switch_total.load(std::memory_order_relaxed);
+  t.blk_read_bytes_total = metrics_.blk_read_bytes_total.load(std::memory_order_relaxed);
+  t.blk_write_bytes_total = metrics_.blk_write_bytes_total.load(std::memory_order_relaxed);
+  t.tcp_retransmit_total = metrics_.tcp_retransmit_total.load(std::memory_order_relaxed);
+  t.irq_total = metrics_.irq_total.load(std::memory_order_relaxed);
+  t.offcpu_d_ns_total = metrics_.offcpu_d_ns_total.load(std::memory_order_relaxed);
+  t.offcpu_s_ns_total = metrics_.offcpu_s_ns_total.load(std::memory_order_relaxed);
+  t.lock_contended_total = metrics_.lock_contended_total.load(std::memory_order_relaxed);
+  t.lock_wait_ns_total = metrics_.lock_wait_ns_total.load(std::memory_order_relaxed);
+  t.skb_drop_total = metrics_.skb_drop_total.load(std::memory_order_relaxed);
+  t.exec_fail_total = metrics_.exec_fail_total.load(std::memory_order_relaxed);
+  t.proc_short_total = metrics_.proc_short_total.load(std::memory_order_relaxed);
+  t.vfs_read_bytes_total = metrics_.vfs_read_bytes_total.load(std::memory_order_relaxed);
+  t.vfs_write_bytes_total = metrics_.vfs_write_bytes_total.load(std::memory_order_relaxed);
+  t.vfs_ns_total = metrics_.vfs_ns_total.load(std::memory_order_relaxed);
+  t.fsync_total = metrics_.fsync_total.load(std::memory_order_relaxed);
+  t.fsync_ns_total = metrics_.fsync_ns_total.load(std::memory_order_relaxed);
+  t.rtt_samples_total = metrics_.rtt_samples_total.load(std::memory_order_relaxed);
+  t.rtt_us_total = metrics_.rtt_us_total.load(std::memory_order_relaxed);
+  t.listen_overflow_total = metrics_.listen_overflow_total.load(std::memory_order_relaxed);
+  t.syn_overflow_total = metrics_.syn_overflow_total.load(std::memory_order_relaxed);
+
+  std::scoped_lock lk(sig_mu_);
+  signals_.update(t, dt_s, std::clamp(cfg_.smoothing, 0.0, 1.0), mem_pressure_pct);
+  rates_ = signals_.rates();
+  v01_ = signals_.value01();
+  snap_.store(SignalSnapshot{.v01 = v01_, .rates = rates_});
+}
+
+void Session::tick() {
+  const int64_t now = mono_now_ns();
+  const uint32_t steps = clock_.advance(now);
+  const int64_t at = clock_.next_deadline_ns();
+  (void)seq_->arm_at(timer_, at);
+
+  for (uint32_t i = 0; i < steps; i++) {
+    // RT thread: never wait on a writer stalled mid-store; play the previous snapshot instead.
+    if (!snap_.try_load(&last_sig_)) stale_signals_.fetch_add(1, std::memory_order_relaxed);
+    const SignalSnapshot& sig = last_sig_;
+    const MusicFrame frame = engine_.tick(sig.v01, cfg_.density);
+    steps_.fetch_add(1, std::memory_order_relaxed);
+    notes_.fetch_add(frame.notes.size(), std::memory_order_relaxed);
+
+    for (const auto& n : frame.notes) {
+      if (audio_) audio_->submit_note(n);
+      if (osc_.is_running()) osc_.send_note(n);
+    }
+    if (osc_.is_running() && (osc_tick_++ & 3u) == 0u) osc_.send_signals(sig.v01);
+  }
+}
+
+JsonValue Session::status() const {
+  JsonValue v = session_config_to_json(cfg_);
+  v.o["slot"] = JsonValue::make_number(slot_);
+  v.o["running"] = JsonValue::make_bool(timer_ >= 0);
+  v.o["events"] = JsonValue::make_number((double)metrics_.events_total.load(std::memory_order_relaxed));
+  v.o["events_dropped"] = JsonValue::make_number((double)metrics_.events_dropped.load(std::memory_order_relaxed));
+  v.o["steps"] = JsonValue::make_number((double)steps_.load(std::memory_order_relaxed));
+  v.o["notes"] = JsonValue::make_number((double)notes_.load(std::memory_order_relaxed));
+  v.o["stale_signals"] = JsonValue::make_number((double)stale_signals_.load(std::memory_order_relaxed));
+  if (!osc_err_.empty()) v.o["osc_error"] = JsonValue::make_string(osc_err_);
+
+  SignalRates r;
+  Signal01 s;
+  {
+    std::scoped_lock lk(sig_mu_);
+    r = rates_;
+    s = v01_;
+  }
+  v.o["rates"] = JsonValue::make_object({
+    {"exec_s", JsonValue::make_number(r.exec_s)},
+    {"rx_kbs", JsonValue::make_number(r.rx_kbs)},
+    {"tx_kbs", JsonValue::make_number(r.tx_kbs)},
+    {"csw_s", JsonValue::make_number(r.csw_s)},
+    {"blk_r_kbs", JsonValue::make_number(r.blk_r_kbs)},
+    {"blk_w_kbs", JsonValue::make_number(r.blk_w_kbs)},
+    {"retx_s", JsonValue::make_number(r.retx_s)},
+    {"irq_s", JsonValue::make_number(r.irq_s)},
+    {"dwait_ms_s", JsonValue::make_number(r.dwait_ms_s)},
+    {"lock_wait_ms_s", JsonValue::make_number(r.lock_wait_ms_s)},
+    {"drop_s", JsonValue::make_number(r.drop_s)},
+    {"exec_fail_s", JsonValue::make_number(r.exec_fail_s)},
+    {"churn_s", JsonValue::make_number(r.churn_s)},
+    {"vfs_ms_s", JsonValue::make_number(r.vfs_ms_s)},
+    {"fsync_ms_s", JsonValue::make_number(r.fsync_ms_s)},
+    {"rtt_ms", JsonValue::make_number(r.rtt_ms)},
+    {"listen_s", JsonValue::make_number(r.listen_s)},
+    {"syn_s", JsonValue::make_number(r.syn_s)},
+  });
+  v.o["signals"] = JsonValue::make_object({
+    {"exec", JsonValue::make_number(s.exec)},
+    {"rx", JsonValue::make_number(s.rx)},
+    {"tx", JsonValue::make_number(s.tx)},
+    {"csw", JsonValue::make_number(s.csw)},
+    {"io", JsonValue::make_number(s.io)},
+    {"retx", JsonValue::make_number(s.retx)},
+    {"irq", JsonValue::make_number(s.irq)},
+    {"dstate", JsonValue::make_number(s.dstate)},
+    {"lock", JsonValue::make_number(s.lock)},
+    {"drop", JsonValue::make_number(s.drop)},
+    {"churn", JsonValue::make_number(s.churn)},
+    {"vfs", JsonValue::make_number(s.vfs)},
+    {"fsync", JsonValue::make_number(s.fsync)},
+    {"rtt", JsonValue::make_number(s.rtt)},
+    {"listen", JsonValue::make_number(s.listen)},
+  });
+  return v;
+}
+
+} // namespace khor
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "app/config.h"
+#include "engine/clock.h"
+#include "engine/music.h"
+#include "engine/signals.h"
+#include "khor/metrics.h"
+#include "osc/osc.h"
+#include "util/json.h"
+#include "util/seqlock.h"
+
+namespace khor {
+
+class AudioEngine;
+class Reactor;
+
+// One extra pipeline (/api/sessions). The BPF collector feeds metrics() from the
+// session's filter slot; the main sampler calls sample(); steps run on a timer on the
+// sequencer reactor, next to the main music clock, so notes for the shared synth come
+// from the same producer thread.
+class Session {
+ public:
+  Session(SessionConfig cfg, int slot);
+  ~Session();
+
+  Session(const Session&) = delete;
+  Session& operator=(const Session&) = delete;
+
+  const SessionConfig& config() const { return cfg_; }
+  int slot() const { return slot_; }
+  KhorMetrics* metrics() { return &metrics_; }
+
+  // audio may be null; notes go to it only if config().audio. Output errors are reported
+  // in status() but don't fail the session.
+  bool start(std::shared_ptr<const PresetLibrary> lib, Reactor* seq, AudioEngine* audio, std::string* err);
+  // Synchronous: no step runs after it returns.
+  void stop();
+
+  // Main reactor thread.
+  void sample(double dt_s, double mem_pressure_pct);
+
+  JsonValue status() const;
+
+ private:
+  void tick(); // sequencer thread
+
+  SessionConfig cfg_;
+  int slot_ = 0;
+  KhorMetrics metrics_{};
+
+  mutable std::mutex sig_mu_;
+  Signals signals_{};
+  SignalRates rates_{};
+  Signal01 v01_{};
+  SeqLock<SignalSnapshot> snap_{};
+
+  Reactor* seq_ = nullptr;
+  int timer_ = -1;
+  AudioEngine* audio_ = nullptr;
+  MusicEngine engine_{};
+  MusicClock clock_{};
+  OscClient osc_{};
+  std::string osc_err_;
+  uint32_t osc_tick_ = 0;
+  SignalSnapshot last_sig_{}; // sequencer thread: last consistent read of snap_
+
+  std::atomic<uint64_t> steps_{0};
+  std::atomic<uint64_t> notes_{0};
+  std::atomic<uint64_t> stale_signals_{0};
+};
+
+} // namespace khor
@@ -5,9 +5,14 @@
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <chrono>
 #include <cstring>
 #include <numbers>
+#include <memory>
 #include <optional>
+#include <thread>
+
+#include <time.h>
 
 #include "miniaudio.h"
 
@@ -231,12 +236,32 @@ struct Reverb {
 } // namespace
 
 struct AudioEngine::Impl {
+  // One opened playback device. During a switch two exist; only the one in `owner`
+  // renders the synth, the other plays silence. Handing over the pointer hands over
+  // voices, FX tails and queues without copying anything.
+  struct Output {
+    Impl* impl = nullptr;
+    ma_device device{};
+    ma_device_id id{};
+    RtConfig rt{};
+    // Callback thread.
+    bool rt_pending = true;
+    bool owned = false;
+    // Written once by the callback thread, then published via rt_ready.
+    RtThreadStatus rt_status{};
+    std::atomic<bool> rt_ready{false};
+    uint32_t fade_in_left = 0;
+  };
+
+  static constexpr float kFadeS = 0.010f;
+
   ma_context ctx{};
   bool ctx_inited = false;
-  ma_device device{};
+  std::unique_ptr<Output> out;
+  uint32_t device_sr = 48000; // fixed while a context is open; a rate change reopens everything
   std::atomic<bool> device_inited{false};
-  ma_device_id chosen_playback_id{};
-  bool has_chosen_playback_id = false;
+  std::atomic<Output*> owner{nullptr};
+  std::atomic<Output*> handover_to{nullptr};
 
   ma_backend backends[3]{};
   ma_uint32 backend_count = 0;
@@ -246,6 +271,7 @@ struct AudioEngine::Impl {
   std::string device_name;
 
   SpscQueue<NoteEvent, 1024> q{};
+  SpscQueue<NoteEvent, 256> live_q{};
   std::atomic<uint64_t> q_drops{0};
 
   static constexpr int kMaxVoices = 24;
@@ -262,6 +288,29 @@ struct AudioEngine::Impl {
 
   float limiter_gain = 1.0f;
 
+
+  // Sample-clocked sequencer (music.clock = "audio"); owned by the caller of set_step_source().
+  std::atomic<StepSource*> step_src{nullptr};
+  uint32_t frames_to_step = 0; // callback thread
+
+  // Device clock, published by the callback under a seqlock (odd = write in progress).
+  uint64_t frames_total = 0;
+  std::atomic<uint32_t> clk_seq{0};
+  std::atomic<uint64_t> clk_frames{0};
+  std::atomic<int64_t> clk_ns{0};
+
+  void publish_clock(ma_uint32 frames) {
+    frames_total += frames;
+    timespec ts{};
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    const uint32_t seq = clk_seq.load(std::memory_order_relaxed);
+    clk_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    clk_frames.store(frames_total, std::memory_order_relaxed);
+    clk_ns.store((int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec, std::memory_order_relaxed);
+    clk_seq.store(seq + 2, std::memory_order_release);
+  }
+
   bool init_context(std::string* err) {
     if (ctx_inited) return true;
     ma_result r = ma_context_init(backends, backend_count, nullptr, &ctx);
@@ -280,48 +329,120 @@ struct AudioEngine::Impl {
 
   static void data_cb(ma_device* device, void* out, const void* in, ma_uint32 frames) {
     (void)in;
-    auto* self = (Impl*)device->pUserData;
-    if (!self) return;
-    self->render((float*)out, frames);
+    auto* o = (Output*)device->pUserData;
+    if (!o || !o->impl) return;
+    Impl* self = o->impl;
+    float* buf = (float*)out;
+    if (o->rt_pending) {
+      // The backend owns this thread, so its scheduling can only be set from inside the callback.
+      o->rt_pending = false;
+      o->rt_status = rt_apply_current_thread(o->rt);
+      rt_prefault_stack(64 * 1024);
+      o->rt_ready.store(true, std::memory_order_release);
+    }
+
+    if (self->owner.load(std::memory_order_acquire) != o) {
+      std::fill(buf, buf + frames * 2, 0.0f);
+      o->owned = false;
+      return;
+    }
+    if (!o->owned) {
+      o->owned = true;
+      o->fade_in_left = (uint32_t)(kFadeS * (float)self->device_sr);
+    }
+
+    self->render(buf, frames);
+    self->publish_clock(frames);
+
+    if (o->fade_in_left > 0) {
+      const float total = kFadeS * (float)self->device_sr;
+      for (ma_uint32 i = 0; i < frames && o->fade_in_left > 0; i++, o->fade_in_left--) {
+        const float g = 1.0f - (float)o->fade_in_left / total;
+        buf[i * 2 + 0] *= g;
+        buf[i * 2 + 1] *= g;
+      }
+    }
+
+    if (Output* next = self->handover_to.load(std::memory_order_acquire); next && next != o) {
+      // Last buffer on this device: fade it out, then the next callback of `next` picks the synth up.
+      for (ma_uint32 i = 0; i < frames; i++) {
+        const float g = 1.0f - (float)(i + 1) / (float)frames;
+        buf[i * 2 + 0] *= g;
+        buf[i * 2 + 1] *= g;
+      }
+      self->handover_to.store(nullptr, std::memory_order_relaxed);
+      self->owner.store(next, std::memory_order_release);
+    }
+  }
+
+  void start_voice(NoteEvent ev, uint32_t sr) {
+    ev.midi = std::clamp(ev.midi, 0, 127);
+    ev.velocity = std::clamp(ev.velocity, 0.0f, 1.0f);
+    ev.dur_s = std::max(0.01f, ev.dur_s);
+
+    // Find a free voice; otherwise steal the quietest.
+    Voice* slot = nullptr;
+    for (auto& v : voices) {
+      if (!v.active) { slot = &v; break; }
+    }
+    if (!slot) {
+      slot = &voices[0];
+      float best = 1e9f;
+      for (auto& v : voices) {
+        float score = v.env.value;
+        if (score < best) { best = score; slot = &v; }
+      }
+    }
+
+    const float hz = dsp::midi_to_hz(ev.midi);
+    slot->active = true;
+    slot->midi = ev.midi;
+    slot->phase = 0.0f;
+    slot->phase_inc = 2.0f * (float)std::numbers::pi * hz / (float)sr;
+    slot->velocity = ev.velocity;
+    slot->samples_until_release = (int)(ev.dur_s * (float)sr);
+    slot->env.note_on((float)sr);
+    slot->filter = dsp::Svf{};
   }
 
   void render(float* out, ma_uint32 frames) {
     // Interleaved stereo f32.
-    const uint32_t sr = (uint32_t)cfg.sample_rate;
+    const uint32_t sr = device_sr;
     std::fill(out, out + frames * 2, 0.0f);
 
-    // Drain note queue (SPSC, no locks).
+    // Drain note queues (SPSC, no locks).
     NoteEvent ev;
-    while (q.pop(&ev)) {
-      ev.midi = std::clamp(ev.midi, 0, 127);
-      ev.velocity = std::clamp(ev.velocity, 0.0f, 1.0f);
-      ev.dur_s = std::max(0.01f, ev.dur_s);
+    while (q.pop(&ev)) start_voice(ev, sr);
+    while (live_q.pop(&ev)) start_voice(ev, sr);
+
+    StepSource* src = step_src.load(std::memory_order_acquire);
+    if (!src) {
+      frames_to_step = 0; // re-attaching starts on a step
+      render_span(out, frames, sr);
+      return;
+    }
 
-      // Find a free voice; otherwise steal the quietest.
-      Voice* slot = nullptr;
-      for (auto& v : voices) {
-        if (!v.active) { slot = &v; break; }
-      }
-      if (!slot) {
-        slot = &voices[0];
-        float best = 1e9f;
-        for (auto& v : voices) {
-          float score = v.env.value;
-          if (score < best) { best = score; slot = &v; }
-        }
+    // Sample-clocked sequencing: split the buffer at step boundaries.
+    ma_uint32 done = 0;
+    while (done < frames) {
+      if (frames_to_step == 0) {
+        MusicFrame f;
+        src->step(&f);
+        cutoff01.store(f.synth.cutoff01, std::memory_order_relaxed);
+        resonance01.store(f.synth.resonance01, std::memory_order_relaxed);
+        delay_mix01.store(f.synth.delay_mix01, std::memory_order_relaxed);
+        reverb_mix01.store(f.synth.reverb_mix01, std::memory_order_relaxed);
+        for (const auto& n : f.notes) start_voice(n, sr);
+        frames_to_step = src->frames_until_step(sr);
       }
-
-      const float hz = dsp::midi_to_hz(ev.midi);
-      slot->active = true;
-      slot->midi = ev.midi;
-      slot->phase = 0.0f;
-      slot->phase_inc = 2.0f * (float)std::numbers::pi * hz / (float)sr;
-      slot->velocity = ev.velocity;
-      slot->samples_until_release = (int)(ev.dur_s * (float)sr);
-      slot->env.note_on((float)sr);
-      slot->filter = dsp::Svf{};
+      const ma_uint32 n = std::min<ma_uint32>(frames - done, frames_to_step);
+      render_span(out + (std::size_t)done * 2, n, sr);
+      frames_to_step -= n;
+      done += n;
     }
+  }
 
+  void render_span(float* out, ma_uint32 frames, uint32_t sr) {
     const float cutoff = std::clamp(cutoff01.load(std::memory_order_relaxed), 0.0f, 1.0f);
     const float res = std::clamp(resonance01.load(std::memory_order_relaxed), 0.0f, 1.0f);
 
@@ -458,46 +579,94 @@ struct AudioEngine::Impl {
     return false;
   }
 
-  bool start_device(std::string* err) {
+  // Opens and starts a device on the existing context. The new output renders silence until it owns the synth.
+  std::unique_ptr<Output> open_output(const AudioConfig& want, std::string* name, std::string* err) {
+    auto o = std::make_unique<Output>();
+    o->impl = this;
+    o->rt = want.rt;
+
     ma_device_config dc = ma_device_config_init(ma_device_type_playback);
     dc.playback.format = ma_format_f32;
     dc.playback.channels = 2;
-    dc.sampleRate = (ma_uint32)cfg.sample_rate;
+    dc.sampleRate = (ma_uint32)want.sample_rate;
     dc.dataCallback = &Impl::data_cb;
-    dc.pUserData = this;
+    dc.pUserData = o.get();
 
     std::string picked_name;
-    has_chosen_playback_id = false;
-    if (pick_device_id(cfg, &ctx, &chosen_playback_id, &picked_name)) {
-      has_chosen_playback_id = true;
-      dc.playback.pDeviceID = &chosen_playback_id;
-      device_name = picked_name;
+    if (pick_device_id(want, &ctx, &o->id, &picked_name)) {
+      dc.playback.pDeviceID = &o->id;
+      *name = picked_name;
     } else {
-      device_name = "default";
+      *name = "default";
     }
 
-    if (ma_device_init(&ctx, &dc, &device) != MA_SUCCESS) {
+    if (ma_device_init(&ctx, &dc, &o->device) != MA_SUCCESS) {
       if (err) *err = "ma_device_init failed (audio device unavailable?)";
-      return false;
+      return nullptr;
     }
-    device_inited.store(true, std::memory_order_release);
+    if (ma_device_start(&o->device) != MA_SUCCESS) {
+      ma_device_uninit(&o->device);
+      if (err) *err = "ma_device_start failed";
+      return nullptr;
+    }
+    return o;
+  }
+
+  bool start_device(std::string* err) {
+    device_sr = (uint32_t)cfg.sample_rate;
+    frames_total = 0;
+    frames_to_step = 0;
+    clk_seq.store(0, std::memory_order_release);
 
     delay.init((uint32_t)cfg.sample_rate, 0.26f, 0.28f);
     reverb.init((uint32_t)cfg.sample_rate);
 
-    if (ma_device_start(&device) != MA_SUCCESS) {
-      if (err) *err = "ma_device_start failed";
-      return false;
-    }
+    std::string name;
+    out = open_output(cfg, &name, err);
+    if (!out) return false;
+    device_name = name;
+    owner.store(out.get(), std::memory_order_release);
+    device_inited.store(true, std::memory_order_release);
 
-    backend_name = device.pContext ? ma_get_backend_name(device.pContext->backend) : "unknown";
+    backend_name = ma_get_backend_name(ctx.backend);
     std::fprintf(stderr, "khor-audio: backend=%s device=%s sr=%d\n",
       backend_name.c_str(), device_name.c_str(), cfg.sample_rate);
     return true;
   }
 
+  // Moves playback to the device in `want` while the current one keeps playing:
+  // open the new device, let the old callback fade out and pass the synth over, then close the old one.
+  bool switch_device(const AudioConfig& want, std::string* err) {
+    using clock = std::chrono::steady_clock;
+    const auto t0 = clock::now();
+
+    std::string name;
+    std::unique_ptr<Output> next = open_output(want, &name, err);
+    if (!next) return false; // old device keeps playing
+
+    handover_to.store(next.get(), std::memory_order_release);
+    const auto deadline = t0 + std::chrono::milliseconds(500);
+    while (owner.load(std::memory_order_acquire) != next.get() && clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // Uninit joins the old callback, so forcing the handover afterwards is safe if it stalled.
+    ma_device_uninit(&out->device);
+    handover_to.store(nullptr, std::memory_order_relaxed);
+    owner.store(next.get(), std::memory_order_release);
+
+    out = std::move(next);
+    const std::string prev_name = device_name;
+    device_name = name;
+    std::fprintf(stderr, "khor-audio: switched %s -> %s in %.1f ms\n", prev_name.c_str(), device_name.c_str(),
+      std::chrono::duration<double, std::milli>(clock::now() - t0).count());
+    return true;
+  }
+
   void stop_device() {
-    if (device_inited.load(std::memory_order_acquire)) ma_device_uninit(&device);
+    if (out) ma_device_uninit(&out->device);
+    out.reset();
+    owner.store(nullptr, std::memory_order_release);
+    handover_to.store(nullptr, std::memory_order_relaxed);
     device_inited.store(false, std::memory_order_release);
     backend_name.clear();
     device_name.clear();
@@ -544,6 +713,17 @@ void AudioEngine::stop() {
 }
 
 bool AudioEngine::restart(const AudioConfig& cfg, std::string* err) {
+  if (!impl_) return false;
+  // Same backend and rate: the context and synth state stay, only the device changes. The switch
+  // opens the new device before closing the old one, which an exclusive (ALSA hw) device refuses,
+  // so an unchanged device (an rt-only change) or a failed open goes through stop() + start().
+  if (impl_->device_inited.load(std::memory_order_acquire) && impl_->ctx_inited &&
+      cfg.backend == impl_->cfg.backend && cfg.sample_rate == impl_->cfg.sample_rate &&
+      cfg.device != impl_->cfg.device && impl_->switch_device(cfg, nullptr)) {
+    impl_->cfg = cfg;
+    impl_->master_gain.store(cfg.master_gain, std::memory_order_relaxed);
+    return true;
+  }
   stop();
   return start(cfg, err);
 }
@@ -553,6 +733,36 @@ bool AudioEngine::is_running() const { return impl_ && impl_->device_inited.load
 std::string AudioEngine::backend_name() const { return impl_ ? impl_->backend_name : ""; }
 std::string AudioEngine::device_name() const { return impl_ ? impl_->device_name : ""; }
 
+bool AudioEngine::rt_status(RtThreadStatus* out) const {
+  if (!impl_ || !impl_->device_inited.load(std::memory_order_acquire)) return false;
+  const Impl::Output* o = impl_->out.get();
+  if (!o || !o->rt_ready.load(std::memory_order_acquire)) return false;
+  if (out) *out = o->rt_status;
+  return true;
+}
+
+void AudioEngine::set_step_source(StepSource* src) {
+  if (impl_) impl_->step_src.store(src, std::memory_order_release);
+}
+
+bool AudioEngine::clock_sample(uint64_t* frames, int64_t* mono_ns, uint32_t* sample_rate) const {
+  if (!impl_ || !impl_->device_inited.load(std::memory_order_acquire)) return false;
+  for (int attempt = 0; attempt < 8; attempt++) {
+    const uint32_t s0 = impl_->clk_seq.load(std::memory_order_acquire);
+    if (s0 == 0) return false;
+    if (s0 & 1u) continue;
+    const uint64_t f = impl_->clk_frames.load(std::memory_order_relaxed);
+    const int64_t ns = impl_->clk_ns.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (impl_->clk_seq.load(std::memory_order_relaxed) != s0) continue;
+    if (frames) *frames = f;
+    if (mono_ns) *mono_ns = ns;
+    if (sample_rate) *sample_rate = impl_->device_sr;
+    return true;
+  }
+  return false;
+}
+
 void AudioEngine::submit_note(const NoteEvent& ev) {
   if (!impl_ || !impl_->device_inited.load(std::memory_order_acquire)) return;
   if (!impl_->q.push(ev)) {
@@ -560,6 +770,13 @@ void AudioEngine::submit_note(const NoteEvent& ev) {
   }
 }
 
+void AudioEngine::submit_live_note(const NoteEvent& ev) {
+  if (!impl_ || !impl_->device_inited.load(std::memory_order_acquire)) return;
+  if (!impl_->live_q.push(ev)) {
+    impl_->q_drops.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
 void AudioEngine::set_master_gain(float gain) {
   if (!impl_) return;
   impl_->master_gain.store(gain, std::memory_order_relaxed);
@@ -6,6 +6,8 @@
 #include <vector>
 
 #include "engine/note_event.h"
+#include "engine/step_source.h"
+#include "util/rt.h"
 
 namespace khor {
 
@@ -20,6 +22,7 @@ struct AudioConfig {
   std::string device;      // "" (default) | substring match | "id:<hex>"
   int sample_rate = 48000; // Hz
   float master_gain = 0.25f;
+  RtConfig rt{}; // applied to the device's callback thread on its first buffer
 };
 
 struct AudioStatus {
@@ -46,8 +49,23 @@ class AudioEngine {
 
   std::string backend_name() const;
   std::string device_name() const;
-
+  // Scheduling the callback thread obtained; false until the first buffer was rendered.
+  // Caller's lock: it reads the current output, which start/stop/restart free.
+  bool rt_status(RtThreadStatus* out) const;
+  // Frames rendered so far and the CLOCK_MONOTONIC time the last buffer was handed over,
+  // read consistently. False until the first buffer. For slaving the music clock to the device.
+  bool clock_sample(uint64_t* frames, int64_t* mono_ns, uint32_t* sample_rate) const;
+
+  // Sequencer notes (single producer: the music thread).
   void submit_note(const NoteEvent& ev);
+  // Notes played live from control input; a separate SPSC lane so the music
+  // thread stays the only producer on the sequencer queue. Single producer too:
+  // callers on more than one thread must funnel through one (App uses its reactor).
+  void submit_live_note(const NoteEvent& ev);
+
+  // Runs src inside the render callback (sample-exact steps; its synth params override set_filter/set_fx).
+  // nullptr detaches. src must stay alive while attached or until the device is stopped.
+  void set_step_source(StepSource* src);
 
   // Real-time safe (atomic).
   void set_master_gain(float gain);
@@ -1,38 +1,110 @@
 #include "bpf/collector.h"
 
+#include <algorithm>
+#include <array>
+#include <cctype>
 #include <cerrno>
 #include <cstdarg>
+#include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <thread>
 
 #include "../bpf/khor.h"
+#include "util/reactor.h"
 
 #if defined(KHOR_HAS_BPF)
 #include "khor.skel.h"
 #include <bpf/bpf.h>
+#include <bpf/btf.h>
 #include <bpf/libbpf.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #endif
 
 namespace khor {
 
+static_assert(BpfCollector::kMaxSessions == KHOR_MAX_SESSIONS, "session slots must match bpf/khor.h");
+static_assert(OffCpuHistogram::kBuckets == KHOR_OFFCPU_BUCKETS, "off-CPU buckets must match bpf/khor.h");
+static_assert(LifetimeHistogram::kBuckets == KHOR_LIFETIME_BUCKETS, "lifetime buckets must match bpf/khor.h");
+static_assert(LockTypeStat::kBuckets == KHOR_LOCK_BUCKETS, "lock buckets must match bpf/khor.h");
+static_assert(VfsOpStat::kBuckets == KHOR_VFS_BUCKETS, "VFS buckets must match bpf/khor.h");
+static_assert(HllWindow::kRegisters == KHOR_HLL_REGS, "HLL registers must match bpf/khor.h");
+static_assert(CmsWindow::kRows == KHOR_CMS_ROWS && CmsWindow::kWidth == KHOR_CMS_WIDTH,
+              "count-min layout must match bpf/khor.h");
+static_assert(SketchWindow::kRttBuckets == KHOR_RTT_BUCKETS, "RTT buckets must match bpf/khor.h");
+static_assert(sizeof(khor_hll) % 8 == 0, "per-CPU values are copied at 8-byte strides");
+
+static constexpr const char* kLockTypeNames[KHOR_LOCK_TYPES] = {
+  "spinlock", "rwlock", "mutex", "rwsem", "rtmutex", "percpu-rwsem", "other",
+};
+
+static constexpr const char* kVfsOpNames[KHOR_VFS_OPS] = {"read", "write", "fsync"};
+
 struct BpfCollector::Impl {
   std::atomic<bool> running{false};
   std::atomic<bool> ok{false};
   std::atomic<int> err_code{0};
   std::string err;
 
-  KhorMetrics* metrics = nullptr;
+  // Userspace copy of the khor_cfg value; the whole table is rewritten on every change.
+  khor_bpf_sessions table{};
+  // Where each slot's samples go; read by the reactor thread.
+  std::array<std::atomic<KhorMetrics*>, KHOR_MAX_SESSIONS> sinks{};
+  std::atomic<ExecEventQueue*> exec_q{nullptr};
+  std::atomic<uint64_t> exec_q_full{0};
+
+  bool write_table(std::string* err);
+
+  // Profiler state; changed under the caller's lock, counters readable from anywhere.
+  uint32_t prof_hz = 0;
+  uint32_t prof_capacity = 0;
+  std::string prof_err;
+  std::atomic<uint64_t> prof_samples{0};
+  std::atomic<uint64_t> prof_dropped{0};
+  std::atomic<uint64_t> prof_stack_errors{0};
+
+  bool locks = false;   // lock probes attached
+  std::string lock_err; // why not, when asked for
+
+  bool vfs = false;    // VFS fentry/fexit probes attached
+  std::string vfs_err; // why not
+
+  // enum skb_drop_reason names by value, read from vmlinux BTF on first use.
+  std::vector<std::string> drop_names;
 
 #if defined(KHOR_HAS_BPF)
   ring_buffer* rb = nullptr;
   khor_bpf* skel = nullptr;
   int cfg_map_fd = -1;
-  std::thread poller;
+  Reactor* reactor = nullptr;
+  int rb_fd = -1;
+  std::vector<bpf_link*> prof_links;
+  std::vector<bpf_link*> vfs_links;
+  bpf_link* tcp6_link = nullptr; // IPv6 accept-queue probe, when ipv6 is there to probe
+  // take_window()'s per-CPU copies, sized on the first window and reused after.
+  std::vector<khor_hll> win_hll;
+  std::vector<khor_cms> win_cms;
+  std::vector<khor_rtt_hist> win_rtt;
+
+  bool open_profile(uint32_t hz, std::string* err);
+  void close_profile();
+  bool attach_vfs(std::string* err);
+  void detach_vfs();
 #endif
 };
 
+static khor_bpf_config to_bpf_config(const BpfConfig& cfg) {
+  khor_bpf_config bcfg{};
+  bcfg.enabled_mask = cfg.enabled_mask == 0xFFFFFFFFu ? 0u : cfg.enabled_mask;
+  bcfg.sample_interval_ms = cfg.sample_interval_ms;
+  bcfg.tgid_allow = cfg.tgid_allow;
+  bcfg.tgid_deny = cfg.tgid_deny;
+  bcfg.cgroup_id = cfg.cgroup_id;
+  return bcfg;
+}
+
 static std::string errno_string(int err) {
   if (err == 0) return "OK";
   int e = err < 0 ? -err : err;
@@ -43,6 +115,105 @@ static std::string errno_string(int err) {
   return std::string(buf);
 }
 
+bool BpfCollector::Impl::write_table(std::string* e) {
+  // Only scan up to the highest live slot.
+  table.count = 0;
+  for (uint32_t i = 0; i < KHOR_MAX_SESSIONS; i++) {
+    if (table.active & (1u << i)) table.count = i + 1;
+  }
+#if !defined(KHOR_HAS_BPF)
+  (void)e;
+  return true;
+#else
+  if (!skel || cfg_map_fd < 0) return true; // written on start()
+  uint32_t k = 0;
+  if (bpf_map_update_elem(cfg_map_fd, &k, &table, BPF_ANY) != 0) {
+    if (e) *e = "failed to update BPF config map: " + errno_string(errno);
+    return false;
+  }
+  return true;
+#endif
+}
+
+#if defined(KHOR_HAS_BPF)
+bool BpfCollector::Impl::open_profile(uint32_t hz, std::string* e) {
+  close_profile();
+  prof_err.clear();
+  if (hz == 0) return true;
+  if (!skel || prof_capacity == 0) {
+    prof_err = "profiler maps not allocated (restart BPF with the profiler enabled)";
+    if (e) *e = prof_err;
+    return false;
+  }
+
+  perf_event_attr attr{};
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_SOFTWARE;
+  attr.config = PERF_COUNT_SW_CPU_CLOCK;
+  attr.freq = 1;
+  attr.sample_freq = hz;
+
+  const int ncpu = libbpf_num_possible_cpus();
+  int last_errno = 0;
+  for (int cpu = 0; cpu < ncpu; cpu++) {
+    const int fd = (int)::syscall(__NR_perf_event_open, &attr, -1, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0) {
+      if (errno != ENODEV) last_errno = errno; // ENODEV: offline CPU
+      continue;
+    }
+    // The link owns fd from here on.
+    bpf_link* link = bpf_program__attach_perf_event(skel->progs.khor_cpu_sample, fd);
+    if (!link) {
+      last_errno = errno;
+      ::close(fd);
+      continue;
+    }
+    prof_links.push_back(link);
+  }
+  if (prof_links.empty()) {
+    prof_err = "perf_event_open failed: " + errno_string(last_errno ? last_errno : ENODEV) + " (need CAP_PERFMON)";
+    if (e) *e = prof_err;
+    return false;
+  }
+  prof_hz = hz;
+  return true;
+}
+
+void BpfCollector::Impl::close_profile() {
+  for (bpf_link* l : prof_links) bpf_link__destroy(l);
+  prof_links.clear();
+  prof_hz = 0;
+}
+
+static std::array<bpf_program*, 6> vfs_programs(khor_bpf* s) {
+  return {s->progs.fentry_vfs_read,  s->progs.fexit_vfs_read,  s->progs.fentry_vfs_write,
+          s->progs.fexit_vfs_write, s->progs.fentry_vfs_fsync_range, s->progs.fexit_vfs_fsync_range};
+}
+
+// All or nothing: an fentry without its fexit would only leave stamps behind.
+bool BpfCollector::Impl::attach_vfs(std::string* e) {
+  detach_vfs();
+  for (bpf_program* p : vfs_programs(skel)) {
+    bpf_link* link = bpf_program__attach(p);
+    if (!link) {
+      const int attach_errno = errno;
+      detach_vfs();
+      if (e) *e = "fentry/fexit attach failed: " + errno_string(attach_errno) + " (needs BPF trampolines)";
+      return false;
+    }
+    vfs_links.push_back(link);
+  }
+  vfs = true;
+  return true;
+}
+
+void BpfCollector::Impl::detach_vfs() {
+  for (bpf_link* l : vfs_links) bpf_link__destroy(l);
+  vfs_links.clear();
+  vfs = false;
+}
+#endif
+
 BpfCollector::BpfCollector() : impl_(new Impl()) {}
 BpfCollector::~BpfCollector() { stop(); delete impl_; impl_ = nullptr; }
 
@@ -69,29 +240,511 @@ bool BpfCollector::apply_config(const BpfConfig& cfg, std::string* err) {
     if (err) *err = "BPF not running";
     return false;
   }
+  impl_->table.s[0] = to_bpf_config(cfg);
+  impl_->table.active |= 1u;
+  impl_->table.exec_rate = cfg.exec_event_rate;
+  impl_->table.exec_burst = cfg.exec_event_burst;
+  if (!impl_->write_table(err)) return false;
+  if (cfg.profile_hz != impl_->prof_hz) return impl_->open_profile(cfg.profile_hz, err);
+  return true;
+#endif
+}
 
-  khor_bpf_config bcfg{};
-  bcfg.enabled_mask = cfg.enabled_mask == 0xFFFFFFFFu ? 0u : cfg.enabled_mask;
-  bcfg.sample_interval_ms = cfg.sample_interval_ms;
-  bcfg.tgid_allow = cfg.tgid_allow;
-  bcfg.tgid_deny = cfg.tgid_deny;
-  bcfg.cgroup_id = cfg.cgroup_id;
+bool BpfCollector::set_session(int slot, const BpfConfig& cfg, KhorMetrics* metrics, std::string* err) {
+  if (!impl_) return false;
+  if (slot < 1 || slot >= KHOR_MAX_SESSIONS || !metrics) {
+    if (err) *err = "invalid session slot";
+    return false;
+  }
+  impl_->sinks[(std::size_t)slot].store(metrics, std::memory_order_release);
+  impl_->table.s[slot] = to_bpf_config(cfg);
+  impl_->table.active |= 1u << slot;
+  return impl_->write_table(err);
+}
 
-  uint32_t k = 0;
-  int rc = bpf_map_update_elem(impl_->cfg_map_fd, &k, &bcfg, BPF_ANY);
-  if (rc != 0) {
-    if (err) *err = "failed to update BPF config map: " + errno_string(errno);
+void BpfCollector::clear_session(int slot) {
+  if (!impl_ || slot < 1 || slot >= KHOR_MAX_SESSIONS) return;
+  impl_->table.active &= ~(1u << slot);
+  impl_->table.s[slot] = khor_bpf_config{};
+  (void)impl_->write_table(nullptr);
+  impl_->sinks[(std::size_t)slot].store(nullptr, std::memory_order_release);
+#if defined(KHOR_HAS_BPF)
+  // Samples already in the ring are dropped; wait out a delivery that may hold the old pointer.
+  if (impl_->reactor) impl_->reactor->call([] {});
+#endif
+}
+
+bool BpfCollector::drain_profile(std::vector<ProfileStack>* out, std::size_t max, std::string* err) {
+  if (!impl_ || !out) return false;
+  out->clear();
+#if !defined(KHOR_HAS_BPF)
+  (void)max;
+  if (err) *err = "built without eBPF support";
+  return false;
+#else
+  if (!impl_->skel || impl_->prof_capacity == 0) {
+    if (err) *err = "profiler not running";
+    return false;
+  }
+  const int pfd = bpf_map__fd(impl_->skel->maps.khor_prof);
+  const int sfd = bpf_map__fd(impl_->skel->maps.khor_stacks);
+  const int stfd = bpf_map__fd(impl_->skel->maps.khor_prof_stats);
+
+  // Collect keys first: deleting while walking with get_next_key restarts the walk.
+  std::vector<khor_prof_key> keys;
+  keys.reserve(impl_->prof_capacity); // never reallocates below, so prev stays valid
+  khor_prof_key cur{};
+  const khor_prof_key* prev = nullptr;
+  while (keys.size() < impl_->prof_capacity && bpf_map_get_next_key(pfd, prev, &cur) == 0) {
+    keys.push_back(cur);
+    prev = &keys.back();
+  }
+
+  // A sample landing between lookup and delete is lost; that's well below the sampling noise.
+  struct Entry {
+    khor_prof_key key;
+    khor_prof_value val;
+  };
+  std::vector<Entry> entries;
+  entries.reserve(keys.size());
+  for (const auto& k : keys) {
+    Entry en{k, {}};
+    if (bpf_map_lookup_elem(pfd, &k, &en.val) != 0) continue;
+    (void)bpf_map_delete_elem(pfd, &k);
+    entries.push_back(en);
+  }
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.val.count > b.val.count; });
+
+  std::array<uint64_t, KHOR_PROF_STACK_DEPTH> ips{};
+  auto read_stack = [&](int id, std::vector<uint64_t>* frames) {
+    if (id < 0 || bpf_map_lookup_elem(sfd, &id, ips.data()) != 0) return;
+    for (uint64_t ip : ips) {
+      if (!ip) break;
+      frames->push_back(ip);
+    }
+  };
+  out->reserve(entries.size());
+  for (std::size_t i = 0; i < entries.size(); i++) {
+    const Entry& en = entries[i];
+    ProfileStack ps;
+    ps.tgid = en.key.tgid;
+    ps.comm.assign(en.val.comm, strnlen(en.val.comm, sizeof(en.val.comm)));
+    ps.count = en.val.count;
+    if (i < max) {
+      read_stack(en.key.kernel_stack, &ps.kernel);
+      read_stack(en.key.user_stack, &ps.user);
+    }
+    out->push_back(std::move(ps));
+  }
+  // Free every referenced stack id so the stack map doesn't fill up over time.
+  for (const auto& en : entries) {
+    if (en.key.kernel_stack >= 0) (void)bpf_map_delete_elem(sfd, &en.key.kernel_stack);
+    if (en.key.user_stack >= 0) (void)bpf_map_delete_elem(sfd, &en.key.user_stack);
+  }
+
+  const int ncpu = libbpf_num_possible_cpus();
+  if (ncpu > 0) {
+    std::vector<khor_prof_stats> per((std::size_t)ncpu);
+    const uint32_t zero = 0;
+    if (bpf_map_lookup_elem(stfd, &zero, per.data()) == 0) {
+      khor_prof_stats sum{};
+      for (const auto& p : per) {
+        sum.samples += p.samples;
+        sum.dropped += p.dropped;
+        sum.stack_errors += p.stack_errors;
+      }
+      const uint64_t before = impl_->prof_samples.exchange(sum.samples, std::memory_order_relaxed);
+      impl_->prof_dropped.store(sum.dropped, std::memory_order_relaxed);
+      impl_->prof_stack_errors.store(sum.stack_errors, std::memory_order_relaxed);
+      KhorMetrics* m = impl_->sinks[0].load(std::memory_order_acquire);
+      if (m && sum.samples > before) m->prof_samples_total.fetch_add(sum.samples - before, std::memory_order_relaxed);
+    }
+  }
+  return true;
+#endif
+}
+
+ProfileStatus BpfCollector::profile_status() const {
+  ProfileStatus s;
+  if (!impl_) return s;
+  s.hz = impl_->prof_hz;
+  s.max_stacks = impl_->prof_capacity;
+#if defined(KHOR_HAS_BPF)
+  s.cpus = (uint32_t)impl_->prof_links.size();
+#endif
+  s.samples = impl_->prof_samples.load(std::memory_order_relaxed);
+  s.dropped = impl_->prof_dropped.load(std::memory_order_relaxed);
+  s.stack_errors = impl_->prof_stack_errors.load(std::memory_order_relaxed);
+  s.error = impl_->prof_err;
+  return s;
+}
+
+bool BpfCollector::offcpu_histogram(OffCpuHistogram* out, std::string* err) const {
+  if (!impl_ || !out) return false;
+  *out = OffCpuHistogram{};
+#if !defined(KHOR_HAS_BPF)
+  if (err) *err = "built without eBPF support";
+  return false;
+#else
+  if (!impl_->skel) {
+    if (err) *err = "not running";
+    return false;
+  }
+  const int ncpu = libbpf_num_possible_cpus();
+  if (ncpu <= 0) {
+    if (err) *err = "libbpf_num_possible_cpus: " + errno_string(ncpu);
+    return false;
+  }
+  std::vector<khor_offcpu_hist> per((std::size_t)ncpu);
+  const uint32_t zero = 0;
+  if (bpf_map_lookup_elem(bpf_map__fd(impl_->skel->maps.khor_offcpu_hist), &zero, per.data()) != 0) {
+    if (err) *err = "khor_offcpu_hist lookup: " + errno_string(errno);
+    return false;
+  }
+  for (const auto& h : per) {
+    for (std::size_t i = 0; i < OffCpuHistogram::kBuckets; i++) {
+      out->d[i] += h.d[i];
+      out->s[i] += h.s[i];
+    }
+  }
+  return true;
+#endif
+}
+
+void BpfCollector::set_exec_queue(ExecEventQueue* q) {
+  if (impl_) impl_->exec_q.store(q, std::memory_order_release);
+}
+
+ExecEventStats BpfCollector::exec_event_stats() const {
+  ExecEventStats s;
+  if (!impl_) return s;
+  s.queue_full = impl_->exec_q_full.load(std::memory_order_relaxed);
+#if defined(KHOR_HAS_BPF)
+  if (!impl_->skel) return s;
+  const int ncpu = libbpf_num_possible_cpus();
+  if (ncpu <= 0) return s;
+  std::vector<khor_exec_limiter> per((std::size_t)ncpu);
+  const uint32_t zero = 0;
+  if (bpf_map_lookup_elem(bpf_map__fd(impl_->skel->maps.khor_exec_limit), &zero, per.data()) != 0) return s;
+  for (const auto& l : per) {
+    s.emitted += l.emitted;
+    s.throttled += l.throttled;
+    s.lost += l.lost;
+  }
+#endif
+  return s;
+}
+
+bool BpfCollector::lifetime_histogram(LifetimeHistogram* out, std::string* err) const {
+  if (!impl_ || !out) return false;
+  *out = LifetimeHistogram{};
+#if !defined(KHOR_HAS_BPF)
+  if (err) *err = "built without eBPF support";
+  return false;
+#else
+  if (!impl_->skel) {
+    if (err) *err = "not running";
+    return false;
+  }
+  const int ncpu = libbpf_num_possible_cpus();
+  if (ncpu <= 0) {
+    if (err) *err = "libbpf_num_possible_cpus: " + errno_string(ncpu);
+    return false;
+  }
+  std::vector<khor_lifetime_hist> per((std::size_t)ncpu);
+  const uint32_t zero = 0;
+  if (bpf_map_lookup_elem(bpf_map__fd(impl_->skel->maps.khor_lifetime), &zero, per.data()) != 0) {
+    if (err) *err = "khor_lifetime lookup: " + errno_string(errno);
+    return false;
+  }
+  for (const auto& h : per) {
+    for (std::size_t i = 0; i < LifetimeHistogram::kBuckets; i++) out->b[i] += h.b[i];
+  }
+  return true;
+#endif
+}
+
+bool BpfCollector::lock_stats(std::vector<LockTypeStat>* out, std::string* err) const {
+  if (!impl_ || !out) return false;
+  out->clear();
+#if !defined(KHOR_HAS_BPF)
+  if (err) *err = "built without eBPF support";
+  return false;
+#else
+  if (!impl_->skel || !impl_->locks) {
+    if (err) *err = impl_->lock_err.empty() ? "lock probes not loaded" : impl_->lock_err;
+    return false;
+  }
+  const int ncpu = libbpf_num_possible_cpus();
+  if (ncpu <= 0) {
+    if (err) *err = "libbpf_num_possible_cpus: " + errno_string(ncpu);
+    return false;
+  }
+  const int fd = bpf_map__fd(impl_->skel->maps.khor_lock_stats);
+  std::vector<khor_lock_stat> per((std::size_t)ncpu);
+  for (uint32_t t = 0; t < KHOR_LOCK_TYPES; t++) {
+    LockTypeStat ls;
+    ls.type = kLockTypeNames[t];
+    if (bpf_map_lookup_elem(fd, &t, per.data()) == 0) {
+      for (const auto& p : per) {
+        ls.count += p.count;
+        ls.wait_ns += p.wait_ns;
+        ls.max_ns = std::max<uint64_t>(ls.max_ns, p.max_ns);
+        for (std::size_t i = 0; i < LockTypeStat::kBuckets; i++) ls.hist[i] += p.hist[i];
+      }
+    }
+    out->push_back(ls);
+  }
+  return true;
+#endif
+}
+
+bool BpfCollector::vfs_stats(std::vector<VfsOpStat>* out, std::string* err) const {
+  if (!impl_ || !out) return false;
+  out->clear();
+#if !defined(KHOR_HAS_BPF)
+  if (err) *err = "built without eBPF support";
+  return false;
+#else
+  if (!impl_->skel || !impl_->vfs) {
+    if (err) *err = impl_->vfs_err.empty() ? "VFS probes not loaded" : impl_->vfs_err;
+    return false;
+  }
+  const int ncpu = libbpf_num_possible_cpus();
+  if (ncpu <= 0) {
+    if (err) *err = "libbpf_num_possible_cpus: " + errno_string(ncpu);
     return false;
   }
+  const int fd = bpf_map__fd(impl_->skel->maps.khor_vfs_stats);
+  std::vector<khor_vfs_stat> per((std::size_t)ncpu);
+  for (uint32_t op = 0; op < KHOR_VFS_OPS; op++) {
+    VfsOpStat vs;
+    vs.op = kVfsOpNames[op];
+    if (bpf_map_lookup_elem(fd, &op, per.data()) == 0) {
+      for (const auto& p : per) {
+        vs.count += p.count;
+        vs.bytes += p.bytes;
+        vs.ns += p.ns;
+        vs.max_ns = std::max<uint64_t>(vs.max_ns, p.max_ns);
+        for (std::size_t i = 0; i < VfsOpStat::kBuckets; i++) vs.hist[i] += p.hist[i];
+      }
+    }
+    out->push_back(vs);
+  }
   return true;
 #endif
 }
 
-bool BpfCollector::start(const BpfConfig& cfg, KhorMetrics* metrics, std::string* err) {
+bool BpfCollector::vfs_files(std::vector<VfsFileStat>* out, std::string* err) const {
+  if (!impl_ || !out) return false;
+  out->clear();
+#if !defined(KHOR_HAS_BPF)
+  if (err) *err = "built without eBPF support";
+  return false;
+#else
+  if (!impl_->skel || !impl_->vfs) {
+    if (err) *err = impl_->vfs_err.empty() ? "VFS probes not loaded" : impl_->vfs_err;
+    return false;
+  }
+  const int fd = bpf_map__fd(impl_->skel->maps.khor_vfs_files);
+  khor_vfs_file_key key{};
+  khor_vfs_file_key next{};
+  const void* prev = nullptr;
+  // Entries evicted during the walk can make get_next_key restart from the top; the cap keeps
+  // that from looping.
+  for (std::size_t n = 0; n < 2 * KHOR_VFS_FILES && bpf_map_get_next_key(fd, prev, &next) == 0; n++) {
+    key = next;
+    prev = &key;
+    khor_vfs_file v{};
+    if (bpf_map_lookup_elem(fd, &key, &v) != 0) continue;
+    VfsFileStat f;
+    f.ino = key.ino;
+    f.dev_major = key.dev >> 20;
+    f.dev_minor = key.dev & 0xfffffu;
+    f.name.assign(v.name, ::strnlen(v.name, sizeof(v.name)));
+    f.comm.assign(v.comm, ::strnlen(v.comm, sizeof(v.comm)));
+    f.read_bytes = v.read_bytes;
+    f.write_bytes = v.write_bytes;
+    f.ops = v.ops;
+    f.ns = v.ns;
+    f.fsync_count = v.fsync_count;
+    f.fsync_ns = v.fsync_ns;
+    out->push_back(std::move(f));
+  }
+  return true;
+#endif
+}
+
+#if defined(KHOR_HAS_BPF)
+// "SKB_DROP_REASON_TCP_CSUM" -> "tcp_csum". Empty where the kernel has no such value (or no
+// drop reasons at all, before 5.17).
+static std::vector<std::string> load_drop_reason_names() {
+  std::vector<std::string> names(KHOR_DROP_REASONS);
+  btf* vmlinux = btf__load_vmlinux_btf();
+  if (!vmlinux || libbpf_get_error(vmlinux)) return names;
+  const int id = btf__find_by_name_kind(vmlinux, "skb_drop_reason", BTF_KIND_ENUM);
+  if (id > 0) {
+    const btf_type* t = btf__type_by_id(vmlinux, (uint32_t)id);
+    const struct btf_enum* e = btf_enum(t);
+    for (uint16_t i = 0; i < btf_vlen(t); i++, e++) {
+      if (e->val < 0 || e->val >= KHOR_DROP_REASONS) continue;
+      std::string n = btf__name_by_offset(vmlinux, e->name_off);
+      for (const char* prefix : {"SKB_DROP_REASON_", "SKB_"}) {
+        if (n.rfind(prefix, 0) == 0) {
+          n.erase(0, std::strlen(prefix));
+          break;
+        }
+      }
+      for (char& c : n) c = (char)std::tolower((unsigned char)c);
+      names[(std::size_t)e->val] = std::move(n);
+    }
+  }
+  btf__free(vmlinux);
+  return names;
+}
+#endif
+
+bool BpfCollector::drop_reasons(std::vector<DropReasonStat>* out, std::string* err) const {
+  if (!impl_ || !out) return false;
+  out->clear();
+#if !defined(KHOR_HAS_BPF)
+  if (err) *err = "built without eBPF support";
+  return false;
+#else
+  if (!impl_->skel) {
+    if (err) *err = "not running";
+    return false;
+  }
+  const int ncpu = libbpf_num_possible_cpus();
+  if (ncpu <= 0) {
+    if (err) *err = "libbpf_num_possible_cpus: " + errno_string(ncpu);
+    return false;
+  }
+  if (impl_->drop_names.empty()) impl_->drop_names = load_drop_reason_names();
+
+  const int fd = bpf_map__fd(impl_->skel->maps.khor_drops);
+  std::vector<uint64_t> per((std::size_t)ncpu);
+  for (uint32_t r = 0; r < KHOR_DROP_REASONS; r++) {
+    if (bpf_map_lookup_elem(fd, &r, per.data()) != 0) continue;
+    uint64_t sum = 0;
+    for (uint64_t v : per) sum += v;
+    if (!sum) continue;
+    DropReasonStat d;
+    d.reason = r;
+    d.name = impl_->drop_names[r];
+    if (d.name.empty()) d.name = r == KHOR_DROP_REASONS - 1 ? "other" : "reason_" + std::to_string(r);
+    d.count = sum;
+    out->push_back(std::move(d));
+  }
+  std::sort(out->begin(), out->end(), [](const DropReasonStat& a, const DropReasonStat& b) { return a.count > b.count; });
+  return true;
+#endif
+}
+
+#if defined(KHOR_HAS_BPF)
+static void merge_cms(const std::vector<khor_cms>& per, CmsWindow* out) {
+  for (const auto& m : per) {
+    const khor_u64* c = &m.c[0][0];
+    for (std::size_t i = 0; i < out->counters.size(); i++) out->counters[i] += c[i];
+    for (const auto& k : m.cand) {
+      if (!k.hash) continue;
+      CmsCandidate cc;
+      cc.hash = k.hash;
+      cc.est = k.est;
+      cc.tgid = k.id;
+      cc.family = k.family;
+      std::memcpy(cc.label.data(), k.label, cc.label.size());
+      out->add_candidate(cc);
+    }
+  }
+}
+#endif
+
+bool BpfCollector::take_window(SketchWindow* out, std::string* err) {
+  if (!impl_ || !out) return false;
+  *out = SketchWindow{};
+#if !defined(KHOR_HAS_BPF)
+  if (err) *err = "built without eBPF support";
+  return false;
+#else
+  if (!impl_->skel || impl_->cfg_map_fd < 0) {
+    if (err) *err = "not running";
+    return false;
+  }
+  const int ncpu = libbpf_num_possible_cpus();
+  if (ncpu <= 0) {
+    if (err) *err = "libbpf_num_possible_cpus: " + errno_string(ncpu);
+    return false;
+  }
+  if (impl_->win_hll.size() != (std::size_t)ncpu) {
+    impl_->win_hll.resize((std::size_t)ncpu);
+    impl_->win_cms.resize((std::size_t)ncpu);
+    impl_->win_rtt.resize((std::size_t)ncpu);
+  }
+  uint32_t closed = impl_->table.window_epoch & 1u;
+  impl_->table.window_epoch = closed ^ 1u;
+  if (!impl_->write_table(err)) {
+    impl_->table.window_epoch = closed;
+    return false;
+  }
+
+  // A probe that read the table just before the flip may still land in the closed set; it
+  // then counts toward the window after next (or, between the read and the clear, is lost),
+  // which neither sketch minds.
+  const int fd = bpf_map__fd(impl_->skel->maps.khor_hll);
+  std::vector<khor_hll>& per = impl_->win_hll;
+  if (bpf_map_lookup_elem(fd, &closed, per.data()) != 0) {
+    if (err) *err = "khor_hll lookup: " + errno_string(errno);
+    return false;
+  }
+  HllWindow& hll = out->hll;
+  for (const auto& h : per) {
+    for (std::size_t i = 0; i < KHOR_HLL_REGS; i++) {
+      hll.exec_parents[i] = std::max(hll.exec_parents[i], h.reg[KHOR_HLL_EXEC][i]);
+      hll.tgids[i] = std::max(hll.tgids[i], h.reg[KHOR_HLL_CSW][i]);
+      hll.peers[i] = std::max(hll.peers[i], h.reg[KHOR_HLL_PEER][i]);
+    }
+  }
+  std::fill(per.begin(), per.end(), khor_hll{});
+  (void)bpf_map_update_elem(fd, &closed, per.data(), BPF_ANY);
+
+  const int cfd = bpf_map__fd(impl_->skel->maps.khor_cms);
+  std::vector<khor_cms>& cms = impl_->win_cms;
+  const std::pair<uint32_t, CmsWindow*> sketches[] = {
+    {KHOR_CMS_TGID_CSW, &out->switches},
+    {KHOR_CMS_PEER_BYTES, &out->peer_bytes},
+  };
+  for (const auto& [sketch, dst] : sketches) {
+    const uint32_t key = sketch * 2 + closed;
+    if (bpf_map_lookup_elem(cfd, &key, cms.data()) != 0) {
+      if (err) *err = "khor_cms lookup: " + errno_string(errno);
+      return false;
+    }
+    merge_cms(cms, dst);
+    std::fill(cms.begin(), cms.end(), khor_cms{});
+    (void)bpf_map_update_elem(cfd, &key, cms.data(), BPF_ANY);
+  }
+
+  const int rfd = bpf_map__fd(impl_->skel->maps.khor_rtt);
+  std::vector<khor_rtt_hist>& rtt = impl_->win_rtt;
+  if (bpf_map_lookup_elem(rfd, &closed, rtt.data()) != 0) {
+    if (err) *err = "khor_rtt lookup: " + errno_string(errno);
+    return false;
+  }
+  for (const auto& h : rtt) {
+    for (std::size_t i = 0; i < KHOR_RTT_BUCKETS; i++) out->rtt[i] += h.b[i];
+  }
+  std::fill(rtt.begin(), rtt.end(), khor_rtt_hist{});
+  (void)bpf_map_update_elem(rfd, &closed, rtt.data(), BPF_ANY);
+  return true;
+#endif
+}
+
+bool BpfCollector::start(const BpfConfig& cfg, KhorMetrics* metrics, Reactor* reactor, std::string* err) {
   if (!impl_) return false;
   stop();
 
-  impl_->metrics = metrics;
+  impl_->sinks[0].store(metrics, std::memory_order_release);
   impl_->running.store(cfg.enabled);
 
   if (!cfg.enabled) {
@@ -102,12 +755,19 @@ bool BpfCollector::start(const BpfConfig& cfg, KhorMetrics* metrics, std::string
   }
 
 #if !defined(KHOR_HAS_BPF)
+  (void)reactor;
   impl_->ok.store(false);
   impl_->err_code.store(0);
   impl_->err = "built without eBPF support";
   if (err) *err = impl_->err;
   return false;
 #else
+  if (!reactor) {
+    impl_->err = "no reactor";
+    if (err) *err = impl_->err;
+    return false;
+  }
+
   libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
 
   const bool debug_libbpf = (std::getenv("KHOR_DEBUG_LIBBPF") != nullptr);
@@ -119,17 +779,66 @@ bool BpfCollector::start(const BpfConfig& cfg, KhorMetrics* metrics, std::string
     libbpf_set_print([](enum libbpf_print_level, const char*, va_list) { return 0; });
   }
 
-  khor_bpf* skel = khor_bpf__open();
-  long open_err = libbpf_get_error(skel);
-  if (open_err) {
-    impl_->err_code.store((int)-open_err);
-    impl_->err = "open failed: " + errno_string((int)open_err);
-    if (err) *err = impl_->err;
-    return false;
+  // Without the profiler its maps stay at one entry (a stack map preallocates every slot).
+  impl_->prof_capacity = cfg.profile_hz ? std::clamp(cfg.profile_max_stacks, 64u, 65536u) : 0u;
+  const uint32_t prof_entries = impl_->prof_capacity ? impl_->prof_capacity : 1u;
+  impl_->prof_samples.store(0);
+  impl_->prof_dropped.store(0);
+  impl_->prof_stack_errors.store(0);
+
+  // The lock tracepoints only exist on 5.19+; without them the programs would fail to attach.
+  impl_->locks = false;
+  impl_->lock_err.clear();
+  bool want_locks = cfg.locks;
+  if (want_locks && ::access("/sys/kernel/tracing/events/lock/contention_begin", F_OK) != 0 &&
+      ::access("/sys/kernel/debug/tracing/events/lock/contention_begin", F_OK) != 0) {
+    impl_->lock_err = "lock:contention_begin tracepoint not available (needs Linux 5.19+ and tracefs)";
+    want_locks = false;
+  } else if (!want_locks) {
+    impl_->lock_err = "disabled by config (features.locks)";
+  }
+
+  impl_->vfs_err.clear();
+  bool want_vfs = cfg.vfs;
+  if (want_vfs && ::access("/sys/kernel/btf/vmlinux", F_OK) != 0) {
+    impl_->vfs_err = "kernel BTF not available (/sys/kernel/btf/vmlinux)";
+    want_vfs = false;
+  } else if (!want_vfs) {
+    impl_->vfs_err = "disabled by config (features.vfs)";
   }
-  impl_->skel = skel;
 
-  int rc = khor_bpf__load(skel);
+  // A kernel without fentry/fexit (before 5.5) rejects the whole object, so it is opened
+  // again without the VFS programs.
+  khor_bpf* skel = nullptr;
+  int rc = 0;
+  for (bool vfs = want_vfs;; vfs = false) {
+    skel = khor_bpf__open();
+    const long open_err = libbpf_get_error(skel);
+    if (open_err) {
+      impl_->err_code.store((int)-open_err);
+      impl_->err = "open failed: " + errno_string((int)open_err);
+      if (err) *err = impl_->err;
+      return false;
+    }
+    impl_->skel = skel;
+    (void)bpf_map__set_max_entries(skel->maps.khor_stacks, prof_entries);
+    (void)bpf_map__set_max_entries(skel->maps.khor_prof, prof_entries);
+    (void)bpf_program__set_autoload(skel->progs.tp_contention_begin, want_locks);
+    (void)bpf_program__set_autoload(skel->progs.tp_contention_end, want_locks);
+    for (bpf_program* p : vfs_programs(skel)) {
+      (void)bpf_program__set_autoload(p, vfs);
+      (void)bpf_program__set_autoattach(p, false);
+    }
+    (void)bpf_program__set_autoattach(skel->progs.kp_tcp_v6_syn_recv_sock, false);
+    rc = khor_bpf__load(skel);
+    if (rc == 0 || !vfs) {
+      want_vfs = vfs;
+      break;
+    }
+    impl_->vfs_err = "VFS probes rejected: " + errno_string(rc) + " (fentry/fexit needs Linux 5.5+)";
+    khor_bpf__destroy(skel);
+    impl_->skel = nullptr;
+  }
   if (rc) {
     impl_->err_code.store(rc);
     impl_->err = "load failed: " + errno_string(rc) + " (need CAP_BPF/CAP_PERFMON or root)";
@@ -146,7 +855,11 @@ bool BpfCollector::start(const BpfConfig& cfg, KhorMetrics* metrics, std::string
     stop();
     return false;
   }
-  (void)apply_config(cfg, nullptr);
+  impl_->table.s[0] = to_bpf_config(cfg);
+  impl_->table.active |= 1u;
+  impl_->table.exec_rate = cfg.exec_event_rate;
+  impl_->table.exec_burst = cfg.exec_event_burst;
+  (void)impl_->write_table(nullptr);
 
   rc = khor_bpf__attach(skel);
   if (rc) {
@@ -156,12 +869,33 @@ bool BpfCollector::start(const BpfConfig& cfg, KhorMetrics* metrics, std::string
     stop();
     return false;
   }
+  impl_->locks = want_locks;
+  if (want_vfs && !impl_->attach_vfs(&impl_->vfs_err)) {
+    std::fprintf(stderr, "khor-daemon: vfs: %s\n", impl_->vfs_err.c_str());
+  }
+  // Without it only IPv6 handshake-ACK overflows go uncounted.
+  impl_->tcp6_link = bpf_program__attach(skel->progs.kp_tcp_v6_syn_recv_sock);
 
-  auto on_event = [](void* ctx, void* data, size_t) -> int {
-    auto* m = (KhorMetrics*)ctx;
+  auto on_event = [](void* ctx, void* data, size_t size) -> int {
+    auto* impl = (Impl*)ctx;
     auto* e = (const khor_event*)data;
-    if (!m || !e) return 0;
+    if (!impl || !e || e->session >= KHOR_MAX_SESSIONS) return 0;
+    KhorMetrics* m = impl->sinks[e->session].load(std::memory_order_acquire);
+    if (!m) return 0;
     m->events_total.fetch_add(1, std::memory_order_relaxed);
+    if (e->type == KHOR_EV_EXEC) {
+      if (size < offsetof(khor_event, u) + sizeof(khor_exec_payload)) return 0;
+      ExecEventQueue* q = impl->exec_q.load(std::memory_order_acquire);
+      if (!q) return 0;
+      ExecEvent ev;
+      ev.ts_ns = e->ts_ns;
+      ev.tgid = e->tgid;
+      ev.cgroup_id = e->u.exec.cgroup_id;
+      std::memcpy(ev.comm.data(), e->comm, std::min(ev.comm.size(), sizeof(e->comm)));
+      ev.comm.back() = '\0';
+      if (!q->push(ev)) impl->exec_q_full.fetch_add(1, std::memory_order_relaxed);
+      return 0;
+    }
     if (e->type == KHOR_EV_SAMPLE) {
       m->exec_total.fetch_add(e->u.sample.exec_count, std::memory_order_relaxed);
       m->net_rx_bytes_total.fetch_add(e->u.sample.net_rx_bytes, std::memory_order_relaxed);
@@ -171,12 +905,28 @@ bool BpfCollector::start(const BpfConfig& cfg, KhorMetrics* metrics, std::string
       m->blk_write_bytes_total.fetch_add(e->u.sample.blk_write_bytes, std::memory_order_relaxed);
       m->tcp_retransmit_total.fetch_add(e->u.sample.tcp_retransmits, std::memory_order_relaxed);
       m->irq_total.fetch_add(e->u.sample.irq_count, std::memory_order_relaxed);
+      m->offcpu_d_ns_total.fetch_add(e->u.sample.offcpu_d_ns, std::memory_order_relaxed);
+      m->offcpu_s_ns_total.fetch_add(e->u.sample.offcpu_s_ns, std::memory_order_relaxed);
+      m->lock_contended_total.fetch_add(e->u.sample.lock_count, std::memory_order_relaxed);
+      m->lock_wait_ns_total.fetch_add(e->u.sample.lock_wait_ns, std::memory_order_relaxed);
+      m->skb_drop_total.fetch_add(e->u.sample.skb_drops, std::memory_order_relaxed);
+      m->exec_fail_total.fetch_add(e->u.sample.exec_fail, std::memory_order_relaxed);
+      m->proc_short_total.fetch_add(e->u.sample.exec_short, std::memory_order_relaxed);
+      m->vfs_read_bytes_total.fetch_add(e->u.sample.vfs_read_bytes, std::memory_order_relaxed);
+      m->vfs_write_bytes_total.fetch_add(e->u.sample.vfs_write_bytes, std::memory_order_relaxed);
+      m->vfs_ns_total.fetch_add(e->u.sample.vfs_ns, std::memory_order_relaxed);
+      m->fsync_total.fetch_add(e->u.sample.fsync_count, std::memory_order_relaxed);
+      m->fsync_ns_total.fetch_add(e->u.sample.fsync_ns, std::memory_order_relaxed);
+      m->rtt_samples_total.fetch_add(e->u.sample.rtt_count, std::memory_order_relaxed);
+      m->rtt_us_total.fetch_add(e->u.sample.rtt_us, std::memory_order_relaxed);
+      m->listen_overflow_total.fetch_add(e->u.sample.listen_overflow, std::memory_order_relaxed);
+      m->syn_overflow_total.fetch_add(e->u.sample.syn_overflow, std::memory_order_relaxed);
       m->events_dropped.fetch_add(e->u.sample.lost_events, std::memory_order_relaxed);
     }
     return 0;
   };
 
-  impl_->rb = ring_buffer__new(bpf_map__fd(skel->maps.events), on_event, impl_->metrics, nullptr);
+  impl_->rb = ring_buffer__new(bpf_map__fd(skel->maps.events), on_event, impl_, nullptr);
   if (!impl_->rb) {
     impl_->err_code.store(-ENOMEM);
     impl_->err = "ring buffer init failed";
@@ -185,25 +935,36 @@ bool BpfCollector::start(const BpfConfig& cfg, KhorMetrics* metrics, std::string
     return false;
   }
 
+  // Consume on the reactor thread only when the kernel signals data (no polling timeout).
+  const int rb_fd = ring_buffer__epoll_fd(impl_->rb);
+  const bool registered = rb_fd >= 0 && reactor->add_fd(rb_fd, [impl = impl_] {
+    const int r = ring_buffer__consume(impl->rb);
+    if (r < 0 && r != -EINTR) {
+      // Consume errors don't mean ringbuf drops, but it's still useful for health.
+      impl->err_code.store(r);
+      impl->err = "ring_buffer__consume: " + errno_string(r);
+    }
+  });
+  if (!registered) {
+    impl_->err_code.store(-EINVAL);
+    impl_->err = "ring buffer epoll registration failed";
+    if (err) *err = impl_->err;
+    stop();
+    return false;
+  }
+  impl_->reactor = reactor;
+  impl_->rb_fd = rb_fd;
+
   impl_->ok.store(true);
   impl_->err_code.store(0);
   impl_->err.clear();
   std::fprintf(stderr, "khor-daemon: eBPF enabled\n");
 
-  impl_->running.store(true);
-  impl_->poller = std::thread([impl = impl_] {
-    while (impl->running.load() && impl->ok.load()) {
-      int r = ring_buffer__poll(impl->rb, 50 /* ms */);
-      if (r == -EINTR) continue;
-      if (r < 0) {
-        // Poll errors don't mean ringbuf drops, but it's still useful for health.
-        impl->err_code.store(r);
-        impl->err = "ring_buffer__poll: " + errno_string(r);
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));
-      }
-    }
-  });
+  // The profiler failing (no CAP_PERFMON, no perf events in a VM) leaves the tracepoints running.
+  std::string pe;
+  if (cfg.profile_hz && !impl_->open_profile(cfg.profile_hz, &pe)) std::fprintf(stderr, "khor-daemon: profiler: %s\n", pe.c_str());
 
+  impl_->running.store(true);
   return true;
 #endif
 }
@@ -212,7 +973,16 @@ void BpfCollector::stop() {
   if (!impl_) return;
   impl_->running.store(false);
 #if defined(KHOR_HAS_BPF)
-  if (impl_->poller.joinable()) impl_->poller.join();
+  // Synchronous: once this returns the reactor won't touch rb again.
+  if (impl_->reactor && impl_->rb_fd >= 0) impl_->reactor->remove_fd(impl_->rb_fd);
+  impl_->reactor = nullptr;
+  impl_->rb_fd = -1;
+  impl_->close_profile();
+  impl_->prof_capacity = 0;
+  impl_->locks = false;
+  impl_->detach_vfs();
+  if (impl_->tcp6_link) bpf_link__destroy(impl_->tcp6_link);
+  impl_->tcp6_link = nullptr;
   if (impl_->rb) ring_buffer__free(impl_->rb);
   impl_->rb = nullptr;
   if (impl_->skel) khor_bpf__destroy(impl_->skel);
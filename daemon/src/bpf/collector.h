@@ -1,13 +1,18 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "khor/metrics.h"
+#include "util/spsc_queue.h"
 
 namespace khor {
 
+class Reactor;
+
 struct BpfConfig {
   bool enabled = true;
   uint32_t enabled_mask = 0xFFFFFFFFu;
@@ -15,6 +20,168 @@ struct BpfConfig {
   uint32_t tgid_allow = 0;
   uint32_t tgid_deny = 0;
   uint64_t cgroup_id = 0;
+
+  // On-CPU profiler over slot 0's filters. 0 = off. The stack map size is fixed when the
+  // object is loaded, so changing max_stacks or turning the profiler on or off needs a restart.
+  uint32_t profile_hz = 0;
+  uint32_t profile_max_stacks = 2048;
+
+  // lock:contention_begin/end probes (Linux 5.19+). Fixed at load.
+  bool locks = false;
+
+  // fentry/fexit on vfs_read, vfs_write and vfs_fsync_range (BPF trampolines). Fixed at load.
+  bool vfs = false;
+
+  // Per-exec records for slot 0 (token bucket per CPU); 0 = off. Live.
+  uint32_t exec_event_rate = 0;
+  uint32_t exec_event_burst = 0;
+};
+
+// One successful exec seen by slot 0, forwarded from the ring buffer (exec events on).
+struct ExecEvent {
+  uint64_t ts_ns = 0; // CLOCK_MONOTONIC
+  uint32_t tgid = 0;
+  uint64_t cgroup_id = 0;
+  std::array<char, 16> comm{}; // NUL-terminated
+};
+
+// Filled by the reactor thread, drained by whichever single thread plays the triggers.
+using ExecEventQueue = SpscQueue<ExecEvent, 256>;
+
+struct ExecEventStats {
+  uint64_t emitted = 0;      // records the kernel sent
+  uint64_t throttled = 0;    // execs over the rate limit
+  uint64_t lost = 0;         // ring buffer full
+  uint64_t queue_full = 0;   // records the consumer didn't keep up with
+};
+
+// One aggregated call stack from the profiler, innermost frame first.
+struct ProfileStack {
+  uint32_t tgid = 0;
+  std::string comm;
+  uint64_t count = 0;
+  std::vector<uint64_t> kernel;
+  std::vector<uint64_t> user;
+};
+
+struct ProfileStatus {
+  uint32_t hz = 0;         // 0 = not sampling
+  uint32_t cpus = 0;       // perf events attached
+  uint32_t max_stacks = 0; // map capacity, 0 if the object was loaded without the profiler
+  uint64_t samples = 0;
+  uint64_t dropped = 0;      // distinct stacks beyond max_stacks within one drain period
+  uint64_t stack_errors = 0; // samples whose stacks couldn't be captured
+  std::string error;
+};
+
+// Off-CPU waits seen by slot 0, cumulative since the object was loaded. Bucket i counts
+// waits in [2^i, 2^(i+1)) us; bucket 0 also holds the sub-microsecond ones.
+struct OffCpuHistogram {
+  static constexpr std::size_t kBuckets = 32;
+  std::array<uint64_t, kBuckets> d{}; // uninterruptible (D)
+  std::array<uint64_t, kBuckets> s{}; // interruptible sleep (S)
+};
+
+// Exec-to-exit lifetimes of processes seen by slot 0, cumulative since load. Bucket i
+// counts [2^i, 2^(i+1)) us; the last bucket holds everything longer.
+struct LifetimeHistogram {
+  static constexpr std::size_t kBuckets = 32;
+  std::array<uint64_t, kBuckets> b{};
+};
+
+// Contended acquisitions of one kernel lock class seen by slot 0, cumulative since load.
+// Bucket i of hist counts waits in [2^i, 2^(i+1)) ns.
+struct LockTypeStat {
+  static constexpr std::size_t kBuckets = 32;
+  const char* type = "";
+  uint64_t count = 0;
+  uint64_t wait_ns = 0;
+  uint64_t max_ns = 0;
+  std::array<uint64_t, kBuckets> hist{};
+};
+
+// VFS calls of one kind (read, write, fsync) on regular files seen by slot 0, cumulative
+// since load. Bucket i of hist counts calls taking [2^i, 2^(i+1)) ns.
+struct VfsOpStat {
+  static constexpr std::size_t kBuckets = 32;
+  const char* op = "";
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+  uint64_t ns = 0;
+  uint64_t max_ns = 0;
+  std::array<uint64_t, kBuckets> hist{};
+};
+
+// One file's VFS totals (slot 0), cumulative while it stays in the kernel's LRU.
+struct VfsFileStat {
+  uint64_t ino = 0;
+  uint32_t dev_major = 0;
+  uint32_t dev_minor = 0;
+  std::string name; // last path component when first seen
+  std::string comm; // first process that touched it
+  uint64_t read_bytes = 0;
+  uint64_t write_bytes = 0;
+  uint64_t ops = 0;
+  uint64_t ns = 0;
+  uint64_t fsync_count = 0;
+  uint64_t fsync_ns = 0;
+};
+
+// Packets dropped for one kfree_skb reason (slot 0), cumulative since load.
+struct DropReasonStat {
+  uint32_t reason = 0; // enum skb_drop_reason value; the last slot also collects subsystem reasons
+  std::string name;    // from the kernel's BTF, e.g. "tcp_csum", "netfilter_drop"
+  uint64_t count = 0;
+};
+
+// HyperLogLog registers of one window (slot 0), merged over CPUs. See engine/sketch.h.
+struct HllWindow {
+  static constexpr std::size_t kRegisters = 256;
+  std::array<uint8_t, kRegisters> exec_parents{}; // parents of exec callers
+  std::array<uint8_t, kRegisters> tgids{};        // processes switched out
+  std::array<uint8_t, kRegisters> peers{};        // remote addresses of packets
+};
+
+// A key some CPU's candidate table held at the end of the window.
+struct CmsCandidate {
+  uint64_t hash = 0;
+  uint64_t est = 0;                // the holding CPU's estimate
+  uint32_t tgid = 0;
+  uint32_t family = 0;             // 4 or 6 for addresses
+  std::array<uint8_t, 16> label{}; // comm (NUL-padded) or the address in network order
+};
+
+// One count-min sketch of a window (slot 0): counters summed over CPUs, candidates
+// deduplicated by hash. Fixed size, so taking a window never allocates. See engine/sketch.h.
+struct CmsWindow {
+  static constexpr std::size_t kRows = 4;
+  static constexpr std::size_t kWidth = 512;
+  static constexpr std::size_t kMaxCandidates = 256;
+  std::array<uint64_t, kRows * kWidth> counters{}; // row-major
+  std::array<CmsCandidate, kMaxCandidates> candidates{};
+  std::size_t n_candidates = 0;
+
+  // Once full, a new key displaces the one with the smallest estimate if it is heavier.
+  void add_candidate(const CmsCandidate& c) {
+    std::size_t lightest = 0;
+    for (std::size_t i = 0; i < n_candidates; i++) {
+      if (candidates[i].hash == c.hash) {
+        if (c.est > candidates[i].est) candidates[i].est = c.est;
+        return;
+      }
+      if (candidates[i].est < candidates[lightest].est) lightest = i;
+    }
+    if (n_candidates < kMaxCandidates) candidates[n_candidates++] = c;
+    else if (c.est > candidates[lightest].est) candidates[lightest] = c;
+  }
+};
+
+struct SketchWindow {
+  static constexpr std::size_t kRttBuckets = 32;
+  HllWindow hll;
+  CmsWindow switches;   // context switches by tgid
+  CmsWindow peer_bytes; // packet bytes by remote address
+  std::array<uint64_t, kRttBuckets> rtt{}; // TCP smoothed RTT samples; bucket i = [2^i, 2^(i+1)) us
 };
 
 struct BpfStatus {
@@ -24,15 +191,21 @@ struct BpfStatus {
   std::string error;
 };
 
+// One loaded BPF object serving up to kMaxSessions filter slots. Slot 0 is configured by
+// start()/apply_config(); the others by set_session(). Each slot's samples go to its own
+// KhorMetrics, and the probes evaluate every slot within a single event.
 class BpfCollector {
  public:
+  static constexpr int kMaxSessions = 8;
+
   BpfCollector();
   ~BpfCollector();
 
   BpfCollector(const BpfCollector&) = delete;
   BpfCollector& operator=(const BpfCollector&) = delete;
 
-  bool start(const BpfConfig& cfg, KhorMetrics* metrics, std::string* err);
+  // The ring buffer's epoll fd is registered with the reactor and consumed on its thread.
+  bool start(const BpfConfig& cfg, KhorMetrics* metrics, Reactor* reactor, std::string* err);
   void stop();
 
   bool is_running() const;
@@ -41,6 +214,44 @@ class BpfCollector {
   // Best-effort live update (mask + interval + filters).
   bool apply_config(const BpfConfig& cfg, std::string* err);
 
+  // Slots 1..kMaxSessions-1. Kept across stop()/start(); takes effect in the kernel while running.
+  // clear_session() returns once no event is being delivered to that slot's metrics.
+  bool set_session(int slot, const BpfConfig& cfg, KhorMetrics* metrics, std::string* err);
+  void clear_session(int slot);
+
+  // Takes (and clears) the stacks sampled since the last call, most frequent first. Frames are
+  // only read for the first max of them; the rest come back with counts alone.
+  // Also adds the new samples to slot 0's prof_samples_total.
+  bool drain_profile(std::vector<ProfileStack>* out, std::size_t max, std::string* err);
+  ProfileStatus profile_status() const;
+
+  // Sums the per-CPU off-CPU histograms.
+  bool offcpu_histogram(OffCpuHistogram* out, std::string* err) const;
+
+  // Exec records go here; nullptr discards them. Set before start().
+  void set_exec_queue(ExecEventQueue* q);
+  // Kernel counters summed over CPUs, plus the queue's own drops. Zero while not running.
+  ExecEventStats exec_event_stats() const;
+
+  // Sums the per-CPU process lifetime histograms.
+  bool lifetime_histogram(LifetimeHistogram* out, std::string* err) const;
+
+  // One entry per lock class (spinlock, rwlock, mutex, rwsem, rtmutex, percpu-rwsem, other),
+  // summed over CPUs. False with a reason when the lock probes aren't attached.
+  bool lock_stats(std::vector<LockTypeStat>* out, std::string* err) const;
+
+  // read, write, fsync, summed over CPUs. False with a reason when the VFS probes aren't attached.
+  bool vfs_stats(std::vector<VfsOpStat>* out, std::string* err) const;
+  // Every file in the kernel's LRU, unsorted.
+  bool vfs_files(std::vector<VfsFileStat>* out, std::string* err) const;
+
+  // Reasons with at least one drop, most frequent first. Benign reasons are filtered in the kernel.
+  bool drop_reasons(std::vector<DropReasonStat>* out, std::string* err) const;
+
+  // Ends the current sketch window: the probes move to the other set of HyperLogLog registers
+  // count-min counters and RTT histogram, and this one is read, merged over CPUs and cleared.
+  bool take_window(SketchWindow* out, std::string* err);
+
  private:
   struct Impl;
   Impl* impl_ = nullptr;
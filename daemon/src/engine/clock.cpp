@@ -0,0 +1,133 @@
+#include "engine/clock.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "engine/music.h"
+
+namespace khor {
+
+const char* clock_overrun_name(ClockOverrun p) {
+  return p == ClockOverrun::CatchUp ? "catch_up" : "skip";
+}
+
+bool clock_overrun_parse(std::string_view s, ClockOverrun* out) {
+  ClockOverrun p;
+  if (s == "skip") p = ClockOverrun::Skip;
+  else if (s == "catch_up") p = ClockOverrun::CatchUp;
+  else return false;
+  if (out) *out = p;
+  return true;
+}
+
+void LatenessHistogram::record(int64_t late_ns) {
+  if (late_ns < 0) late_ns = 0;
+  const uint64_t us = (uint64_t)(late_ns / 1000);
+  std::size_t i = 0;
+  while (i < kBoundsUs.size() && us > kBoundsUs[i]) i++;
+  counts_[i].fetch_add(1, std::memory_order_relaxed);
+  n_.fetch_add(1, std::memory_order_relaxed);
+  sum_ns_.fetch_add(late_ns, std::memory_order_relaxed);
+  if (late_ns > max_ns_.load(std::memory_order_relaxed)) max_ns_.store(late_ns, std::memory_order_relaxed);
+}
+
+double LatenessHistogram::mean_ns() const {
+  const uint64_t n = count();
+  return n ? (double)sum_ns_.load(std::memory_order_relaxed) / (double)n : 0.0;
+}
+
+uint32_t LatenessHistogram::quantile_us(double q) const {
+  const uint64_t n = count();
+  if (n == 0) return 0;
+  const uint64_t want = (uint64_t)std::ceil(std::clamp(q, 0.0, 1.0) * (double)n);
+  uint64_t acc = 0;
+  for (std::size_t i = 0; i < kBoundsUs.size(); i++) {
+    acc += bucket(i);
+    if (acc >= want) return kBoundsUs[i];
+  }
+  return kBoundsUs.back() + 1;
+}
+
+static double step_period_ns(double bpm, double rate) {
+  // tick_ms() is in reference time; a faster reference clock means shorter monotonic steps.
+  return MusicEngine::tick_ms(bpm) * 1e6 / rate;
+}
+
+void MusicClock::reset(int64_t now_ns, double bpm) {
+  bpm_ = bpm;
+  period_ns_ = step_period_ns(bpm_, rate_);
+  origin_ns_ = now_ns;
+  k_ = 0;
+}
+
+void MusicClock::rebase(int64_t now_ns, double period_ns) {
+  const double step_start = (double)origin_ns_ + (double)k_ * period_ns_;
+  const double phase = std::clamp(((double)now_ns - step_start) / period_ns_, 0.0, 1.0);
+  origin_ns_ = now_ns - (int64_t)std::llround(phase * period_ns);
+  k_ = 0;
+  period_ns_ = period_ns;
+  stats_.retempos.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MusicClock::set_bpm(int64_t now_ns, double bpm) {
+  if (bpm == bpm_) return;
+  bpm_ = bpm;
+  const double p = step_period_ns(bpm_, rate_);
+  if (p != period_ns_) rebase(now_ns, p);
+}
+
+void MusicClock::set_rate(int64_t now_ns, double rate) {
+  if (!(rate > 0.0) || rate == rate_) return;
+  rate_ = rate;
+  const double p = step_period_ns(bpm_, rate_);
+  if (p != period_ns_) rebase(now_ns, p);
+}
+
+int64_t MusicClock::next_deadline_ns() const {
+  return origin_ns_ + (int64_t)std::llround((double)(k_ + 1) * period_ns_);
+}
+
+uint32_t MusicClock::advance(int64_t now_ns) {
+  const int64_t due = next_deadline_ns();
+  if (now_ns < due) return 0;
+
+  const int64_t late = now_ns - due;
+  hist_.record(late);
+  stats_.wakeups.fetch_add(1, std::memory_order_relaxed);
+
+  const uint64_t missed = (uint64_t)((double)late / period_ns_);
+  k_ += missed + 1;
+
+  uint32_t run = 1;
+  if (missed > 0) {
+    stats_.overruns.fetch_add(1, std::memory_order_relaxed);
+    if (overrun_ == ClockOverrun::CatchUp) run = (uint32_t)std::min<uint64_t>(missed + 1, kMaxCatchUp);
+    stats_.skipped.fetch_add(missed + 1 - run, std::memory_order_relaxed);
+  }
+  stats_.steps.fetch_add(run, std::memory_order_relaxed);
+  return run;
+}
+
+bool AudioClockTracker::observe(uint64_t frames, int64_t mono_ns, uint32_t sample_rate) {
+  if (sample_rate == 0) return false;
+  if (!have_ || sample_rate != sr_ || frames < frames0_ || mono_ns <= ns0_) {
+    // First sample, or the device was reopened: start a new window.
+    have_ = true;
+    frames0_ = frames;
+    ns0_ = mono_ns;
+    sr_ = sample_rate;
+    return false;
+  }
+  const int64_t dt = mono_ns - ns0_;
+  if (dt < kWindowNs) return false;
+
+  const double audio_s = (double)(frames - frames0_) / (double)sr_;
+  const double mono_s = (double)dt * 1e-9;
+  const double r = std::clamp(audio_s / mono_s, 0.99, 1.01);
+  rate_ += 0.25 * (r - rate_);
+  frames0_ = frames;
+  ns0_ = mono_ns;
+  return true;
+}
+
+} // namespace khor
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+namespace khor {
+
+// What to do when a wakeup is a whole step (or more) late.
+enum class ClockOverrun : uint8_t {
+  Skip,    // drop the missed steps, run one, stay on the grid
+  CatchUp, // run the missed steps back to back (up to kMaxCatchUp), then continue
+};
+
+const char* clock_overrun_name(ClockOverrun p);
+bool clock_overrun_parse(std::string_view s, ClockOverrun* out);
+
+// Wakeup lateness in fixed log-ish buckets. Written by the sequencer, read by the API.
+class LatenessHistogram {
+ public:
+  // Upper bounds (inclusive) in microseconds; one more bucket counts everything above.
+  static constexpr std::array<uint32_t, 10> kBoundsUs = {50, 100, 250, 500, 1000, 2000, 5000, 10000, 25000, 50000};
+  static constexpr std::size_t kBuckets = kBoundsUs.size() + 1;
+
+  void record(int64_t late_ns);
+
+  uint64_t bucket(std::size_t i) const { return counts_[i].load(std::memory_order_relaxed); }
+  uint64_t count() const { return n_.load(std::memory_order_relaxed); }
+  int64_t max_ns() const { return max_ns_.load(std::memory_order_relaxed); }
+  double mean_ns() const;
+  // Upper bound of the bucket holding the q-quantile (0..1); kBoundsUs.back()+ for the overflow bucket.
+  uint32_t quantile_us(double q) const;
+
+ private:
+  std::array<std::atomic<uint64_t>, kBuckets> counts_{};
+  std::atomic<uint64_t> n_{0};
+  std::atomic<int64_t> sum_ns_{0};
+  std::atomic<int64_t> max_ns_{0};
+};
+
+struct ClockStats {
+  std::atomic<uint64_t> wakeups{0};   // timer expirations that ran at least one step
+  std::atomic<uint64_t> steps{0};     // steps handed to the sequencer
+  std::atomic<uint64_t> overruns{0};  // wakeups at least one full step late
+  std::atomic<uint64_t> skipped{0};   // steps dropped by the overrun policy
+  std::atomic<uint64_t> retempos{0};  // bpm/rate changes applied mid-step
+};
+
+// Absolute-deadline step clock for the 16th-note grid.
+//
+// Deadlines are origin + k * period, so there is no accumulated rounding drift.
+// A tempo (or rate) change keeps the elapsed fraction of the current step and
+// rescales the remainder, so the grid never jumps. Not thread-safe except for
+// stats()/lateness(), which may be read from anywhere.
+class MusicClock {
+ public:
+  static constexpr uint32_t kMaxCatchUp = 4;
+
+  void reset(int64_t now_ns, double bpm);
+  void set_overrun(ClockOverrun p) { overrun_ = p; }
+  ClockOverrun overrun() const { return overrun_; }
+
+  void set_bpm(int64_t now_ns, double bpm);
+  // Reference seconds per monotonic second (audio clock slaving); 1.0 = free-running.
+  void set_rate(int64_t now_ns, double rate);
+
+  // Call on wakeup. Returns the number of steps due now (0 for an early wakeup).
+  uint32_t advance(int64_t now_ns);
+  int64_t next_deadline_ns() const;
+
+  double bpm() const { return bpm_; }
+  double rate() const { return rate_; }
+  double period_ns() const { return period_ns_; }
+
+  const ClockStats& stats() const { return stats_; }
+  const LatenessHistogram& lateness() const { return hist_; }
+
+ private:
+  void rebase(int64_t now_ns, double period_ns);
+
+  double bpm_ = 110.0;
+  double rate_ = 1.0;
+  double period_ns_ = 0.0;
+  int64_t origin_ns_ = 0;
+  uint64_t k_ = 0; // steps completed since origin
+  ClockOverrun overrun_ = ClockOverrun::Skip;
+
+  ClockStats stats_{};
+  LatenessHistogram hist_{};
+};
+
+// Estimates reference-clock speed from (frames, monotonic time) pairs taken by the audio callback.
+// Long windows + EMA keep buffer-granularity jitter out; the result is clamped to +-1%.
+class AudioClockTracker {
+ public:
+  static constexpr int64_t kWindowNs = 2'000'000'000;
+
+  // Returns true when a new rate estimate is available in rate().
+  bool observe(uint64_t frames, int64_t mono_ns, uint32_t sample_rate);
+  void reset() { have_ = false; rate_ = 1.0; }
+  double rate() const { return rate_; }
+
+ private:
+  bool have_ = false;
+  uint64_t frames0_ = 0;
+  int64_t ns0_ = 0;
+  uint32_t sr_ = 0;
+  double rate_ = 1.0;
+};
+
+} // namespace khor
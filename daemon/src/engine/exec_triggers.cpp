@@ -0,0 +1,49 @@
+#include "engine/exec_triggers.h"
+
+#include <algorithm>
+
+#include "engine/music.h"
+
+namespace khor {
+
+bool comm_glob_match(std::string_view pattern, std::string_view comm) {
+  // Iterative '*' backtracking: remember the last star and retry one character further on.
+  std::size_t p = 0, s = 0;
+  std::size_t star = std::string_view::npos, resume = 0;
+  while (s < comm.size()) {
+    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == comm[s])) {
+      p++;
+      s++;
+    } else if (p < pattern.size() && pattern[p] == '*') {
+      star = p++;
+      resume = s;
+    } else if (star != std::string_view::npos) {
+      p = star + 1;
+      s = ++resume;
+    } else {
+      return false;
+    }
+  }
+  while (p < pattern.size() && pattern[p] == '*') p++;
+  return p == pattern.size();
+}
+
+void ExecTriggerTable::configure(const std::vector<ExecTrigger>& triggers) {
+  triggers_.assign(triggers.begin(), triggers.begin() + (std::ptrdiff_t)std::min(triggers.size(), kMaxTriggers));
+}
+
+bool ExecTriggerTable::match(std::string_view comm, uint64_t cgroup_id, int key_midi, NoteBuffer* out) const {
+  for (const auto& t : triggers_) {
+    if (t.cgroup_id && t.cgroup_id != cgroup_id) continue;
+    if (!comm_glob_match(t.comm, comm)) continue;
+    NoteEvent n;
+    n.midi = std::clamp(key_midi + t.semitones, 0, 127);
+    n.velocity = (float)std::clamp(t.velocity, 0.0, 1.0);
+    n.dur_s = (float)std::max(t.duration, 0.01);
+    n.channel = std::clamp(t.channel, 1, 16);
+    return out && out->push_back(n);
+  }
+  return false;
+}
+
+} // namespace khor
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "engine/music.h"
+#include "util/spsc_queue.h"
+
+namespace khor {
+
+// A note played when a matching process execs (features.exec_events).
+struct ExecTrigger {
+  std::string comm;       // glob over the comm (at most 15 chars): '*' any run, '?' any one char
+  uint64_t cgroup_id = 0; // 0 = any cgroup
+  int semitones = 12;     // from the key
+  double velocity = 0.7;  // 0..1
+  double duration = 0.25; // seconds
+  int channel = 1;        // 1..16
+
+  bool operator==(const ExecTrigger&) const = default;
+};
+
+bool comm_glob_match(std::string_view pattern, std::string_view comm);
+
+// The configured triggers, checked in order; the first match plays. Built off the hot path,
+// matched on the sequencer thread without allocating.
+class ExecTriggerTable {
+ public:
+  static constexpr std::size_t kMaxTriggers = 16;
+
+  void configure(const std::vector<ExecTrigger>& triggers);
+  bool empty() const { return triggers_.empty(); }
+
+  // Appends the first matching trigger's note; false if none matches or out is full.
+  bool match(std::string_view comm, uint64_t cgroup_id, int key_midi, NoteBuffer* out) const;
+
+  // Plays queued execs into out. Stops while out is full, so an exec is never taken without
+  // its note; the rest wait for the next step. Without triggers the queue is just emptied.
+  // Returns the execs that matched.
+  template <typename Event, std::size_t N>
+  std::size_t drain(SpscQueue<Event, N>* q, int key_midi, NoteBuffer* out) const {
+    std::size_t hits = 0;
+    Event ev;
+    while ((empty() || !out->full()) && q->pop(&ev)) {
+      if (empty()) continue;
+      const std::string_view comm(ev.comm.data(), ::strnlen(ev.comm.data(), ev.comm.size()));
+      if (match(comm, ev.cgroup_id, key_midi, out)) hits++;
+    }
+    return hits;
+  }
+
+ private:
+  std::vector<ExecTrigger> triggers_;
+};
+
+} // namespace khor
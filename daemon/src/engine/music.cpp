@@ -1,34 +1,16 @@
 #include "engine/music.h"
 
 #include <algorithm>
-#include <array>
 #include <cmath>
 
+#include "engine/preset_rules.h"
+#include "engine/presets.h"
+
 namespace khor {
 namespace {
 
-static float clamp01f(float v) { return std::clamp(v, 0.0f, 1.0f); }
-static double clamp01(double v) { return std::clamp(v, 0.0, 1.0); }
-
-struct ScaleDef {
-  const int* degrees = nullptr;
-  int count = 0;
-};
-
-static ScaleDef scale_from_string(const std::string& s) {
-  static constexpr int kPentaMinor[] = {0, 3, 5, 7, 10};
-  static constexpr int kNatMinor[] = {0, 2, 3, 5, 7, 8, 10};
-  static constexpr int kDorian[] = {0, 2, 3, 5, 7, 9, 10};
-
-  auto eq = [&](const char* name) -> bool {
-    return s == name;
-  };
-
-  if (eq("pentatonic_minor") || eq("penta_minor") || eq("pentatonic")) return {kPentaMinor, (int)(sizeof(kPentaMinor) / sizeof(kPentaMinor[0]))};
-  if (eq("natural_minor") || eq("minor")) return {kNatMinor, (int)(sizeof(kNatMinor) / sizeof(kNatMinor[0]))};
-  if (eq("dorian")) return {kDorian, (int)(sizeof(kDorian) / sizeof(kDorian[0]))};
-  return {kPentaMinor, (int)(sizeof(kPentaMinor) / sizeof(kPentaMinor[0]))};
-}
+using preset::clamp01;
+using preset::push_note;
 
 static uint64_t splitmix64(uint64_t& x) {
   uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
@@ -37,199 +19,176 @@ static uint64_t splitmix64(uint64_t& x) {
   return z ^ (z >> 31);
 }
 
-static double frand01(uint64_t& state) {
-  uint64_t v = splitmix64(state);
+} // namespace
+
+double StepState::rand01() {
+  uint64_t v = splitmix64(seed);
   // 53 bits of mantissa.
   return (double)(v >> 11) * (1.0 / 9007199254740992.0);
 }
 
-static int pick_note(int key_midi, const ScaleDef& sc, int degree, int octave) {
-  if (sc.count <= 0) return std::clamp(key_midi, 0, 127);
-  degree %= sc.count;
-  if (degree < 0) degree += sc.count;
-  int midi = key_midi + sc.degrees[degree] + octave * 12;
-  return std::clamp(midi, 0, 127);
-}
+MusicEngine::MusicEngine() { configure(MusicConfig{}); }
 
-// MIDI channel convention for DAW routing.
-static constexpr int kChMelody = 1;
-static constexpr int kChBass   = 2;
-static constexpr int kChChords = 3;
-static constexpr int kChPerc   = 10;
-
-static void push_note(std::vector<NoteEvent>& out, int midi, float vel, float dur_s, int ch = 1) {
-  NoteEvent ev;
-  ev.midi = std::clamp(midi, 0, 127);
-  ev.velocity = clamp01f(vel);
-  ev.dur_s = std::max(0.02f, dur_s);
-  ev.channel = ch;
-  out.push_back(ev);
+void MusicEngine::configure(const MusicConfig& cfg) {
+  const PresetDef* def = lib_ ? lib_->find(cfg.preset) : preset_find(cfg.preset);
+  preset_.def = def ? def : &builtin_presets()[0];
+
+  const ScaleDef& sc = scale_find(cfg.scale);
+  preset_.scale_count = sc.count;
+  std::copy(std::begin(sc.degrees), std::end(sc.degrees), preset_.scale.begin());
+
+  preset_.key_midi = std::clamp(cfg.key_midi, 0, 127);
+  rebuild_pitch_table();
 }
 
-} // namespace
+void MusicEngine::set_key(int key_midi) {
+  key_midi = std::clamp(key_midi, 0, 127);
+  if (key_midi == preset_.key_midi) return;
+  preset_.key_midi = key_midi;
+  rebuild_pitch_table();
+}
 
-MusicFrame MusicEngine::tick(const Signal01& s_in, const MusicConfig& cfg_in) {
-  Signal01 s = s_in;
-  MusicConfig cfg = cfg_in;
+void MusicEngine::rebuild_pitch_table() {
+  for (int oct = 0; oct < CompiledPreset::kOctaves; oct++) {
+    for (int deg = 0; deg < 12; deg++) {
+      const int d = preset_.scale_count > 0 ? deg % preset_.scale_count : 0;
+      const int midi = preset_.key_midi + preset_.scale[(std::size_t)d] + oct * 12;
+      preset_.pitch[(std::size_t)(oct * 12 + deg)] = std::clamp(midi, 0, 127);
+    }
+  }
+}
 
-  cfg.density = clamp01(cfg.density);
-  if (!(cfg.bpm > 1.0 && cfg.bpm < 400.0)) cfg.bpm = 110.0;
-  cfg.key_midi = std::clamp(cfg.key_midi, 0, 127);
+MusicFrame MusicEngine::tick(const Signal01& s, const MusicConfig& cfg) {
+  configure(cfg);
+  return tick(s, cfg.density);
+}
 
-  const ScaleDef sc = scale_from_string(cfg.scale);
-  const double activity = std::max({s.exec, s.rx, s.tx, s.csw, s.io, s.retx, s.irq});
+MusicFrame MusicEngine::tick(const Signal01& s, double density) {
+  const CompiledPreset& p = preset_;
+  const double activity = std::max({s.exec, s.rx, s.tx, s.csw, s.io, s.retx, s.irq, s.drop, s.churn, s.vfs, s.fsync, s.listen});
 
   MusicFrame out;
-  out.notes.reserve(8);
 
-  // Synth params: map IO to cutoff; map exec to resonance; presets adjust FX.
-  SynthParams sp;
-  sp.cutoff01 = (float)clamp01(0.30 + 0.60 * s.io + 0.15 * (s.rx + s.tx) * 0.5 - 0.20 * s.mem);
-  sp.resonance01 = (float)clamp01(0.18 + 0.55 * s.exec + 0.15 * s.mem);
+  // Synth params: map IO (block or VFS, whichever is busier) to cutoff; map exec to resonance; presets adjust FX.
+  out.synth.cutoff01 = (float)clamp01(0.30 + 0.60 * std::max(s.io, s.vfs) + 0.15 * (s.rx + s.tx) * 0.5 - 0.20 * s.mem);
+  out.synth.resonance01 = (float)clamp01(0.18 + 0.55 * s.exec + 0.15 * s.mem);
+  // IPC tilts the filter: efficient code opens it, stalled code muffles it.
+  if (s.ipc > 0.0) out.synth.cutoff01 = (float)clamp01(out.synth.cutoff01 + 0.20 * (s.ipc - 0.4));
 
-  const bool silent_by_default = (cfg.preset != "drone");
-  if (silent_by_default && activity < 0.03) {
+  if (p.def->idle_silence && activity < 0.03) {
     // Still advance the clock, but don't emit anything.
     step_ = (step_ + 1) & 15;
     if (step_ == 0) bar_++;
-    out.synth = sp;
     return out;
   }
 
+  StepState st;
+  st.step = step_;
+  st.density = clamp01(density);
+  st.activity = activity;
+
   // Deterministic randomness seeded by the current grid position + signals.
-  uint64_t seed = 0x6a09e667f3bcc909ULL;
-  seed ^= (uint64_t)bar_ * 0x9e3779b97f4a7c15ULL;
-  seed ^= (uint64_t)step_ * 0xbf58476d1ce4e5b9ULL;
-  seed ^= (uint64_t)std::llround(s.exec * 1000000.0) * 0x94d049bb133111ebULL;
-  seed ^= (uint64_t)std::llround(s.rx * 1000000.0) * 0x2545f4914f6cdd1dULL;
-  seed ^= (uint64_t)std::llround(s.tx * 1000000.0) * 0x7f4a7c159e3779b9ULL;
-  seed ^= (uint64_t)std::llround(s.csw * 1000000.0) * 0x1ce4e5b9bf58476dULL;
-  seed ^= (uint64_t)std::llround(s.io * 1000000.0) * 0x133111eb94d049bbULL;
-
-  const double dens = cfg.density;
-
-  if (cfg.preset == "ambient") {
-    sp.reverb_mix01 = (float)clamp01(0.38 + 0.35 * s.rx + 0.15 * s.mem);
-    sp.delay_mix01 = (float)clamp01(0.10 + 0.22 * s.tx);
-
-    const double p_note = dens * (0.12 + 0.88 * activity) * 0.35;
-    if (frand01(seed) < p_note) {
-      const int deg = (int)(frand01(seed) * sc.count);
-      const int oct = (int)(frand01(seed) * 3.0); // 0..2
-      const int midi = pick_note(cfg.key_midi, sc, deg, oct);
-      const float vel = (float)clamp01(0.12 + 0.70 * (0.65 * s.rx + 0.35 * s.tx));
-      const float dur = (float)std::clamp(0.20 + 0.70 * (0.40 + 0.60 * s.rx) * (0.30 + 0.70 * dens), 0.10, 1.10);
-      push_note(out.notes, midi, vel, dur, kChMelody);
-    }
+  st.seed = 0x6a09e667f3bcc909ULL;
+  st.seed ^= (uint64_t)bar_ * 0x9e3779b97f4a7c15ULL;
+  st.seed ^= (uint64_t)step_ * 0xbf58476d1ce4e5b9ULL;
+  st.seed ^= (uint64_t)std::llround(s.exec * 1000000.0) * 0x94d049bb133111ebULL;
+  st.seed ^= (uint64_t)std::llround(s.rx * 1000000.0) * 0x2545f4914f6cdd1dULL;
+  st.seed ^= (uint64_t)std::llround(s.tx * 1000000.0) * 0x7f4a7c159e3779b9ULL;
+  st.seed ^= (uint64_t)std::llround(s.csw * 1000000.0) * 0x1ce4e5b9bf58476dULL;
+  st.seed ^= (uint64_t)std::llround(s.io * 1000000.0) * 0x133111eb94d049bbULL;
 
-    // Exec accents: gentle dyads.
-    const double p_exec = dens * s.exec * 0.18;
-    if (frand01(seed) < p_exec) {
-      const int root = pick_note(cfg.key_midi, sc, 0, 1);
-      const int fifth = pick_note(cfg.key_midi, sc, 2, 1); // in pentatonic this is close to a fifth-ish feel
-      push_note(out.notes, root, 0.42f, 0.35f, kChChords);
-      push_note(out.notes, fifth, 0.30f, 0.35f, kChChords);
-    }
-  } else if (cfg.preset == "percussive") {
-    sp.cutoff01 = (float)clamp01(0.62 + 0.30 * s.io);
-    sp.reverb_mix01 = (float)clamp01(0.10 + 0.15 * s.rx);
-    sp.delay_mix01 = (float)clamp01(0.06 + 0.10 * s.tx);
-
-    // Kick-like low note on downbeats influenced by exec.
-    if (step_ % 4 == 0) {
-      const double p_kick = dens * (0.05 + 0.95 * s.exec) * 0.65;
-      if (frand01(seed) < p_kick) {
-        const int midi = std::clamp(cfg.key_midi - 24, 0, 127);
-        push_note(out.notes, midi, (float)clamp01(0.35 + 0.55 * s.exec), 0.08f, kChBass);
-      }
+  p.def->step(p, s, st, out);
+
+  // Round-trip time: the farther away the peers, the wetter the echo.
+  out.synth.delay_mix01 = (float)clamp01(out.synth.delay_mix01 + 0.35 * s.rtt);
+
+  const double dens = st.density;
+
+  // TCP retransmit glitch: chromatic stab outside the scale.
+  if (s.retx > 0.08) {
+    const double p_glitch = dens * s.retx * 0.6;
+    if (st.rand01() < p_glitch) {
+      int semi = (int)(st.rand01() * 12.0);
+      int oct = 2 + (int)(st.rand01() * 2.0);
+      push_note(out, p.offset(semi + oct * 12), (float)clamp01(0.25 + 0.60 * s.retx), 0.06f, p.ch_perc);
     }
+  }
 
-    // Clicks from scheduler activity.
-    const double p_click = dens * (0.10 + 0.90 * s.csw) * 0.95;
-    if (frand01(seed) < p_click) {
-      const int deg = (int)(frand01(seed) * sc.count);
-      const int midi = pick_note(cfg.key_midi, sc, deg, 3 + (step_ & 1)); // high
-      push_note(out.notes, midi, (float)clamp01(0.18 + 0.75 * s.csw), 0.05f, kChPerc);
+  // IRQ texture: very short hi-hat-like notes in high register.
+  if (s.irq > 0.10) {
+    const double p_tick = dens * s.irq * 0.40;
+    if (st.rand01() < p_tick) {
+      int deg = (int)(st.rand01() * p.scale_count);
+      int midi = p.note(deg, 4 + (int)(step_ & 1));
+      push_note(out, midi, (float)clamp01(0.06 + 0.18 * s.irq), 0.02f, p.ch_perc);
     }
+  }
 
-    // Network adds mid hits.
-    const double p_mid = dens * (0.10 + 0.90 * (s.rx + s.tx) * 0.5) * 0.35;
-    if (frand01(seed) < p_mid) {
-      const int deg = (int)(frand01(seed) * sc.count);
-      const int midi = pick_note(cfg.key_midi, sc, deg, 2);
-      push_note(out.notes, midi, (float)clamp01(0.10 + 0.60 * (s.rx + s.tx) * 0.5), 0.07f, kChPerc);
+  // CPU profile concentration: one hot function drones a root pedal at the bar; spread-out load stays quiet.
+  if (s.entropy > 0.0 && step_ == 0) {
+    const double focus = 1.0 - s.entropy;
+    if (st.rand01() < dens * focus * 0.5) {
+      push_note(out, p.note(0, 1), (float)clamp01(0.15 + 0.35 * focus), 1.5f, p.ch_bass);
     }
-  } else if (cfg.preset == "arp") {
-    sp.reverb_mix01 = (float)clamp01(0.18 + 0.20 * s.rx);
-    sp.delay_mix01 = (float)clamp01(0.22 + 0.35 * s.tx);
-
-    static constexpr int kPattern[] = {0, 1, 2, 1};
-    const int pdeg = kPattern[step_ & 3];
-    const double gate = (s.rx + s.tx) * 0.5;
-    const double p_arp = dens * (0.20 + 0.80 * gate);
-    if (gate > 0.05 && frand01(seed) < p_arp) {
-      const int midi = pick_note(cfg.key_midi, sc, pdeg, 2 + ((step_ >> 2) & 1));
-      const float vel = (float)clamp01(0.12 + 0.75 * gate);
-      push_note(out.notes, midi, vel, 0.12f, kChMelody);
+  }
+
+  // Many different processes on the CPUs: a wide, quiet chord at the bar, one voice per order of magnitude.
+  if (s.actors > 0.25 && step_ == 0 && st.rand01() < dens * 0.5) {
+    const int voices = 1 + (int)std::lround(s.actors * 3.0);
+    for (int v = 0; v < voices; v++) {
+      push_note(out, p.note(v * 2, 2 + v / 2), (float)clamp01(0.05 + 0.15 * s.actors), 1.0f, p.ch_chords);
     }
+  }
 
-    // Exec adds chord stabs on bar start.
-    if (step_ == 0) {
-      const double p_stab = dens * (0.10 + 0.90 * s.exec) * 0.6;
-      if (frand01(seed) < p_stab) {
-        const int root = pick_note(cfg.key_midi, sc, 0, 1);
-        const int up = pick_note(cfg.key_midi, sc, 2, 1);
-        push_note(out.notes, root, 0.45f, 0.20f, kChChords);
-        push_note(out.notes, up, 0.30f, 0.20f, kChChords);
-      }
+  // Tasks stuck in D state: a low tritone drags on the half-bar.
+  if (s.dstate > 0.15 && (step_ & 7) == 4) {
+    if (st.rand01() < dens * s.dstate * 0.7) {
+      push_note(out, p.offset(6 + 12), (float)clamp01(0.12 + 0.40 * s.dstate), 1.2f, p.ch_chords);
     }
-  } else { // drone
-    sp.reverb_mix01 = (float)clamp01(0.45 + 0.25 * s.rx + 0.12 * s.mem);
-    sp.delay_mix01 = (float)clamp01(0.05 + 0.10 * s.tx);
-    sp.cutoff01 = (float)clamp01(0.18 + 0.78 * s.io);
-    sp.resonance01 = (float)clamp01(0.30 + 0.55 * s.exec);
-
-    // Sustain a low root by retriggering each bar.
-    if (step_ == 0) {
-      const int midi = std::clamp(cfg.key_midi - 24, 0, 127);
-      push_note(out.notes, midi, (float)clamp01(0.08 + 0.28 * s.io), 2.3f, kChBass);
+  }
+
+  // Packet drops: a note cut off almost as soon as it starts, an octave below the retransmit glitches.
+  if (s.drop > 0.08) {
+    if (st.rand01() < dens * s.drop * 0.5) {
+      const int deg = (int)(st.rand01() * p.scale_count);
+      push_note(out, p.note(deg, 1), (float)clamp01(0.20 + 0.55 * s.drop), 0.015f, p.ch_perc);
     }
-    if (step_ == 8 && activity > 0.10) {
-      const int midi = std::clamp(cfg.key_midi - 12, 0, 127);
-      push_note(out.notes, midi, (float)clamp01(0.05 + 0.20 * activity), 1.6f, kChBass);
+  }
+
+  // Lock contention: the same short note stutters on the offbeats, like a spinning CPU.
+  if (s.lock > 0.12 && (step_ & 1)) {
+    if (st.rand01() < dens * s.lock * 0.5) {
+      push_note(out, p.note(4, 3), (float)clamp01(0.10 + 0.35 * s.lock), 0.03f, p.ch_perc);
     }
+  }
 
-    // Network sprinkles.
-    const double p_top = dens * (0.05 + 0.95 * (s.rx + s.tx) * 0.5) * 0.25;
-    if (frand01(seed) < p_top) {
-      const int deg = (int)(frand01(seed) * sc.count);
-      const int midi = pick_note(cfg.key_midi, sc, deg, 3);
-      push_note(out.notes, midi, (float)clamp01(0.05 + 0.35 * (s.rx + s.tx) * 0.5), 0.40f, kChMelody);
+  // Process churn: clicks climbing the scale in the top register, one per step, like a loop spinning.
+  if (s.churn > 0.10) {
+    if (st.rand01() < dens * s.churn * 0.6) {
+      push_note(out, p.note((int)step_, 4), (float)clamp01(0.08 + 0.30 * s.churn), 0.02f, p.ch_perc);
     }
   }
 
-  // TCP retransmit glitch: chromatic stab outside the scale.
-  if (s.retx > 0.08) {
-    const double p_glitch = dens * s.retx * 0.6;
-    if (frand01(seed) < p_glitch) {
-      int semi = (int)(frand01(seed) * 12.0);
-      int oct = 2 + (int)(frand01(seed) * 2.0);
-      int midi = std::clamp(cfg.key_midi + semi + oct * 12, 0, 127);
-      push_note(out.notes, midi, (float)clamp01(0.25 + 0.60 * s.retx), 0.06f, kChPerc);
+  // fsync stalls: a low fifth held across the beat, longer the longer commits wait.
+  if (s.fsync > 0.12 && (step_ & 3) == 0) {
+    if (st.rand01() < dens * s.fsync * 0.6) {
+      push_note(out, p.offset(7), (float)clamp01(0.15 + 0.40 * s.fsync), (float)(0.3 + 1.2 * s.fsync), p.ch_bass);
     }
   }
 
-  // IRQ texture: very short hi-hat-like notes in high register.
-  if (s.irq > 0.10) {
-    const double p_tick = dens * s.irq * 0.40;
-    if (frand01(seed) < p_tick) {
-      int deg = (int)(frand01(seed) * sc.count);
-      int midi = pick_note(cfg.key_midi, sc, deg, 4 + (step_ & 1));
-      push_note(out.notes, midi, (float)clamp01(0.06 + 0.18 * s.irq), 0.02f, kChPerc);
+  // Cache misses: a minor second grinds against the root in the bass at the half-bars.
+  if (s.miss > 0.15 && (step_ & 7) == 0) {
+    if (st.rand01() < dens * s.miss * 0.6) {
+      push_note(out, p.offset(1), (float)clamp01(0.12 + 0.35 * s.miss), 0.5f, p.ch_bass);
     }
   }
 
-  out.synth = sp;
+  // Listen queue overflow: a busy tone, two notes alternating on the offbeat eighths.
+  if (s.listen > 0.08 && (step_ & 1)) {
+    if (st.rand01() < dens * s.listen * 0.7) {
+      push_note(out, p.note((step_ & 2) ? 2 : 0, 3), (float)clamp01(0.15 + 0.45 * s.listen), 0.08f, p.ch_perc);
+    }
+  }
 
   step_ = (step_ + 1) & 15;
   if (step_ == 0) bar_++;
@@ -238,4 +197,3 @@ MusicFrame MusicEngine::tick(const Signal01& s_in, const MusicConfig& cfg_in) {
 }
 
 } // namespace khor
-
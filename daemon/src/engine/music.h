@@ -1,19 +1,23 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <memory>
 #include <string>
-#include <vector>
 
 #include "engine/note_event.h"
 #include "engine/signals.h"
 
 namespace khor {
 
+struct PresetDef;
+class PresetLibrary;
+
 struct MusicConfig {
   double bpm = 110.0;
   int key_midi = 62; // D4
   std::string scale = "pentatonic_minor";
-  std::string preset = "ambient"; // ambient|percussive|arp|drone
+  std::string preset = "ambient"; // see presets.cpp for the registry
   double density = 0.35;          // 0..1
 };
 
@@ -24,16 +28,111 @@ struct SynthParams {
   float reverb_mix01 = 0.15f;
 };
 
+// Notes produced by one tick. Inline storage so a tick never allocates;
+// notes beyond capacity are dropped (and counted).
+class NoteBuffer {
+ public:
+  static constexpr std::size_t kCapacity = 32;
+
+  bool push_back(const NoteEvent& ev) {
+    if (n_ == kCapacity) {
+      dropped_++;
+      return false;
+    }
+    buf_[n_++] = ev;
+    return true;
+  }
+
+  std::size_t size() const { return n_; }
+  bool empty() const { return n_ == 0; }
+  bool full() const { return n_ == kCapacity; }
+  uint32_t dropped() const { return dropped_; }
+
+  const NoteEvent& operator[](std::size_t i) const { return buf_[i]; }
+  const NoteEvent* begin() const { return buf_.data(); }
+  const NoteEvent* end() const { return buf_.data() + n_; }
+
+ private:
+  std::array<NoteEvent, kCapacity> buf_{};
+  std::size_t n_ = 0;
+  uint32_t dropped_ = 0;
+};
+
 struct MusicFrame {
-  std::vector<NoteEvent> notes;
+  NoteBuffer notes;
   SynthParams synth;
 };
 
+// A preset resolved against the configured scale and key. Built by
+// MusicEngine::configure()/set_key(); the tick only does table lookups.
+struct CompiledPreset {
+  static constexpr int kOctaves = 6;
+
+  const PresetDef* def = nullptr;
+  int key_midi = 62;
+  int scale_count = 0;
+  std::array<int, 12> scale{};
+  std::array<int, kOctaves * 12> pitch{}; // pitch[octave * 12 + degree], clamped MIDI
+
+  // MIDI channel per voice role (DAW routing convention).
+  int ch_melody = 1;
+  int ch_bass = 2;
+  int ch_chords = 3;
+  int ch_perc = 10;
+
+  int note(int degree, int octave) const {
+    if (scale_count <= 0) return key_midi;
+    degree %= scale_count;
+    if (degree < 0) degree += scale_count;
+    if (octave >= 0 && octave < kOctaves) return pitch[(std::size_t)(octave * 12 + degree)];
+    const int midi = key_midi + scale[(std::size_t)degree] + octave * 12;
+    return midi < 0 ? 0 : (midi > 127 ? 127 : midi);
+  }
+
+  // Key-relative pitch outside the scale (bass roots, chromatic stabs).
+  int offset(int semitones) const {
+    const int midi = key_midi + semitones;
+    return midi < 0 ? 0 : (midi > 127 ? 127 : midi);
+  }
+};
+
+// Per-tick state handed to a preset's step function.
+struct StepState {
+  uint32_t step = 0; // 0..15
+  double density = 0.0;
+  double activity = 0.0;
+  uint64_t seed = 0;
+
+  // Deterministic randomness; advances the seed.
+  double rand01();
+};
+
 // Deterministic 16th-note sequencer driven by Signal01.
 class MusicEngine {
  public:
+  MusicEngine();
+
+  // Presets are looked up here (built-ins + user presets); nullptr means built-ins only.
+  // The engine keeps the snapshot alive, so a reload never invalidates the active preset.
+  void set_library(std::shared_ptr<const PresetLibrary> lib) { lib_ = std::move(lib); }
+
+  // Resolves preset + scale + key. Call when the config changes, not per tick.
+  void configure(const MusicConfig& cfg);
+  // Rebuilds the pitch table only if the key actually changed.
+  void set_key(int key_midi);
+
+  MusicFrame tick(const Signal01& s, double density);
+  // One-shot convenience (tests, tools): configure() + tick().
   MusicFrame tick(const Signal01& s, const MusicConfig& cfg);
 
+  const CompiledPreset& preset() const { return preset_; }
+
+  // Takes over another engine's bar/step position, so swapping in a reconfigured engine keeps the groove.
+  void continue_from(const MusicEngine& prev) {
+    bar_ = prev.bar_;
+    step_ = prev.step_;
+  }
+
   // For scheduling the next tick.
   static double tick_ms(double bpm) {
     // 16th note grid.
@@ -45,9 +144,12 @@ class MusicEngine {
   }
 
  private:
+  void rebuild_pitch_table();
+
+  std::shared_ptr<const PresetLibrary> lib_;
+  CompiledPreset preset_{};
   uint64_t bar_ = 0;
   uint32_t step_ = 0; // 0..15
 };
 
 } // namespace khor
-
@@ -0,0 +1,444 @@
+#include "engine/preset_rules.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace khor {
+namespace {
+
+using preset::clamp01;
+using preset::push_note;
+
+struct NamedSource {
+  const char* name;
+  RuleSource src;
+};
+
+static constexpr NamedSource kSources[] = {
+  {"exec", RuleSource::Exec}, {"rx", RuleSource::Rx},     {"tx", RuleSource::Tx},
+  {"csw", RuleSource::Csw},   {"io", RuleSource::Io},     {"retx", RuleSource::Retx},
+  {"irq", RuleSource::Irq},   {"mem", RuleSource::Mem},   {"net", RuleSource::Net},
+  {"entropy", RuleSource::Entropy}, {"dstate", RuleSource::Dstate}, {"lock", RuleSource::Lock},
+  {"drop", RuleSource::Drop},       {"spawners", RuleSource::Spawners}, {"actors", RuleSource::Actors},
+  {"peers", RuleSource::Peers},       {"churn", RuleSource::Churn},
+  {"vfs", RuleSource::Vfs},           {"fsync", RuleSource::Fsync},
+  {"rtt", RuleSource::Rtt},           {"listen", RuleSource::Listen},
+  {"ipc", RuleSource::Ipc},           {"miss", RuleSource::Miss},
+  {"activity", RuleSource::Activity}, {"one", RuleSource::One},
+};
+
+static constexpr const char* kSynthNames[] = {"cutoff", "resonance", "delay", "reverb"};
+static constexpr float SynthParams::*kSynthFields[] = {
+  &SynthParams::cutoff01,
+  &SynthParams::resonance01,
+  &SynthParams::delay_mix01,
+  &SynthParams::reverb_mix01,
+};
+
+struct NamedChannel {
+  const char* name;
+  int channel;
+};
+
+static constexpr NamedChannel kChannels[] = {
+  {"melody", CompiledPreset{}.ch_melody},
+  {"bass", CompiledPreset{}.ch_bass},
+  {"chords", CompiledPreset{}.ch_chords},
+  {"perc", CompiledPreset{}.ch_perc},
+};
+
+static void step_rules(const CompiledPreset& p, const Signal01& s, StepState& st, MusicFrame& out) {
+  const RuleTable& t = *p.def->rules;
+
+  std::array<float, (std::size_t)RuleSource::Count> src;
+  src[(std::size_t)RuleSource::Exec] = (float)s.exec;
+  src[(std::size_t)RuleSource::Rx] = (float)s.rx;
+  src[(std::size_t)RuleSource::Tx] = (float)s.tx;
+  src[(std::size_t)RuleSource::Csw] = (float)s.csw;
+  src[(std::size_t)RuleSource::Io] = (float)s.io;
+  src[(std::size_t)RuleSource::Retx] = (float)s.retx;
+  src[(std::size_t)RuleSource::Irq] = (float)s.irq;
+  src[(std::size_t)RuleSource::Mem] = (float)s.mem;
+  src[(std::size_t)RuleSource::Entropy] = (float)s.entropy;
+  src[(std::size_t)RuleSource::Dstate] = (float)s.dstate;
+  src[(std::size_t)RuleSource::Lock] = (float)s.lock;
+  src[(std::size_t)RuleSource::Drop] = (float)s.drop;
+  src[(std::size_t)RuleSource::Churn] = (float)s.churn;
+  src[(std::size_t)RuleSource::Vfs] = (float)s.vfs;
+  src[(std::size_t)RuleSource::Fsync] = (float)s.fsync;
+  src[(std::size_t)RuleSource::Rtt] = (float)s.rtt;
+  src[(std::size_t)RuleSource::Listen] = (float)s.listen;
+  src[(std::size_t)RuleSource::Ipc] = (float)s.ipc;
+  src[(std::size_t)RuleSource::Miss] = (float)s.miss;
+  src[(std::size_t)RuleSource::Spawners] = (float)s.spawners;
+  src[(std::size_t)RuleSource::Actors] = (float)s.actors;
+  src[(std::size_t)RuleSource::Peers] = (float)s.peers;
+  src[(std::size_t)RuleSource::Net] = (float)((s.rx + s.tx) * 0.5);
+  src[(std::size_t)RuleSource::Activity] = (float)st.activity;
+  src[(std::size_t)RuleSource::One] = 1.0f;
+
+  for (int i = 0; i < t.synth_count; i++) {
+    const SynthRule& r = t.synth[(std::size_t)i];
+    out.synth.*kSynthFields[(std::size_t)r.target] = (float)clamp01(r.base + r.gain * src[(std::size_t)r.src]);
+  }
+
+  const uint16_t step_bit = (uint16_t)(1u << (st.step & 15u));
+  const float dens = (float)st.density;
+
+  for (int i = 0; i < t.rule_count; i++) {
+    const PresetRule& r = t.rules[(std::size_t)i];
+    const float v = src[(std::size_t)r.src];
+    if (!(r.step_mask & step_bit) || !(v > r.min)) continue;
+    if (st.rand01() >= dens * (r.p_base + r.p_gain * v)) continue;
+
+    const float vel = r.vel_base + r.vel_gain * v;
+    if (r.fixed_pitch) {
+      push_note(out, p.offset(r.semitones), vel, r.dur_s, r.channel);
+      continue;
+    }
+
+    int deg = r.degree[st.step & 15u];
+    if (deg == PresetRule::kRandomDegree) deg = (int)(st.rand01() * p.scale_count);
+    const int oct = r.oct_lo + (r.oct_span > 0 ? (int)(st.rand01() * (r.oct_span + 1)) : 0);
+    for (int c = 0; c < r.chord_n; c++) {
+      push_note(out, p.note(deg + r.chord[(std::size_t)c], oct), vel, r.dur_s, r.channel);
+    }
+  }
+}
+
+// ---- Compilation ----
+
+static bool fail(std::string* err, const std::string& where, const std::string& msg) {
+  if (err) *err = where + ": " + msg;
+  return false;
+}
+
+static bool is_int(const JsonValue& v, double lo, double hi) {
+  return v.is_number() && std::floor(v.num) == v.num && v.num >= lo && v.num <= hi;
+}
+
+static bool in_range(const JsonValue& v, double lo, double hi) {
+  return v.is_number() && std::isfinite(v.num) && v.num >= lo && v.num <= hi;
+}
+
+static bool parse_source(const JsonValue* v, RuleSource def, RuleSource* out) {
+  if (!v) {
+    *out = def;
+    return true;
+  }
+  if (!v->is_string()) return false;
+  for (const auto& s : kSources) {
+    if (v->s == s.name) {
+      *out = s.src;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Number or [base, gain].
+static bool parse_pair(const JsonValue* v, float* base, float* gain, double lo, double hi) {
+  if (!v) return true;
+  if (v->is_number()) {
+    if (!in_range(*v, lo, hi)) return false;
+    *base = (float)v->num;
+    *gain = 0.0f;
+    return true;
+  }
+  if (!v->is_array() || v->a.size() != 2 || !in_range(v->a[0], lo, hi) || !in_range(v->a[1], -hi, hi)) return false;
+  *base = (float)v->a[0].num;
+  *gain = (float)v->a[1].num;
+  return true;
+}
+
+static bool compile_rule(const JsonValue& j, const std::string& where, PresetRule* r, std::string* err) {
+  if (!j.is_object()) return fail(err, where, "must be an object");
+
+  if (!parse_source(json_get(j, "signal"), RuleSource::One, &r->src)) return fail(err, where, "unknown signal");
+
+  if (const JsonValue* v = json_get(j, "min")) {
+    if (!in_range(*v, 0.0, 1.0)) return fail(err, where + ".min", "must be 0..1");
+    r->min = (float)v->num;
+  }
+
+  if (!json_get(j, "p")) return fail(err, where + ".p", "required");
+  if (!parse_pair(json_get(j, "p"), &r->p_base, &r->p_gain, 0.0, 1.0)) {
+    return fail(err, where + ".p", "must be a probability or [base, gain] within 0..1");
+  }
+
+  // Step gating: explicit list, or every/phase.
+  if (const JsonValue* v = json_get(j, "steps")) {
+    if (!v->is_array() || v->a.empty()) return fail(err, where + ".steps", "must be a non-empty array of 0..15");
+    r->step_mask = 0;
+    for (const auto& e : v->a) {
+      if (!is_int(e, 0, 15)) return fail(err, where + ".steps", "must be a non-empty array of 0..15");
+      r->step_mask |= (uint16_t)(1u << (int)e.num);
+    }
+  } else {
+    const JsonValue* ev = json_get(j, "every");
+    const JsonValue* ph = json_get(j, "phase");
+    const int every = ev ? (is_int(*ev, 1, 16) ? (int)ev->num : 0) : 1;
+    const int phase = ph ? (is_int(*ph, 0, 15) ? (int)ph->num : -1) : 0;
+    if (every == 0) return fail(err, where + ".every", "must be 1..16");
+    if (phase < 0 || phase >= every) return fail(err, where + ".phase", "must be 0..every-1");
+    r->step_mask = 0;
+    for (int s = phase; s < 16; s += every) r->step_mask |= (uint16_t)(1u << s);
+  }
+
+  // Pitch.
+  const JsonValue* semi = json_get(j, "semitones");
+  const JsonValue* deg = json_get(j, "degree");
+  if (semi && deg) return fail(err, where, "use either degree or semitones");
+  if (semi) {
+    if (!is_int(*semi, -48, 48)) return fail(err, where + ".semitones", "must be an integer -48..48");
+    r->fixed_pitch = true;
+    r->semitones = (int8_t)semi->num;
+  } else {
+    r->degree.fill(PresetRule::kRandomDegree);
+    if (deg && deg->is_array()) {
+      if (deg->a.empty() || deg->a.size() > 16) return fail(err, where + ".degree", "pattern must have 1..16 entries");
+      for (const auto& e : deg->a) {
+        if (!is_int(e, 0, 11)) return fail(err, where + ".degree", "pattern entries must be 0..11");
+      }
+      for (std::size_t s = 0; s < 16; s++) r->degree[s] = (int8_t)deg->a[s % deg->a.size()].num;
+    } else if (deg && is_int(*deg, 0, 11)) {
+      r->degree.fill((int8_t)deg->num);
+    } else if (deg && !(deg->is_string() && deg->s == "random")) {
+      return fail(err, where + ".degree", "must be \"random\", 0..11, or a pattern array");
+    }
+  }
+
+  if (const JsonValue* v = json_get(j, "octave")) {
+    const int top = CompiledPreset::kOctaves - 1;
+    if (is_int(*v, 0, top)) {
+      r->oct_lo = (int8_t)v->num;
+      r->oct_span = 0;
+    } else if (v->is_array() && v->a.size() == 2 && is_int(v->a[0], 0, top) && is_int(v->a[1], v->a[0].num, top)) {
+      r->oct_lo = (int8_t)v->a[0].num;
+      r->oct_span = (int8_t)(v->a[1].num - v->a[0].num);
+    } else {
+      return fail(err, where + ".octave", "must be 0..5 or [lo, hi]");
+    }
+  }
+
+  if (const JsonValue* v = json_get(j, "chord")) {
+    if (!v->is_array() || v->a.empty() || (int)v->a.size() > PresetRule::kMaxChord) {
+      return fail(err, where + ".chord", "must have 1..4 degree offsets");
+    }
+    r->chord_n = 0;
+    for (const auto& e : v->a) {
+      if (!is_int(e, 0, 11)) return fail(err, where + ".chord", "offsets must be 0..11");
+      r->chord[r->chord_n++] = (int8_t)e.num;
+    }
+  }
+
+  if (!parse_pair(json_get(j, "velocity"), &r->vel_base, &r->vel_gain, 0.0, 1.0)) {
+    return fail(err, where + ".velocity", "must be 0..1 or [base, gain]");
+  }
+
+  if (const JsonValue* v = json_get(j, "duration")) {
+    if (!in_range(*v, 0.02, 4.0)) return fail(err, where + ".duration", "must be 0.02..4 seconds");
+    r->dur_s = (float)v->num;
+  }
+
+  if (const JsonValue* v = json_get(j, "channel")) {
+    bool ok = false;
+    if (is_int(*v, 1, 16)) {
+      r->channel = (uint8_t)v->num;
+      ok = true;
+    } else if (v->is_string()) {
+      for (const auto& c : kChannels) {
+        if (v->s == c.name) {
+          r->channel = (uint8_t)c.channel;
+          ok = true;
+        }
+      }
+    }
+    if (!ok) return fail(err, where + ".channel", "must be 1..16 or melody|bass|chords|perc");
+  }
+
+  return true;
+}
+
+static bool valid_name(std::string_view n) {
+  if (n.empty() || n.size() > 32) return false;
+  return std::all_of(n.begin(), n.end(), [](char c) {
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+  });
+}
+
+static uint64_t fnv1a(uint64_t h, const void* p, std::size_t n) {
+  const auto* b = (const uint8_t*)p;
+  for (std::size_t i = 0; i < n; i++) {
+    h ^= b[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static std::vector<std::filesystem::path> list_json(const std::string& dir) {
+  std::vector<std::filesystem::path> out;
+  std::error_code ec;
+  for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+    if (it->path().extension() == ".json" && it->is_regular_file(ec)) out.push_back(it->path());
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+} // namespace
+
+bool compile_preset_json(const JsonValue& doc, std::string_view name_hint, UserPreset* out, std::string* err) {
+  if (!out) return false;
+  if (!doc.is_object()) return fail(err, "preset", "must be a JSON object");
+
+  UserPreset u;
+  u.name = json_get_string(doc, "name", std::string(name_hint));
+  if (!valid_name(u.name)) return fail(err, "name", "must be 1..32 chars of [a-z0-9_-]");
+  if (preset_find(u.name)) return fail(err, "name", "'" + u.name + "' is a built-in preset");
+  u.hint = json_get_string(doc, "hint", "user preset");
+
+  u.def.density = json_get_number(doc, "density", 0.5);
+  u.def.smoothing = json_get_number(doc, "smoothing", 0.7);
+  if (!(u.def.density >= 0.0 && u.def.density <= 1.0)) return fail(err, "density", "must be 0..1");
+  if (!(u.def.smoothing >= 0.0 && u.def.smoothing <= 1.0)) return fail(err, "smoothing", "must be 0..1");
+  u.def.idle_silence = json_get_bool(doc, "idle_silence", true);
+
+  if (const JsonValue* sy = json_get(doc, "synth")) {
+    if (!sy->is_object()) return fail(err, "synth", "must be an object");
+    for (const auto& [key, v] : sy->o) {
+      const auto it = std::find_if(std::begin(kSynthNames), std::end(kSynthNames), [&](const char* n) { return key == n; });
+      if (it == std::end(kSynthNames)) return fail(err, "synth." + key, "unknown parameter");
+      SynthRule& r = u.table.synth[(std::size_t)u.table.synth_count++];
+      r.target = (SynthTarget)(it - std::begin(kSynthNames));
+      if (v.is_number()) {
+        if (!in_range(v, 0.0, 1.0)) return fail(err, "synth." + key, "must be 0..1");
+        r.base = (float)v.num;
+        continue;
+      }
+      if (!v.is_object()) return fail(err, "synth." + key, "must be 0..1 or {signal, base, gain}");
+      if (!parse_source(json_get(v, "signal"), RuleSource::One, &r.src)) return fail(err, "synth." + key, "unknown signal");
+      r.base = (float)json_get_number(v, "base", 0.0);
+      r.gain = (float)json_get_number(v, "gain", 0.0);
+      if (!std::isfinite(r.base) || !std::isfinite(r.gain)) return fail(err, "synth." + key, "base/gain must be numbers");
+    }
+  }
+
+  const JsonValue* rules = json_get(doc, "rules");
+  if (!rules || !rules->is_array() || rules->a.empty()) return fail(err, "rules", "must be a non-empty array");
+  if ((int)rules->a.size() > RuleTable::kMaxRules) {
+    return fail(err, "rules", "at most " + std::to_string(RuleTable::kMaxRules) + " rules");
+  }
+  for (std::size_t i = 0; i < rules->a.size(); i++) {
+    PresetRule& r = u.table.rules[(std::size_t)u.table.rule_count++];
+    if (!compile_rule(rules->a[i], "rules[" + std::to_string(i) + "]", &r, err)) return false;
+  }
+
+  u.def.step = &step_rules;
+  *out = std::move(u);
+  // Only now: def points into *out, not into the local.
+  out->def.name = out->name.c_str();
+  out->def.hint = out->hint.c_str();
+  out->def.rules = &out->table;
+  return true;
+}
+
+PresetLibrary::PresetLibrary() {
+  for (const auto& p : builtin_presets()) all_.push_back(&p);
+}
+
+std::shared_ptr<const PresetLibrary> PresetLibrary::load_dir(const std::string& dir) {
+  auto lib = std::make_shared<PresetLibrary>();
+  lib->dir_ = dir;
+
+  for (const auto& path : list_json(dir)) {
+    const std::string file = path.filename().string();
+    std::ifstream f(path);
+    if (!f.good()) {
+      lib->errors_.push_back(file + ": open failed");
+      continue;
+    }
+    std::ostringstream ss;
+    ss << f.rdbuf();
+
+    JsonValue doc;
+    JsonParseError perr;
+    if (!json_parse(ss.str(), &doc, &perr)) {
+      lib->errors_.push_back(file + ": " + perr.message);
+      continue;
+    }
+
+    auto u = std::make_unique<UserPreset>();
+    std::string e;
+    if (!compile_preset_json(doc, path.stem().string(), u.get(), &e)) {
+      lib->errors_.push_back(file + ": " + e);
+      continue;
+    }
+    if (lib->find(u->name)) {
+      lib->errors_.push_back(file + ": duplicate preset name '" + u->name + "'");
+      continue;
+    }
+
+    // Heap-allocated, so def's pointers into it stay valid for the library's lifetime.
+    u->file = path.string();
+    lib->all_.push_back(&u->def);
+    lib->user_.push_back(std::move(u));
+  }
+  return lib;
+}
+
+const PresetDef* PresetLibrary::find(std::string_view name) const {
+  for (const PresetDef* p : all_) {
+    if (name == p->name) return p;
+  }
+  return nullptr;
+}
+
+const UserPreset* PresetLibrary::user(const PresetDef* def) const {
+  for (const auto& u : user_) {
+    if (&u->def == def) return u.get();
+  }
+  return nullptr;
+}
+
+uint64_t preset_dir_fingerprint(const std::string& dir) {
+  // Polled from the sampler thread, so walk the directory with getdents64 into a stack
+  // buffer instead of std::filesystem (which allocates per entry).
+  const int dfd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dfd < 0) return 0;
+
+  uint64_t sum = 0;
+  alignas(8) char buf[4096];
+  for (;;) {
+    const ssize_t n = ::getdents64(dfd, buf, sizeof(buf));
+    if (n <= 0) break;
+    for (ssize_t off = 0; off < n;) {
+      const auto* d = (const struct dirent64*)(buf + off);
+      off += d->d_reclen;
+
+      const std::size_t len = std::strlen(d->d_name);
+      if (len < 5 || std::memcmp(d->d_name + len - 5, ".json", 5) != 0) continue;
+      struct stat st {};
+      if (::fstatat(dfd, d->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) continue;
+
+      // Order-independent: directory order is not stable across edits.
+      uint64_t h = fnv1a(0xcbf29ce484222325ULL, d->d_name, len);
+      h = fnv1a(h, &st.st_size, sizeof(st.st_size));
+      h = fnv1a(h, &st.st_mtim, sizeof(st.st_mtim));
+      sum += h | 1;
+    }
+  }
+  ::close(dfd);
+  return sum;
+}
+
+} // namespace khor
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "engine/presets.h"
+#include "util/json.h"
+
+namespace khor {
+
+// Inputs a rule can read. Evaluated once per tick into a flat table.
+enum class RuleSource : uint8_t {
+  Exec,
+  Rx,
+  Tx,
+  Csw,
+  Io,
+  Retx,
+  Irq,
+  Mem,
+  Entropy,  // CPU profile entropy (0 unless features.profile)
+  Dstate,   // off-CPU time in D state
+  Lock,     // kernel lock contention (0 unless features.locks)
+  Drop,     // packet drops (kfree_skb reasons)
+  Churn,    // processes gone within 1 ms of exec
+  Vfs,      // time in file reads and writes (0 unless features.vfs)
+  Fsync,    // time in fsync (0 unless features.vfs)
+  Rtt,      // TCP round-trip time
+  Listen,   // listen queue overflows
+  Ipc,      // instructions per cycle (0 unless features.pmu has hardware counters)
+  Miss,     // LLC misses per instruction, or page faults (0 unless features.pmu)
+  Spawners, // distinct parents spawning processes
+  Actors,   // distinct processes running
+  Peers,    // distinct remote addresses
+  Net,      // (rx + tx) / 2
+  Activity, // max of the event signals
+  One,      // constant 1
+  Count,
+};
+
+enum class SynthTarget : uint8_t { Cutoff, Resonance, Delay, Reverb, Count };
+
+// One note-emitting rule, fully resolved at load time:
+//   fires on steps in step_mask, when src > min, with p = density * (p_base + p_gain * src).
+struct PresetRule {
+  static constexpr int8_t kRandomDegree = -1;
+  static constexpr int kMaxChord = 4;
+
+  uint16_t step_mask = 0xffff;
+  RuleSource src = RuleSource::One;
+  float min = -1.0f; // -1: no gate
+  float p_base = 0.0f;
+  float p_gain = 0.0f;
+
+  // Pitch: either scale degree (per step, or random) + octave range, or a fixed key offset.
+  std::array<int8_t, 16> degree{};
+  bool fixed_pitch = false;
+  int8_t semitones = 0;
+  int8_t oct_lo = 2;
+  int8_t oct_span = 0; // octave = oct_lo + floor(rand * (oct_span + 1)) when > 0
+  std::array<int8_t, kMaxChord> chord{}; // degree offsets stacked on the chosen degree
+  uint8_t chord_n = 1;
+
+  float vel_base = 0.5f;
+  float vel_gain = 0.0f;
+  float dur_s = 0.2f;
+  uint8_t channel = 1;
+};
+
+// synth.<target> = clamp01(base + gain * src), applied before the note rules.
+struct SynthRule {
+  SynthTarget target = SynthTarget::Cutoff;
+  RuleSource src = RuleSource::One;
+  float base = 0.0f;
+  float gain = 0.0f;
+};
+
+struct RuleTable {
+  static constexpr int kMaxRules = 24;
+
+  std::array<PresetRule, kMaxRules> rules{};
+  int rule_count = 0;
+  std::array<SynthRule, (int)SynthTarget::Count> synth{};
+  int synth_count = 0;
+};
+
+// A preset loaded from JSON. def.rules points at table; def.name/hint at the strings,
+// so use it where it was compiled (a copy's def still points at the original).
+struct UserPreset {
+  std::string name;
+  std::string hint;
+  std::string file;
+  RuleTable table;
+  PresetDef def{};
+};
+
+// Validates and compiles one preset document into a ready-to-play out->def. name_hint is
+// used when "name" is absent.
+bool compile_preset_json(const JsonValue& doc, std::string_view name_hint, UserPreset* out, std::string* err);
+
+// Immutable set of selectable presets: built-ins followed by user presets.
+// Shared by snapshot so a running MusicEngine keeps its PresetDef pointers valid across reloads.
+class PresetLibrary {
+ public:
+  PresetLibrary(); // built-ins only
+
+  // Loads every *.json in dir (sorted by file name). Bad files are skipped and reported in errors().
+  static std::shared_ptr<const PresetLibrary> load_dir(const std::string& dir);
+
+  std::span<const PresetDef* const> all() const { return all_; }
+  // nullptr if unknown.
+  const PresetDef* find(std::string_view name) const;
+  // nullptr for built-ins.
+  const UserPreset* user(const PresetDef* def) const;
+
+  const std::string& dir() const { return dir_; }
+  const std::vector<std::string>& errors() const { return errors_; }
+
+ private:
+  std::string dir_;
+  std::vector<std::unique_ptr<UserPreset>> user_;
+  std::vector<const PresetDef*> all_;
+  std::vector<std::string> errors_;
+};
+
+// Cheap change detector for the presets directory (names, sizes, mtimes of *.json). 0 if missing.
+uint64_t preset_dir_fingerprint(const std::string& dir);
+
+} // namespace khor
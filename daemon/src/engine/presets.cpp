@@ -0,0 +1,170 @@
+#include "engine/presets.h"
+
+#include <array>
+
+namespace khor {
+namespace {
+
+using preset::clamp01;
+using preset::push_note;
+
+static void step_ambient(const CompiledPreset& p, const Signal01& s, StepState& st, MusicFrame& out) {
+  SynthParams& sp = out.synth;
+  const double dens = st.density;
+  sp.reverb_mix01 = (float)clamp01(0.38 + 0.35 * s.rx + 0.15 * s.mem);
+  sp.delay_mix01 = (float)clamp01(0.10 + 0.22 * s.tx);
+
+  const double p_note = dens * (0.12 + 0.88 * st.activity) * 0.35;
+  if (st.rand01() < p_note) {
+    const int deg = (int)(st.rand01() * p.scale_count);
+    const int oct = (int)(st.rand01() * 3.0); // 0..2
+    const int midi = p.note(deg, oct);
+    const float vel = (float)clamp01(0.12 + 0.70 * (0.65 * s.rx + 0.35 * s.tx));
+    const float dur = (float)std::clamp(0.20 + 0.70 * (0.40 + 0.60 * s.rx) * (0.30 + 0.70 * dens), 0.10, 1.10);
+    push_note(out, midi, vel, dur, p.ch_melody);
+  }
+
+  // Exec accents: gentle dyads.
+  const double p_exec = dens * s.exec * 0.18;
+  if (st.rand01() < p_exec) {
+    const int root = p.note(0, 1);
+    const int fifth = p.note(2, 1); // in pentatonic this is close to a fifth-ish feel
+    push_note(out, root, 0.42f, 0.35f, p.ch_chords);
+    push_note(out, fifth, 0.30f, 0.35f, p.ch_chords);
+  }
+}
+
+static void step_percussive(const CompiledPreset& p, const Signal01& s, StepState& st, MusicFrame& out) {
+  SynthParams& sp = out.synth;
+  const double dens = st.density;
+  sp.cutoff01 = (float)clamp01(0.62 + 0.30 * s.io);
+  sp.reverb_mix01 = (float)clamp01(0.10 + 0.15 * s.rx);
+  sp.delay_mix01 = (float)clamp01(0.06 + 0.10 * s.tx);
+
+  // Kick-like low note on downbeats influenced by exec.
+  if (st.step % 4 == 0) {
+    const double p_kick = dens * (0.05 + 0.95 * s.exec) * 0.65;
+    if (st.rand01() < p_kick) {
+      push_note(out, p.offset(-24), (float)clamp01(0.35 + 0.55 * s.exec), 0.08f, p.ch_bass);
+    }
+  }
+
+  // Clicks from scheduler activity.
+  const double p_click = dens * (0.10 + 0.90 * s.csw) * 0.95;
+  if (st.rand01() < p_click) {
+    const int deg = (int)(st.rand01() * p.scale_count);
+    const int midi = p.note(deg, 3 + (int)(st.step & 1)); // high
+    push_note(out, midi, (float)clamp01(0.18 + 0.75 * s.csw), 0.05f, p.ch_perc);
+  }
+
+  // Network adds mid hits.
+  const double p_mid = dens * (0.10 + 0.90 * (s.rx + s.tx) * 0.5) * 0.35;
+  if (st.rand01() < p_mid) {
+    const int deg = (int)(st.rand01() * p.scale_count);
+    const int midi = p.note(deg, 2);
+    push_note(out, midi, (float)clamp01(0.10 + 0.60 * (s.rx + s.tx) * 0.5), 0.07f, p.ch_perc);
+  }
+}
+
+static void step_arp(const CompiledPreset& p, const Signal01& s, StepState& st, MusicFrame& out) {
+  SynthParams& sp = out.synth;
+  const double dens = st.density;
+  sp.reverb_mix01 = (float)clamp01(0.18 + 0.20 * s.rx);
+  sp.delay_mix01 = (float)clamp01(0.22 + 0.35 * s.tx);
+
+  static constexpr int kPattern[] = {0, 1, 2, 1};
+  const int pdeg = kPattern[st.step & 3];
+  const double gate = (s.rx + s.tx) * 0.5;
+  const double p_arp = dens * (0.20 + 0.80 * gate);
+  if (gate > 0.05 && st.rand01() < p_arp) {
+    const int midi = p.note(pdeg, 2 + (int)((st.step >> 2) & 1));
+    const float vel = (float)clamp01(0.12 + 0.75 * gate);
+    push_note(out, midi, vel, 0.12f, p.ch_melody);
+  }
+
+  // Exec adds chord stabs on bar start.
+  if (st.step == 0) {
+    const double p_stab = dens * (0.10 + 0.90 * s.exec) * 0.6;
+    if (st.rand01() < p_stab) {
+      push_note(out, p.note(0, 1), 0.45f, 0.20f, p.ch_chords);
+      push_note(out, p.note(2, 1), 0.30f, 0.20f, p.ch_chords);
+    }
+  }
+}
+
+static void step_drone(const CompiledPreset& p, const Signal01& s, StepState& st, MusicFrame& out) {
+  SynthParams& sp = out.synth;
+  const double dens = st.density;
+  sp.reverb_mix01 = (float)clamp01(0.45 + 0.25 * s.rx + 0.12 * s.mem);
+  sp.delay_mix01 = (float)clamp01(0.05 + 0.10 * s.tx);
+  sp.cutoff01 = (float)clamp01(0.18 + 0.78 * s.io);
+  sp.resonance01 = (float)clamp01(0.30 + 0.55 * s.exec);
+
+  // Sustain a low root by retriggering each bar.
+  if (st.step == 0) {
+    push_note(out, p.offset(-24), (float)clamp01(0.08 + 0.28 * s.io), 2.3f, p.ch_bass);
+  }
+  if (st.step == 8 && st.activity > 0.10) {
+    push_note(out, p.offset(-12), (float)clamp01(0.05 + 0.20 * st.activity), 1.6f, p.ch_bass);
+  }
+
+  // Network sprinkles.
+  const double p_top = dens * (0.05 + 0.95 * (s.rx + s.tx) * 0.5) * 0.25;
+  if (st.rand01() < p_top) {
+    const int deg = (int)(st.rand01() * p.scale_count);
+    const int midi = p.note(deg, 3);
+    push_note(out, midi, (float)clamp01(0.05 + 0.35 * (s.rx + s.tx) * 0.5), 0.40f, p.ch_melody);
+  }
+}
+
+static constexpr PresetDef kPresets[] = {
+  {"ambient", "slow, sparse, more reverb", 0.20, 0.92, true, &step_ambient},
+  {"percussive", "tight envelope, scheduler-driven rhythm", 0.80, 0.35, true, &step_percussive},
+  {"arp", "network-driven arpeggio + exec stabs", 0.55, 0.60, true, &step_arp},
+  {"drone", "IO controls timbre; sustained tones", 0.10, 0.95, false, &step_drone},
+};
+
+static constexpr ScaleDef kScales[] = {
+  {"pentatonic_minor", {0, 3, 5, 7, 10}, 5},
+  {"natural_minor", {0, 2, 3, 5, 7, 8, 10}, 7},
+  {"dorian", {0, 2, 3, 5, 7, 9, 10}, 7},
+};
+
+struct ScaleAlias {
+  const char* alias;
+  const char* name;
+};
+
+static constexpr ScaleAlias kScaleAliases[] = {
+  {"penta_minor", "pentatonic_minor"},
+  {"pentatonic", "pentatonic_minor"},
+  {"minor", "natural_minor"},
+};
+
+} // namespace
+
+std::span<const PresetDef> builtin_presets() { return kPresets; }
+
+const PresetDef* preset_find(std::string_view name) {
+  for (const auto& p : kPresets) {
+    if (name == p.name) return &p;
+  }
+  return nullptr;
+}
+
+std::span<const ScaleDef> builtin_scales() { return kScales; }
+
+const ScaleDef& scale_find(std::string_view name) {
+  for (const auto& a : kScaleAliases) {
+    if (name == a.alias) {
+      name = a.name;
+      break;
+    }
+  }
+  for (const auto& s : kScales) {
+    if (name == s.name) return s;
+  }
+  return kScales[0];
+}
+
+} // namespace khor
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <span>
+#include <string_view>
+
+#include "engine/music.h"
+
+namespace khor {
+
+struct ScaleDef {
+  const char* name;
+  int degrees[12];
+  int count;
+};
+
+struct RuleTable;
+
+// Preset step: reads signals, writes synth params and notes for one 16th step.
+using PresetStepFn = void (*)(const CompiledPreset& p, const Signal01& s, StepState& st, MusicFrame& out);
+
+struct PresetDef {
+  const char* name;
+  const char* hint;
+  double density;   // applied when the preset is selected
+  double smoothing; // applied when the preset is selected
+  bool idle_silence; // emit nothing while all signals are idle
+  PresetStepFn step;
+  const RuleTable* rules = nullptr; // data-driven presets (preset_rules.h)
+};
+
+// Built-in presets, in display order. Adding a preset means adding one entry here.
+std::span<const PresetDef> builtin_presets();
+// nullptr if unknown.
+const PresetDef* preset_find(std::string_view name);
+
+std::span<const ScaleDef> builtin_scales();
+// Accepts aliases ("minor", "pentatonic", ...); unknown names resolve to pentatonic minor.
+const ScaleDef& scale_find(std::string_view name);
+
+namespace preset {
+
+inline double clamp01(double v) { return std::clamp(v, 0.0, 1.0); }
+
+inline void push_note(MusicFrame& out, int midi, float vel, float dur_s, int ch) {
+  NoteEvent ev;
+  ev.midi = std::clamp(midi, 0, 127);
+  ev.velocity = std::clamp(vel, 0.0f, 1.0f);
+  ev.dur_s = std::max(0.01f, dur_s); // the synth's floor; the drop blip is 15 ms
+  ev.channel = ch;
+  out.notes.push_back(ev);
+}
+
+} // namespace preset
+
+} // namespace khor
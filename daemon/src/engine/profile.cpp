@@ -0,0 +1,88 @@
+#include "engine/profile.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace khor {
+
+double profile_entropy01(const std::vector<uint64_t>& counts) {
+  uint64_t total = 0;
+  for (uint64_t c : counts) total += c;
+  if (total == 0) return 0.0;
+  double h = 0.0;
+  for (uint64_t c : counts) {
+    if (!c) continue;
+    const double p = (double)c / (double)total;
+    h -= p * std::log2(p);
+  }
+  return std::clamp(h / 8.0, 0.0, 1.0);
+}
+
+uint64_t log2_quantile(const uint64_t* buckets, std::size_t n, double q) {
+  uint64_t total = 0;
+  for (std::size_t i = 0; i < n; i++) total += buckets[i];
+  if (total == 0) return 0;
+  const uint64_t want = std::max<uint64_t>(1, (uint64_t)std::ceil(std::clamp(q, 0.0, 1.0) * (double)total));
+  uint64_t acc = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    acc += buckets[i];
+    if (acc >= want) return i >= 63 ? UINT64_MAX : 2ULL << i;
+  }
+  return n >= 64 ? UINT64_MAX : 1ULL << n;
+}
+
+void HotFunctions::add(std::string_view name, std::string_view module, uint64_t samples) {
+  if (!samples) return;
+  std::string key;
+  key.reserve(module.size() + 1 + name.size());
+  key.append(module).push_back('\0');
+  key.append(name);
+  auto [it, inserted] = table_.try_emplace(std::move(key));
+  if (inserted) {
+    it->second.name = std::string(name);
+    it->second.module = std::string(module);
+  }
+  it->second.window += samples;
+}
+
+double HotFunctions::end_window() {
+  std::vector<uint64_t> counts;
+  uint64_t total = 0;
+  for (auto& [key, e] : table_) {
+    if (e.window) counts.push_back(e.window);
+    total += e.window;
+    e.decayed = e.decayed * decay_ + (double)e.window;
+    e.window = 0;
+  }
+  last_window_samples_ = total;
+
+  // Forget functions that stopped showing up, then cap the table.
+  std::erase_if(table_, [](const auto& kv) { return kv.second.decayed < 0.5; });
+  if (table_.size() > kMaxEntries) {
+    std::vector<double> v;
+    v.reserve(table_.size());
+    for (const auto& [key, e] : table_) v.push_back(e.decayed);
+    std::nth_element(v.begin(), v.begin() + (std::ptrdiff_t)(table_.size() - kMaxEntries), v.end());
+    const double cut = v[table_.size() - kMaxEntries];
+    std::erase_if(table_, [cut](const auto& kv) { return kv.second.decayed < cut; });
+  }
+  return profile_entropy01(counts);
+}
+
+std::vector<HotFunction> HotFunctions::top(std::size_t n) const {
+  std::vector<HotFunction> out;
+  double total = 0.0;
+  out.reserve(table_.size());
+  for (const auto& [key, e] : table_) {
+    total += e.decayed;
+    out.push_back(HotFunction{e.name, e.module, e.decayed, 0.0});
+  }
+  const std::size_t k = std::min(n, out.size());
+  std::partial_sort(out.begin(), out.begin() + (std::ptrdiff_t)k, out.end(),
+                    [](const HotFunction& a, const HotFunction& b) { return a.samples > b.samples; });
+  out.resize(k);
+  for (auto& h : out) h.share = total > 0.0 ? h.samples / total : 0.0;
+  return out;
+}
+
+} // namespace khor
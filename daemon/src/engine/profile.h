@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace khor {
+
+struct HotFunction {
+  std::string name;
+  std::string module;
+  double samples = 0.0; // decayed sample count
+  double share = 0.0;   // of all decayed samples, 0..1
+};
+
+// Shannon entropy of a sample distribution in bits, scaled so that 256 equally hot
+// functions (8 bits) read 1.0. 0 for no samples or a single function.
+double profile_entropy01(const std::vector<uint64_t>& counts);
+
+// For histograms whose bucket i covers [2^i, 2^(i+1)) units (off-CPU in us, lock waits in ns):
+// upper bound of the bucket holding the q-quantile (0..1), 0 if empty.
+uint64_t log2_quantile(const uint64_t* buckets, std::size_t n, double q);
+
+// Profiler samples per function. Samples are added for the current window (one drain of
+// the kernel maps); closing a window yields that window's entropy and folds it into a
+// table that decays per window, which is what the hot-function list is built from.
+class HotFunctions {
+ public:
+  static constexpr std::size_t kMaxEntries = 1024;
+
+  explicit HotFunctions(double decay = 0.8) : decay_(decay) {}
+
+  void add(std::string_view name, std::string_view module, uint64_t samples);
+  // Returns the closed window's profile_entropy01().
+  double end_window();
+
+  std::vector<HotFunction> top(std::size_t n) const;
+  uint64_t last_window_samples() const { return last_window_samples_; }
+  std::size_t size() const { return table_.size(); }
+
+ private:
+  struct Entry {
+    std::string name;
+    std::string module;
+    uint64_t window = 0;
+    double decayed = 0.0;
+  };
+
+  double decay_;
+  std::unordered_map<std::string, Entry> table_; // key: module + '\0' + name
+  uint64_t last_window_samples_ = 0;
+};
+
+} // namespace khor
@@ -0,0 +1,84 @@
+#include "engine/render_sequencer.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace khor {
+
+RenderSequencer::RenderSequencer(Inputs in) : in_(in) {}
+
+RenderSequencer::~RenderSequencer() {
+  if (efd_ >= 0) ::close(efd_);
+}
+
+bool RenderSequencer::open(std::string* err) {
+  if (efd_ >= 0) return true;
+  efd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (efd_ < 0) {
+    if (err) *err = std::string("eventfd failed: ") + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+void RenderSequencer::take_notify() {
+  uint64_t v = 0;
+  if (efd_ >= 0) (void)!::read(efd_, &v, sizeof(v));
+}
+
+bool RenderSequencer::configure(std::shared_ptr<const PresetLibrary> lib, const MusicConfig& cfg) {
+  if (pending_.load(std::memory_order_acquire) >= 0) return false;
+  // The callback has taken ctl_slot_, so the other slot is idle.
+  const int slot = 1 - ctl_slot_;
+  engines_[(std::size_t)slot].set_library(std::move(lib));
+  engines_[(std::size_t)slot].configure(cfg);
+  ctl_slot_ = slot;
+  pending_.store(slot, std::memory_order_release);
+  return true;
+}
+
+void RenderSequencer::cancel_pending() {
+  // Exactly one of this and step() wins the exchange; an untaken slot is idle again.
+  if (pending_.exchange(-1, std::memory_order_acq_rel) >= 0) ctl_slot_ = 1 - ctl_slot_;
+}
+
+uint32_t RenderSequencer::frames_until_step(uint32_t sample_rate) {
+  const double bpm = in_.bpm ? in_.bpm->load(std::memory_order_relaxed) : 110.0;
+  const double exact = MusicEngine::tick_ms(bpm) * 1e-3 * (double)sample_rate + frac_;
+  const double whole = std::floor(exact);
+  frac_ = exact - whole;
+  return whole < 1.0 ? 1u : (uint32_t)whole;
+}
+
+void RenderSequencer::step(MusicFrame* out) {
+  if (const int p = pending_.exchange(-1, std::memory_order_acq_rel); p >= 0) {
+    engines_[(std::size_t)p].continue_from(engines_[(std::size_t)active_]);
+    active_ = p;
+  }
+  MusicEngine& e = engines_[(std::size_t)active_];
+  if (in_.key_midi) e.set_key(in_.key_midi->load(std::memory_order_relaxed));
+
+  StepRecord rec;
+  // A sampler write caught mid-store keeps the previous snapshot for this step.
+  if (in_.signals && !in_.signals->try_load(&last_sig_)) stale_.fetch_add(1, std::memory_order_relaxed);
+  rec.sig = last_sig_;
+  const double density = in_.density ? in_.density->load(std::memory_order_relaxed) : 0.35;
+  rec.frame = e.tick(rec.sig.v01, density);
+  if (out) *out = rec.frame;
+
+  steps_.fetch_add(1, std::memory_order_relaxed);
+  if (!out_q_.push(rec)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (efd_ >= 0) {
+    const uint64_t one = 1;
+    (void)!::write(efd_, &one, sizeof(one));
+  }
+}
+
+} // namespace khor
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "engine/music.h"
+#include "engine/signals.h"
+#include "engine/step_source.h"
+#include "util/seqlock.h"
+#include "util/spsc_queue.h"
+
+namespace khor {
+
+// MusicEngine driven from the audio render callback (music.clock = "audio").
+//
+// Steps land on exact sample boundaries; signals, bpm, key and density are read from
+// lock-free cells. A new configuration is built by the control thread into the engine
+// slot the callback isn't using and handed over by index, so the callback never
+// allocates, frees, or drops a PresetLibrary reference. Every step is also queued for
+// the sequencer thread (MIDI/OSC) and announced on an eventfd.
+class RenderSequencer final : public StepSource {
+ public:
+  struct Inputs {
+    const SeqLock<SignalSnapshot>* signals = nullptr;
+    const std::atomic<double>* bpm = nullptr;
+    const std::atomic<double>* density = nullptr;
+    const std::atomic<int>* key_midi = nullptr;
+  };
+
+  // A step as seen by the callback, for the outputs that aren't the synth.
+  struct StepRecord {
+    MusicFrame frame;
+    SignalSnapshot sig;
+  };
+
+  explicit RenderSequencer(Inputs in);
+  ~RenderSequencer() override;
+
+  RenderSequencer(const RenderSequencer&) = delete;
+  RenderSequencer& operator=(const RenderSequencer&) = delete;
+
+  bool open(std::string* err);
+  // Readable after each step; drain with take_notify().
+  int notify_fd() const { return efd_; }
+  void take_notify();
+
+  // Control thread. False while the previous configuration hasn't reached the callback yet; retry later.
+  bool configure(std::shared_ptr<const PresetLibrary> lib, const MusicConfig& cfg);
+  // Control thread, after detaching from the callback: takes back a handover it never picked up.
+  void cancel_pending();
+  // Sequencer thread.
+  bool pop(StepRecord* out) { return out_q_.pop(out); }
+
+  uint64_t steps() const { return steps_.load(std::memory_order_relaxed); }
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+  // Steps that reused the previous signal snapshot because a write was in progress.
+  uint64_t stale_signals() const { return stale_.load(std::memory_order_relaxed); }
+
+  // StepSource (audio callback thread).
+  uint32_t frames_until_step(uint32_t sample_rate) override;
+  void step(MusicFrame* out) override;
+
+ private:
+  Inputs in_;
+  std::array<MusicEngine, 2> engines_{};
+  int active_ = 0;               // callback thread
+  int ctl_slot_ = 0;             // control thread: slot last handed over
+  std::atomic<int> pending_{-1}; // slot published by configure(), taken by the callback
+  double frac_ = 0.0;            // sub-frame remainder carried between steps
+  SignalSnapshot last_sig_{};    // callback thread: last consistent signal read
+
+  SpscQueue<StepRecord, 64> out_q_{};
+  std::atomic<uint64_t> steps_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> stale_{0};
+  int efd_ = -1;
+};
+
+} // namespace khor
@@ -26,7 +26,7 @@ static double ema(double prev, double x, double alpha) {
 
 } // namespace
 
-void Signals::update(const Totals& cur, double dt_s, double smoothing01, double mem_pressure_pct) {
+void Signals::update(const Totals& cur, double dt_s, double smoothing01, const Gauges& g) {
   cur_ = cur;
   if (!has_prev_) {
     prev_ = cur;
@@ -46,7 +46,38 @@ void Signals::update(const Totals& cur, double dt_s, double smoothing01, double
   rates_.blk_w_kbs = (double)(cur.blk_write_bytes_total - prev_.blk_write_bytes_total) / dt_s / 1024.0;
   rates_.retx_s = (double)(cur.tcp_retransmit_total - prev_.tcp_retransmit_total) / dt_s;
   rates_.irq_s = (double)(cur.irq_total - prev_.irq_total) / dt_s;
-  rates_.mem_pct = mem_pressure_pct;
+  rates_.dwait_ms_s = (double)(cur.offcpu_d_ns_total - prev_.offcpu_d_ns_total) / dt_s / 1e6;
+  rates_.swait_ms_s = (double)(cur.offcpu_s_ns_total - prev_.offcpu_s_ns_total) / dt_s / 1e6;
+  rates_.lock_s = (double)(cur.lock_contended_total - prev_.lock_contended_total) / dt_s;
+  rates_.lock_wait_ms_s = (double)(cur.lock_wait_ns_total - prev_.lock_wait_ns_total) / dt_s / 1e6;
+  rates_.drop_s = (double)(cur.skb_drop_total - prev_.skb_drop_total) / dt_s;
+  rates_.exec_fail_s = (double)(cur.exec_fail_total - prev_.exec_fail_total) / dt_s;
+  rates_.churn_s = (double)(cur.proc_short_total - prev_.proc_short_total) / dt_s;
+  rates_.vfs_r_kbs = (double)(cur.vfs_read_bytes_total - prev_.vfs_read_bytes_total) / dt_s / 1024.0;
+  rates_.vfs_w_kbs = (double)(cur.vfs_write_bytes_total - prev_.vfs_write_bytes_total) / dt_s / 1024.0;
+  rates_.vfs_ms_s = (double)(cur.vfs_ns_total - prev_.vfs_ns_total) / dt_s / 1e6;
+  rates_.fsync_s = (double)(cur.fsync_total - prev_.fsync_total) / dt_s;
+  rates_.fsync_ms_s = (double)(cur.fsync_ns_total - prev_.fsync_ns_total) / dt_s / 1e6;
+  const uint64_t rtt_n = cur.rtt_samples_total - prev_.rtt_samples_total;
+  rates_.rtt_ms = rtt_n ? (double)(cur.rtt_us_total - prev_.rtt_us_total) / (double)rtt_n / 1e3 : 0.0;
+  rates_.rtt_p50_ms = g.rtt_p50_us / 1e3;
+  rates_.rtt_p99_ms = g.rtt_p99_us / 1e3;
+  rates_.listen_s = (double)(cur.listen_overflow_total - prev_.listen_overflow_total) / dt_s;
+  rates_.syn_s = (double)(cur.syn_overflow_total - prev_.syn_overflow_total) / dt_s;
+  const double cycles = (double)(cur.pmu_cycles_total - prev_.pmu_cycles_total);
+  const double instr = (double)(cur.pmu_instructions_total - prev_.pmu_instructions_total);
+  rates_.gcycles_s = cycles / dt_s / 1e9;
+  rates_.ipc = cycles > 0.0 ? instr / cycles : 0.0;
+  rates_.llc_mpki = instr > 0.0 ? (double)(cur.pmu_cache_misses_total - prev_.pmu_cache_misses_total) * 1e3 / instr : 0.0;
+  rates_.branch_mpki = instr > 0.0 ? (double)(cur.pmu_branch_misses_total - prev_.pmu_branch_misses_total) * 1e3 / instr : 0.0;
+  rates_.fault_s = (double)(cur.page_faults_total - prev_.page_faults_total) / dt_s;
+  rates_.major_fault_s = (double)(cur.major_faults_total - prev_.major_faults_total) / dt_s;
+  rates_.mem_pct = g.mem_pressure_pct;
+  rates_.prof_hz = g.prof_hz;
+  rates_.entropy = g.prof_entropy;
+  rates_.spawners = g.distinct_spawners;
+  rates_.actors = g.distinct_actors;
+  rates_.peers = g.distinct_peers;
 
   const double exec01 = norm_log(rates_.exec_s, 250.0);
   const double rx01 = norm_log(rates_.rx_kbs, 50000.0);
@@ -55,7 +86,24 @@ void Signals::update(const Totals& cur, double dt_s, double smoothing01, double
   const double io01 = norm_log(rates_.blk_r_kbs + rates_.blk_w_kbs, 80000.0);
   const double retx01 = norm_log(rates_.retx_s, 50.0);     // 50 retx/sec is severe
   const double irq01 = norm_log(rates_.irq_s, 200000.0);   // 200k IRQs/sec is busy
-  const double mem01 = clamp01(mem_pressure_pct / 100.0);   // already 0-100, just scale
+  const double mem01 = clamp01(g.mem_pressure_pct / 100.0); // already 0-100, just scale
+  const double entropy01 = clamp01(g.prof_entropy);
+  const double dstate01 = norm_log(rates_.dwait_ms_s, 10000.0); // ten tasks stuck in D the whole time
+  const double spawners01 = norm_log(g.distinct_spawners, 100.0);
+  const double actors01 = norm_log(g.distinct_actors, 2000.0);
+  const double peers01 = norm_log(g.distinct_peers, 5000.0);
+  const double drop01 = norm_log(rates_.drop_s, 5000.0);          // a full backlog drops thousands/sec
+  const double lock01 = norm_log(rates_.lock_wait_ms_s, 2000.0);  // two CPUs doing nothing but wait
+  const double churn01 = norm_log(rates_.churn_s, 500.0);          // a shell loop forking `true` flat out
+  const double vfs01 = norm_log(rates_.vfs_ms_s, 2000.0);          // two tasks doing nothing but file I/O
+  const double fsync01 = norm_log(rates_.fsync_ms_s, 1000.0);      // one task stuck in fsync the whole time
+  // The tail when there is a window to read it from (slot 0), the mean otherwise (sessions).
+  const double rtt01 = norm_log(rates_.rtt_p99_ms > 0.0 ? rates_.rtt_p99_ms : rates_.rtt_ms, 500.0);
+  const double listen01 = norm_log(rates_.listen_s + rates_.syn_s, 1000.0); // a SYN flood against a small backlog
+  // Idle CPUs barely count cycles, and their IPC says nothing; below a tenth of a busy core it reads 0.
+  const double ipc01 = rates_.gcycles_s >= 0.1 ? clamp01(rates_.ipc / 3.0) : 0.0; // 3 is near peak sustained
+  const double miss01 = instr > 0.0 ? norm_log(rates_.llc_mpki, 50.0)           // 50 MPKI: streaming through DRAM
+                                    : std::max(norm_log(rates_.fault_s, 200000.0), norm_log(rates_.major_fault_s, 1000.0));
 
   v01_.exec = ema(v01_.exec, exec01, smoothing01);
   v01_.rx = ema(v01_.rx, rx01, smoothing01);
@@ -65,6 +113,20 @@ void Signals::update(const Totals& cur, double dt_s, double smoothing01, double
   v01_.retx = ema(v01_.retx, retx01, smoothing01 * 0.5); // less smoothing for spiky signal
   v01_.irq = ema(v01_.irq, irq01, smoothing01);
   v01_.mem = ema(v01_.mem, mem01, 0.95);                  // very smooth, slow-moving
+  v01_.entropy = ema(v01_.entropy, entropy01, smoothing01);
+  v01_.dstate = ema(v01_.dstate, dstate01, smoothing01);
+  v01_.spawners = ema(v01_.spawners, spawners01, smoothing01);
+  v01_.actors = ema(v01_.actors, actors01, smoothing01);
+  v01_.peers = ema(v01_.peers, peers01, smoothing01);
+  v01_.drop = ema(v01_.drop, drop01, smoothing01 * 0.5);
+  v01_.lock = ema(v01_.lock, lock01, smoothing01 * 0.5); // storms are bursty
+  v01_.churn = ema(v01_.churn, churn01, smoothing01 * 0.5);
+  v01_.vfs = ema(v01_.vfs, vfs01, smoothing01);
+  v01_.fsync = ema(v01_.fsync, fsync01, smoothing01 * 0.5); // a stall is a spike
+  v01_.rtt = ema(v01_.rtt, rtt01, smoothing01);
+  v01_.listen = ema(v01_.listen, listen01, smoothing01 * 0.5);
+  v01_.ipc = ema(v01_.ipc, ipc01, smoothing01);
+  v01_.miss = ema(v01_.miss, miss01, smoothing01);
 
   prev_ = cur;
 }
@@ -14,6 +14,35 @@ struct SignalRates {
   double retx_s = 0.0;   // TCP retransmits/sec
   double irq_s = 0.0;    // IRQs/sec
   double mem_pct = 0.0;   // memory pressure % (0..100)
+  double prof_hz = 0.0;   // profiler samples/sec
+  double entropy = 0.0;   // CPU profile entropy (0..1)
+  double dwait_ms_s = 0.0; // off-CPU time in D state (uninterruptible), ms per second, summed over tasks
+  double swait_ms_s = 0.0; // same for S state (interruptible sleep)
+  double lock_s = 0.0;       // contended kernel lock acquisitions/sec
+  double lock_wait_ms_s = 0.0; // time spent waiting for them, ms per second summed over CPUs
+  double drop_s = 0.0;         // packets dropped/sec (kfree_skb, benign reasons excluded)
+  double exec_fail_s = 0.0;    // failed execve/execveat per sec
+  double churn_s = 0.0;        // processes/sec gone within 1 ms of their exec
+  double vfs_r_kbs = 0.0;      // vfs_read on regular files, page cache hits included
+  double vfs_w_kbs = 0.0;      // vfs_write on regular files
+  double vfs_ms_s = 0.0;       // time spent in them, ms per second summed over tasks
+  double fsync_s = 0.0;        // fsync/fdatasync calls per sec
+  double fsync_ms_s = 0.0;     // time spent in them, ms per second summed over tasks
+  double rtt_ms = 0.0;         // mean TCP smoothed RTT over this period's samples
+  double rtt_p50_ms = 0.0;     // percentiles over the last ~1 s (log2 buckets, upper bounds; slot 0)
+  double rtt_p99_ms = 0.0;
+  double listen_s = 0.0;       // connections dropped/sec on a full accept queue
+  double syn_s = 0.0;          // SYNs/sec that found the SYN queue full
+  double gcycles_s = 0.0;      // CPU cycles/sec summed over CPUs, in billions (features.pmu)
+  double ipc = 0.0;            // instructions per cycle
+  double llc_mpki = 0.0;       // last-level cache misses per 1000 instructions
+  double branch_mpki = 0.0;    // branch mispredictions per 1000 instructions
+  double fault_s = 0.0;        // page faults/sec (the fallback without a PMU)
+  double major_fault_s = 0.0;  // the ones that had to read from disk
+  // Distinct counts over the last ~1 s (HyperLogLog, about 6.5% error).
+  double spawners = 0.0; // processes whose children called exec
+  double actors = 0.0;   // processes that ran
+  double peers = 0.0;    // remote addresses seen on the wire
 };
 
 struct Signal01 {
@@ -26,6 +55,26 @@ struct Signal01 {
   double retx = 0.0;  // TCP retransmits (spiky)
   double irq = 0.0;   // IRQ rate (fast texture)
   double mem = 0.0;    // memory pressure (slow mood)
+  double entropy = 0.0; // CPU profile spread: low = one hot function, high = load spread out
+  double dstate = 0.0;  // time tasks spend blocked in D state (I/O, locks)
+  double lock = 0.0;    // kernel lock contention wait time
+  double drop = 0.0;    // packet drops (spiky)
+  double churn = 0.0;   // short-lived processes (fork/exec storms)
+  double vfs = 0.0;     // time spent in file reads and writes, cached or not
+  double fsync = 0.0;   // time spent in fsync (commit stalls)
+  double rtt = 0.0;     // TCP round-trip time (tail)
+  double listen = 0.0;  // listen queue overflows (a server not keeping up)
+  double ipc = 0.0;     // instructions per cycle of busy CPUs; falls when code is memory-bound
+  double miss = 0.0;    // LLC misses per instruction (page faults without a PMU)
+  double spawners = 0.0; // how many different parents are spawning processes
+  double actors = 0.0;   // how many different processes are running
+  double peers = 0.0;    // how many different hosts are talking
+};
+
+// What the sampler publishes each period; read lock-free by the sequencer and the audio callback.
+struct SignalSnapshot {
+  Signal01 v01{};
+  SignalRates rates{};
 };
 
 // Converts monotonically increasing counters into rates and stable 0..1 signals.
@@ -40,9 +89,49 @@ class Signals {
     uint64_t blk_write_bytes_total = 0;
     uint64_t tcp_retransmit_total = 0;
     uint64_t irq_total = 0;
+    uint64_t offcpu_d_ns_total = 0;
+    uint64_t offcpu_s_ns_total = 0;
+    uint64_t lock_contended_total = 0;
+    uint64_t lock_wait_ns_total = 0;
+    uint64_t skb_drop_total = 0;
+    uint64_t exec_fail_total = 0;
+    uint64_t proc_short_total = 0;
+    uint64_t vfs_read_bytes_total = 0;
+    uint64_t vfs_write_bytes_total = 0;
+    uint64_t vfs_ns_total = 0;
+    uint64_t fsync_total = 0;
+    uint64_t fsync_ns_total = 0;
+    uint64_t rtt_samples_total = 0;
+    uint64_t rtt_us_total = 0;
+    uint64_t listen_overflow_total = 0;
+    uint64_t syn_overflow_total = 0;
+    uint64_t pmu_cycles_total = 0;
+    uint64_t pmu_instructions_total = 0;
+    uint64_t pmu_cache_misses_total = 0;
+    uint64_t pmu_branch_misses_total = 0;
+    uint64_t page_faults_total = 0;
+    uint64_t major_faults_total = 0;
+  };
+
+  // Point-in-time values, used as they are.
+  struct Gauges {
+    double mem_pressure_pct = 0.0;
+    // Profiler window results (refreshed about once a second; 0 while it is off).
+    double prof_hz = 0.0;
+    double prof_entropy = 0.0;
+    // Distinct-count window results (about once a second).
+    double distinct_spawners = 0.0;
+    double distinct_actors = 0.0;
+    double distinct_peers = 0.0;
+    // RTT window percentiles (about once a second; 0 without samples).
+    double rtt_p50_us = 0.0;
+    double rtt_p99_us = 0.0;
   };
 
-  void update(const Totals& cur, double dt_s, double smoothing01, double mem_pressure_pct = 0.0);
+  void update(const Totals& cur, double dt_s, double smoothing01, const Gauges& g);
+  void update(const Totals& cur, double dt_s, double smoothing01, double mem_pressure_pct = 0.0) {
+    update(cur, dt_s, smoothing01, Gauges{.mem_pressure_pct = mem_pressure_pct});
+  }
 
   Totals totals() const { return cur_; }
   SignalRates rates() const { return rates_; }
@@ -0,0 +1,101 @@
+#include "engine/sketch.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+namespace khor {
+
+uint64_t sketch_mix64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+void hll_add(uint8_t* regs, std::size_t m, uint64_t hash) {
+  const int bits = std::countr_zero((uint64_t)m);
+  const std::size_t idx = (std::size_t)(hash >> (64 - bits));
+  const uint64_t w = hash << bits;
+  const uint8_t rank = (uint8_t)(w ? std::countl_zero(w) + 1 : 64 - bits + 1);
+  regs[idx] = std::max(regs[idx], rank);
+}
+
+void hll_merge(uint8_t* dst, const uint8_t* src, std::size_t m) {
+  for (std::size_t i = 0; i < m; i++) dst[i] = std::max(dst[i], src[i]);
+}
+
+double hll_estimate(const uint8_t* regs, std::size_t m) {
+  const double md = (double)m;
+  double sum = 0.0;
+  std::size_t zeros = 0;
+  for (std::size_t i = 0; i < m; i++) {
+    sum += std::ldexp(1.0, -(int)regs[i]);
+    if (!regs[i]) zeros++;
+  }
+  const double alpha = 0.7213 / (1.0 + 1.079 / md);
+  const double e = alpha * md * md / sum;
+  if (e <= 2.5 * md && zeros) return md * std::log(md / (double)zeros);
+  return e;
+}
+
+std::size_t cms_index(uint64_t hash, std::size_t row, std::size_t width) {
+  const uint32_t h1 = (uint32_t)hash;
+  const uint32_t h2 = (uint32_t)(hash >> 32) | 1u;
+  return (std::size_t)((uint32_t)(h1 + (uint32_t)row * h2) & (uint32_t)(width - 1));
+}
+
+CountMin::CountMin(std::size_t rows, std::size_t width) : rows_(rows), width_(width), c_(rows * width, 0) {}
+
+void CountMin::add(uint64_t hash, uint64_t w) {
+  for (std::size_t r = 0; r < rows_; r++) c_[r * width_ + cms_index(hash, r, width_)] += w;
+}
+
+void CountMin::merge(const uint64_t* counters) {
+  for (std::size_t i = 0; i < c_.size(); i++) c_[i] += counters[i];
+}
+
+void CountMin::clear() {
+  std::fill(c_.begin(), c_.end(), 0);
+}
+
+uint64_t CountMin::estimate(uint64_t hash) const {
+  if (!rows_) return 0;
+  uint64_t est = UINT64_MAX;
+  for (std::size_t r = 0; r < rows_; r++) est = std::min(est, c_[r * width_ + cms_index(hash, r, width_)]);
+  return est;
+}
+
+uint64_t CountMin::total() const {
+  uint64_t sum = 0;
+  for (std::size_t i = 0; i < width_ && rows_; i++) sum += c_[i];
+  return sum;
+}
+
+double CountMin::error_bound() const {
+  return width_ ? std::exp(1.0) / (double)width_ * (double)total() : 0.0;
+}
+
+double CountMin::confidence() const {
+  return 1.0 - std::exp(-(double)rows_);
+}
+
+std::size_t cms_top_k(const CountMin& s, std::span<const uint64_t> candidates, std::span<HeavyHitter> out) {
+  // Insertion into the (small) output keeps it sorted; once full, the lightest falls off the end.
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < candidates.size(); i++) {
+    const uint64_t est = s.estimate(candidates[i]);
+    if (!est) continue;
+    std::size_t j = n < out.size() ? n++ : out.size();
+    for (; j > 0 && out[j - 1].estimate < est; j--) {
+      if (j < out.size()) out[j] = out[j - 1];
+    }
+    if (j < out.size()) out[j] = HeavyHitter{.index = i, .estimate = est};
+  }
+  return n;
+}
+
+} // namespace khor
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace khor {
+
+// Same finalizer as the BPF probes' mix64().
+uint64_t sketch_mix64(uint64_t x);
+
+// HyperLogLog over m one-byte registers (m a power of two, >= 16). hll_add() is the update the
+// probes do in the kernel: the top log2(m) bits pick the register, which keeps the highest
+// rank (leading zeros + 1) of the remaining bits.
+void hll_add(uint8_t* regs, std::size_t m, uint64_t hash);
+// Registers taken from several CPUs (or windows) combine by per-register max.
+void hll_merge(uint8_t* dst, const uint8_t* src, std::size_t m);
+// Cardinality estimate with the small-range (linear counting) correction; standard error is
+// about 1.04/sqrt(m), 6.5% for 256 registers.
+double hll_estimate(const uint8_t* regs, std::size_t m);
+
+// Count-min sketch with the probes' layout: rows x width counters (width a power of two), row r
+// of hash h at (lo32(h) + r * (hi32(h) | 1)) mod width. An estimate is the minimum over rows, so
+// it never undercounts and overcounts by at most e/width of the total with probability
+// 1 - exp(-rows).
+std::size_t cms_index(uint64_t hash, std::size_t row, std::size_t width);
+
+class CountMin {
+ public:
+  CountMin(std::size_t rows, std::size_t width);
+
+  void add(uint64_t hash, uint64_t w);
+  // Adds rows * width counters laid out row-major, e.g. one CPU's copy from the kernel.
+  void merge(const uint64_t* counters);
+  void clear();
+
+  uint64_t estimate(uint64_t hash) const;
+  uint64_t total() const;
+  double error_bound() const;
+  double confidence() const;
+
+  std::size_t rows() const { return rows_; }
+  std::size_t width() const { return width_; }
+  const uint64_t* counters() const { return c_.data(); }
+
+ private:
+  std::size_t rows_;
+  std::size_t width_;
+  std::vector<uint64_t> c_;
+};
+
+struct HeavyHitter {
+  std::size_t index = 0; // into the candidate list
+  uint64_t estimate = 0;
+};
+
+// Fills out with the out.size() candidates with the largest estimates, largest first, and returns
+// how many it found. Doesn't allocate. Duplicate hashes are the caller's problem.
+std::size_t cms_top_k(const CountMin& s, std::span<const uint64_t> candidates, std::span<HeavyHitter> out);
+
+} // namespace khor
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+#include "engine/music.h"
+
+namespace khor {
+
+// A sequencer clocked by someone else's sample counter: the audio callback asks how many
+// frames remain until the next 16th step and calls step() exactly on that frame.
+// Both run on the callback thread and must not block or allocate.
+class StepSource {
+ public:
+  virtual ~StepSource() = default;
+
+  virtual uint32_t frames_until_step(uint32_t sample_rate) = 0;
+  virtual void step(MusicFrame* out) = 0;
+};
+
+} // namespace khor
@@ -99,6 +99,10 @@ bool HttpServer::start(const std::string& host, int port, const std::string& ui_
     json_reply(res, impl_->app->api_presets());
   });
 
+  impl_->http.Post("/api/presets/reload", [&](const httplib::Request&, httplib::Response& res) {
+    json_reply(res, impl_->app->api_reload_presets());
+  });
+
   impl_->http.Post("/api/preset/select", [&](const httplib::Request& req, httplib::Response& res) {
     std::string name = req.has_param("name") ? req.get_param_value("name") : "";
     if (name.empty()) {
@@ -115,6 +119,61 @@ bool HttpServer::start(const std::string& host, int port, const std::string& ui_
     json_reply(res, json_ok(true));
   });
 
+  impl_->http.Get("/api/sessions", [&](const httplib::Request&, httplib::Response& res) {
+    json_reply(res, impl_->app->api_sessions());
+  });
+
+  impl_->http.Post("/api/sessions", [&](const httplib::Request& req, httplib::Response& res) {
+    JsonValue body;
+    JsonParseError perr;
+    if (!json_parse(req.body, &body, &perr) || !body.is_object()) {
+      res.status = 400;
+      json_reply(res, json_error("invalid JSON body"));
+      return;
+    }
+    JsonValue out;
+    int status = 200;
+    (void)impl_->app->api_put_session(body, &out, &status);
+    res.status = status;
+    json_reply(res, out);
+  });
+
+  impl_->http.Delete(R"(/api/sessions/([A-Za-z0-9_.\-]+))", [&](const httplib::Request& req, httplib::Response& res) {
+    JsonValue out;
+    int status = 200;
+    (void)impl_->app->api_delete_session(req.matches[1].str(), &out, &status);
+    res.status = status;
+    json_reply(res, out);
+  });
+
+  impl_->http.Get("/api/profile", [&](const httplib::Request&, httplib::Response& res) {
+    json_reply(res, impl_->app->api_profile());
+  });
+
+  impl_->http.Get("/api/locks", [&](const httplib::Request&, httplib::Response& res) {
+    json_reply(res, impl_->app->api_locks());
+  });
+
+  impl_->http.Get("/api/drops", [&](const httplib::Request&, httplib::Response& res) {
+    json_reply(res, impl_->app->api_drops());
+  });
+
+  impl_->http.Get("/api/vfs", [&](const httplib::Request&, httplib::Response& res) {
+    json_reply(res, impl_->app->api_vfs());
+  });
+
+  impl_->http.Get("/api/heavy", [&](const httplib::Request&, httplib::Response& res) {
+    json_reply(res, impl_->app->api_heavy());
+  });
+
+  impl_->http.Get("/api/cgroups", [&](const httplib::Request& req, httplib::Response& res) {
+    const std::string name = req.has_param("name") ? req.get_param_value("name") : "";
+    int status = 200;
+    JsonValue out = impl_->app->api_cgroups(name, &status);
+    res.status = status;
+    json_reply(res, out);
+  });
+
   impl_->http.Get("/api/audio/devices", [&](const httplib::Request&, httplib::Response& res) {
     std::vector<AudioDeviceInfo> devs;
     std::string e;
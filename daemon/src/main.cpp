@@ -1,10 +1,10 @@
-#include <atomic>
 #include <csignal>
 #include <cstdio>
 #include <cstdlib>
 #include <optional>
 #include <string>
-#include <thread>
+
+#include <pthread.h>
 
 #include "app/app.h"
 #include "app/config.h"
@@ -24,6 +24,7 @@ struct Cli {
   std::optional<bool> enable_audio;
   std::optional<bool> enable_midi;
   std::optional<bool> enable_osc;
+  std::optional<bool> enable_osc_in;
   std::optional<bool> enable_fake;
 };
 
@@ -43,6 +44,7 @@ static void print_help(const char* argv0) {
     "  --no-audio                Disable audio output\n"
     "  --midi                    Enable MIDI output (ALSA sequencer)\n"
     "  --osc                     Enable OSC output (UDP)\n"
+    "  --osc-in                  Enable OSC control input (UDP listener)\n"
     "  --fake                    Enable fake metrics mode when BPF is unavailable\n"
     "\n",
     argv0 ? argv0 : "khor-daemon"
@@ -88,6 +90,7 @@ static bool parse_args(int argc, char** argv, Cli* out, std::string* err) {
     if (a == "--no-audio") { out->enable_audio = false; continue; }
     if (a == "--midi") { out->enable_midi = true; continue; }
     if (a == "--osc") { out->enable_osc = true; continue; }
+    if (a == "--osc-in") { out->enable_osc_in = true; continue; }
     if (a == "--fake") { out->enable_fake = true; continue; }
 
     if (err) *err = "unknown argument: " + a;
@@ -96,11 +99,17 @@ static bool parse_args(int argc, char** argv, Cli* out, std::string* err) {
   return true;
 }
 
-static volatile std::sig_atomic_t g_stop = 0;
-
 } // namespace
 
 int main(int argc, char** argv) {
+  // SIGINT/SIGTERM are delivered through a signalfd on the reactor; block them before
+  // any thread exists so every thread inherits the mask.
+  sigset_t sigs;
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGINT);
+  sigaddset(&sigs, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &sigs, nullptr);
+
   Cli cli;
   std::string arg_err;
   if (!parse_args(argc, argv, &cli, &arg_err)) {
@@ -137,13 +146,12 @@ int main(int argc, char** argv) {
   if (cli.enable_audio) cfg.enable_audio = *cli.enable_audio;
   if (cli.enable_midi) cfg.enable_midi = *cli.enable_midi;
   if (cli.enable_osc) cfg.enable_osc = *cli.enable_osc;
+  if (cli.enable_osc_in) cfg.enable_osc_in = *cli.enable_osc_in;
   if (cli.enable_fake) cfg.enable_fake = *cli.enable_fake;
 
   khor::App app(config_path, cfg);
-  std::string app_err;
-  (void)app.start(&app_err);
-  if (!app_err.empty()) std::fprintf(stderr, "khor-daemon: warning: %s\n", app_err.c_str());
 
+  // Bind HTTP first: /api/health answers "starting" while the subsystems come up.
   khor::HttpServer http(&app);
   std::string http_err;
   if (!http.start(cfg.listen_host, cfg.listen_port, cfg.ui_dir, cfg.serve_ui, &http_err)) {
@@ -151,12 +159,11 @@ int main(int argc, char** argv) {
     return 2;
   }
 
-  std::signal(SIGINT, +[](int) { g_stop = 1; });
-  std::signal(SIGTERM, +[](int) { g_stop = 1; });
+  std::string app_err;
+  (void)app.start(&app_err);
+  if (!app_err.empty()) std::fprintf(stderr, "khor-daemon: warning: %s\n", app_err.c_str());
 
-  while (!g_stop) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(200));
-  }
+  app.run();
 
   http.stop();
   app.stop();
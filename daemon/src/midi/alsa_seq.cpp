@@ -1,12 +1,13 @@
 #include "midi/alsa_seq.h"
 
 #include <algorithm>
-#include <atomic>
+#include <array>
 #include <chrono>
+#include <cmath>
 #include <mutex>
 #include <string>
-#include <thread>
-#include <vector>
+
+#include "util/reactor.h"
 
 #if defined(KHOR_HAS_ALSA_SEQ)
 #include <alsa/asoundlib.h>
@@ -20,8 +21,8 @@ struct MidiOut::Impl {
   int port = -1;
   std::string port_name;
 
-  std::atomic<bool> running{false};
-  std::thread worker;
+  Reactor* reactor = nullptr;
+  int timer_id = -1;
 
   struct NoteKey {
     int channel;
@@ -33,8 +34,15 @@ struct MidiOut::Impl {
     std::chrono::steady_clock::time_point due;
     NoteKey key;
   };
+  // Fixed table (unordered; swap-remove) so scheduling a note-off never allocates.
+  static constexpr std::size_t kMaxPendingOffs = 256;
   std::mutex mu;
-  std::vector<PendingOff> offs;
+  std::array<PendingOff, kMaxPendingOffs> offs{};
+  std::size_t n_offs = 0;
+  std::chrono::steady_clock::time_point armed = std::chrono::steady_clock::time_point::max();
+
+  // Serializes writes to the seq handle (reactor thread, HTTP test notes).
+  std::mutex io_mu;
 
   std::chrono::steady_clock::time_point last_cc = std::chrono::steady_clock::time_point{};
 
@@ -45,6 +53,7 @@ struct MidiOut::Impl {
 
   void send_event(const snd_seq_event_t* ev) {
     if (!seq || !ev) return;
+    std::scoped_lock lk(io_mu);
     (void)snd_seq_event_output_direct(seq, const_cast<snd_seq_event_t*>(ev));
   }
 
@@ -80,28 +89,39 @@ struct MidiOut::Impl {
     send_event(&ev);
   }
 
-  void loop() {
-    while (running.load(std::memory_order_relaxed)) {
-      std::vector<NoteKey> due_notes;
-      auto now = std::chrono::steady_clock::now();
-
-      {
-        std::scoped_lock lk(mu);
-        auto it = offs.begin();
-        while (it != offs.end()) {
-          if (it->due <= now) {
-            due_notes.push_back(it->key);
-            it = offs.erase(it);
-          } else {
-            ++it;
-          }
+  // Call with mu held. steady_clock is CLOCK_MONOTONIC on Linux, so its epoch matches the timerfd's.
+  void arm_locked(std::chrono::steady_clock::time_point due) {
+    armed = due;
+    if (due == std::chrono::steady_clock::time_point::max()) {
+      (void)reactor->arm_periodic(timer_id, std::chrono::nanoseconds(0));
+      return;
+    }
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(due.time_since_epoch()).count();
+    (void)reactor->arm_at(timer_id, timespec{.tv_sec = (time_t)(ns / 1000000000), .tv_nsec = (long)(ns % 1000000000)});
+  }
+
+  // Runs on the reactor thread when the earliest note-off is due.
+  void fire_due() {
+    std::array<NoteKey, kMaxPendingOffs> due_notes;
+    std::size_t n_due = 0;
+    {
+      std::scoped_lock lk(mu);
+      const auto now = std::chrono::steady_clock::now();
+      auto next = std::chrono::steady_clock::time_point::max();
+      std::size_t i = 0;
+      while (i < n_offs) {
+        if (offs[i].due <= now) {
+          due_notes[n_due++] = offs[i].key;
+          offs[i] = offs[--n_offs];
+        } else {
+          next = std::min(next, offs[i].due);
+          ++i;
         }
       }
-
-      for (const auto& k : due_notes) send_note_off(k.channel, k.midi);
-
-      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      arm_locked(next);
     }
+
+    for (std::size_t i = 0; i < n_due; i++) send_note_off(due_notes[i].channel, due_notes[i].midi);
   }
 #else
   std::string why = "built without ALSA sequencer support (install alsa-lib-devel and rebuild)";
@@ -111,15 +131,20 @@ struct MidiOut::Impl {
 MidiOut::MidiOut() : impl_(new Impl()) {}
 MidiOut::~MidiOut() { stop(); delete impl_; impl_ = nullptr; }
 
-bool MidiOut::start(const std::string& port_name, int channel_1_16, std::string* err) {
+bool MidiOut::start(const std::string& port_name, int channel_1_16, Reactor* reactor, std::string* err) {
   if (!impl_) return false;
 #if !defined(KHOR_HAS_ALSA_SEQ)
   if (err) *err = impl_->why;
   (void)port_name;
   (void)channel_1_16;
+  (void)reactor;
   return false;
 #else
   stop();
+  if (!reactor) {
+    if (err) *err = "midi: no reactor";
+    return false;
+  }
 
   (void)channel_1_16; // channel now per-note, not global
   impl_->port_name = port_name.empty() ? "khor" : port_name;
@@ -143,8 +168,13 @@ bool MidiOut::start(const std::string& port_name, int channel_1_16, std::string*
     return false;
   }
 
-  impl_->running.store(true, std::memory_order_relaxed);
-  impl_->worker = std::thread([impl = impl_] { impl->loop(); });
+  impl_->reactor = reactor;
+  impl_->timer_id = reactor->add_timer([impl = impl_](uint64_t) { impl->fire_due(); });
+  if (impl_->timer_id < 0) {
+    if (err) *err = "midi: timerfd setup failed";
+    stop();
+    return false;
+  }
   return true;
 #endif
 }
@@ -152,12 +182,16 @@ bool MidiOut::start(const std::string& port_name, int channel_1_16, std::string*
 void MidiOut::stop() {
   if (!impl_) return;
 #if defined(KHOR_HAS_ALSA_SEQ)
-  impl_->running.store(false, std::memory_order_relaxed);
-  if (impl_->worker.joinable()) impl_->worker.join();
+  if (impl_->reactor) impl_->reactor->remove_timer(impl_->timer_id);
+  impl_->reactor = nullptr;
+  impl_->timer_id = -1;
+  // Don't leave notes hanging on the synth side.
+  for (std::size_t i = 0; i < impl_->n_offs; i++) impl_->send_note_off(impl_->offs[i].key.channel, impl_->offs[i].key.midi);
+  impl_->n_offs = 0;
+  impl_->armed = std::chrono::steady_clock::time_point::max();
   if (impl_->seq) snd_seq_close(impl_->seq);
   impl_->seq = nullptr;
   impl_->port = -1;
-  impl_->offs.clear();
 #endif
 }
 
@@ -180,10 +214,24 @@ void MidiOut::send_note(const NoteEvent& ev) {
 
   const float dur = std::max(0.02f, ev.dur_s);
   const auto due = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(dur));
+  Impl::NoteKey evicted{.channel = -1, .midi = 0};
   {
     std::scoped_lock lk(impl_->mu);
-    impl_->offs.push_back(Impl::PendingOff{.due = due, .key = {.channel = ch, .midi = midi}});
+    std::size_t slot = impl_->n_offs;
+    if (slot == Impl::kMaxPendingOffs) {
+      // Table full: end the note that is due soonest early and reuse its slot.
+      slot = 0;
+      for (std::size_t i = 1; i < impl_->n_offs; i++) {
+        if (impl_->offs[i].due < impl_->offs[slot].due) slot = i;
+      }
+      evicted = impl_->offs[slot].key;
+    } else {
+      impl_->n_offs++;
+    }
+    impl_->offs[slot] = Impl::PendingOff{.due = due, .key = {.channel = ch, .midi = midi}};
+    if (due < impl_->armed) impl_->arm_locked(due);
   }
+  if (evicted.channel >= 0) impl_->send_note_off(evicted.channel, evicted.midi);
 #else
   (void)ev;
 #endif
@@ -8,6 +8,8 @@
 
 namespace khor {
 
+class Reactor;
+
 struct MidiStatus {
   bool enabled = false;
   bool ok = false;
@@ -24,7 +26,8 @@ class MidiOut {
   MidiOut(const MidiOut&) = delete;
   MidiOut& operator=(const MidiOut&) = delete;
 
-  bool start(const std::string& port_name, int channel_1_16, std::string* err);
+  // Note-offs are scheduled on a reactor timer armed for the earliest pending note.
+  bool start(const std::string& port_name, int channel_1_16, Reactor* reactor, std::string* err);
   void stop();
   bool is_running() const;
 
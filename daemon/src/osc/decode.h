@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+
+#include <arpa/inet.h>
+
+namespace khor::osc {
+
+inline constexpr int kMaxArgs = 8;
+
+struct Arg {
+  char tag = 0; // 'i' | 'f' | 's' | 'T' | 'F'
+  int32_t i = 0;
+  float f = 0.0f;
+  std::string_view s;
+
+  float as_float() const {
+    if (tag == 'f') return f;
+    if (tag == 'i') return (float)i;
+    if (tag == 'T') return 1.0f;
+    return 0.0f;
+  }
+  int32_t as_int() const {
+    if (tag == 'i') return i;
+    // The cast is undefined outside the int32 range; decode_message already rejected NaN/inf.
+    if (tag == 'f') return f >= 2147483648.0f ? INT32_MAX : f < -2147483648.0f ? INT32_MIN : (int32_t)f;
+    if (tag == 'T') return 1;
+    return 0;
+  }
+  bool is_number() const { return tag == 'i' || tag == 'f'; }
+};
+
+// Decoded view into a packet buffer (string_views point into the packet).
+struct Message {
+  std::string_view address;
+  std::string_view tags; // without the leading ','
+  std::array<Arg, kMaxArgs> args{};
+  int argc = 0;
+};
+
+namespace detail {
+
+inline bool read_str(std::span<const uint8_t> b, std::size_t* off, std::string_view* out) {
+  const std::size_t start = *off;
+  const void* nul = start < b.size() ? std::memchr(b.data() + start, 0, b.size() - start) : nullptr;
+  if (!nul) return false;
+  const std::size_t len = (std::size_t)((const uint8_t*)nul - b.data()) - start;
+  const std::size_t next = (start + len + 4u) & ~std::size_t{3};
+  if (next > b.size()) return false;
+  *out = std::string_view((const char*)b.data() + start, len);
+  *off = next;
+  return true;
+}
+
+inline bool read_u32(std::span<const uint8_t> b, std::size_t* off, uint32_t* out) {
+  if (*off + 4 > b.size()) return false;
+  uint32_t be = 0;
+  std::memcpy(&be, b.data() + *off, 4);
+  *out = ntohl(be);
+  *off += 4;
+  return true;
+}
+
+} // namespace detail
+
+// Decodes one OSC message. Supports i/f/s/T/F arguments; anything else fails, and so does a
+// NaN or infinite float (std::clamp would pass NaN straight through to the controls).
+inline bool decode_message(std::span<const uint8_t> b, Message* out) {
+  if (!out || b.empty() || (b.size() & 3u) != 0 || b[0] != '/') return false;
+  std::size_t off = 0;
+  *out = Message{};
+  if (!detail::read_str(b, &off, &out->address)) return false;
+
+  std::string_view tags;
+  if (off == b.size()) return true; // no type tag string: no args
+  if (!detail::read_str(b, &off, &tags) || tags.empty() || tags[0] != ',') return false;
+  tags.remove_prefix(1);
+  if ((int)tags.size() > kMaxArgs) return false;
+  out->tags = tags;
+
+  for (char t : tags) {
+    Arg& a = out->args[out->argc++];
+    a.tag = t;
+    uint32_t u = 0;
+    switch (t) {
+      case 'i':
+        if (!detail::read_u32(b, &off, &u)) return false;
+        a.i = (int32_t)u;
+        break;
+      case 'f':
+        if (!detail::read_u32(b, &off, &u)) return false;
+        std::memcpy(&a.f, &u, sizeof(u));
+        if (!std::isfinite(a.f)) return false;
+        break;
+      case 's':
+        if (!detail::read_str(b, &off, &a.s)) return false;
+        break;
+      case 'T':
+      case 'F':
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+// Calls fn(const Message&) for every message in a packet, descending into
+// bundles (timetags are ignored: control input is applied immediately).
+// Returns false if any part of the packet was malformed.
+template <typename Fn>
+bool for_each_message(std::span<const uint8_t> b, Fn&& fn, int depth = 0) {
+  static constexpr char kBundle[8] = {'#', 'b', 'u', 'n', 'd', 'l', 'e', 0};
+  if (b.size() >= 16 && std::memcmp(b.data(), kBundle, 8) == 0) {
+    if (depth >= 4) return false;
+    std::size_t off = 16; // "#bundle\0" + 8-byte timetag
+    bool ok = true;
+    while (off < b.size()) {
+      uint32_t len = 0;
+      if (!detail::read_u32(b, &off, &len) || len > b.size() - off) return false;
+      ok &= for_each_message(b.subspan(off, len), fn, depth + 1);
+      off += len;
+    }
+    return ok;
+  }
+
+  Message m;
+  if (!decode_message(b, &m)) return false;
+  fn(m);
+  return true;
+}
+
+} // namespace khor::osc
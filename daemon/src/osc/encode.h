@@ -1,10 +1,11 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
-#include <string>
-#include <vector>
+#include <span>
 
 #include <arpa/inet.h>
 
@@ -13,71 +14,132 @@
 
 namespace khor::osc {
 
-inline void pad4(std::vector<uint8_t>& b) {
-  while ((b.size() & 3u) != 0) b.push_back(0);
-}
+// Largest message we ever encode (metrics: 16B address + 12B tags + 9 floats).
+inline constexpr std::size_t kMaxPacket = 128;
 
-inline void put_str(std::vector<uint8_t>& b, const char* s) {
-  if (!s) s = "";
-  const std::size_t n = std::strlen(s);
-  b.insert(b.end(), (const uint8_t*)s, (const uint8_t*)s + n);
-  b.push_back(0);
-  pad4(b);
-}
+using Packet = std::array<uint8_t, kMaxPacket>;
 
-inline void put_i32(std::vector<uint8_t>& b, int32_t v) {
-  uint32_t be = htonl((uint32_t)v);
-  const uint8_t* p = (const uint8_t*)&be;
-  b.insert(b.end(), p, p + 4);
-}
+// OSC string literal padded to 4 bytes at compile time (includes the terminating NUL).
+template <std::size_t N>
+struct Str {
+  static constexpr std::size_t kSize = (N + 3u) & ~std::size_t{3};
+  std::array<char, kSize> bytes{};
 
-inline void put_f32(std::vector<uint8_t>& b, float f) {
-  uint32_t u = 0;
-  static_assert(sizeof(float) == sizeof(uint32_t));
-  std::memcpy(&u, &f, sizeof(u));
-  u = htonl(u);
-  const uint8_t* p = (const uint8_t*)&u;
-  b.insert(b.end(), p, p + 4);
-}
+  consteval Str(const char (&s)[N]) {
+    for (std::size_t i = 0; i < N; i++) bytes[i] = s[i];
+  }
+};
+
+// Type tag string (",iiff") built from the argument list at compile time.
+template <char... Tags>
+inline constexpr auto kTypeTags = [] {
+  constexpr std::size_t n = sizeof...(Tags) + 2; // ',' + tags + NUL
+  std::array<char, (n + 3u) & ~std::size_t{3}> out{};
+  out[0] = ',';
+  std::size_t i = 1;
+  ((out[i++] = Tags), ...);
+  return out;
+}();
+
+// Writes an OSC message into a caller-provided buffer. Never allocates; once the
+// buffer would overflow the writer latches !ok() and further puts are ignored.
+class Writer {
+ public:
+  explicit Writer(std::span<uint8_t> out) : out_(out) {}
+
+  template <std::size_t N>
+  void put_raw(const std::array<char, N>& a) {
+    if (!reserve(N)) return;
+    std::memcpy(out_.data() + n_, a.data(), N);
+    n_ += N;
+  }
+
+  template <std::size_t N>
+  void put_str(const Str<N>& s) { put_raw(s.bytes); }
+
+  void put_str(const char* s) {
+    if (!s) s = "";
+    const std::size_t len = std::strlen(s);
+    const std::size_t padded = (len + 4u) & ~std::size_t{3};
+    if (!reserve(padded)) return;
+    std::memcpy(out_.data() + n_, s, len);
+    std::memset(out_.data() + n_ + len, 0, padded - len);
+    n_ += padded;
+  }
 
-inline std::vector<uint8_t> encode_note(const NoteEvent& ev) {
-  std::vector<uint8_t> b;
-  b.reserve(64);
-  put_str(b, "/khor/note");
-  put_str(b, ",iiff");
-  put_i32(b, (int32_t)std::clamp(ev.channel, 1, 16));
-  put_i32(b, (int32_t)std::clamp(ev.midi, 0, 127));
-  put_f32(b, std::clamp(ev.velocity, 0.0f, 1.0f));
-  put_f32(b, std::max(0.0f, ev.dur_s));
-  return b;
+  void put_i32(int32_t v) { put_u32((uint32_t)v); }
+
+  void put_f32(float f) {
+    uint32_t u = 0;
+    static_assert(sizeof(float) == sizeof(uint32_t));
+    std::memcpy(&u, &f, sizeof(u));
+    put_u32(u);
+  }
+
+  bool ok() const { return ok_; }
+  // Encoded size, or 0 if the message did not fit.
+  std::size_t size() const { return ok_ ? n_ : 0; }
+
+ private:
+  bool reserve(std::size_t n) {
+    if (!ok_ || n_ + n > out_.size()) {
+      ok_ = false;
+      return false;
+    }
+    return true;
+  }
+
+  void put_u32(uint32_t v) {
+    if (!reserve(4)) return;
+    const uint32_t be = htonl(v);
+    std::memcpy(out_.data() + n_, &be, 4);
+    n_ += 4;
+  }
+
+  std::span<uint8_t> out_;
+  std::size_t n_ = 0;
+  bool ok_ = true;
+};
+
+inline constexpr Str kAddrNote{"/khor/note"};
+inline constexpr Str kAddrSignal{"/khor/signal"};
+inline constexpr Str kAddrMetrics{"/khor/metrics"};
+
+// Encoders return the message size in bytes, or 0 if `out` is too small.
+inline std::size_t encode_note(const NoteEvent& ev, std::span<uint8_t> out) {
+  Writer w(out);
+  w.put_str(kAddrNote);
+  w.put_raw(kTypeTags<'i', 'i', 'f', 'f'>);
+  w.put_i32((int32_t)std::clamp(ev.channel, 1, 16));
+  w.put_i32((int32_t)std::clamp(ev.midi, 0, 127));
+  w.put_f32(std::clamp(ev.velocity, 0.0f, 1.0f));
+  w.put_f32(std::max(0.0f, ev.dur_s));
+  return w.size();
 }
 
-inline std::vector<uint8_t> encode_signal(const char* name, float v01) {
-  std::vector<uint8_t> b;
-  b.reserve(96);
-  put_str(b, "/khor/signal");
-  put_str(b, ",sf");
-  put_str(b, name ? name : "");
-  put_f32(b, std::clamp(v01, 0.0f, 1.0f));
-  return b;
+inline std::size_t encode_signal(const char* name, float v01, std::span<uint8_t> out) {
+  Writer w(out);
+  w.put_str(kAddrSignal);
+  w.put_raw(kTypeTags<'s', 'f'>);
+  w.put_str(name ? name : "");
+  w.put_f32(std::clamp(v01, 0.0f, 1.0f));
+  return w.size();
 }
 
-inline std::vector<uint8_t> encode_metrics(const SignalRates& r) {
-  std::vector<uint8_t> b;
-  b.reserve(160);
-  put_str(b, "/khor/metrics");
-  put_str(b, ",fffffffff");
-  put_f32(b, (float)r.exec_s);
-  put_f32(b, (float)r.rx_kbs);
-  put_f32(b, (float)r.tx_kbs);
-  put_f32(b, (float)r.csw_s);
-  put_f32(b, (float)r.blk_r_kbs);
-  put_f32(b, (float)r.blk_w_kbs);
-  put_f32(b, (float)r.retx_s);
-  put_f32(b, (float)r.irq_s);
-  put_f32(b, (float)r.mem_pct);
-  return b;
+inline std::size_t encode_metrics(const SignalRates& r, std::span<uint8_t> out) {
+  Writer w(out);
+  w.put_str(kAddrMetrics);
+  w.put_raw(kTypeTags<'f', 'f', 'f', 'f', 'f', 'f', 'f', 'f', 'f'>);
+  w.put_f32((float)r.exec_s);
+  w.put_f32((float)r.rx_kbs);
+  w.put_f32((float)r.tx_kbs);
+  w.put_f32((float)r.csw_s);
+  w.put_f32((float)r.blk_r_kbs);
+  w.put_f32((float)r.blk_w_kbs);
+  w.put_f32((float)r.retx_s);
+  w.put_f32((float)r.irq_s);
+  w.put_f32((float)r.mem_pct);
+  return w.size();
 }
 
 } // namespace khor::osc
-
@@ -1,98 +1,257 @@
 #include "osc/osc.h"
 
+#include <array>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
+#include <iterator>
 
 #include <netdb.h>
+#include <netinet/in.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 #include "osc/encode.h"
 
 namespace khor {
-struct OscClient::Impl {
-  int fd = -1;
-  sockaddr_storage addr{};
-  socklen_t addr_len = 0;
+namespace {
+
+// /khor/signal messages, in send order: one per Signal01 field.
+struct SignalField {
+  const char* name;
+  double Signal01::*v;
+};
+constexpr SignalField kSignalFields[] = {
+  {"exec", &Signal01::exec},
+  {"rx", &Signal01::rx},
+  {"tx", &Signal01::tx},
+  {"csw", &Signal01::csw},
+  {"io", &Signal01::io},
+  {"retx", &Signal01::retx},
+  {"irq", &Signal01::irq},
+  {"mem", &Signal01::mem},
+  {"entropy", &Signal01::entropy},
+  {"dstate", &Signal01::dstate},
+  {"lock", &Signal01::lock},
+  {"drop", &Signal01::drop},
+  {"spawners", &Signal01::spawners},
+  {"actors", &Signal01::actors},
+  {"peers", &Signal01::peers},
+  {"churn", &Signal01::churn},
+  {"vfs", &Signal01::vfs},
+  {"fsync", &Signal01::fsync},
+  {"rtt", &Signal01::rtt},
+  {"listen", &Signal01::listen},
+  {"ipc", &Signal01::ipc},
+  {"miss", &Signal01::miss},
+};
+static_assert(sizeof(Signal01) == std::size(kSignalFields) * sizeof(double), "every Signal01 field is sent");
+
+// Messages per batch (send_signals sends one per signal).
+constexpr std::size_t kMaxBatchMsgs = std::size(kSignalFields);
+
+bool is_multicast(const sockaddr_storage& a) {
+  if (a.ss_family == AF_INET) {
+    const auto* in = (const sockaddr_in*)&a;
+    return IN_MULTICAST(ntohl(in->sin_addr.s_addr));
+  }
+  if (a.ss_family == AF_INET6) {
+    const auto* in6 = (const sockaddr_in6*)&a;
+    return IN6_IS_ADDR_MULTICAST(&in6->sin6_addr);
+  }
+  return false;
+}
+
+} // namespace
+
+bool osc_parse_dest(const std::string& s, OscDest* out) {
+  if (!out) return false;
   std::string host;
-  int port = 0;
+  std::string port_s;
+  if (!s.empty() && s[0] == '[') {
+    const auto close = s.find(']');
+    if (close == std::string::npos || close + 1 >= s.size() || s[close + 1] != ':') return false;
+    host = s.substr(1, close - 1);
+    port_s = s.substr(close + 2);
+  } else {
+    const auto pos = s.rfind(':');
+    if (pos == std::string::npos) return false;
+    host = s.substr(0, pos);
+    port_s = s.substr(pos + 1);
+  }
+  if (host.empty() || port_s.empty()) return false;
+  char* endp = nullptr;
+  const long v = std::strtol(port_s.c_str(), &endp, 10);
+  if (!endp || *endp != 0 || v < 1 || v > 65535) return false;
+  out->host = std::move(host);
+  out->port = (int)v;
+  return true;
+}
+
+struct OscClient::Impl {
+  struct Dest {
+    sockaddr_storage addr{};
+    socklen_t addr_len = 0;
+  };
+
+  // One socket per address family; destinations are grouped by family so each
+  // batch is a single sendmmsg() per socket.
+  int fd4 = -1;
+  int fd6 = -1;
+  std::array<Dest, kMaxDests> dests4{};
+  std::array<Dest, kMaxDests> dests6{};
+  int n4 = 0;
+  int n6 = 0;
+
+  void send_to(int fd, const Dest* dests, int ndests, const osc::Packet* msgs, const std::size_t* lens, int nmsgs) {
+    if (fd < 0 || ndests <= 0) return;
+    std::array<mmsghdr, kMaxBatchMsgs * kMaxDests> mh;
+    std::array<iovec, kMaxBatchMsgs * kMaxDests> iov;
+    unsigned n = 0;
+    for (int m = 0; m < nmsgs; m++) {
+      if (lens[m] == 0) continue;
+      for (int d = 0; d < ndests; d++) {
+        iov[n].iov_base = (void*)msgs[m].data();
+        iov[n].iov_len = lens[m];
+        mh[n] = mmsghdr{};
+        mh[n].msg_hdr.msg_name = (void*)&dests[d].addr;
+        mh[n].msg_hdr.msg_namelen = dests[d].addr_len;
+        mh[n].msg_hdr.msg_iov = &iov[n];
+        mh[n].msg_hdr.msg_iovlen = 1;
+        n++;
+      }
+    }
+    // Best-effort like sendto(): a full socket buffer drops the rest of the batch. sendmmsg
+    // fails only on the first message, so an unreachable destination skips just that one.
+    unsigned off = 0;
+    while (off < n) {
+      const int sent = ::sendmmsg(fd, mh.data() + off, n - off, MSG_DONTWAIT);
+      if (sent > 0) {
+        off += (unsigned)sent;
+      } else if (sent == 0 || errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+        break;
+      } else if (errno != EINTR) {
+        off++;
+      }
+    }
+  }
+
+  void send(const osc::Packet* msgs, const std::size_t* lens, int nmsgs) {
+    send_to(fd4, dests4.data(), n4, msgs, lens, nmsgs);
+    send_to(fd6, dests6.data(), n6, msgs, lens, nmsgs);
+  }
 };
 
 OscClient::OscClient() : impl_(new Impl()) {}
 OscClient::~OscClient() { stop(); delete impl_; impl_ = nullptr; }
 
-bool OscClient::start(const std::string& host, int port, std::string* err) {
+bool OscClient::start(const std::vector<OscDest>& dests, int multicast_ttl, std::string* err) {
   if (!impl_) return false;
   stop();
 
-  if (port < 1 || port > 65535) {
-    if (err) *err = "invalid OSC port";
+  if (dests.empty()) {
+    if (err) *err = "no OSC destinations";
     return false;
   }
-
-  addrinfo hints{};
-  hints.ai_family = AF_UNSPEC;
-  hints.ai_socktype = SOCK_DGRAM;
-  hints.ai_protocol = IPPROTO_UDP;
-
-  addrinfo* res = nullptr;
-  const std::string port_s = std::to_string(port);
-  if (getaddrinfo(host.c_str(), port_s.c_str(), &hints, &res) != 0 || !res) {
-    if (err) *err = "failed to resolve OSC host";
+  if ((int)dests.size() > kMaxDests) {
+    if (err) *err = "too many OSC destinations (max " + std::to_string(kMaxDests) + ")";
     return false;
   }
 
-  int fd = -1;
-  sockaddr_storage out_addr{};
-  socklen_t out_len = 0;
-  for (addrinfo* it = res; it; it = it->ai_next) {
-    fd = ::socket(it->ai_family, it->ai_socktype, it->ai_protocol);
-    if (fd < 0) continue;
-    std::memcpy(&out_addr, it->ai_addr, it->ai_addrlen);
-    out_len = (socklen_t)it->ai_addrlen;
-    break;
-  }
-  freeaddrinfo(res);
+  bool want_mcast4 = false;
+  bool want_mcast6 = false;
+  for (const auto& d : dests) {
+    if (d.port < 1 || d.port > 65535) {
+      if (err) *err = "invalid OSC port";
+      stop();
+      return false;
+    }
 
-  if (fd < 0) {
-    if (err) *err = "failed to create OSC UDP socket";
-    return false;
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+
+    addrinfo* res = nullptr;
+    const std::string port_s = std::to_string(d.port);
+    if (getaddrinfo(d.host.c_str(), port_s.c_str(), &hints, &res) != 0 || !res) {
+      if (err) *err = "failed to resolve OSC host: " + d.host;
+      stop();
+      return false;
+    }
+
+    bool added = false;
+    for (addrinfo* it = res; it && !added; it = it->ai_next) {
+      const bool v6 = it->ai_family == AF_INET6;
+      if (!v6 && it->ai_family != AF_INET) continue;
+      int& fd = v6 ? impl_->fd6 : impl_->fd4;
+      if (fd < 0) fd = ::socket(it->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+      if (fd < 0) continue;
+
+      Impl::Dest& out = v6 ? impl_->dests6[impl_->n6++] : impl_->dests4[impl_->n4++];
+      std::memcpy(&out.addr, it->ai_addr, it->ai_addrlen);
+      out.addr_len = (socklen_t)it->ai_addrlen;
+      if (is_multicast(out.addr)) (v6 ? want_mcast6 : want_mcast4) = true;
+      added = true;
+    }
+    freeaddrinfo(res);
+
+    if (!added) {
+      if (err) *err = "failed to create OSC UDP socket for " + d.host;
+      stop();
+      return false;
+    }
   }
 
-  impl_->fd = fd;
-  impl_->addr = out_addr;
-  impl_->addr_len = out_len;
-  impl_->host = host;
-  impl_->port = port;
+  const int ttl = multicast_ttl < 0 ? 0 : (multicast_ttl > 255 ? 255 : multicast_ttl);
+  if (want_mcast4) (void)::setsockopt(impl_->fd4, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  if (want_mcast6) (void)::setsockopt(impl_->fd6, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof(ttl));
   return true;
 }
 
 void OscClient::stop() {
   if (!impl_) return;
-  if (impl_->fd >= 0) ::close(impl_->fd);
-  impl_->fd = -1;
-  impl_->addr_len = 0;
-  impl_->host.clear();
-  impl_->port = 0;
+  if (impl_->fd4 >= 0) ::close(impl_->fd4);
+  if (impl_->fd6 >= 0) ::close(impl_->fd6);
+  impl_->fd4 = -1;
+  impl_->fd6 = -1;
+  impl_->n4 = 0;
+  impl_->n6 = 0;
 }
 
-bool OscClient::is_running() const { return impl_ && impl_->fd >= 0; }
+bool OscClient::is_running() const { return impl_ && (impl_->fd4 >= 0 || impl_->fd6 >= 0); }
+
+int OscClient::dest_count() const { return impl_ ? impl_->n4 + impl_->n6 : 0; }
 
 void OscClient::send_note(const NoteEvent& ev) {
   if (!is_running()) return;
-  const auto payload = osc::encode_note(ev);
-  (void)::sendto(impl_->fd, payload.data(), payload.size(), MSG_DONTWAIT, (const sockaddr*)&impl_->addr, impl_->addr_len);
+  osc::Packet p;
+  const std::size_t n = osc::encode_note(ev, p);
+  impl_->send(&p, &n, 1);
 }
 
 void OscClient::send_signal(const char* name, float value01) {
   if (!is_running()) return;
-  const auto payload = osc::encode_signal(name, value01);
-  (void)::sendto(impl_->fd, payload.data(), payload.size(), MSG_DONTWAIT, (const sockaddr*)&impl_->addr, impl_->addr_len);
+  osc::Packet p;
+  const std::size_t n = osc::encode_signal(name, value01, p);
+  impl_->send(&p, &n, 1);
+}
+
+void OscClient::send_signals(const Signal01& s) {
+  if (!is_running()) return;
+  std::array<osc::Packet, kMaxBatchMsgs> p;
+  std::array<std::size_t, kMaxBatchMsgs> n;
+  for (std::size_t i = 0; i < kMaxBatchMsgs; i++) {
+    n[i] = osc::encode_signal(kSignalFields[i].name, (float)(s.*kSignalFields[i].v), p[i]);
+  }
+  impl_->send(p.data(), n.data(), (int)kMaxBatchMsgs);
 }
 
 void OscClient::send_metrics(const SignalRates& r) {
   if (!is_running()) return;
-  const auto payload = osc::encode_metrics(r);
-  (void)::sendto(impl_->fd, payload.data(), payload.size(), MSG_DONTWAIT, (const sockaddr*)&impl_->addr, impl_->addr_len);
+  osc::Packet p;
+  const std::size_t n = osc::encode_metrics(r, p);
+  impl_->send(&p, &n, 1);
 }
 
 } // namespace khor
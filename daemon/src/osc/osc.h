@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "engine/note_event.h"
 #include "engine/signals.h"
@@ -16,20 +17,35 @@ struct OscStatus {
   std::string error;
 };
 
+struct OscDest {
+  std::string host; // hostname, IPv4/IPv6 literal, or multicast group
+  int port = 0;
+};
+
+// Parses "host:port" or "[v6addr]:port".
+bool osc_parse_dest(const std::string& s, OscDest* out);
+
+// UDP OSC sender. Every message fans out to all destinations with one sendmmsg()
+// per address family; encoding happens in stack buffers (no allocation per send).
 class OscClient {
  public:
+  static constexpr int kMaxDests = 16;
+
   OscClient();
   ~OscClient();
 
   OscClient(const OscClient&) = delete;
   OscClient& operator=(const OscClient&) = delete;
 
-  bool start(const std::string& host, int port, std::string* err);
+  bool start(const std::vector<OscDest>& dests, int multicast_ttl, std::string* err);
   void stop();
   bool is_running() const;
+  int dest_count() const;
 
   void send_note(const NoteEvent& ev);
   void send_signal(const char* name, float value01);
+  // All Signal01 lanes as /khor/signal messages in a single batch.
+  void send_signals(const Signal01& s);
   void send_metrics(const SignalRates& r);
 
  private:
@@ -38,4 +54,3 @@ class OscClient {
 };
 
 } // namespace khor
-
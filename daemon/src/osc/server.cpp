@@ -0,0 +1,148 @@
+#include "osc/server.h"
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "util/reactor.h"
+
+namespace khor {
+
+struct OscServer::Impl {
+  static constexpr int kBatch = 16;
+  static constexpr std::size_t kMaxDatagram = 1536;
+
+  int fd = -1;
+  Reactor* reactor = nullptr;
+  std::atomic<bool> running{false};
+  Handler handler;
+
+  std::atomic<uint64_t> packets{0};
+  std::atomic<uint64_t> messages{0};
+  std::atomic<uint64_t> errors{0};
+
+  // Receive buffers, touched only by the reactor thread.
+  std::array<std::array<uint8_t, kMaxDatagram>, kBatch> bufs{};
+  std::array<iovec, kBatch> iov{};
+  std::array<mmsghdr, kBatch> mh{};
+
+  void drain() {
+    for (;;) {
+      for (int i = 0; i < kBatch; i++) {
+        iov[i].iov_base = bufs[i].data();
+        iov[i].iov_len = bufs[i].size();
+        mh[i] = mmsghdr{};
+        mh[i].msg_hdr.msg_iov = &iov[i];
+        mh[i].msg_hdr.msg_iovlen = 1;
+      }
+      const int n = ::recvmmsg(fd, mh.data(), kBatch, MSG_DONTWAIT, nullptr);
+      if (n <= 0) return;
+      for (int i = 0; i < n; i++) {
+        packets.fetch_add(1, std::memory_order_relaxed);
+        if (mh[i].msg_hdr.msg_flags & MSG_TRUNC) {
+          errors.fetch_add(1, std::memory_order_relaxed);
+          continue;
+        }
+        const std::span<const uint8_t> pkt(bufs[i].data(), mh[i].msg_len);
+        const bool ok = osc::for_each_message(pkt, [&](const osc::Message& m) {
+          messages.fetch_add(1, std::memory_order_relaxed);
+          handler(m);
+        });
+        if (!ok) errors.fetch_add(1, std::memory_order_relaxed);
+      }
+      if (n < kBatch) return;
+    }
+  }
+};
+
+OscServer::OscServer() : impl_(new Impl()) {}
+OscServer::~OscServer() { stop(); delete impl_; impl_ = nullptr; }
+
+bool OscServer::start(const std::string& host, int port, Handler handler, Reactor* reactor, std::string* err) {
+  if (!impl_) return false;
+  stop();
+
+  if (!reactor) {
+    if (err) *err = "osc input: no reactor";
+    return false;
+  }
+  if (port < 1 || port > 65535) {
+    if (err) *err = "invalid OSC listen port";
+    return false;
+  }
+  if (!handler) {
+    if (err) *err = "missing OSC handler";
+    return false;
+  }
+
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_protocol = IPPROTO_UDP;
+  hints.ai_flags = AI_PASSIVE;
+
+  addrinfo* res = nullptr;
+  const std::string port_s = std::to_string(port);
+  if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port_s.c_str(), &hints, &res) != 0 || !res) {
+    if (err) *err = "failed to resolve OSC listen host";
+    return false;
+  }
+
+  int fd = -1;
+  for (addrinfo* it = res; it; it = it->ai_next) {
+    fd = ::socket(it->ai_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (fd < 0) continue;
+    const int one = 1;
+    (void)::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (::bind(fd, it->ai_addr, it->ai_addrlen) == 0) break;
+    ::close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+
+  if (fd < 0) {
+    if (err) *err = "failed to bind OSC listen socket (port in use?)";
+    return false;
+  }
+
+  impl_->fd = fd;
+  impl_->handler = std::move(handler);
+  if (!reactor->add_fd(fd, [impl = impl_] { impl->drain(); })) {
+    if (err) *err = std::string("osc input: epoll registration failed: ") + std::strerror(errno);
+    ::close(fd);
+    impl_->fd = -1;
+    impl_->handler = nullptr;
+    return false;
+  }
+  impl_->reactor = reactor;
+  impl_->running.store(true);
+  return true;
+}
+
+void OscServer::stop() {
+  if (!impl_) return;
+  impl_->running.store(false);
+  if (impl_->reactor && impl_->fd >= 0) impl_->reactor->remove_fd(impl_->fd);
+  impl_->reactor = nullptr;
+  if (impl_->fd >= 0) ::close(impl_->fd);
+  impl_->fd = -1;
+  impl_->handler = nullptr;
+}
+
+bool OscServer::is_running() const { return impl_ && impl_->running.load(); }
+
+OscServerStats OscServer::stats() const {
+  OscServerStats s;
+  if (!impl_) return s;
+  s.packets = impl_->packets.load(std::memory_order_relaxed);
+  s.messages = impl_->messages.load(std::memory_order_relaxed);
+  s.errors = impl_->errors.load(std::memory_order_relaxed);
+  return s;
+}
+
+} // namespace khor
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "osc/decode.h"
+
+namespace khor {
+
+struct OscServerStats {
+  uint64_t packets = 0;
+  uint64_t messages = 0;
+  uint64_t errors = 0; // malformed packets
+};
+
+class Reactor;
+
+// UDP OSC control listener. The socket is registered with the reactor; when it
+// becomes readable, datagrams are drained with recvmmsg() and each decoded
+// message is handed to the handler on the reactor thread.
+class OscServer {
+ public:
+  using Handler = std::function<void(const osc::Message&)>;
+
+  OscServer();
+  ~OscServer();
+
+  OscServer(const OscServer&) = delete;
+  OscServer& operator=(const OscServer&) = delete;
+
+  bool start(const std::string& host, int port, Handler handler, Reactor* reactor, std::string* err);
+  void stop();
+  bool is_running() const;
+
+  OscServerStats stats() const;
+
+ private:
+  struct Impl;
+  Impl* impl_ = nullptr;
+};
+
+} // namespace khor
@@ -0,0 +1,229 @@
+#include "pmu/pmu.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace khor {
+
+namespace {
+
+struct EventSpec {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+};
+
+constexpr uint64_t kLlcReadMiss = PERF_COUNT_HW_CACHE_LL | ((uint64_t)PERF_COUNT_HW_CACHE_OP_READ << 8) |
+  ((uint64_t)PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+// The LLC read-miss cache event isn't there on every CPU (most AMD parts); the generic
+// cache-misses event is the last-level cache too, on the PMUs that have it.
+constexpr EventSpec kHwEvents[] = {
+  {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {"llc_misses", PERF_TYPE_HW_CACHE, kLlcReadMiss},
+  {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+static_assert(std::size(kHwEvents) == (std::size_t)PmuEvent::Count, "one spec per PmuEvent");
+
+constexpr EventSpec kSwEvents[] = {
+  {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+  {"major_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ},
+};
+static_assert(std::size(kSwEvents) == (std::size_t)PmuSwEvent::Count, "one spec per PmuSwEvent");
+
+int perf_open(uint32_t type, uint64_t config, int cpu, int group_fd) {
+  perf_event_attr attr{};
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.exclude_hv = 1;
+  return (int)::syscall(__NR_perf_event_open, &attr, -1, cpu, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+std::string errno_string(int e) {
+  char buf[128];
+  std::snprintf(buf, sizeof(buf), "%s (errno=%d)", std::strerror(e), e);
+  return buf;
+}
+
+} // namespace
+
+const char* pmu_mode_name(PmuMode m) {
+  switch (m) {
+    case PmuMode::Hardware: return "hardware";
+    case PmuMode::Software: return "software";
+    default: return "off";
+  }
+}
+
+bool pmu_add_delta(const PmuGroupRead& prev, const PmuGroupRead& cur, std::size_t n, double* out) {
+  if (cur.running_ns <= prev.running_ns || cur.enabled_ns < prev.enabled_ns) return false;
+  const double scale = (double)(cur.enabled_ns - prev.enabled_ns) / (double)(cur.running_ns - prev.running_ns);
+  for (std::size_t i = 0; i < n && i < cur.v.size(); i++) {
+    if (cur.v[i] >= prev.v[i]) out[i] += (double)(cur.v[i] - prev.v[i]) * scale;
+  }
+  return true;
+}
+
+struct PmuCollector::Impl {
+  struct Group {
+    std::vector<int> fds;                                  // leader first
+    std::array<int, (std::size_t)PmuEvent::Count> pos{};   // index in the group read, -1 if not open
+    PmuGroupRead prev{};
+    bool have_prev = false;
+  };
+
+  PmuMode mode = PmuMode::Off;
+  std::size_t nevents = 0;
+  std::vector<Group> groups;
+  std::vector<std::string> events;
+  std::string error;
+
+  // The leader has to open; a member that won't is left out of this CPU's group.
+  bool open_group(int cpu, const EventSpec* specs, std::size_t n, Group* g, int* err) {
+    g->pos.fill(-1);
+    for (std::size_t i = 0; i < n; i++) {
+      const int leader = g->fds.empty() ? -1 : g->fds.front();
+      if (i > 0 && leader < 0) break;
+      int fd = perf_open(specs[i].type, specs[i].config, cpu, leader);
+      if (fd < 0 && specs[i].type == PERF_TYPE_HW_CACHE) {
+        fd = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, cpu, leader);
+      }
+      if (fd < 0) {
+        if (i == 0) {
+          *err = errno;
+          return false;
+        }
+        continue;
+      }
+      g->pos[i] = (int)g->fds.size();
+      g->fds.push_back(fd);
+    }
+    return true;
+  }
+
+  // Every CPU that can; ENODEV alone means an offline CPU.
+  bool open_all(const EventSpec* specs, std::size_t n, int* err) {
+    const long ncpu = ::sysconf(_SC_NPROCESSORS_CONF);
+    int last = 0;
+    for (int cpu = 0; cpu < (int)ncpu; cpu++) {
+      Group g;
+      int e = 0;
+      if (!open_group(cpu, specs, n, &g, &e)) {
+        if (e != ENODEV || !last) last = e;
+        continue;
+      }
+      groups.push_back(std::move(g));
+    }
+    if (groups.empty()) {
+      *err = last ? last : ENODEV;
+      return false;
+    }
+    nevents = n;
+    for (std::size_t i = 0; i < n; i++) {
+      for (const auto& g : groups) {
+        if (g.pos[i] >= 0) {
+          events.push_back(specs[i].name);
+          break;
+        }
+      }
+    }
+    return true;
+  }
+
+  void close_all() {
+    for (auto& g : groups) {
+      for (int fd : g.fds) ::close(fd);
+    }
+    groups.clear();
+    events.clear();
+    nevents = 0;
+  }
+};
+
+PmuCollector::PmuCollector() : impl_(new Impl()) {}
+PmuCollector::~PmuCollector() { stop(); delete impl_; impl_ = nullptr; }
+
+bool PmuCollector::start(std::string* err) {
+  if (!impl_) return false;
+  stop();
+  impl_->error.clear();
+
+  int hw_err = 0;
+  if (impl_->open_all(kHwEvents, std::size(kHwEvents), &hw_err)) {
+    impl_->mode = PmuMode::Hardware;
+    return true;
+  }
+  // EACCES/EPERM would fail the software events too; anything else is a missing PMU.
+  impl_->error = "hardware counters unavailable: " + errno_string(hw_err);
+  if (hw_err == ENOENT || hw_err == ENODEV || hw_err == EOPNOTSUPP) impl_->error += " (no PMU, e.g. a VM without a virtual PMU)";
+
+  int sw_err = 0;
+  if (impl_->open_all(kSwEvents, std::size(kSwEvents), &sw_err)) {
+    impl_->mode = PmuMode::Software;
+    return true;
+  }
+  impl_->error = "perf_event_open failed: " + errno_string(sw_err) + " (need CAP_PERFMON or kernel.perf_event_paranoid <= 0)";
+  if (err) *err = impl_->error;
+  return false;
+}
+
+void PmuCollector::stop() {
+  if (!impl_) return;
+  impl_->close_all();
+  impl_->mode = PmuMode::Off;
+}
+
+bool PmuCollector::is_running() const { return impl_ && impl_->mode != PmuMode::Off; }
+
+bool PmuCollector::read(PmuDeltas* out) {
+  if (!impl_ || !out) return false;
+  *out = PmuDeltas{};
+  out->mode = impl_->mode;
+  if (impl_->mode == PmuMode::Off) return false;
+
+  double* dst = impl_->mode == PmuMode::Hardware ? out->hw.data() : out->sw.data();
+  uint64_t enabled = 0;
+  uint64_t running = 0;
+  for (auto& g : impl_->groups) {
+    // { nr, time_enabled, time_running, value[nr] }
+    uint64_t buf[3 + (std::size_t)PmuEvent::Count] = {};
+    const ssize_t n = ::read(g.fds.front(), buf, sizeof(buf));
+    if (n < (ssize_t)(3 * sizeof(uint64_t))) continue;
+    PmuGroupRead cur;
+    cur.enabled_ns = buf[1];
+    cur.running_ns = buf[2];
+    for (std::size_t i = 0; i < impl_->nevents; i++) {
+      const int p = g.pos[i];
+      if (p >= 0 && (uint64_t)p < buf[0]) cur.v[i] = buf[3 + p];
+    }
+    if (g.have_prev && pmu_add_delta(g.prev, cur, impl_->nevents, dst)) {
+      enabled += cur.enabled_ns - g.prev.enabled_ns;
+      running += cur.running_ns - g.prev.running_ns;
+    }
+    g.prev = cur;
+    g.have_prev = true;
+  }
+  out->running = enabled ? (double)running / (double)enabled : 0.0;
+  return true;
+}
+
+PmuStatus PmuCollector::status() const {
+  PmuStatus st;
+  if (!impl_) return st;
+  st.mode = impl_->mode;
+  st.cpus = (int)impl_->groups.size();
+  st.events = impl_->events;
+  st.error = impl_->error;
+  return st;
+}
+
+} // namespace khor
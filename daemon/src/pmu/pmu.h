@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace khor {
+
+enum class PmuMode : uint8_t { Off, Hardware, Software };
+const char* pmu_mode_name(PmuMode m);
+
+// Counted events, in group order (the first is the group leader).
+enum class PmuEvent : uint8_t { Cycles, Instructions, CacheMisses, BranchMisses, Count };
+// Software fallback, for when the PMU isn't there (most VMs without a vPMU).
+enum class PmuSwEvent : uint8_t { PageFaults, MajorFaults, Count };
+
+// One group read (PERF_FORMAT_GROUP | TOTAL_TIME_ENABLED | TOTAL_TIME_RUNNING), raw, by
+// PmuEvent (or PmuSwEvent); an event the CPU wouldn't open stays 0.
+struct PmuGroupRead {
+  uint64_t enabled_ns = 0;
+  uint64_t running_ns = 0;
+  std::array<uint64_t, (std::size_t)PmuEvent::Count> v{};
+};
+
+// Counts since the previous read(), summed over CPUs. A group multiplexed off the PMU for
+// part of the interval is scaled up by enabled/running, as perf stat does.
+struct PmuDeltas {
+  PmuMode mode = PmuMode::Off;
+  std::array<double, (std::size_t)PmuEvent::Count> hw{};
+  std::array<double, (std::size_t)PmuSwEvent::Count> sw{};
+  double running = 0.0; // share of the interval the groups were counting (1 = never multiplexed)
+};
+
+// Adds cur - prev of a group's first n values to out[0..n), scaled for multiplexing.
+// False (and nothing added) when the group didn't run in between.
+bool pmu_add_delta(const PmuGroupRead& prev, const PmuGroupRead& cur, std::size_t n, double* out);
+
+struct PmuStatus {
+  PmuMode mode = PmuMode::Off;
+  int cpus = 0;                    // CPUs with an open group
+  std::vector<std::string> events; // what is being counted
+  std::string error;               // why hardware counters aren't in use, if they aren't
+};
+
+// System-wide counting groups, one per online CPU, read with read(2) at sample cadence.
+// Needs CAP_PERFMON (or perf_event_paranoid <= 0).
+class PmuCollector {
+ public:
+  PmuCollector();
+  ~PmuCollector();
+
+  PmuCollector(const PmuCollector&) = delete;
+  PmuCollector& operator=(const PmuCollector&) = delete;
+
+  // Hardware groups (cycles, instructions, LLC misses, branch misses) when the PMU has them,
+  // otherwise the software page fault counters. False only if neither can be opened.
+  bool start(std::string* err);
+  void stop();
+  bool is_running() const;
+
+  // Caller's lock. The first read after start() only sets the baseline.
+  bool read(PmuDeltas* out);
+  PmuStatus status() const;
+
+ private:
+  struct Impl;
+  Impl* impl_ = nullptr;
+};
+
+} // namespace khor
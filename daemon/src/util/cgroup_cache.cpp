@@ -0,0 +1,332 @@
+#include "util/cgroup_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util/reactor.h"
+
+namespace khor {
+
+namespace {
+
+constexpr std::string_view kUnitSuffixes[] = {".service", ".scope", ".slice", ".socket", ".mount", ".swap"};
+
+bool is_hex(char c) { return std::isxdigit((unsigned char)c) != 0; }
+
+bool ends_with(std::string_view s, std::string_view suf) {
+  return s.size() >= suf.size() && s.substr(s.size() - suf.size()) == suf;
+}
+
+bool is_unit(std::string_view comp) {
+  for (auto suf : kUnitSuffixes) {
+    if (comp.size() > suf.size() && ends_with(comp, suf)) return true;
+  }
+  return false;
+}
+
+// Components of a cgroup path, innermost first.
+std::vector<std::string_view> components_rev(std::string_view path) {
+  std::vector<std::string_view> out;
+  while (!path.empty()) {
+    const auto slash = path.rfind('/');
+    const auto comp = slash == std::string_view::npos ? path : path.substr(slash + 1);
+    if (!comp.empty()) out.push_back(comp);
+    if (slash == std::string_view::npos) break;
+    path = path.substr(0, slash);
+  }
+  return out;
+}
+
+// "docker-<id>.scope", "cri-containerd-<id>.scope", "crio-<id>", "libpod-<id>.scope", "<id>".
+std::string_view hex64_in(std::string_view comp) {
+  for (std::size_t i = 0; i + 64 <= comp.size(); i++) {
+    if (i > 0 && is_hex(comp[i - 1])) continue;
+    std::size_t n = 0;
+    while (i + n < comp.size() && is_hex(comp[i + n])) n++;
+    if (n == 64) return comp.substr(i, 64);
+    i += n;
+  }
+  return {};
+}
+
+} // namespace
+
+std::string cgroup_unit_name(std::string_view path) {
+  for (auto comp : components_rev(path)) {
+    if (is_unit(comp)) return std::string(comp);
+  }
+  return {};
+}
+
+std::string cgroup_container_id(std::string_view path) {
+  for (auto comp : components_rev(path)) {
+    if (auto id = hex64_in(comp); !id.empty()) return std::string(id);
+  }
+  return {};
+}
+
+struct CgroupCache::Impl {
+  static constexpr uint32_t kMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+  int fd = -1;
+  Reactor* reactor = nullptr;
+  std::atomic<bool> running{false};
+  std::function<void()> on_change;
+  std::string root;
+
+  mutable std::mutex mu;
+  std::unordered_map<uint64_t, CgroupInfo> by_id;
+  std::map<std::string, uint64_t> by_path; // ordered: a subtree is a contiguous range
+  std::unordered_map<int, std::string> wd_path;
+  std::atomic<uint64_t> generation{0};
+  std::atomic<bool> watch_limited{false};
+
+  std::string abs_path(const std::string& rel) const { return rel == "/" ? root : root + rel; }
+
+  // Caller holds mu. Returns true if the entry is new.
+  bool add_one(const std::string& rel) {
+    struct stat st{};
+    if (::stat(abs_path(rel).c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return false;
+    const uint64_t id = (uint64_t)st.st_ino;
+    if (auto it = by_path.find(rel); it != by_path.end()) {
+      if (it->second == id) return false;
+      by_id.erase(it->second); // removed and recreated while events were lost
+    }
+
+    if (fd >= 0) {
+      const int wd = ::inotify_add_watch(fd, abs_path(rel).c_str(), kMask);
+      if (wd >= 0) wd_path[wd] = rel;
+      else if (errno == ENOSPC) watch_limited.store(true, std::memory_order_relaxed);
+    }
+    CgroupInfo ci;
+    ci.id = id;
+    ci.path = rel;
+    ci.unit = cgroup_unit_name(rel);
+    ci.container = cgroup_container_id(rel);
+    by_path[rel] = id;
+    by_id[id] = std::move(ci);
+    return true;
+  }
+
+  // Caller holds mu. Adds rel and everything below it; returns the number of new entries.
+  std::size_t add_tree(const std::string& rel, std::unordered_set<std::string>* seen = nullptr) {
+    std::size_t added = add_one(rel) ? 1 : 0;
+    if (seen) seen->insert(rel);
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    const auto base = fs::path(abs_path(rel));
+    for (fs::recursive_directory_iterator it(base, fs::directory_options::skip_permission_denied, ec), end;
+         !ec && it != end; it.increment(ec)) {
+      if (!it->is_directory(ec) || it->is_symlink(ec)) {
+        it.disable_recursion_pending();
+        continue;
+      }
+      const std::string sub = (rel == "/" ? std::string() : rel) + "/" + fs::relative(it->path(), base, ec).generic_string();
+      if (ec) break;
+      if (add_one(sub)) added++;
+      if (seen) seen->insert(sub);
+    }
+    return added;
+  }
+
+  // Caller holds mu. Drops rel and its subtree; returns the number of removed entries.
+  std::size_t remove_tree(const std::string& rel) {
+    std::size_t removed = 0;
+    const std::string prefix = rel + "/";
+    for (auto it = by_path.lower_bound(rel); it != by_path.end();) {
+      if (it->first != rel && it->first.compare(0, prefix.size(), prefix) != 0) break;
+      by_id.erase(it->second);
+      it = by_path.erase(it);
+      removed++;
+    }
+    return removed;
+  }
+
+  // Caller holds mu. Only after an event queue overflow: reconcile with cgroupfs.
+  std::size_t rescan() {
+    std::unordered_set<std::string> seen;
+    std::size_t changed = add_tree("/", &seen);
+    for (auto it = by_path.begin(); it != by_path.end();) {
+      if (seen.count(it->first)) { ++it; continue; }
+      by_id.erase(it->second);
+      it = by_path.erase(it);
+      changed++;
+    }
+    return changed;
+  }
+
+  void drain() {
+    alignas(inotify_event) char buf[8192];
+    std::size_t changed = 0;
+    for (;;) {
+      const ssize_t n = ::read(fd, buf, sizeof(buf));
+      if (n <= 0) break;
+      std::lock_guard<std::mutex> lk(mu);
+      for (ssize_t off = 0; off < n;) {
+        const auto* ev = reinterpret_cast<const inotify_event*>(buf + off);
+        off += (ssize_t)(sizeof(inotify_event) + ev->len);
+        if (ev->mask & IN_Q_OVERFLOW) {
+          changed += rescan();
+          continue;
+        }
+        if (ev->mask & IN_IGNORED) {
+          wd_path.erase(ev->wd);
+          continue;
+        }
+        if (!(ev->mask & IN_ISDIR) || ev->len == 0) continue;
+        const auto w = wd_path.find(ev->wd);
+        if (w == wd_path.end()) continue;
+        const std::string rel = (w->second == "/" ? std::string() : w->second) + "/" + ev->name;
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) changed += add_tree(rel);
+        else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) changed += remove_tree(rel);
+      }
+    }
+    if (changed == 0) return;
+    generation.fetch_add(1, std::memory_order_relaxed);
+    if (on_change) on_change();
+  }
+};
+
+CgroupCache::CgroupCache() : impl_(new Impl()) {}
+CgroupCache::~CgroupCache() { stop(); delete impl_; impl_ = nullptr; }
+
+bool CgroupCache::start(const std::string& root, Reactor* reactor, std::function<void()> on_change, std::string* err) {
+  if (!impl_) return false;
+  stop();
+
+  if (!reactor) {
+    if (err) *err = "cgroup cache: no reactor";
+    return false;
+  }
+  struct stat st{};
+  if (::stat(root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+    if (err) *err = "cgroup cache: " + root + ": " + std::strerror(errno ? errno : ENOTDIR);
+    return false;
+  }
+
+  const int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    if (err) *err = std::string("inotify_init1 failed: ") + std::strerror(errno);
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lk(impl_->mu);
+    impl_->fd = fd;
+    impl_->root = root;
+    while (impl_->root.size() > 1 && impl_->root.back() == '/') impl_->root.pop_back();
+    impl_->by_id.clear();
+    impl_->by_path.clear();
+    impl_->wd_path.clear();
+    impl_->watch_limited.store(false);
+    // Watches go in before each directory is listed, so a mkdir racing the walk is seen either way.
+    impl_->add_tree("/");
+  }
+  impl_->generation.fetch_add(1, std::memory_order_relaxed);
+  impl_->on_change = std::move(on_change);
+
+  if (!reactor->add_fd(fd, [impl = impl_] { impl->drain(); })) {
+    if (err) *err = std::string("cgroup cache: epoll registration failed: ") + std::strerror(errno);
+    stop();
+    return false;
+  }
+  impl_->reactor = reactor;
+  impl_->running.store(true);
+  return true;
+}
+
+void CgroupCache::stop() {
+  if (!impl_) return;
+  impl_->running.store(false);
+  if (impl_->reactor && impl_->fd >= 0) impl_->reactor->remove_fd(impl_->fd);
+  impl_->reactor = nullptr;
+  std::lock_guard<std::mutex> lk(impl_->mu);
+  if (impl_->fd >= 0) ::close(impl_->fd);
+  impl_->fd = -1;
+  impl_->on_change = nullptr;
+  impl_->wd_path.clear();
+}
+
+bool CgroupCache::is_running() const { return impl_ && impl_->running.load(); }
+
+bool CgroupCache::lookup(uint64_t id, CgroupInfo* out) const {
+  if (!impl_) return false;
+  std::lock_guard<std::mutex> lk(impl_->mu);
+  const auto it = impl_->by_id.find(id);
+  if (it == impl_->by_id.end()) return false;
+  if (out) *out = it->second;
+  return true;
+}
+
+uint64_t CgroupCache::resolve(std::string_view name, CgroupInfo* out) const {
+  if (!impl_ || name.empty()) return 0;
+
+  uint64_t num = 0;
+  const auto [p, ec] = std::from_chars(name.data(), name.data() + name.size(), num);
+  if (ec == std::errc() && p == name.data() + name.size()) {
+    // A raw id is taken as given even if the cgroup isn't known (yet).
+    if (out && !lookup(num, out)) *out = CgroupInfo{num, {}, {}, {}};
+    return num;
+  }
+
+  std::lock_guard<std::mutex> lk(impl_->mu);
+  const CgroupInfo* best = nullptr;
+  if (name.front() == '/') {
+    std::string path(name);
+    while (path.size() > 1 && path.back() == '/') path.pop_back();
+    if (auto it = impl_->by_path.find(path); it != impl_->by_path.end()) best = &impl_->by_id.at(it->second);
+  } else {
+    const bool hex = name.size() >= 12 && name.size() <= 64 && std::all_of(name.begin(), name.end(), is_hex);
+    // Nested cgroups inherit their unit/container; the shortest path is the unit's own cgroup.
+    for (const auto& [id, ci] : impl_->by_id) {
+      const bool hit = ci.unit == name || (hex && ci.container.compare(0, name.size(), name) == 0);
+      if (hit && (!best || ci.path.size() < best->path.size())) best = &ci;
+    }
+  }
+  if (!best) return 0;
+  if (out) *out = *best;
+  return best->id;
+}
+
+std::vector<CgroupInfo> CgroupCache::list(std::size_t max) const {
+  std::vector<CgroupInfo> out;
+  if (!impl_) return out;
+  std::lock_guard<std::mutex> lk(impl_->mu);
+  out.reserve(std::min(max, impl_->by_path.size()));
+  for (const auto& [path, id] : impl_->by_path) {
+    if (out.size() >= max) break;
+    out.push_back(impl_->by_id.at(id));
+  }
+  return out;
+}
+
+std::size_t CgroupCache::size() const {
+  if (!impl_) return 0;
+  std::lock_guard<std::mutex> lk(impl_->mu);
+  return impl_->by_id.size();
+}
+
+std::size_t CgroupCache::watches() const {
+  if (!impl_) return 0;
+  std::lock_guard<std::mutex> lk(impl_->mu);
+  return impl_->wd_path.size();
+}
+
+bool CgroupCache::watch_limited() const { return impl_ && impl_->watch_limited.load(std::memory_order_relaxed); }
+
+uint64_t CgroupCache::generation() const { return impl_ ? impl_->generation.load(std::memory_order_relaxed) : 0; }
+
+} // namespace khor
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace khor {
+
+class Reactor;
+
+struct CgroupInfo {
+  uint64_t id = 0;       // cgroup v2 id (the directory's inode; what bpf_get_current_cgroup_id() returns)
+  std::string path;      // relative to the cgroup2 mount, "/" for the root
+  std::string unit;      // innermost systemd unit ("nginx.service", "session-2.scope"), or ""
+  std::string container; // container id from the runtime's cgroup naming, or ""
+};
+
+// Innermost systemd unit component of a cgroup path (.service/.scope/.slice/.socket/.mount), or "".
+std::string cgroup_unit_name(std::string_view path);
+// Container id from docker/containerd/cri-o/podman cgroup names (a run of 64 hex digits), or "".
+std::string cgroup_container_id(std::string_view path);
+
+// cgroup id -> path/unit/container. cgroupfs is walked once at start(); after that
+// inotify mkdir/rmdir events on every cgroup directory keep it current, so lookups
+// never touch the filesystem. Events are handled on the reactor thread; queries are
+// thread-safe. If the inotify watch limit is hit, directories beyond it are still
+// indexed but changes under them are only caught by a rescan after an event queue overflow.
+class CgroupCache {
+ public:
+  CgroupCache();
+  ~CgroupCache();
+
+  CgroupCache(const CgroupCache&) = delete;
+  CgroupCache& operator=(const CgroupCache&) = delete;
+
+  // on_change runs on the reactor thread after entries were added or removed.
+  bool start(const std::string& root, Reactor* reactor, std::function<void()> on_change, std::string* err);
+  void stop();
+  bool is_running() const;
+
+  bool lookup(uint64_t id, CgroupInfo* out) const;
+  // Accepts a decimal id, a path ("/system.slice/nginx.service"), a unit name ("nginx.service")
+  // or a container id (12+ hex digit prefix). Returns 0 if nothing matches.
+  uint64_t resolve(std::string_view name, CgroupInfo* out = nullptr) const;
+  std::vector<CgroupInfo> list(std::size_t max) const;
+
+  std::size_t size() const;
+  std::size_t watches() const;
+  bool watch_limited() const; // some directories couldn't be watched (fs.inotify.max_user_watches)
+  uint64_t generation() const; // bumped on every change
+
+ private:
+  struct Impl;
+  Impl* impl_ = nullptr;
+};
+
+} // namespace khor
@@ -0,0 +1,100 @@
+#include "util/file_watch.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "util/reactor.h"
+
+namespace khor {
+
+struct FileWatch::Impl {
+  static constexpr uint32_t kMask = IN_CLOSE_WRITE | IN_MOVED_TO;
+
+  int fd = -1;
+  Reactor* reactor = nullptr;
+  std::atomic<bool> running{false};
+  std::string name; // file name inside the watched directory
+  Handler handler;
+  std::atomic<uint64_t> events{0};
+
+  void drain() {
+    alignas(inotify_event) char buf[4096];
+    for (;;) {
+      const ssize_t n = ::read(fd, buf, sizeof(buf));
+      if (n <= 0) return;
+      bool hit = false;
+      for (ssize_t off = 0; off < n;) {
+        const auto* ev = reinterpret_cast<const inotify_event*>(buf + off);
+        if ((ev->mask & kMask) && ev->len > 0 && name == ev->name) hit = true;
+        off += (ssize_t)(sizeof(inotify_event) + ev->len);
+      }
+      if (hit) {
+        events.fetch_add(1, std::memory_order_relaxed);
+        handler();
+      }
+    }
+  }
+};
+
+FileWatch::FileWatch() : impl_(new Impl()) {}
+FileWatch::~FileWatch() { stop(); delete impl_; impl_ = nullptr; }
+
+bool FileWatch::start(const std::string& path, Handler handler, Reactor* reactor, std::string* err) {
+  if (!impl_) return false;
+  stop();
+
+  if (!reactor || !handler) {
+    if (err) *err = "file watch: no reactor or handler";
+    return false;
+  }
+
+  const std::filesystem::path p(path);
+  std::string dir = p.parent_path().string();
+  if (dir.empty()) dir = ".";
+
+  const int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    if (err) *err = std::string("inotify_init1 failed: ") + std::strerror(errno);
+    return false;
+  }
+  if (::inotify_add_watch(fd, dir.c_str(), Impl::kMask | IN_ONLYDIR) < 0) {
+    if (err) *err = "inotify_add_watch " + dir + ": " + std::strerror(errno);
+    ::close(fd);
+    return false;
+  }
+
+  impl_->fd = fd;
+  impl_->name = p.filename().string();
+  impl_->handler = std::move(handler);
+  if (!reactor->add_fd(fd, [impl = impl_] { impl->drain(); })) {
+    if (err) *err = std::string("file watch: epoll registration failed: ") + std::strerror(errno);
+    ::close(fd);
+    impl_->fd = -1;
+    impl_->handler = nullptr;
+    return false;
+  }
+  impl_->reactor = reactor;
+  impl_->running.store(true);
+  return true;
+}
+
+void FileWatch::stop() {
+  if (!impl_) return;
+  impl_->running.store(false);
+  if (impl_->reactor && impl_->fd >= 0) impl_->reactor->remove_fd(impl_->fd);
+  impl_->reactor = nullptr;
+  if (impl_->fd >= 0) ::close(impl_->fd);
+  impl_->fd = -1;
+  impl_->handler = nullptr;
+}
+
+bool FileWatch::is_running() const { return impl_ && impl_->running.load(); }
+
+uint64_t FileWatch::events() const { return impl_ ? impl_->events.load(std::memory_order_relaxed) : 0; }
+
+} // namespace khor
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace khor {
+
+class Reactor;
+
+// inotify watch on one file, dispatched on a reactor. Fires when the file is closed
+// after writing or when another file is renamed over it (editors, config management).
+// The parent directory is watched, so replacing the inode doesn't end the watch.
+class FileWatch {
+ public:
+  using Handler = std::function<void()>;
+
+  FileWatch();
+  ~FileWatch();
+
+  FileWatch(const FileWatch&) = delete;
+  FileWatch& operator=(const FileWatch&) = delete;
+
+  bool start(const std::string& path, Handler handler, Reactor* reactor, std::string* err);
+  void stop();
+  bool is_running() const;
+
+  // Matching inotify events seen since start().
+  uint64_t events() const;
+
+ private:
+  struct Impl;
+  Impl* impl_ = nullptr;
+};
+
+} // namespace khor
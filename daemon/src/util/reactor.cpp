@@ -0,0 +1,231 @@
+#include "util/reactor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace khor {
+
+int64_t mono_now_ns() {
+  timespec ts{};
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+Reactor::Reactor() = default;
+
+Reactor::~Reactor() {
+  stop();
+  for (auto& h : handlers_) {
+    if (h->owned) ::close(h->fd);
+  }
+  if (wake_fd_ >= 0) ::close(wake_fd_);
+  if (ep_fd_ >= 0) ::close(ep_fd_);
+}
+
+bool Reactor::open(std::string* err) {
+  if (ep_fd_ >= 0) return true;
+  ep_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (ep_fd_ < 0 || wake_fd_ < 0) {
+    if (err) *err = std::string("epoll/eventfd setup failed: ") + std::strerror(errno);
+    return false;
+  }
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr; // wake fd
+  if (::epoll_ctl(ep_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) != 0) {
+    if (err) *err = std::string("epoll_ctl failed: ") + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool Reactor::in_loop_thread() const {
+  return running_.load(std::memory_order_acquire) && loop_tid_.load() == std::this_thread::get_id();
+}
+
+bool Reactor::add_handler(std::unique_ptr<Handler> h) {
+  bool ok = false;
+  call([&] {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = h.get();
+    if (ep_fd_ < 0 || ::epoll_ctl(ep_fd_, EPOLL_CTL_ADD, h->fd, &ev) != 0) return;
+    handlers_.push_back(std::move(h));
+    nfds_.store(handlers_.size(), std::memory_order_relaxed);
+    ok = true;
+  });
+  return ok;
+}
+
+void Reactor::remove_handler(int fd) {
+  call([&] {
+    auto it = std::find_if(handlers_.begin(), handlers_.end(), [&](const auto& h) { return h->fd == fd; });
+    if (it == handlers_.end()) return;
+    (void)::epoll_ctl(ep_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    (*it)->dead = true;
+    if ((*it)->owned) ::close(fd);
+    graveyard_.push_back(std::move(*it));
+    handlers_.erase(it);
+    nfds_.store(handlers_.size(), std::memory_order_relaxed);
+    if (!running_.load(std::memory_order_acquire)) graveyard_.clear();
+  });
+}
+
+bool Reactor::add_fd(int fd, IoFn fn) {
+  if (fd < 0 || !fn) return false;
+  auto h = std::make_unique<Handler>();
+  h->fd = fd;
+  h->io = std::move(fn);
+  return add_handler(std::move(h));
+}
+
+void Reactor::remove_fd(int fd) { remove_handler(fd); }
+
+int Reactor::add_timer(TimerFn fn) {
+  if (!fn) return -1;
+  const int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) return -1;
+  auto h = std::make_unique<Handler>();
+  h->fd = fd;
+  h->owned = true;
+  h->timer = std::move(fn);
+  if (!add_handler(std::move(h))) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void Reactor::remove_timer(int id) {
+  if (id >= 0) remove_handler(id);
+}
+
+bool Reactor::arm_periodic(int id, std::chrono::nanoseconds period) {
+  if (id < 0) return false;
+  const auto ns = std::max<int64_t>(0, period.count());
+  itimerspec its{};
+  its.it_interval.tv_sec = (time_t)(ns / 1000000000);
+  its.it_interval.tv_nsec = (long)(ns % 1000000000);
+  its.it_value = its.it_interval;
+  return ::timerfd_settime(id, 0, &its, nullptr) == 0;
+}
+
+bool Reactor::arm_at(int id, const timespec& abs_monotonic) {
+  if (id < 0) return false;
+  itimerspec its{};
+  its.it_value = abs_monotonic;
+  if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) its.it_value.tv_nsec = 1; // 0 would disarm
+  return ::timerfd_settime(id, TFD_TIMER_ABSTIME, &its, nullptr) == 0;
+}
+
+bool Reactor::arm_at(int id, int64_t abs_monotonic_ns) {
+  return arm_at(id, timespec{.tv_sec = (time_t)(abs_monotonic_ns / 1000000000), .tv_nsec = (long)(abs_monotonic_ns % 1000000000)});
+}
+
+void Reactor::post(std::function<void()> fn) {
+  {
+    std::scoped_lock lk(post_mu_);
+    posted_.push_back(std::move(fn));
+  }
+  const uint64_t one = 1;
+  (void)!::write(wake_fd_, &one, sizeof(one));
+}
+
+void Reactor::call(const std::function<void()>& fn) {
+  if (in_loop_thread()) {
+    fn();
+    return;
+  }
+
+  std::mutex mu;
+  std::condition_variable cv;
+  bool done = false;
+  {
+    std::scoped_lock lk(ctl_mu_);
+    if (!running_.load(std::memory_order_acquire)) {
+      fn();
+      return;
+    }
+    post([&] {
+      fn();
+      std::scoped_lock lk2(mu);
+      done = true;
+      cv.notify_one();
+    });
+  }
+  std::unique_lock lk(mu);
+  cv.wait(lk, [&] { return done; });
+}
+
+void Reactor::drain_posted() {
+  {
+    std::scoped_lock lk(post_mu_);
+    running_posted_.swap(posted_);
+  }
+  for (auto& fn : running_posted_) fn();
+  running_posted_.clear();
+}
+
+bool Reactor::run() {
+  if (ep_fd_ < 0) return false;
+  {
+    std::scoped_lock lk(ctl_mu_);
+    loop_tid_.store(std::this_thread::get_id());
+    running_.store(true, std::memory_order_release);
+  }
+
+  epoll_event evs[32];
+  while (!stop_.load(std::memory_order_acquire)) {
+    const int n = ::epoll_wait(ep_fd_, evs, 32, -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    wakeups_.fetch_add(1, std::memory_order_relaxed);
+
+    for (int i = 0; i < n; i++) {
+      auto* h = (Handler*)evs[i].data.ptr;
+      if (!h) {
+        uint64_t v = 0;
+        (void)!::read(wake_fd_, &v, sizeof(v));
+        drain_posted();
+        continue;
+      }
+      if (h->dead) continue;
+      if (h->timer) {
+        uint64_t exp = 0;
+        if (::read(h->fd, &exp, sizeof(exp)) == (ssize_t)sizeof(exp) && exp > 0) h->timer(exp);
+      } else {
+        h->io();
+      }
+    }
+    graveyard_.clear();
+  }
+
+  {
+    std::scoped_lock lk(ctl_mu_);
+    running_.store(false, std::memory_order_release);
+    loop_tid_.store(std::thread::id{});
+    drain_posted(); // release any call() that raced with shutdown
+    graveyard_.clear();
+  }
+  return true;
+}
+
+void Reactor::stop() {
+  stop_.store(true, std::memory_order_release);
+  if (wake_fd_ >= 0) {
+    const uint64_t one = 1;
+    (void)!::write(wake_fd_, &one, sizeof(one));
+  }
+}
+
+} // namespace khor
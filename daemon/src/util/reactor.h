@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+namespace khor {
+
+// CLOCK_MONOTONIC in nanoseconds, the timebase of arm_at().
+int64_t mono_now_ns();
+
+// Single-threaded epoll loop. Everything that used to sleep in its own thread
+// (sampler, music clock, BPF ringbuf, MIDI note-offs, OSC input, signals)
+// registers an fd here and runs on the thread that calls run().
+//
+// Registration and removal are thread-safe: they hop onto the loop thread via
+// call(), so once remove_fd() returns the callback will not run again.
+class Reactor {
+ public:
+  using IoFn = std::function<void()>;
+  using TimerFn = std::function<void(uint64_t expirations)>;
+
+  Reactor();
+  ~Reactor();
+
+  Reactor(const Reactor&) = delete;
+  Reactor& operator=(const Reactor&) = delete;
+
+  bool open(std::string* err);
+
+  // fn runs on the loop thread whenever fd is readable (level-triggered).
+  bool add_fd(int fd, IoFn fn);
+  void remove_fd(int fd);
+
+  // CLOCK_MONOTONIC timerfd owned by the reactor. Returns a timer id, or -1.
+  int add_timer(TimerFn fn);
+  void remove_timer(int id);
+  // Thread-safe (plain timerfd_settime). A zero period disarms.
+  bool arm_periodic(int id, std::chrono::nanoseconds period);
+  bool arm_at(int id, const timespec& abs_monotonic);
+  bool arm_at(int id, int64_t abs_monotonic_ns);
+
+  // Queues fn for the loop thread.
+  void post(std::function<void()> fn);
+  // Runs fn on the loop thread and waits. Inline when already on it or when the loop isn't running.
+  void call(const std::function<void()>& fn);
+
+  // Dispatches until stop(). Returns false if the reactor isn't open.
+  bool run();
+  void stop();
+  bool is_running() const { return running_.load(std::memory_order_acquire); }
+  bool in_loop_thread() const;
+
+  // epoll_wait returns since open(); a rough idle-wakeup measure for /api/health.
+  uint64_t wakeups() const { return wakeups_.load(std::memory_order_relaxed); }
+  std::size_t fd_count() const { return nfds_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Handler {
+    int fd = -1;
+    bool owned = false; // timerfds are closed on removal
+    bool dead = false;
+    IoFn io;
+    TimerFn timer;
+  };
+
+  bool add_handler(std::unique_ptr<Handler> h);
+  void remove_handler(int fd);
+  void drain_posted();
+
+  int ep_fd_ = -1;
+  int wake_fd_ = -1;
+
+  std::atomic<bool> running_{false};
+  std::atomic<bool> stop_{false};
+  std::atomic<std::thread::id> loop_tid_{};
+  std::atomic<uint64_t> wakeups_{0};
+  std::atomic<std::size_t> nfds_{0};
+
+  // Loop-thread only. Removed handlers are parked until the current batch is done.
+  std::vector<std::unique_ptr<Handler>> handlers_;
+  std::vector<std::unique_ptr<Handler>> graveyard_;
+
+  // Serializes inline call()s with the loop starting/stopping.
+  std::recursive_mutex ctl_mu_;
+
+  std::mutex post_mu_;
+  std::vector<std::function<void()>> posted_;
+  std::vector<std::function<void()>> running_posted_;
+};
+
+} // namespace khor
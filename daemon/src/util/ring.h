@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+namespace khor {
+
+// Fixed-capacity ring that overwrites the oldest entry when full.
+// Storage is inline; push never allocates. Not thread-safe.
+template <typename T, std::size_t Capacity>
+class FixedRing {
+  static_assert(Capacity >= 1, "Capacity too small");
+
+ public:
+  static constexpr std::size_t capacity() { return Capacity; }
+
+  void push(const T& v) {
+    buf_[(head_ + size_) % Capacity] = v;
+    if (size_ < Capacity) {
+      size_++;
+    } else {
+      head_ = (head_ + 1) % Capacity;
+    }
+  }
+
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  void clear() { head_ = size_ = 0; }
+
+  // 0 = oldest.
+  const T& operator[](std::size_t i) const { return buf_[(head_ + i) % Capacity]; }
+  const T& back() const { return (*this)[size_ - 1]; }
+
+ private:
+  std::array<T, Capacity> buf_{};
+  std::size_t head_ = 0;
+  std::size_t size_ = 0;
+};
+
+} // namespace khor
@@ -0,0 +1,135 @@
+#include "util/rt.h"
+
+#include <algorithm>
+#include <alloca.h>
+#include <cerrno>
+#include <cstring>
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace khor {
+
+const char* rt_policy_name(RtPolicy p) {
+  switch (p) {
+    case RtPolicy::Fifo: return "fifo";
+    case RtPolicy::Rr: return "rr";
+    case RtPolicy::Other: break;
+  }
+  return "other";
+}
+
+const char* rt_sched_name(int policy) {
+  switch (policy) {
+    case SCHED_OTHER: return "other";
+    case SCHED_FIFO: return "fifo";
+    case SCHED_RR: return "rr";
+    case SCHED_BATCH: return "batch";
+    case SCHED_IDLE: return "idle";
+    default: return "unknown";
+  }
+}
+
+bool rt_policy_parse(std::string_view s, RtPolicy* out) {
+  RtPolicy p;
+  if (s == "other" || s.empty()) p = RtPolicy::Other;
+  else if (s == "fifo") p = RtPolicy::Fifo;
+  else if (s == "rr") p = RtPolicy::Rr;
+  else return false;
+  if (out) *out = p;
+  return true;
+}
+
+static int set_sched(int policy, int prio) {
+  sched_param sp{};
+  sp.sched_priority = prio;
+  // pid 0 is the calling thread. Reset-on-fork keeps helpers we spawn off the RT class.
+  return ::sched_setscheduler(0, policy | SCHED_RESET_ON_FORK, &sp) == 0 ? 0 : errno;
+}
+
+RtThreadStatus rt_apply_current_thread(const RtConfig& cfg) {
+  RtThreadStatus st;
+  st.applied = true;
+  st.tid = (int)::syscall(SYS_gettid);
+
+  if (cfg.policy == RtPolicy::Other) {
+    // Drop back if an earlier config made this thread real-time.
+    const int cur = ::sched_getscheduler(0);
+    if (cur >= 0 && (cur & ~SCHED_RESET_ON_FORK) != SCHED_OTHER) st.sched_errno = set_sched(SCHED_OTHER, 0);
+  } else {
+    const int policy = cfg.policy == RtPolicy::Fifo ? SCHED_FIFO : SCHED_RR;
+    const int prio = std::clamp(cfg.priority, ::sched_get_priority_min(policy), ::sched_get_priority_max(policy));
+    st.sched_errno = set_sched(policy, prio);
+    if (st.sched_errno == EPERM) {
+      // Unprivileged processes may use RT priorities up to RLIMIT_RTPRIO; raise the soft limit if allowed.
+      rlimit rl{};
+      if (::getrlimit(RLIMIT_RTPRIO, &rl) == 0 && rl.rlim_cur < (rlim_t)prio && rl.rlim_max > rl.rlim_cur) {
+        rl.rlim_cur = std::min<rlim_t>(rl.rlim_max, (rlim_t)prio);
+        if (::setrlimit(RLIMIT_RTPRIO, &rl) == 0) {
+          st.sched_errno = set_sched(policy, std::min(prio, (int)rl.rlim_cur));
+        }
+      }
+    }
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (cfg.cpus.empty()) {
+    // Unpinned: follow the process (main thread) mask, which also undoes an earlier pinning.
+    if (::sched_getaffinity(::getpid(), sizeof(set), &set) != 0) CPU_ZERO(&set);
+  } else {
+    for (int c : cfg.cpus) {
+      if (c >= 0 && c < CPU_SETSIZE) CPU_SET(c, &set);
+    }
+  }
+  if (CPU_COUNT(&set) > 0 || !cfg.cpus.empty()) {
+    st.affinity_errno = ::sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : errno;
+  }
+
+  const int pol = ::sched_getscheduler(0);
+  st.policy = pol >= 0 ? (pol & ~SCHED_RESET_ON_FORK) : SCHED_OTHER;
+  sched_param sp{};
+  if (::sched_getparam(0, &sp) == 0) st.priority = sp.sched_priority;
+  cpu_set_t now;
+  CPU_ZERO(&now);
+  if (::sched_getaffinity(0, sizeof(now), &now) == 0) st.cpus_allowed = CPU_COUNT(&now);
+  return st;
+}
+
+bool rt_lock_memory(std::string* err) {
+  if (::mlockall(MCL_CURRENT | MCL_FUTURE) == 0) return true;
+  const int e = errno;
+  if (err) {
+    *err = std::string("mlockall failed: ") + std::strerror(e);
+    if (e == ENOMEM || e == EPERM) *err += " (raise RLIMIT_MEMLOCK, e.g. LimitMEMLOCK=infinity)";
+  }
+  return false;
+}
+
+void rt_unlock_memory() { (void)::munlockall(); }
+
+void rt_prefault_stack(std::size_t bytes) {
+  bytes = std::min<std::size_t>(bytes, 1u << 20);
+  volatile unsigned char* p = (volatile unsigned char*)alloca(bytes);
+  const long page = ::sysconf(_SC_PAGESIZE);
+  const std::size_t step = page > 0 ? (std::size_t)page : 4096u;
+  for (std::size_t i = 0; i < bytes; i += step) p[i] = 0;
+}
+
+std::string rt_status_error(const RtConfig& cfg, const RtThreadStatus& st) {
+  std::string out;
+  if (st.sched_errno != 0) {
+    out = std::string(rt_policy_name(cfg.policy)) + " refused: " + std::strerror(st.sched_errno);
+    if (st.sched_errno == EPERM) out += " (needs CAP_SYS_NICE or RLIMIT_RTPRIO >= priority, e.g. LimitRTPRIO=)";
+  }
+  if (st.affinity_errno != 0) {
+    if (!out.empty()) out += "; ";
+    out += std::string("cpu pinning failed: ") + std::strerror(st.affinity_errno);
+  }
+  return out;
+}
+
+} // namespace khor
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace khor {
+
+enum class RtPolicy { Other, Fifo, Rr };
+
+// Scheduling wanted for a timing-critical thread (sequencer, audio callback).
+struct RtConfig {
+  RtPolicy policy = RtPolicy::Other;
+  int priority = 10;     // 1..99, FIFO/RR only
+  std::vector<int> cpus; // empty: inherit affinity
+};
+
+// What a thread actually obtained. Plain ints so the audio callback can fill it without allocating.
+struct RtThreadStatus {
+  bool applied = false;  // rt_apply_current_thread() has run on the thread
+  int tid = 0;
+  int policy = 0;        // SCHED_* read back from the kernel
+  int priority = 0;
+  int sched_errno = 0;   // why FIFO/RR was refused (EPERM: no CAP_SYS_NICE / RLIMIT_RTPRIO)
+  int affinity_errno = 0;
+  int cpus_allowed = 0;  // CPUs in the thread's affinity mask afterwards
+};
+
+const char* rt_policy_name(RtPolicy p);
+// Name of a kernel SCHED_* value ("other", "fifo", "rr", "batch", "idle", ...).
+const char* rt_sched_name(int policy);
+bool rt_policy_parse(std::string_view s, RtPolicy* out);
+
+// Applies policy/priority/affinity to the calling thread and reads back the result.
+// On EPERM the RLIMIT_RTPRIO soft limit is raised towards the hard limit and the call retried,
+// so LimitRTPRIO= (systemd) or an rtprio entry in limits.conf is enough; no CAP_SYS_NICE needed.
+// Never allocates.
+RtThreadStatus rt_apply_current_thread(const RtConfig& cfg);
+
+// mlockall(MCL_CURRENT | MCL_FUTURE): every mapping, present and future (thread stacks, heap
+// arenas), is populated and locked when it is made, so the RT threads never take a page fault.
+bool rt_lock_memory(std::string* err);
+void rt_unlock_memory();
+
+// Touches `bytes` of the calling thread's stack so a locked stack never faults later.
+void rt_prefault_stack(std::size_t bytes);
+
+// Human-readable reason for a failed rt_apply_current_thread(); empty when everything was granted.
+std::string rt_status_error(const RtConfig& cfg, const RtThreadStatus& st);
+
+} // namespace khor
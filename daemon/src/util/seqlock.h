@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace khor {
+
+// Single-writer snapshot cell. Readers never block the writer and never take a lock,
+// so the audio callback can read what the sampler publishes. The payload is kept in
+// relaxed atomic words (no data race); a read retries a few times while a write is in progress.
+template <typename T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable_v<T>, "SeqLock payload must be trivially copyable");
+  static constexpr std::size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+ public:
+  SeqLock() { store(T{}); }
+
+  // Writer thread only.
+  void store(const T& v) {
+    std::array<uint64_t, kWords> tmp{};
+    std::memcpy(tmp.data(), &v, sizeof(T));
+    const uint32_t s = seq_.load(std::memory_order_relaxed);
+    seq_.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (std::size_t i = 0; i < kWords; i++) words_[i].store(tmp[i], std::memory_order_relaxed);
+    seq_.store(s + 2, std::memory_order_release);
+  }
+
+  // Bounded: a writer preempted mid-store (on the same CPU as a SCHED_FIFO reader) would
+  // otherwise be waited on forever. Leaves *out untouched on failure, so readers keep
+  // their last good copy.
+  bool try_load(T* out, int max_tries = 8) const {
+    std::array<uint64_t, kWords> tmp{};
+    for (int i = 0; i < max_tries; i++) {
+      const uint32_t s0 = seq_.load(std::memory_order_acquire);
+      if (s0 & 1u) continue;
+      for (std::size_t w = 0; w < kWords; w++) tmp[w] = words_[w].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq_.load(std::memory_order_relaxed) == s0) {
+        std::memcpy(static_cast<void*>(out), tmp.data(), sizeof(T));
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  std::atomic<uint32_t> seq_{0};
+  std::array<std::atomic<uint64_t>, kWords> words_{};
+};
+
+} // namespace khor
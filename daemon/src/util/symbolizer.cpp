@@ -0,0 +1,296 @@
+#include "util/symbolizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <cxxabi.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace khor {
+
+namespace {
+
+using steady = std::chrono::steady_clock;
+
+constexpr auto kMapsMaxAge = std::chrono::seconds(5);
+
+struct FuncSym {
+  uint64_t addr = 0;
+  uint64_t size = 0;
+  std::string name;
+};
+
+struct LoadSeg {
+  uint64_t offset = 0;
+  uint64_t vaddr = 0;
+  uint64_t filesz = 0;
+};
+
+struct ElfImage {
+  bool ok = false;
+  std::vector<FuncSym> syms; // sorted by addr
+  std::vector<LoadSeg> loads;
+  uint64_t last_use = 0;
+};
+
+struct Mapping {
+  uint64_t start = 0;
+  uint64_t end = 0;
+  uint64_t offset = 0;
+  std::string path;
+  std::string file_key; // "dev inode": the same library in every process shares one ElfImage
+};
+
+struct Proc {
+  std::vector<Mapping> maps; // executable, file-backed; sorted by start
+  steady::time_point loaded{};
+  uint64_t last_use = 0;
+};
+
+struct KernelSym {
+  uint64_t addr = 0;
+  std::string name;
+  std::string module;
+};
+
+std::string base_name(const std::string& path) {
+  const auto slash = path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+std::string demangle(const std::string& name) {
+  if (name.size() < 2 || name[0] != '_' || name[1] != 'Z') return name;
+  int status = 0;
+  char* d = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+  if (status != 0 || !d) return name;
+  std::string out(d);
+  std::free(d);
+  return out;
+}
+
+// Function symbols and PT_LOAD segments of a 64-bit ELF file. Everything is bounds-checked;
+// a malformed file just yields no symbols.
+bool read_elf(const std::string& path, ElfImage* img) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st{};
+  if (::fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Elf64_Ehdr)) {
+    ::close(fd);
+    return false;
+  }
+  const std::size_t size = (std::size_t)st.st_size;
+  void* mem = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) return false;
+  const auto* base = static_cast<const uint8_t*>(mem);
+  auto in_file = [&](uint64_t off, uint64_t len) { return off <= size && len <= size - off; };
+
+  const auto* eh = reinterpret_cast<const Elf64_Ehdr*>(base);
+  const bool elf64 = std::memcmp(eh->e_ident, ELFMAG, SELFMAG) == 0 && eh->e_ident[EI_CLASS] == ELFCLASS64;
+  if (elf64 && eh->e_phentsize == sizeof(Elf64_Phdr) && in_file(eh->e_phoff, (uint64_t)eh->e_phnum * sizeof(Elf64_Phdr))) {
+    const auto* ph = reinterpret_cast<const Elf64_Phdr*>(base + eh->e_phoff);
+    for (int i = 0; i < eh->e_phnum; i++) {
+      if (ph[i].p_type == PT_LOAD) img->loads.push_back(LoadSeg{ph[i].p_offset, ph[i].p_vaddr, ph[i].p_filesz});
+    }
+  }
+  if (elf64 && eh->e_shentsize == sizeof(Elf64_Shdr) && in_file(eh->e_shoff, (uint64_t)eh->e_shnum * sizeof(Elf64_Shdr))) {
+    const auto* sh = reinterpret_cast<const Elf64_Shdr*>(base + eh->e_shoff);
+    for (int i = 0; i < eh->e_shnum; i++) {
+      if (sh[i].sh_type != SHT_SYMTAB && sh[i].sh_type != SHT_DYNSYM) continue;
+      if (sh[i].sh_link >= eh->e_shnum || sh[i].sh_entsize != sizeof(Elf64_Sym)) continue;
+      const Elf64_Shdr& strs = sh[sh[i].sh_link];
+      if (!in_file(sh[i].sh_offset, sh[i].sh_size) || !in_file(strs.sh_offset, strs.sh_size)) continue;
+      const auto* sym = reinterpret_cast<const Elf64_Sym*>(base + sh[i].sh_offset);
+      const char* str = reinterpret_cast<const char*>(base + strs.sh_offset);
+      const std::size_t n = sh[i].sh_size / sizeof(Elf64_Sym);
+      for (std::size_t j = 0; j < n; j++) {
+        const unsigned type = ELF64_ST_TYPE(sym[j].st_info);
+        if ((type != STT_FUNC && type != STT_GNU_IFUNC) || sym[j].st_shndx == SHN_UNDEF || sym[j].st_value == 0) continue;
+        if (sym[j].st_name >= strs.sh_size) continue;
+        const char* name = str + sym[j].st_name;
+        img->syms.push_back(FuncSym{sym[j].st_value, sym[j].st_size, std::string(name, strnlen(name, strs.sh_size - sym[j].st_name))});
+      }
+    }
+  }
+  ::munmap(mem, size);
+
+  // .symtab and .dynsym overlap; keep one entry per address.
+  std::sort(img->syms.begin(), img->syms.end(), [](const FuncSym& a, const FuncSym& b) { return a.addr < b.addr; });
+  img->syms.erase(std::unique(img->syms.begin(), img->syms.end(), [](const FuncSym& a, const FuncSym& b) { return a.addr == b.addr; }),
+                  img->syms.end());
+  img->syms.shrink_to_fit();
+  return elf64;
+}
+
+template <typename Map>
+void evict_lru(Map& m, std::size_t max) {
+  while (m.size() > max) {
+    auto victim = m.begin();
+    for (auto it = m.begin(); it != m.end(); ++it) {
+      if (it->second.last_use < victim->second.last_use) victim = it;
+    }
+    m.erase(victim);
+  }
+}
+
+} // namespace
+
+struct Symbolizer::Impl {
+  std::size_t max_files;
+  std::size_t max_procs;
+  uint64_t use = 0;
+
+  std::unordered_map<std::string, ElfImage> files;
+  std::unordered_map<uint32_t, Proc> procs;
+
+  bool kernel_loaded = false;
+  std::vector<KernelSym> ksyms; // sorted; empty if kallsyms hides addresses
+
+  void load_kernel() {
+    kernel_loaded = true;
+    std::ifstream f("/proc/kallsyms");
+    std::string line;
+    while (std::getline(f, line)) {
+      // "ffffffff81000000 T _stext" or "... t foo\t[module]"
+      std::istringstream ls(line);
+      std::string addr, type, name, mod;
+      if (!(ls >> addr >> type >> name)) continue;
+      if (type != "t" && type != "T") continue;
+      const uint64_t a = std::strtoull(addr.c_str(), nullptr, 16);
+      if (a == 0) continue;
+      ls >> mod;
+      ksyms.push_back(KernelSym{a, std::move(name), mod.empty() ? "[kernel]" : mod});
+    }
+    std::sort(ksyms.begin(), ksyms.end(), [](const KernelSym& a, const KernelSym& b) { return a.addr < b.addr; });
+  }
+
+  Proc* load_proc(uint32_t tgid) {
+    std::ifstream f("/proc/" + std::to_string(tgid) + "/maps");
+    if (!f) {
+      procs.erase(tgid);
+      return nullptr;
+    }
+    Proc p;
+    p.loaded = steady::now();
+    p.last_use = ++use;
+    std::string line;
+    while (std::getline(f, line)) {
+      // start-end perms offset dev inode path
+      unsigned long long start = 0, end = 0, off = 0, ino = 0;
+      char perms[8] = {};
+      char dev[16] = {};
+      int pos = 0;
+      if (std::sscanf(line.c_str(), "%llx-%llx %7s %llx %15s %llu %n", &start, &end, perms, &off, dev, &ino, &pos) < 6) continue;
+      if (perms[2] != 'x' || ino == 0 || pos <= 0 || (std::size_t)pos >= line.size()) continue;
+      std::string path = line.substr((std::size_t)pos);
+      if (path.empty() || path[0] != '/') continue;
+      p.maps.push_back(Mapping{start, end, off, path, std::string(dev) + " " + std::to_string(ino)});
+    }
+    std::sort(p.maps.begin(), p.maps.end(), [](const Mapping& a, const Mapping& b) { return a.start < b.start; });
+    auto& slot = procs[tgid];
+    slot = std::move(p);
+    evict_lru(procs, max_procs);
+    const auto it = procs.find(tgid);
+    return it == procs.end() ? nullptr : &it->second;
+  }
+
+  const Mapping* find_mapping(uint32_t tgid, uint64_t ip) {
+    auto find = [&](Proc& p) -> const Mapping* {
+      p.last_use = ++use;
+      auto it = std::upper_bound(p.maps.begin(), p.maps.end(), ip, [](uint64_t v, const Mapping& m) { return v < m.start; });
+      if (it == p.maps.begin()) return nullptr;
+      --it;
+      return ip < it->end ? &*it : nullptr;
+    };
+    auto it = procs.find(tgid);
+    const bool fresh = it != procs.end() && steady::now() - it->second.loaded < kMapsMaxAge;
+    if (fresh) {
+      if (const Mapping* m = find(it->second)) return m;
+      // Possibly a library loaded since; fall through to one re-read.
+    }
+    Proc* p = load_proc(tgid);
+    return p ? find(*p) : nullptr;
+  }
+
+  ElfImage& image(uint32_t tgid, const Mapping& m) {
+    auto it = files.find(m.file_key);
+    if (it == files.end()) {
+      ElfImage img;
+      // Through the process's root so binaries inside containers resolve.
+      img.ok = read_elf("/proc/" + std::to_string(tgid) + "/root" + m.path, &img) || read_elf(m.path, &img);
+      it = files.emplace(m.file_key, std::move(img)).first;
+      it->second.last_use = ++use;
+      const std::string key = m.file_key;
+      evict_lru(files, max_files);
+      it = files.find(key);
+    }
+    it->second.last_use = ++use;
+    return it->second;
+  }
+};
+
+Symbolizer::Symbolizer(std::size_t max_files, std::size_t max_procs) : impl_(new Impl()) {
+  impl_->max_files = std::max<std::size_t>(1, max_files);
+  impl_->max_procs = std::max<std::size_t>(1, max_procs);
+}
+
+Symbolizer::~Symbolizer() { delete impl_; impl_ = nullptr; }
+
+bool Symbolizer::kernel_available() {
+  if (!impl_->kernel_loaded) impl_->load_kernel();
+  return !impl_->ksyms.empty();
+}
+
+Symbol Symbolizer::kernel(uint64_t ip) {
+  Symbol s{"[unknown]", "[kernel]", false};
+  if (!kernel_available()) return s;
+  const auto& ks = impl_->ksyms;
+  auto it = std::upper_bound(ks.begin(), ks.end(), ip, [](uint64_t v, const KernelSym& k) { return v < k.addr; });
+  if (it == ks.begin()) return s;
+  --it;
+  return Symbol{it->name, it->module, true};
+}
+
+Symbol Symbolizer::user(uint32_t tgid, uint64_t ip) {
+  Symbol s{"[unknown]", "[unknown]", false};
+  const Mapping* m = impl_->find_mapping(tgid, ip);
+  if (!m) return s;
+  s.module = base_name(m->path);
+  const Mapping map = *m; // image() may evict the process entry
+  const ElfImage& img = impl_->image(tgid, map);
+  if (!img.ok || img.syms.empty()) return s;
+
+  const uint64_t file_off = ip - map.start + map.offset;
+  uint64_t vaddr = file_off;
+  for (const auto& seg : img.loads) {
+    if (file_off >= seg.offset && file_off < seg.offset + seg.filesz) {
+      vaddr = file_off - seg.offset + seg.vaddr;
+      break;
+    }
+  }
+  auto it = std::upper_bound(img.syms.begin(), img.syms.end(), vaddr, [](uint64_t v, const FuncSym& f) { return v < f.addr; });
+  if (it == img.syms.begin()) return s;
+  --it;
+  if (it->size && vaddr >= it->addr + it->size) return s;
+  s.name = demangle(it->name);
+  s.known = true;
+  return s;
+}
+
+std::size_t Symbolizer::files_cached() const { return impl_->files.size(); }
+std::size_t Symbolizer::procs_cached() const { return impl_->procs.size(); }
+
+} // namespace khor
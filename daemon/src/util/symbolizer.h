@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace khor {
+
+struct Symbol {
+  std::string name;   // demangled function name, or "[unknown]"
+  std::string module; // "[kernel]", "[<kmod>]", or the binary/library file name
+  bool known = false;
+};
+
+// Instruction pointer -> function name for profiler stacks.
+//
+// Kernel addresses come from /proc/kallsyms (read once). User addresses go through the
+// process's /proc/<pid>/maps to the mapped ELF file (opened via /proc/<pid>/root, so
+// container binaries resolve), whose .symtab/.dynsym function symbols are cached per
+// file. Both caches are bounded; a process's maps are re-read when an address falls
+// outside them or they are older than a few seconds. Not thread-safe.
+class Symbolizer {
+ public:
+  Symbolizer(std::size_t max_files = 64, std::size_t max_procs = 256);
+  ~Symbolizer();
+
+  Symbolizer(const Symbolizer&) = delete;
+  Symbolizer& operator=(const Symbolizer&) = delete;
+
+  Symbol kernel(uint64_t ip);
+  Symbol user(uint32_t tgid, uint64_t ip);
+
+  std::size_t files_cached() const;
+  std::size_t procs_cached() const;
+  bool kernel_available(); // false if kallsyms hides addresses (no CAP_SYSLOG)
+
+ private:
+  struct Impl;
+  Impl* impl_ = nullptr;
+};
+
+} // namespace khor
@@ -1,14 +1,57 @@
+#include <array>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <span>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <netinet/in.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "app/config.h"
 #include "audio/dsp.h"
+#include "bpf/collector.h"
+#include "engine/clock.h"
+#include "engine/exec_triggers.h"
 #include "engine/music.h"
+#include "engine/preset_rules.h"
+#include "engine/presets.h"
+#include "engine/profile.h"
+#include "engine/render_sequencer.h"
 #include "engine/signals.h"
+#include "engine/sketch.h"
+#include "osc/decode.h"
 #include "osc/encode.h"
+#include "osc/osc.h"
+#include "pmu/pmu.h"
+#include "util/cgroup_cache.h"
+#include "util/file_watch.h"
+#include "util/reactor.h"
+#include "util/ring.h"
+#include "util/rt.h"
+#include "util/symbolizer.h"
+
+// Test-only allocation counter: every global operator new in this binary bumps it,
+// so a test can assert that a measured region does not touch the heap.
+static std::atomic<uint64_t> g_allocs{0};
+
+void* operator new(std::size_t n) {
+  g_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
 
 namespace {
 
@@ -45,6 +88,11 @@ static bool approx(double a, double b, double eps) {
   return std::abs(a - b) <= eps;
 }
 
+struct AllocScope {
+  uint64_t start = g_allocs.load(std::memory_order_relaxed);
+  uint64_t count() const { return g_allocs.load(std::memory_order_relaxed) - start; }
+};
+
 TEST_CASE(signals_rates_and_smoothing) {
   khor::Signals s;
   khor::Signals::Totals t0{};
@@ -110,6 +158,99 @@ TEST_CASE(music_channel_assignment) {
   CHECK(has_bass);
 }
 
+TEST_CASE(music_preset_registry) {
+  CHECK(khor::preset_find("percussive") != nullptr);
+  CHECK(khor::preset_find("nope") == nullptr);
+  CHECK(std::string(khor::scale_find("minor").name) == "natural_minor");
+  CHECK(std::string(khor::scale_find("unknown").name) == "pentatonic_minor");
+
+  // Precompiled engine (configure once, tick by density) matches the one-shot path.
+  khor::MusicConfig cfg;
+  cfg.preset = "percussive";
+  cfg.scale = "dorian";
+  cfg.key_midi = 50;
+  cfg.density = 0.9;
+
+  khor::MusicEngine a;
+  khor::MusicEngine b;
+  b.configure(cfg);
+  CHECK(b.preset().pitch[12] == 62); // key 50 + degree 0, octave 1
+
+  khor::Signal01 s{};
+  s.csw = 0.8;
+  s.exec = 0.6;
+  for (int i = 0; i < 32; i++) {
+    const auto fa = a.tick(s, cfg);
+    const auto fb = b.tick(s, cfg.density);
+    CHECK(fa.notes.size() == fb.notes.size());
+    for (std::size_t k = 0; k < fa.notes.size() && k < fb.notes.size(); k++) {
+      CHECK(fa.notes[k].midi == fb.notes[k].midi);
+      CHECK(fa.notes[k].channel == fb.notes[k].channel);
+    }
+  }
+}
+
+TEST_CASE(music_json_preset_rules) {
+  auto compile = [](const char* json, khor::UserPreset* out, std::string* err) {
+    khor::JsonValue doc;
+    khor::JsonParseError perr;
+    if (!khor::json_parse(json, &doc, &perr)) return false;
+    return khor::compile_preset_json(doc, "test", out, err);
+  };
+
+  khor::UserPreset u;
+  std::string err;
+  CHECK(compile(R"({"rules":[{"signal":"bogus","p":0.5}]})", &u, &err) == false);
+  CHECK(err.find("rules[0]") != std::string::npos);
+  CHECK(compile(R"({"name":"ambient","rules":[{"p":0.5}]})", &u, &err) == false);
+  CHECK(compile(R"({"rules":[{"p":0.5,"every":4,"phase":4}]})", &u, &err) == false);
+
+  CHECK(compile(R"({"rules":[{"signal":"csw","p":[0.1,0.9],"every":4,"phase":2,"degree":[0,2],"octave":[1,2]}]})",
+                &u, &err));
+  CHECK(u.table.rule_count == 1);
+  CHECK(u.def.rules == &u.table && u.def.name == u.name);
+  CHECK(u.table.rules[0].step_mask == 0x4444);
+  CHECK(u.table.rules[0].degree[3] == 2);
+  CHECK(u.table.rules[0].oct_span == 1);
+
+  // Loaded from a directory, selected by name, evaluated by the engine.
+  const auto dir = std::filesystem::temp_directory_path() / ("khor-presets-" + std::to_string(::getpid()));
+  std::filesystem::create_directories(dir);
+  std::ofstream(dir / "kick.json") << R"({"hint":"downbeat kick","synth":{"cutoff":0.9},
+    "rules":[{"signal":"one","p":1.0,"steps":[0],"semitones":-24,"velocity":0.8,"duration":0.1,"channel":"bass"}]})";
+  std::ofstream(dir / "broken.json") << "{";
+  const auto lib = khor::PresetLibrary::load_dir(dir.string());
+  std::filesystem::remove_all(dir);
+
+  CHECK(lib->errors().size() == 1);
+  const khor::PresetDef* kick = lib->find("kick");
+  CHECK(kick != nullptr);
+  CHECK(lib->user(kick) != nullptr);
+  CHECK(lib->user(lib->find("drone")) == nullptr);
+
+  khor::MusicEngine eng;
+  eng.set_library(lib);
+  khor::MusicConfig cfg;
+  cfg.preset = "kick";
+  cfg.density = 1.0;
+  eng.configure(cfg);
+  CHECK(eng.preset().def == kick);
+
+  khor::Signal01 s{};
+  s.exec = 0.5;
+  int kicks = 0;
+  for (int i = 0; i < 32; i++) {
+    const auto fr = eng.tick(s, cfg.density);
+    CHECK(approx(fr.synth.cutoff01, 0.9, 1e-6));
+    for (const auto& n : fr.notes) {
+      CHECK(n.midi == cfg.key_midi - 24);
+      CHECK(n.channel == 2);
+      kicks++;
+    }
+  }
+  CHECK(kicks == 2);
+}
+
 TEST_CASE(adsr_envelope) {
   khor::dsp::Adsr e;
   e.a_s = 0.01f;
@@ -133,7 +274,7 @@ TEST_CASE(adsr_envelope) {
   CHECK(e.value <= 1e-6f);
 }
 
-static std::string osc_read_str(const std::vector<uint8_t>& b, std::size_t* off) {
+static std::string osc_read_str(std::span<const uint8_t> b, std::size_t* off) {
   std::size_t i = off ? *off : 0;
   std::string s;
   while (i < b.size() && b[i] != 0) s.push_back((char)b[i++]);
@@ -145,7 +286,7 @@ static std::string osc_read_str(const std::vector<uint8_t>& b, std::size_t* off)
   return s;
 }
 
-static uint32_t osc_read_u32(const std::vector<uint8_t>& b, std::size_t* off) {
+static uint32_t osc_read_u32(std::span<const uint8_t> b, std::size_t* off) {
   std::size_t i = off ? *off : 0;
   if (i + 4 > b.size()) return 0;
   uint32_t u = 0;
@@ -176,6 +317,109 @@ TEST_CASE(signals_new_counters) {
   CHECK(v.mem > 0.0 && v.mem <= 1.0);
 }
 
+// Each case feeds cumulative counters (and that window's gauges) into a fresh Signals,
+// one update per step, and checks the rates and 0..1 values the step produces.
+TEST_CASE(signals_from_counter_deltas) {
+  using T = khor::Signals::Totals;
+  using G = khor::Signals::Gauges;
+  using R = khor::SignalRates;
+  using V = khor::Signal01;
+  struct Step {
+    double dt;
+    void (*feed)(T&, G&);
+    bool (*ok)(const R& r, const V& v, const V& prev);
+  };
+  struct Case {
+    const char* name;
+    double smoothing;
+    std::vector<Step> steps;
+  };
+  const Case cases[] = {
+    {"offcpu: 3 s of D-state waits over 2 s", 0.0, {
+      {2.0, [](T& t, G&) { t.offcpu_d_ns_total = 3000000000ULL; t.offcpu_s_ns_total = 500000000ULL; },
+       [](const R& r, const V& v, const V&) {
+         return approx(r.dwait_ms_s, 1500.0, 1e-6) && approx(r.swait_ms_s, 250.0, 1e-6) && v.dstate > 0.5 && v.dstate < 1.0;
+       }},
+    }},
+    {"lock: 200 ms of waiting in 0.5 s", 0.0, {
+      {0.5, [](T& t, G&) { t.lock_contended_total = 4000; t.lock_wait_ns_total = 200000000ULL; },
+       [](const R& r, const V& v, const V&) {
+         return approx(r.lock_s, 8000.0, 1e-6) && approx(r.lock_wait_ms_s, 400.0, 1e-6) && v.lock > 0.5 && v.lock < 1.0;
+       }},
+    }},
+    {"drop: a 3000/s burst is spiky (half the smoothing)", 0.8, {
+      {0.1, [](T& t, G&) { t.skb_drop_total = 300; },
+       [](const R& r, const V& v, const V&) { return approx(r.drop_s, 3000.0, 1e-6) && v.drop > 0.3; }},
+      {0.1, [](T&, G&) {}, [](const R& r, const V& v, const V& prev) { return r.drop_s == 0.0 && v.drop < prev.drop; }},
+    }},
+    {"churn: failed and long-lived execs are not churn", 0.0, {
+      {1.0, [](T& t, G&) { t.exec_total = 200; t.exec_fail_total = 500; },
+       [](const R& r, const V& v, const V&) { return approx(r.exec_fail_s, 500.0, 1e-9) && v.churn == 0.0; }},
+      {1.0, [](T& t, G&) { t.proc_short_total = 500; },
+       [](const R& r, const V& v, const V&) { return approx(r.churn_s, 500.0, 1e-9) && approx(v.churn, 1.0, 1e-9); }},
+    }},
+    {"vfs: cached reads, then a commit stall", 0.0, {
+      {0.5, [](T& t, G&) { t.vfs_read_bytes_total = 200ULL * 1024 * 1024; t.vfs_ns_total = 300000000ULL; },
+       [](const R& r, const V& v, const V&) {
+         return approx(r.vfs_r_kbs, 400.0 * 1024.0, 1e-6) && approx(r.vfs_ms_s, 600.0, 1e-6) && v.vfs > 0.5 && v.vfs < 1.0 &&
+           v.fsync == 0.0;
+       }},
+      // Two fsyncs holding a task for 0.5 s in total.
+      {0.5, [](T& t, G&) { t.fsync_total = 2; t.fsync_ns_total = 500000000ULL; },
+       [](const R& r, const V& v, const V&) {
+         return approx(r.fsync_s, 4.0, 1e-9) && approx(r.fsync_ms_s, 1000.0, 1e-6) && approx(v.fsync, 1.0, 1e-9);
+       }},
+    }},
+    {"rtt: mean without a window, then the window's tail", 0.0, {
+      // 100 samples averaging 20 ms; no window percentiles (a session): the mean drives the signal.
+      {1.0, [](T& t, G&) { t.rtt_samples_total = 100; t.rtt_us_total = 2000000; },
+       [](const R& r, const V& v, const V&) { return approx(r.rtt_ms, 20.0, 1e-9) && v.rtt > 0.3 && v.rtt < 0.7; }},
+      {1.0, [](T& t, G& g) { t.rtt_samples_total = 200; t.rtt_us_total = 4000000; g.rtt_p50_us = 16384.0; g.rtt_p99_us = 262144.0; },
+       [](const R& r, const V& v, const V& prev) { return approx(r.rtt_p99_ms, 262.144, 1e-9) && v.rtt > prev.rtt; }},
+      // No samples in a period reads as no RTT, not a stale one.
+      {1.0, [](T&, G&) {}, [](const R& r, const V& v, const V&) { return r.rtt_ms == 0.0 && v.rtt == 0.0 && v.listen == 0.0; }},
+      {1.0, [](T& t, G&) { t.listen_overflow_total = 500; t.syn_overflow_total = 500; },
+       [](const R& r, const V& v, const V&) { return approx(r.listen_s, 500.0, 1e-9) && approx(v.listen, 1.0, 1e-9); }},
+    }},
+    {"distinct: actors from the HyperLogLog window", 0.0, {
+      {0.1, [](T&, G& g) { g.distinct_actors = 2000.0; },
+       [](const R& r, const V& v, const V&) { return approx(r.actors, 2000.0, 1e-9) && approx(v.actors, 1.0, 1e-9) && v.peers == 0.0; }},
+    }},
+    {"pmu: IPC and LLC misses, then the page fault fallback", 0.0, {
+      // Two busy cores at 2 GHz retiring 1 instruction per cycle, 20 LLC misses per 1000 instructions.
+      {1.0, [](T& t, G&) { t.pmu_cycles_total = 4000000000ULL; t.pmu_instructions_total = 4000000000ULL; t.pmu_cache_misses_total = 80000000ULL; },
+       [](const R& r, const V& v, const V&) {
+         return approx(r.gcycles_s, 4.0, 1e-9) && approx(r.ipc, 1.0, 1e-9) && approx(r.llc_mpki, 20.0, 1e-9) &&
+           approx(v.ipc, 1.0 / 3.0, 1e-9) && v.miss > 0.5 && v.miss < 1.0;
+       }},
+      // IPC collapse: same cycles, a tenth of the instructions.
+      {1.0, [](T& t, G&) { t.pmu_cycles_total += 4000000000ULL; t.pmu_instructions_total += 400000000ULL; t.pmu_cache_misses_total += 20000000ULL; },
+       [](const R& r, const V& v, const V& prev) { return approx(r.ipc, 0.1, 1e-9) && v.ipc < 0.05 && v.miss > prev.miss; }},
+      // An idle machine reads as no IPC rather than a collapsed one.
+      {1.0, [](T& t, G&) { t.pmu_cycles_total += 10000000ULL; t.pmu_instructions_total += 1000000ULL; },
+       [](const R&, const V& v, const V&) { return v.ipc == 0.0; }},
+      // Without a PMU, page faults stand in for misses.
+      {1.0, [](T& t, G&) { t.page_faults_total = 200000; }, [](const R&, const V& v, const V&) { return approx(v.miss, 1.0, 1e-9); }},
+    }},
+  };
+
+  for (const auto& c : cases) {
+    khor::Signals s;
+    T t{};
+    s.update(t, 1.0, c.smoothing);
+    for (std::size_t i = 0; i < c.steps.size(); i++) {
+      const V prev = s.value01();
+      G g{}; // window gauges don't carry over
+      c.steps[i].feed(t, g);
+      s.update(t, c.steps[i].dt, c.smoothing, g);
+      if (!c.steps[i].ok(s.rates(), s.value01(), prev)) {
+        std::fprintf(stderr, "FAIL %s:%d: %s, step %zu\n", __FILE__, __LINE__, c.name, i);
+        g_fail++;
+      }
+    }
+  }
+}
+
 TEST_CASE(music_retransmit_glitch) {
   // High retx signal should sometimes produce notes even in ambient with low density.
   khor::MusicEngine eng;
@@ -199,6 +443,47 @@ TEST_CASE(music_retransmit_glitch) {
   CHECK(note_count > 0);
 }
 
+// One saturated signal, everything else near idle: each must be heard on its own voice.
+TEST_CASE(music_signal_voices) {
+  using V = khor::Signal01;
+  struct Case {
+    const char* name;
+    const char* preset;
+    void (*set)(V&);
+    bool (*voice)(const khor::NoteEvent& n, int key); // the note this signal plays
+  };
+  const Case cases[] = {
+    {"drop blip", "ambient", [](V& s) { s.drop = 0.9; },
+     [](const khor::NoteEvent& n, int) { return n.channel == 10 && n.dur_s == 0.015f; }},
+    {"churn clicks", "ambient", [](V& s) { s.churn = 0.9; },
+     [](const khor::NoteEvent& n, int key) { return n.channel == 10 && n.midi >= key + 48; }},
+    {"fsync held fifth", "ambient", [](V& s) { s.fsync = 0.9; },
+     [](const khor::NoteEvent& n, int key) { return n.midi == key + 7 && n.dur_s > 1.0f; }},
+    // An overflowing listener alone is activity enough to be heard.
+    {"listen busy tone", "ambient", [](V& s) { s.listen = 0.9; }, [](const khor::NoteEvent& n, int) { return n.dur_s == 0.08f; }},
+    {"miss grind", "drone", [](V& s) { s.exec = 0.05; s.miss = 0.9; },
+     [](const khor::NoteEvent& n, int key) { return n.midi == key + 1 && n.dur_s == 0.5f; }},
+  };
+
+  for (const auto& c : cases) {
+    khor::MusicEngine eng;
+    khor::MusicConfig cfg;
+    cfg.preset = c.preset;
+    cfg.density = 0.8;
+    eng.configure(cfg);
+    V sig{};
+    c.set(sig);
+    int heard = 0;
+    for (int i = 0; i < 64; i++) {
+      for (const auto& n : eng.tick(sig, cfg.density).notes) heard += c.voice(n, cfg.key_midi);
+    }
+    if (heard == 0) {
+      std::fprintf(stderr, "FAIL %s:%d: %s never played\n", __FILE__, __LINE__, c.name);
+      g_fail++;
+    }
+  }
+}
+
 TEST_CASE(osc_encoding_note) {
   khor::NoteEvent ev;
   ev.midi = 64;
@@ -206,8 +491,11 @@ TEST_CASE(osc_encoding_note) {
   ev.dur_s = 0.25f;
   ev.channel = 10;
 
-  const auto msg = khor::osc::encode_note(ev);
-  CHECK((msg.size() & 3u) == 0u);
+  khor::osc::Packet buf;
+  const std::size_t n = khor::osc::encode_note(ev, buf);
+  CHECK(n > 0u);
+  CHECK((n & 3u) == 0u);
+  const std::span<const uint8_t> msg(buf.data(), n);
 
   std::size_t off = 0;
   const std::string addr = osc_read_str(msg, &off);
@@ -221,8 +509,804 @@ TEST_CASE(osc_encoding_note) {
   CHECK(midi == 64u);
 }
 
+TEST_CASE(osc_encoding_fixed_buffers) {
+  static_assert(khor::osc::kTypeTags<'i', 'i', 'f', 'f'>.size() == 8);
+  static_assert(khor::osc::kTypeTags<'s', 'f'>.size() == 4);
+
+  khor::SignalRates r{};
+  r.exec_s = 12.0;
+  khor::osc::Packet buf;
+  const std::size_t n = khor::osc::encode_metrics(r, buf);
+  CHECK(n == 16u + 12u + 9u * 4u);
+
+  std::size_t off = 0;
+  const std::span<const uint8_t> msg(buf.data(), n);
+  CHECK(osc_read_str(msg, &off) == "/khor/metrics");
+  CHECK(osc_read_str(msg, &off) == ",fffffffff");
+
+  // Too-small buffers fail cleanly instead of truncating.
+  uint8_t tiny[12];
+  CHECK(khor::osc::encode_signal("exec", 0.5f, tiny) == 0u);
+}
+
+TEST_CASE(osc_parse_dest) {
+  khor::OscDest d;
+  CHECK(khor::osc_parse_dest("127.0.0.1:9000", &d));
+  CHECK(d.host == "127.0.0.1" && d.port == 9000);
+  CHECK(khor::osc_parse_dest("[ff02::1]:7000", &d));
+  CHECK(d.host == "ff02::1" && d.port == 7000);
+  CHECK(khor::osc_parse_dest("lights.local:53000", &d));
+  CHECK(d.host == "lights.local");
+  CHECK(!khor::osc_parse_dest("nohost", &d));
+  CHECK(!khor::osc_parse_dest("host:0", &d));
+  CHECK(!khor::osc_parse_dest("host:90x", &d));
+}
+
+TEST_CASE(osc_decode_roundtrip_and_bundle) {
+  khor::NoteEvent ev;
+  ev.channel = 3;
+  ev.midi = 70;
+  ev.velocity = 0.25f;
+  ev.dur_s = 0.5f;
+
+  khor::osc::Packet buf;
+  const std::size_t n = khor::osc::encode_note(ev, buf);
+  khor::osc::Message m;
+  CHECK(khor::osc::decode_message(std::span<const uint8_t>(buf.data(), n), &m));
+  CHECK(m.address == "/khor/note");
+  CHECK(m.tags == "iiff");
+  CHECK(m.argc == 4);
+  CHECK(m.args[0].as_int() == 3);
+  CHECK(m.args[1].as_int() == 70);
+  CHECK(approx(m.args[2].as_float(), 0.25, 1e-6));
+
+  // Truncated packets are rejected.
+  CHECK(!khor::osc::decode_message(std::span<const uint8_t>(buf.data(), n - 4), &m));
+  // So are non-finite floats; out-of-range floats saturate as ints.
+  ev.velocity = std::nanf("");
+  CHECK(!khor::osc::decode_message(std::span<const uint8_t>(buf.data(), khor::osc::encode_note(ev, buf)), &m));
+  khor::osc::Arg big;
+  big.tag = 'f';
+  big.f = 1e10f;
+  CHECK(big.as_int() == INT32_MAX);
+  big.f = -1e10f;
+  CHECK(big.as_int() == INT32_MIN);
+
+  // "#bundle" + timetag + [size, message] x2.
+  std::vector<uint8_t> bundle = {'#', 'b', 'u', 'n', 'd', 'l', 'e', 0, 0, 0, 0, 0, 0, 0, 0, 1};
+  khor::osc::Packet sig;
+  const std::size_t sn = khor::osc::encode_signal("exec", 0.5f, sig);
+  for (int i = 0; i < 2; i++) {
+    const uint32_t be = htonl((uint32_t)sn);
+    const auto* p = (const uint8_t*)&be;
+    bundle.insert(bundle.end(), p, p + 4);
+    bundle.insert(bundle.end(), sig.begin(), sig.begin() + (long)sn);
+  }
+  int seen = 0;
+  CHECK(khor::osc::for_each_message(bundle, [&](const khor::osc::Message& msg) {
+    if (msg.address == "/khor/signal" && msg.args[0].s == "exec") seen++;
+  }));
+  CHECK(seen == 2);
+}
+
 } // namespace
 
+TEST_CASE(steady_state_does_not_allocate) {
+  khor::Signal01 s{};
+  s.exec = 0.7;
+  s.rx = 0.6;
+  s.tx = 0.5;
+  s.csw = 0.9;
+  s.io = 0.4;
+  s.retx = 0.5;
+  s.irq = 0.6;
+  s.mem = 0.2;
+
+  // Sequencer: every built-in preset, configured outside the measured region.
+  khor::MusicEngine eng;
+  khor::MusicConfig cfg;
+  cfg.density = 1.0;
+  std::size_t notes = 0;
+  for (const auto& p : khor::builtin_presets()) {
+    cfg.preset = p.name;
+    eng.configure(cfg);
+    AllocScope a;
+    for (int i = 0; i < 64; i++) {
+      eng.set_key(50 + (i & 7));
+      notes += eng.tick(s, cfg.density).notes.size();
+    }
+    CHECK(a.count() == 0);
+  }
+  CHECK(notes > 0);
+
+  // Signal math + history ring.
+  khor::Signals sig;
+  khor::Signals::Totals t{};
+  khor::FixedRing<khor::SignalRates, 600> hist;
+  {
+    AllocScope a;
+    for (int i = 0; i < 1000; i++) {
+      t.exec_total += 3;
+      t.sched_switch_total += 500;
+      sig.update(t, 0.1, 0.5, 1.0);
+      hist.push(sig.rates());
+    }
+    CHECK(a.count() == 0);
+  }
+  CHECK(hist.size() == 600);
+
+  // OSC encoders write into caller buffers.
+  {
+    khor::osc::Packet pkt;
+    khor::NoteEvent ev;
+    khor::SignalRates r{};
+    AllocScope a;
+    std::size_t n = 0;
+    for (int i = 0; i < 64; i++) {
+      n += khor::osc::encode_note(ev, pkt);
+      n += khor::osc::encode_signal("exec", 0.5f, pkt);
+      n += khor::osc::encode_metrics(r, pkt);
+    }
+    CHECK(a.count() == 0);
+    CHECK(n > 0);
+  }
+
+  // Once a second: take_window's candidate merge, then pull_sketches' heavy hitters.
+  {
+    khor::SketchWindow w;
+    khor::CountMin cms(khor::CmsWindow::kRows, khor::CmsWindow::kWidth);
+    std::array<uint64_t, khor::CmsWindow::kMaxCandidates> hashes;
+    std::array<khor::HeavyHitter, 10> top;
+    std::size_t found = 0;
+    AllocScope a;
+    for (int win = 0; win < 8; win++) {
+      w = khor::SketchWindow{};
+      for (uint64_t cpu = 0; cpu < 4; cpu++) {
+        for (uint64_t k = 0; k < 64; k++) {
+          const uint64_t h = khor::sketch_mix64(k + cpu * 32);
+          for (std::size_t r = 0; r < khor::CmsWindow::kRows; r++) {
+            w.switches.counters[r * khor::CmsWindow::kWidth + khor::cms_index(h, r, khor::CmsWindow::kWidth)] += k + 1;
+          }
+          w.switches.add_candidate(khor::CmsCandidate{.hash = h, .est = k + 1});
+        }
+      }
+      cms.clear();
+      cms.merge(w.switches.counters.data());
+      for (std::size_t i = 0; i < w.switches.n_candidates; i++) hashes[i] = w.switches.candidates[i].hash;
+      found += khor::cms_top_k(cms, std::span<const uint64_t>(hashes.data(), w.switches.n_candidates), top);
+    }
+    CHECK(a.count() == 0);
+    CHECK(found == 8 * top.size());
+  }
+}
+
+// What App::music_step + emit_step do per step, minus the audio and MIDI backends that
+// don't exist here: tick, exec triggers into the same frame, then every OSC send.
+TEST_CASE(music_step_path_does_not_allocate) {
+  const int rx = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t sl = sizeof(sa);
+  CHECK(rx >= 0 && ::bind(rx, (sockaddr*)&sa, sizeof(sa)) == 0 && ::getsockname(rx, (sockaddr*)&sa, &sl) == 0);
+  khor::OscClient osc;
+  std::string err;
+  CHECK(osc.start({{.host = "127.0.0.1", .port = ntohs(sa.sin_port)}}, 1, &err));
+
+  khor::ExecTrigger make;
+  make.comm = "make";
+  khor::ExecTriggerTable triggers;
+  triggers.configure({make});
+  khor::ExecEventQueue exec_q;
+  khor::ExecEvent ev;
+  std::memcpy(ev.comm.data(), "make", 5);
+
+  khor::MusicEngine eng;
+  khor::MusicConfig cfg;
+  cfg.preset = "arp";
+  cfg.density = 1.0;
+  eng.configure(cfg);
+  khor::SignalSnapshot sig;
+  sig.v01.exec = sig.v01.csw = sig.v01.rx = 0.8;
+
+  std::size_t notes = 0, hits = 0;
+  {
+    AllocScope a;
+    for (int i = 0; i < 64; i++) {
+      (void)exec_q.push(ev);
+      khor::MusicFrame frame = eng.tick(sig.v01, cfg.density);
+      hits += triggers.drain(&exec_q, 60, &frame.notes);
+      for (const auto& n : frame.notes) osc.send_note(n);
+      notes += frame.notes.size();
+      if ((i & 3) == 0) osc.send_signals(sig.v01);
+      if ((i & 7) == 0) osc.send_metrics(sig.rates);
+    }
+    CHECK(a.count() == 0);
+  }
+  CHECK(hits == 64);
+  CHECK(notes > hits);
+  char buf[512];
+  CHECK(::recv(rx, buf, sizeof(buf), 0) > 0);
+  while (::recv(rx, buf, sizeof(buf), 0) > 0) {
+  }
+  // A destination the kernel refuses (broadcast without SO_BROADCAST) doesn't starve the next one.
+  CHECK(osc.start({{.host = "255.255.255.255", .port = 9}, {.host = "127.0.0.1", .port = ntohs(sa.sin_port)}}, 1, &err));
+  osc.send_signals(sig.v01);
+  int got = 0;
+  while (::recv(rx, buf, sizeof(buf), 0) > 0) got++;
+  CHECK(got == (int)(sizeof(khor::Signal01) / sizeof(double)));
+  osc.stop();
+  ::close(rx);
+
+  // A full frame leaves execs queued (and counts the notes it had to drop) instead of eating them.
+  khor::NoteBuffer full;
+  while (full.push_back(khor::NoteEvent{})) {
+  }
+  CHECK(full.full() && full.dropped() == 1);
+  (void)exec_q.push(ev);
+  CHECK(triggers.drain(&exec_q, 60, &full) == 0);
+  khor::NoteBuffer next;
+  CHECK(triggers.drain(&exec_q, 60, &next) == 1 && next.size() == 1);
+}
+
+TEST_CASE(fixed_ring_overwrites_oldest) {
+  khor::FixedRing<int, 4> r;
+  CHECK(r.empty());
+  for (int i = 0; i < 6; i++) r.push(i);
+  CHECK(r.size() == 4);
+  CHECK(r[0] == 2);
+  CHECK(r.back() == 5);
+}
+
+TEST_CASE(reactor_timers_and_cross_thread_calls) {
+  khor::Reactor r;
+  std::string err;
+  CHECK(r.open(&err));
+
+  int ticks = 0;
+  bool called = false;
+  const int t = r.add_timer([&](uint64_t exp) {
+    ticks += (int)exp;
+    if (ticks >= 5 && called) r.stop();
+  });
+  CHECK(t >= 0);
+  CHECK(r.arm_periodic(t, std::chrono::milliseconds(2)));
+
+  std::thread::id loop_tid{};
+  std::thread other([&] {
+    while (!r.is_running()) std::this_thread::yield();
+    // Runs on the loop thread; returns only after it ran.
+    r.call([&] {
+      loop_tid = std::this_thread::get_id();
+      called = true;
+    });
+  });
+
+  CHECK(r.run());
+  other.join();
+  CHECK(ticks >= 5);
+  CHECK(loop_tid == std::this_thread::get_id());
+
+  // Not running: call() and removal run inline.
+  r.remove_timer(t);
+  CHECK(r.fd_count() == 0);
+  // A loaded host coalesces expirations, so ticks can outrun wakeups.
+  CHECK(r.wakeups() >= 1);
+}
+
+TEST_CASE(file_watch_in_place_writes_and_renames) {
+  namespace fs = std::filesystem;
+  const fs::path dir = fs::temp_directory_path() / ("khor-watch-" + std::to_string(::getpid()));
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  const fs::path target = dir / "config.json";
+
+  khor::Reactor r;
+  std::string err;
+  CHECK(r.open(&err));
+  std::atomic<int> hits{0};
+  khor::FileWatch w;
+  CHECK(w.start(target.string(), [&] { hits++; }, &r, &err));
+
+  // Bounded in case an event never arrives.
+  const int guard = r.add_timer([&](uint64_t) { r.stop(); });
+  CHECK(r.arm_periodic(guard, std::chrono::seconds(5)));
+
+  int after_write = 0;
+  std::thread t([&] {
+    while (!r.is_running()) std::this_thread::yield();
+    auto wait_for = [&](int n) {
+      for (int i = 0; i < 2000 && hits.load() < n; i++) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    };
+    // Other files in the directory don't count; the write that follows does.
+    std::ofstream(dir / "other.json") << "{}";
+    std::ofstream(target) << "{\"a\":1}";
+    wait_for(1);
+    after_write = hits.load();
+    // Replaced by rename, as editors and config management do.
+    std::ofstream(dir / "config.json.tmp") << "{\"a\":2}";
+    fs::rename(dir / "config.json.tmp", target);
+    wait_for(2);
+    r.stop();
+  });
+  CHECK(r.run());
+  t.join();
+  r.remove_timer(guard);
+
+  CHECK(after_write == 1);
+  CHECK(hits.load() == 2);
+  CHECK(w.events() == 2);
+
+  w.stop();
+  CHECK(!w.is_running());
+  CHECK(r.fd_count() == 0);
+  fs::remove_all(dir);
+}
+
+TEST_CASE(cgroup_cache_names_and_incremental_updates) {
+  namespace fs = std::filesystem;
+  const std::string cid(64, 'a');
+  CHECK(khor::cgroup_unit_name("/system.slice/nginx.service") == "nginx.service");
+  CHECK(khor::cgroup_unit_name("/system.slice/nginx.service/worker") == "nginx.service");
+  CHECK(khor::cgroup_unit_name("/user.slice/user-1000.slice/user@1000.service/app.slice/x.scope") == "x.scope");
+  CHECK(khor::cgroup_unit_name("/kubepods/besteffort").empty());
+  CHECK(khor::cgroup_container_id("/system.slice/docker-" + cid + ".scope") == cid);
+  CHECK(khor::cgroup_container_id("/kubepods.slice/kubepods-pod1.slice/cri-containerd-" + cid + ".scope") == cid);
+  CHECK(khor::cgroup_container_id("/docker/" + cid) == cid);
+  CHECK(khor::cgroup_container_id("/system.slice/docker-" + cid + "b.scope").empty()); // 65 hex digits
+
+  // Any directory tree will do: ids are inode numbers, updates come from inotify.
+  const fs::path root = fs::temp_directory_path() / ("khor-cg-" + std::to_string(::getpid()));
+  fs::remove_all(root);
+  fs::create_directories(root / "system.slice" / "nginx.service");
+
+  khor::Reactor r;
+  std::string err;
+  CHECK(r.open(&err));
+  std::atomic<int> changes{0};
+  khor::CgroupCache cc;
+  CHECK(cc.start(root.string(), &r, [&] { changes++; }, &err));
+  CHECK(cc.size() == 3);
+  khor::CgroupInfo ci;
+  const uint64_t nginx = cc.resolve("nginx.service", &ci);
+  CHECK(nginx != 0 && nginx == ci.id);
+  CHECK(ci.path == "/system.slice/nginx.service");
+  CHECK(cc.resolve("/system.slice/nginx.service") == nginx);
+  CHECK(cc.resolve("nope.service") == 0);
+  CHECK(cc.resolve("12345") == 12345);
+
+  const int guard = r.add_timer([&](uint64_t) { r.stop(); });
+  CHECK(r.arm_periodic(guard, std::chrono::seconds(5)));
+  uint64_t container = 0;
+  bool gone = false;
+  std::thread t([&] {
+    while (!r.is_running()) std::this_thread::yield();
+    auto wait_until = [&](auto pred) {
+      for (int i = 0; i < 2000 && !pred(); i++) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    };
+    fs::create_directories(root / "system.slice" / ("docker-" + cid + ".scope") / "init");
+    wait_until([&] { return cc.resolve(cid.substr(0, 12)) != 0 && cc.size() == 5; });
+    container = cc.resolve(cid.substr(0, 12), &ci);
+    fs::remove_all(root / "system.slice" / "nginx.service");
+    wait_until([&] { return cc.resolve("nginx.service") == 0; });
+    gone = !cc.lookup(nginx, nullptr);
+    r.stop();
+  });
+  CHECK(r.run());
+  t.join();
+  r.remove_timer(guard);
+
+  CHECK(container != 0);
+  CHECK(ci.path == "/system.slice/docker-" + cid + ".scope"); // the container's own cgroup, not init/
+  CHECK(gone);
+  CHECK(cc.size() == 4);
+  CHECK(changes.load() >= 2);
+
+  cc.stop();
+  CHECK(r.fd_count() == 0);
+  fs::remove_all(root);
+}
+
+extern "C" __attribute__((noinline)) int khor_test_symbol_target(int x) { return x * 3 + 1; }
+
+TEST_CASE(profile_hot_functions_entropy_and_symbolizer) {
+  CHECK(khor::profile_entropy01({}) == 0.0);
+  CHECK(khor::profile_entropy01({100}) == 0.0);
+  CHECK(approx(khor::profile_entropy01({5, 5}), 1.0 / 8.0, 1e-9));            // 1 bit
+  CHECK(approx(khor::profile_entropy01(std::vector<uint64_t>(256, 3)), 1.0, 1e-9)); // 8 bits
+
+  khor::HotFunctions h(0.5);
+  h.add("spin", "app", 90);
+  h.add("read", "[kernel]", 10);
+  const double e1 = h.end_window();
+  CHECK(e1 > 0.0 && e1 < 1.0 / 8.0);
+  CHECK(h.last_window_samples() == 100);
+  auto top = h.top(1);
+  CHECK(top.size() == 1 && top[0].name == "spin" && approx(top[0].share, 0.9, 1e-9));
+  // Nothing new: the table decays and is eventually forgotten; the idle window has no entropy.
+  CHECK(h.end_window() == 0.0);
+  CHECK(approx(h.top(2)[0].samples, 45.0, 1e-9));
+  for (int i = 0; i < 10; i++) (void)h.end_window();
+  CHECK(h.size() == 0);
+
+  // Our own (unstripped) test binary resolves through /proc/self/maps and its ELF symbols.
+  khor::Symbolizer sym;
+  const auto ip = (uint64_t)(uintptr_t)&khor_test_symbol_target + 2;
+  const khor::Symbol s = sym.user((uint32_t)::getpid(), ip);
+  CHECK(s.known);
+  CHECK(s.name == "khor_test_symbol_target");
+  CHECK(sym.files_cached() == 1 && sym.procs_cached() == 1);
+  CHECK(!sym.user((uint32_t)::getpid(), 0x10).known);
+  CHECK(khor_test_symbol_target(1) == 4);
+}
+
+TEST_CASE(log2_quantiles) {
+  uint64_t b[32] = {};
+  CHECK(khor::log2_quantile(b, 32, 0.5) == 0);
+  b[0] = 1;  // < 2 us
+  b[3] = 98; // 8..16 us
+  b[20] = 1; // ~1-2 s
+  CHECK(khor::log2_quantile(b, 32, 0.0) == 2);
+  CHECK(khor::log2_quantile(b, 32, 0.5) == 16);
+  CHECK(khor::log2_quantile(b, 32, 0.99) == 16);
+  CHECK(khor::log2_quantile(b, 32, 1.0) == (2ULL << 20));
+
+  // Lock waits are bucketed in ns: 300 ns lands in [256, 512).
+  uint64_t lock[32] = {};
+  lock[8] = 10;
+  CHECK(khor::log2_quantile(lock, 32, 0.99) == 512);
+
+  uint64_t rtt[32] = {};
+  rtt[10] = 99; // [1, 2) ms
+  rtt[17] = 1;  // [128, 256) ms
+  CHECK(khor::log2_quantile(rtt, 32, 0.50) == 2048);
+  CHECK(khor::log2_quantile(rtt, 32, 0.99) == 2048);
+  CHECK(khor::log2_quantile(rtt, 32, 1.0) == 262144);
+}
+
+TEST_CASE(pmu_group_deltas_scale_for_multiplexing) {
+  // A group multiplexed off the PMU half the time is scaled up by enabled/running.
+  khor::PmuGroupRead prev;
+  prev.enabled_ns = 1000;
+  prev.running_ns = 1000;
+  prev.v = {100, 200, 3, 4};
+  khor::PmuGroupRead cur = prev;
+  cur.enabled_ns = 3000;
+  cur.running_ns = 2000;
+  cur.v = {1100, 2200, 13, 4};
+  double out[4] = {};
+  CHECK(khor::pmu_add_delta(prev, cur, 4, out));
+  CHECK(approx(out[0], 2000.0, 1e-9) && approx(out[1], 4000.0, 1e-9) && approx(out[2], 20.0, 1e-9) && out[3] == 0.0);
+  // A group that never got on the PMU adds nothing.
+  prev = cur;
+  cur.enabled_ns += 1000;
+  cur.v[0] += 50;
+  CHECK(!khor::pmu_add_delta(prev, cur, 4, out));
+  CHECK(approx(out[0], 2000.0, 1e-9));
+}
+
+TEST_CASE(exec_triggers_match_comm_globs) {
+  CHECK(khor::comm_glob_match("make", "make"));
+  CHECK(!khor::comm_glob_match("make", "cmake"));
+  CHECK(khor::comm_glob_match("*make", "cmake"));
+  CHECK(khor::comm_glob_match("cc?", "cc1"));
+  CHECK(!khor::comm_glob_match("cc?", "cc"));
+  CHECK(khor::comm_glob_match("*a*b*", "xaxxbx"));
+  CHECK(!khor::comm_glob_match("*a*b", "xaxxbx"));
+  CHECK(khor::comm_glob_match("*", ""));
+
+  khor::ExecTrigger gcc;
+  gcc.comm = "*cc*";
+  gcc.semitones = 7;
+  gcc.channel = 3;
+  khor::ExecTrigger pinned;
+  pinned.comm = "*";
+  pinned.cgroup_id = 42;
+  pinned.semitones = 100;
+  khor::ExecTriggerTable table;
+  table.configure({gcc, pinned});
+
+  // First match wins; cgroup-pinned triggers ignore other cgroups; pitch stays in MIDI range.
+  khor::NoteBuffer out;
+  CHECK(table.match("gcc", 42, 60, &out));
+  CHECK(table.match("sh", 42, 60, &out));
+  CHECK(!table.match("sh", 7, 60, &out));
+  CHECK(out.size() == 2);
+  CHECK(out[0].midi == 67 && out[0].channel == 3);
+  CHECK(out[1].midi == 127);
+
+  khor::KhorConfig cfg;
+  std::string err;
+  khor::JsonValue patch;
+  khor::JsonParseError perr;
+  CHECK(khor::json_parse(R"({"features":{"exec_events":true},"exec_events":{"rate":0,"triggers":[
+    {"comm":"cc1*","semitones":5,"channel":99},{"comm":"sh","cgroup_id":1234}
+  ]}})", &patch, &perr));
+  CHECK(khor::config_from_json(patch, &cfg, &err));
+  CHECK(cfg.enable_exec_events);
+  CHECK(cfg.exec_events_rate == 1);
+  CHECK(cfg.exec_triggers.size() == 2);
+  CHECK(cfg.exec_triggers[0].channel == 16);
+  CHECK(cfg.exec_triggers[1].cgroup_id == 1234);
+  khor::KhorConfig back;
+  CHECK(khor::config_from_text(khor::config_to_text(cfg), &back, &err));
+  CHECK(back.exec_triggers == cfg.exec_triggers);
+
+  for (const char* bad : {
+         R"({"exec_events":{"triggers":{"comm":"sh"}}})",
+         R"({"exec_events":{"triggers":[{"semitones":3}]}})",
+       }) {
+    khor::KhorConfig c;
+    err.clear();
+    CHECK(khor::json_parse(bad, &patch, &perr));
+    CHECK(!khor::config_from_json(patch, &c, &err));
+    CHECK(!err.empty());
+  }
+}
+
+TEST_CASE(hyperloglog_distinct_counts) {
+  std::array<uint8_t, 256> a{};
+  CHECK(khor::hll_estimate(a.data(), a.size()) == 0.0);
+
+  // Small sets go through linear counting and are close to exact.
+  for (uint64_t i = 0; i < 10; i++) khor::hll_add(a.data(), a.size(), khor::sketch_mix64(i | (2ULL << 32)));
+  for (uint64_t i = 0; i < 10; i++) khor::hll_add(a.data(), a.size(), khor::sketch_mix64(i | (2ULL << 32)));
+  CHECK(std::fabs(khor::hll_estimate(a.data(), a.size()) - 10.0) < 1.0);
+
+  // Large sets stay within a few standard errors (6.5% at 256 registers), merged from two halves.
+  std::array<uint8_t, 256> b{};
+  std::array<uint8_t, 256> c{};
+  for (uint64_t i = 0; i < 20000; i++) {
+    khor::hll_add((i & 1) ? b.data() : c.data(), b.size(), khor::sketch_mix64(i));
+  }
+  khor::hll_merge(b.data(), c.data(), b.size());
+  const double est = khor::hll_estimate(b.data(), b.size());
+  CHECK(est > 20000.0 * 0.8 && est < 20000.0 * 1.2);
+}
+
+TEST_CASE(count_min_heavy_hitters) {
+  // Two CPUs' copies, as the kernel keeps them: 5 heavy keys over 5000 light ones.
+  khor::CountMin cpu0(4, 512), cpu1(4, 512);
+  std::vector<uint64_t> cand;
+  for (uint64_t k = 0; k < 5; k++) {
+    const uint64_t h = khor::sketch_mix64(k | (2ULL << 32));
+    cand.push_back(h);
+    cpu0.add(h, 1000 * (k + 1));
+    cpu1.add(h, 1000 * (k + 1));
+  }
+  for (uint64_t k = 100; k < 5100; k++) {
+    const uint64_t h = khor::sketch_mix64(k | (2ULL << 32));
+    ((k & 1) ? cpu0 : cpu1).add(h, 3);
+    if (k < 110) cand.push_back(h);
+  }
+
+  khor::CountMin m(4, 512);
+  m.merge(cpu0.counters());
+  m.merge(cpu1.counters());
+  CHECK(m.total() == 2000 * 15 + 3 * 5000);
+  CHECK(approx(m.confidence(), 1.0 - std::exp(-4.0), 1e-12));
+  CHECK(approx(m.error_bound(), std::exp(1.0) / 512.0 * 45000.0, 1e-9));
+
+  // Never under, and over by no more than the bound.
+  for (uint64_t k = 0; k < 5; k++) {
+    const uint64_t est = m.estimate(cand[k]);
+    CHECK(est >= 2000 * (k + 1));
+    CHECK((double)est <= 2000.0 * (double)(k + 1) + m.error_bound());
+  }
+  std::array<khor::HeavyHitter, 3> top;
+  CHECK(khor::cms_top_k(m, cand, top) == 3);
+  CHECK(top[0].index == 4 && top[1].index == 3 && top[2].index == 2);
+  CHECK(khor::cms_top_k(m, {}, top) == 0);
+
+  // Window candidates dedupe by hash; a full table keeps the heaviest.
+  khor::CmsWindow w;
+  for (uint64_t k = 1; k <= khor::CmsWindow::kMaxCandidates + 1; k++) {
+    w.add_candidate(khor::CmsCandidate{.hash = k, .est = k});
+    w.add_candidate(khor::CmsCandidate{.hash = k, .est = k});
+  }
+  CHECK(w.n_candidates == khor::CmsWindow::kMaxCandidates);
+  CHECK(w.candidates[0].hash == khor::CmsWindow::kMaxCandidates + 1);
+}
+
+TEST_CASE(music_clock_deadlines_tempo_and_overruns) {
+  constexpr int64_t ms = 1000000;
+  khor::MusicClock c;
+  c.reset(0, 150.0); // 100 ms steps
+  CHECK(c.next_deadline_ns() == 100 * ms);
+  CHECK(c.advance(99 * ms) == 0); // early wakeup
+  CHECK(c.advance(100 * ms) == 1);
+  CHECK(c.next_deadline_ns() == 200 * ms);
+
+  // Halfway through the step, double the tempo: the remaining half step takes 25 ms.
+  c.set_bpm(150 * ms, 300.0);
+  CHECK(c.next_deadline_ns() == 175 * ms);
+  CHECK(c.advance(175 * ms) == 1);
+  CHECK(c.next_deadline_ns() == 225 * ms);
+
+  // 2.5 steps late: skip runs one step and stays on the grid.
+  CHECK(c.advance(225 * ms + 125 * ms) == 1);
+  CHECK(c.stats().overruns.load() == 1 && c.stats().skipped.load() == 2);
+  CHECK(c.next_deadline_ns() == 375 * ms);
+
+  c.set_overrun(khor::ClockOverrun::CatchUp);
+  CHECK(c.advance(375 * ms + 110 * ms) == 3); // 50 ms steps: two missed + the due one
+  CHECK(c.next_deadline_ns() == 525 * ms);
+  CHECK(c.advance(525 * ms + 500 * ms) == khor::MusicClock::kMaxCatchUp);
+
+  const khor::LatenessHistogram& h = c.lateness();
+  CHECK(h.count() == 5);
+  CHECK(h.bucket(0) == 2); // on time
+  CHECK(h.quantile_us(0.4) == 50);
+  CHECK(h.quantile_us(0.5) > 50000); // overflow bucket
+  CHECK(h.max_ns() == 500 * ms);
+
+  // Audio clock 0.5% fast over one window -> shorter monotonic steps.
+  khor::AudioClockTracker t;
+  CHECK(!t.observe(0, 0, 48000));
+  CHECK(t.observe(96480, khor::AudioClockTracker::kWindowNs, 48000));
+  CHECK(t.rate() > 1.0 && t.rate() < 1.005);
+}
+
+TEST_CASE(render_sequencer_sample_clock_and_handover) {
+  khor::SeqLock<khor::SignalSnapshot> sig;
+  khor::SignalSnapshot snap;
+  snap.v01.exec = snap.v01.csw = snap.v01.rx = 0.8;
+  sig.store(snap);
+  khor::SignalSnapshot got;
+  CHECK(sig.try_load(&got, 1));
+  CHECK(got.v01.exec == 0.8);
+  std::atomic<double> bpm{120.0}, density{1.0};
+  std::atomic<int> key{62};
+  khor::RenderSequencer seq({.signals = &sig, .bpm = &bpm, .density = &density, .key_midi = &key});
+  std::string err;
+  CHECK(seq.open(&err));
+
+  khor::MusicConfig cfg;
+  cfg.preset = "arp";
+  CHECK(seq.configure(nullptr, cfg));
+  CHECK(!seq.configure(nullptr, cfg)); // not picked up by a step yet
+
+  // 44.1 kHz at 120 bpm: 5512.5 frames per 16th; the remainder alternates, nothing drifts.
+  uint64_t frames = 0;
+  std::size_t notes = 0;
+  {
+    AllocScope a;
+    for (int i = 0; i < 32; i++) {
+      khor::MusicFrame f;
+      seq.step(&f);
+      notes += f.notes.size();
+      frames += seq.frames_until_step(44100);
+    }
+    CHECK(a.count() == 0);
+  }
+  CHECK(frames == 32 * 5512 + 16);
+  CHECK(notes > 0);
+  CHECK(seq.steps() == 32);
+
+  // Records reach the consumer side in order, without overflowing.
+  khor::RenderSequencer::StepRecord rec;
+  int popped = 0;
+  while (seq.pop(&rec)) popped++;
+  CHECK(popped == 32);
+  CHECK(rec.sig.v01.exec == 0.8);
+  CHECK(seq.stale_signals() == 0);
+
+  // Handover after a step keeps working.
+  cfg.preset = "drone";
+  CHECK(seq.configure(nullptr, cfg));
+  seq.step(nullptr);
+  CHECK(seq.configure(nullptr, cfg));
+  // Detached with a handover outstanding: the slot is reclaimed instead of blocking configure() forever.
+  CHECK(!seq.configure(nullptr, cfg));
+  seq.cancel_pending();
+  CHECK(seq.configure(nullptr, cfg));
+  seq.step(nullptr);
+  CHECK(seq.configure(nullptr, cfg));
+}
+
+TEST_CASE(rt_policy_and_affinity_readback) {
+  khor::RtPolicy p{};
+  CHECK(khor::rt_policy_parse("fifo", &p) && p == khor::RtPolicy::Fifo);
+  CHECK(khor::rt_policy_parse("rr", &p) && p == khor::RtPolicy::Rr);
+  CHECK(!khor::rt_policy_parse("deadline", &p));
+
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  CHECK(sched_getaffinity(0, sizeof(mask), &mask) == 0);
+  int cpu = 0;
+  while (cpu < CPU_SETSIZE && !CPU_ISSET(cpu, &mask)) cpu++;
+
+  khor::RtThreadStatus pinned{}, fifo{}, unpinned{};
+  std::thread t([&] {
+    khor::RtConfig cfg;
+    cfg.cpus = {cpu};
+    pinned = khor::rt_apply_current_thread(cfg);
+
+    // Privileged or not, the status must describe what the kernel actually did.
+    cfg.policy = khor::RtPolicy::Fifo;
+    cfg.priority = 5;
+    fifo = khor::rt_apply_current_thread(cfg);
+
+    unpinned = khor::rt_apply_current_thread(khor::RtConfig{});
+  });
+  t.join();
+
+  CHECK(pinned.applied && pinned.sched_errno == 0 && pinned.affinity_errno == 0);
+  CHECK(pinned.policy == SCHED_OTHER);
+  CHECK(pinned.cpus_allowed == 1);
+  if (fifo.sched_errno == 0) CHECK(fifo.policy == SCHED_FIFO && fifo.priority == 5);
+  else CHECK(fifo.policy == SCHED_OTHER && !khor::rt_status_error(khor::RtConfig{.policy = khor::RtPolicy::Fifo, .priority = 5, .cpus = {}}, fifo).empty());
+  CHECK(unpinned.policy == SCHED_OTHER);
+  CHECK(unpinned.cpus_allowed == CPU_COUNT(&mask));
+}
+
+TEST_CASE(config_sessions_roundtrip_and_validation) {
+  khor::KhorConfig cfg;
+  std::string err;
+  khor::JsonValue patch;
+  khor::JsonParseError perr;
+  CHECK(khor::json_parse(R"({"sessions":[
+    {"name":"tenant-a","bpf":{"cgroup_id":1234},"music":{"preset":"glitch","bpm":90},"osc":{"port":9100}},
+    {"name":"tenant.b","audio":true}
+  ]})", &patch, &perr));
+  CHECK(khor::config_from_json(patch, &cfg, &err));
+  CHECK(cfg.sessions.size() == 2);
+  CHECK(cfg.sessions[0].bpf_cgroup_id == 1234);
+  CHECK(cfg.sessions[0].preset == "glitch");
+  CHECK(cfg.sessions[0].osc_port == 9100);
+  CHECK(!cfg.sessions[0].audio);
+  CHECK(cfg.sessions[1].audio);
+  CHECK(cfg.sessions[1].preset == "ambient");
+
+  // The file format round-trips.
+  khor::KhorConfig back;
+  CHECK(khor::config_from_text(khor::config_to_text(cfg), &back, &err));
+  CHECK(back.sessions == cfg.sessions);
+
+  // A patch without "sessions" keeps them; an array replaces the list.
+  CHECK(khor::json_parse(R"({"music":{"bpm":120}})", &patch, &perr));
+  CHECK(khor::config_from_json(patch, &cfg, &err));
+  CHECK(cfg.sessions.size() == 2);
+  CHECK(khor::json_parse(R"({"sessions":[]})", &patch, &perr));
+  CHECK(khor::config_from_json(patch, &cfg, &err));
+  CHECK(cfg.sessions.empty());
+
+  for (const char* bad : {
+         R"({"sessions":[{"name":"a"},{"name":"a"}]})",
+         R"({"sessions":[{"name":"has space"}]})",
+         R"({"sessions":[{}]})",
+         R"({"sessions":{"name":"a"}})",
+         R"({"sessions":[{"name":"1"},{"name":"2"},{"name":"3"},{"name":"4"},{"name":"5"},{"name":"6"},{"name":"7"},{"name":"8"}]})",
+       }) {
+    khor::KhorConfig c;
+    err.clear();
+    CHECK(khor::json_parse(bad, &patch, &perr));
+    CHECK(!khor::config_from_json(patch, &c, &err));
+    CHECK(!err.empty());
+  }
+}
+
+// Opt-in probes: off by default, and "features.<name>": true survives a save and reload.
+TEST_CASE(config_feature_flags_roundtrip) {
+  struct Flag {
+    const char* name;
+    bool khor::KhorConfig::*on;
+  };
+  for (const Flag f : {Flag{"profile", &khor::KhorConfig::enable_profile}, Flag{"locks", &khor::KhorConfig::enable_locks},
+                       Flag{"vfs", &khor::KhorConfig::enable_vfs}, Flag{"pmu", &khor::KhorConfig::enable_pmu}}) {
+    khor::KhorConfig cfg;
+    CHECK(!(cfg.*f.on));
+    std::string err;
+    khor::JsonValue patch;
+    khor::JsonParseError perr;
+    CHECK(khor::json_parse(std::string(R"({"features":{")") + f.name + R"(":true}})", &patch, &perr));
+    CHECK(khor::config_from_json(patch, &cfg, &err));
+    khor::KhorConfig back;
+    CHECK(khor::config_from_text(khor::config_to_text(cfg), &back, &err));
+    CHECK(back.*f.on);
+  }
+}
+
 int main() {
   for (const auto& t : tests()) {
     std::fprintf(stderr, "TEST %s\n", t.name);